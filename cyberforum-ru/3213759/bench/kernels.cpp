@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <utility>
+
+#include <imbin/filters.h>
+#include <imbin/palette.h>
+#include <imbin/planar.h>
+#include <imbin/rgb.h>
+#include <imbin/simd.h>
+
+#include "color_convert.h"
+#include "kernels.h"
+#include "pixel_scan.h"
+
+namespace
+{
+    // bytes per second of fn, which handles bytes bytes per call;
+    // the number of calls is doubled until they take long enough to be measured
+    template<typename Fn>
+    double throughput(std::size_t bytes, double minSeconds, Fn &&fn)
+    {
+        for (std::size_t calls = 1;; calls *= 2)
+        {
+            const auto started { std::chrono::steady_clock::now() };
+            for (std::size_t i = 0; i < calls; i++)
+            {
+                fn();
+            }
+            const double seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count() };
+            if (seconds >= minSeconds)
+            {
+                return static_cast<double>(bytes) * static_cast<double>(calls) / seconds;
+            }
+        }
+    }
+
+    std::vector<imbin::Simd> supportedSimd()
+    {
+        std::vector<imbin::Simd> levels;
+        for (imbin::Simd simd : { imbin::Simd::Scalar, imbin::Simd::Ssse3, imbin::Simd::Avx2 })
+        {
+            if (imbin::simdSupported(simd))
+            {
+                levels.push_back(simd);
+            }
+        }
+        return levels;
+    }
+}
+
+std::vector<KernelResult> runKernels(std::uint32_t width, double minSeconds)
+{
+    std::vector<KernelResult> results;
+    const std::size_t rowBytes { static_cast<std::size_t>(width) * 4 };
+    // bytes that look like a photo row, so filters and palette lookups don't see a constant
+    std::vector<unsigned char> source(rowBytes * 2);
+    for (std::size_t i = 0; i < source.size(); i++)
+    {
+        source[i] = static_cast<unsigned char>(i / 4 + (i * 7919) % 13);
+    }
+    std::vector<unsigned char> row(rowBytes);
+    std::vector<unsigned char> out(rowBytes);
+    imbin::Palette palette;
+    palette.entries.assign(source.begin(), source.begin() + static_cast<std::ptrdiff_t>(std::min<std::size_t>(source.size(), 256 * 4)));
+    const std::vector<unsigned char> table { imbin::paletteTable(palette) };
+
+    for (imbin::Simd simd : supportedSimd())
+    {
+        const std::string simdName { imbin::simdName(simd) };
+        results.push_back({ "planar split", simdName, throughput(rowBytes, minSeconds, [&]
+        {
+            imbin::deinterleaveRgba(source.data(), width, out.data(), width, simd);
+        }) });
+        results.push_back({ "planar merge", simdName, throughput(rowBytes, minSeconds, [&]
+        {
+            imbin::interleaveRgba(source.data(), width, width, out.data(), simd);
+        }) });
+        // counted in RGBA8 bytes too
+        results.push_back({ "rgb pack", simdName, throughput(rowBytes, minSeconds, [&]
+        {
+            imbin::packRgb(source.data(), width, out.data(), simd);
+        }) });
+        results.push_back({ "rgb expand", simdName, throughput(rowBytes, minSeconds, [&]
+        {
+            imbin::expandRgb(source.data(), width, out.data(), simd);
+        }) });
+        PixelScan scan { simd };
+        results.push_back({ "opaque/constant/colour scan", simdName, throughput(rowBytes, minSeconds, [&]
+        {
+            scan.reset();
+            scan.add(source.data(), width);
+        }) });
+        // counted in RGBA8 output bytes, the source bytes taken as packed indices
+        results.push_back({ "index expand 4-bit", simdName, throughput(rowBytes, minSeconds, [&]
+        {
+            imbin::expandIndices(source.data(), 0, width, 4, table.data(), out.data(), simd);
+        }) });
+        results.push_back({ "index expand 8-bit", simdName, throughput(rowBytes, minSeconds, [&]
+        {
+            imbin::expandIndices(source.data(), 0, width, 8, table.data(), out.data(), simd);
+        }) });
+
+        const std::pair<const char*, imbin::RowFilter> filters[] {
+            { "unfilter sub", imbin::RowFilter::Sub },
+            { "unfilter up", imbin::RowFilter::Up },
+            { "unfilter average", imbin::RowFilter::Average },
+            { "unfilter paeth", imbin::RowFilter::Paeth }
+        };
+        for (const auto &filter : filters)
+        {
+            // unfiltering the same row over and over is as much work as unfiltering different ones
+            std::copy(source.begin(), source.begin() + static_cast<std::ptrdiff_t>(rowBytes), row.begin());
+            results.push_back({ filter.first, simdName, throughput(rowBytes, minSeconds, [&]
+            {
+                imbin::unfilterRow(filter.second, row.data(), source.data() + rowBytes, rowBytes, 4, simd);
+            }) });
+        }
+
+        // counted in RGBA8 output bytes, the source sizes differ
+        const std::pair<SourceColor, int> sources[] {
+            { SourceColor::Gray, 1 }, { SourceColor::Gray, 8 }, { SourceColor::Gray, 16 },
+            { SourceColor::GrayAlpha, 8 }, { SourceColor::GrayAlpha, 16 },
+            { SourceColor::Rgb, 8 }, { SourceColor::Rgb, 16 }, { SourceColor::Rgba, 16 },
+            { SourceColor::Palette, 4 }, { SourceColor::Palette, 8 }
+        };
+        const SourceInfo info;
+        for (const auto &s : sources)
+        {
+            const RowConverter convert { findRowConverter(s.first, s.second, false, imbin::PixelFormat::Rgba8, simd) };
+            results.push_back({ "convert " + describeSource(s.first, s.second), simdName, throughput(rowBytes, minSeconds, [&]
+            {
+                convert(source.data(), width, out.data(), info);
+            }) });
+        }
+    }
+
+    // picking the filter is scalar only
+    results.push_back({ "filter (pick best)", imbin::simdName(imbin::Simd::Scalar), throughput(rowBytes, minSeconds, [&]
+    {
+        imbin::filterRow(source.data() + rowBytes, source.data(), rowBytes, 4, out.data());
+    }) });
+    return results;
+}
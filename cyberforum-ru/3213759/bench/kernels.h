@@ -0,0 +1,13 @@
+#ifndef BENCH_KERNELS_H
+#define BENCH_KERNELS_H
+
+#include <cstdint>
+#include <vector>
+
+#include "report.h"
+
+// the pixel kernels (planar split and merge, unfiltering, colour conversion) on a row of width pixels,
+// with every instruction set the CPU has; each one runs for at least minSeconds
+std::vector<KernelResult> runKernels(std::uint32_t width, double minSeconds);
+
+#endif // BENCH_KERNELS_H
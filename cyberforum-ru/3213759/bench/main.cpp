@@ -0,0 +1,563 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include <imbin/blocks.h>
+#include <imbin/reader.h>
+#include <imbin/simd.h>
+
+#include "batch.h"
+#include "kernels.h"
+#include "options.h"
+#include "png_decoder.h"
+#include "report.h"
+#include "synthetic.h"
+#include "transform.h"
+
+namespace
+{
+    struct BenchOptions
+    {
+        std::uint32_t width { 1024 };
+        std::uint32_t height { 1024 };
+        std::vector<Content> contents { allContents() };
+        // images per content class, each with its own seed
+        unsigned images { 4 };
+        // runs of every stage per image, the fastest one counts
+        unsigned repeat { 3 };
+        double kernelSeconds { 0.05 };
+        // how long conversions of every small/medium/large image run for the per-image overhead
+        double overheadSeconds { 0.2 };
+        // every block format at every preset too
+        bool blocks { false };
+        // empty for none, "-" for stdout instead of the tables
+        std::string json;
+        // empty means a temporary directory that is removed afterwards
+        std::filesystem::path workDirectory;
+        // the conversion options shared with the converter
+        Options conversion;
+        bool help { false };
+    };
+
+    BenchOptions parseBenchOptions(int argc, char *argv[])
+    {
+        BenchOptions options;
+        // everything that isn't a benchmark option goes to the converter's parser
+        std::vector<char*> forwarded { argv[0] };
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg { argv[i] };
+            std::string value;
+            if (arg == "-h" || arg == "--help")
+            {
+                options.help = true;
+            }
+            else if (takeValue(arg, nullptr, "--size", i, argc, argv, value))
+            {
+                const std::size_t x { value.find('x') };
+                options.width = static_cast<std::uint32_t>(parseRange("--size", value.substr(0, x), 1, 65536));
+                options.height = x == std::string::npos
+                    ? options.width
+                    : static_cast<std::uint32_t>(parseRange("--size", value.substr(x + 1), 1, 65536));
+            }
+            else if (takeValue(arg, nullptr, "--content", i, argc, argv, value))
+            {
+                options.contents.clear();
+                for (std::size_t start = 0; start <= value.size();)
+                {
+                    const std::size_t comma { std::min(value.find(',', start), value.size()) };
+                    options.contents.push_back(parseContent(value.substr(start, comma - start)));
+                    start = comma + 1;
+                }
+            }
+            else if (takeValue(arg, nullptr, "--images", i, argc, argv, value))
+            {
+                options.images = static_cast<unsigned>(parseRange("--images", value, 1, 10000));
+            }
+            else if (takeValue(arg, nullptr, "--repeat", i, argc, argv, value))
+            {
+                options.repeat = static_cast<unsigned>(parseRange("--repeat", value, 1, 1000));
+            }
+            else if (takeValue(arg, nullptr, "--kernel-time", i, argc, argv, value))
+            {
+                options.kernelSeconds = static_cast<double>(parseRange("--kernel-time", value, 0, 60000)) / 1000;
+            }
+            else if (takeValue(arg, nullptr, "--overhead-time", i, argc, argv, value))
+            {
+                options.overheadSeconds = static_cast<double>(parseRange("--overhead-time", value, 0, 60000)) / 1000;
+            }
+            else if (arg == "--blocks")
+            {
+                options.blocks = true;
+            }
+            else if (takeValue(arg, nullptr, "--json", i, argc, argv, value))
+            {
+                options.json = value;
+            }
+            else if (takeValue(arg, nullptr, "--work-dir", i, argc, argv, value))
+            {
+                options.workDirectory = value;
+            }
+            else
+            {
+                forwarded.push_back(argv[i]);
+            }
+        }
+        options.conversion = parseOptions(static_cast<int>(forwarded.size()), forwarded.data());
+        if (!options.conversion.inputs.empty())
+        {
+            throw std::invalid_argument("unexpected argument " + options.conversion.inputs.front().string());
+        }
+        return options;
+    }
+
+    void printBenchUsage(std::ostream &out)
+    {
+        out << "Usage: some-bench [options] [conversion options]\n"
+            << "\n"
+            << "Generates synthetic RGBA images and times every stage of converting them: PNG decode, transform\n"
+            << "(layout and filters), deflate and write, reading the result back, whole conversions with either\n"
+            << "input method, and the pixel kernels on their own.\n"
+            << "\n"
+            << "Options:\n"
+            << "      --size <w>[x<h>]   size of the images (default: 1024x1024)\n"
+            << "      --content <list>   comma-separated content classes: noise, gradient, sprites, photo (default: all)\n"
+            << "      --images <n>       images of every class, each with a different seed (default: 4)\n"
+            << "      --repeat <n>       runs of every stage on every image, the fastest one counts (default: 3)\n"
+            << "      --kernel-time <ms> how long every kernel runs at least (default: 50), 0 skips the kernels\n"
+            << "      --overhead-time <ms>\n"
+            << "                         how long 1 KB, 64 KB and 4 MB images are converted over and over, with the\n"
+            << "                         deflate streams reused and set up anew, for the cost per image (default: 200),\n"
+            << "                         0 skips that\n"
+            << "      --blocks           also encode every image to BC1, BC3 and BC7 at every --quality preset,\n"
+            << "                         with the time, the deflated size and the PSNR of each\n"
+            << "      --json <file>      also write the results as JSON, \"-\" writes them to stdout instead of the tables\n"
+            << "      --work-dir <dir>   where the PNGs and the results go (default: a temporary directory,\n"
+            << "                         removed afterwards)\n"
+            << "  -h, --help             show this message\n"
+            << "\n"
+            << "The conversion options of some (--level, --layout, --filter, --tiles, --independent-blocks,\n"
+            << "--deflate-threads, ...) apply to the stages and the conversions.\n";
+    }
+
+    using Clock = std::chrono::steady_clock;
+
+    // the fastest of repeat runs of fn, setup runs before every one of them and isn't counted
+    template<typename Setup, typename Fn>
+    double fastest(unsigned repeat, Setup &&setup, Fn &&fn)
+    {
+        double best { std::numeric_limits<double>::max() };
+        for (unsigned r = 0; r < repeat; r++)
+        {
+            setup();
+            const auto started { Clock::now() };
+            fn();
+            best = std::min(best, std::chrono::duration<double>(Clock::now() - started).count());
+        }
+        return best;
+    }
+
+    template<typename Fn>
+    double fastest(unsigned repeat, Fn &&fn)
+    {
+        return fastest(repeat, [] {}, fn);
+    }
+
+    std::vector<unsigned char> readWhole(const std::filesystem::path &path)
+    {
+        std::ifstream in { path, std::ios::binary };
+        std::vector<unsigned char> data(std::filesystem::file_size(path));
+        in.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!in)
+        {
+            throw std::runtime_error("couldn't read " + path.string());
+        }
+        return data;
+    }
+
+    // the pixels as the converter would deflate them (without tiles, which have their own pipeline)
+    void transform(ByteBuffer &pixels, std::uint32_t width, std::uint32_t height,
+                   imbin::Layout layout, bool filter, unsigned threads, std::vector<unsigned char> &filters)
+    {
+        if (layout == imbin::Layout::PlanarRows)
+        {
+            toPlanarRows(pixels.data(), height, width, threads);
+        }
+        if (filter)
+        {
+            ByteBuffer previous;
+            filters.resize(height);
+            filterRows(pixels.data(), height, static_cast<std::size_t>(width) * 4, 4, previous, filters.data(), threads);
+        }
+    }
+
+    // what the converter would write for these pixels (minus the DEFL chunk), returns the size of the file
+    std::uint64_t writeOutput(const std::filesystem::path &path, std::uint32_t width, std::uint32_t height,
+                              const ConversionSettings &settings, const std::vector<unsigned char> &filters,
+                              const imbin::BlockIndex *blocks, const ByteBuffer &payload)
+    {
+        imbin::Header header;
+        header.width = width;
+        header.height = height;
+        header.layout = settings.layout;
+        header.flags = settings.filterRows ? imbin::flagFilteredRows : 0;
+        header.uncompressedSize = static_cast<std::uint64_t>(width) * height * 4;
+        header.payloadSize = payload.size();
+        std::vector<imbin::ChunkData> chunks;
+        if (settings.filterRows)
+        {
+            chunks.push_back({ imbin::filterChunk, filters });
+        }
+        if (blocks)
+        {
+            chunks.push_back({ imbin::blockChunk, imbin::serializeBlockIndex(*blocks) });
+        }
+        const std::vector<unsigned char> bytes { imbin::serializeHeader(header, chunks) };
+
+        std::ofstream out { path, std::ios::binary };
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        out.write(reinterpret_cast<const char*>(payload.data()), static_cast<std::streamsize>(payload.size()));
+        out.close();
+        if (!out)
+        {
+            throw std::runtime_error("couldn't write " + path.string());
+        }
+        return bytes.size() + payload.size();
+    }
+
+    void addStage(std::vector<StageResult> &stages, const std::string &name, double seconds, std::uint64_t bytes)
+    {
+        auto stage { std::find_if(stages.begin(), stages.end(), [&name](const StageResult &s) { return s.name == name; }) };
+        if (stage == stages.end())
+        {
+            stages.push_back({ name, seconds, bytes });
+            return;
+        }
+        stage->seconds += seconds;
+        stage->bytes += bytes;
+    }
+
+    void addSize(ContentResult &result, const std::string &name, std::uint64_t bytes)
+    {
+        for (auto &layout : result.layouts)
+        {
+            if (layout.first == name)
+            {
+                layout.second += bytes;
+                return;
+            }
+        }
+        result.layouts.emplace_back(name, bytes);
+    }
+
+    void addBlocks(ContentResult &result, const BlockResult &blocks)
+    {
+        for (BlockResult &existing : result.blocks)
+        {
+            if (existing.name == blocks.name)
+            {
+                existing.seconds += blocks.seconds;
+                existing.rawBytes += blocks.rawBytes;
+                existing.deflatedBytes += blocks.deflatedBytes;
+                existing.squaredError += blocks.squaredError;
+                existing.samples += blocks.samples;
+                return;
+            }
+        }
+        result.blocks.push_back(blocks);
+    }
+
+    ContentResult benchContent(Content content, const BenchOptions &options, const ConversionSettings &settings,
+                               const std::filesystem::path &directory)
+    {
+        ContentResult result;
+        result.content = contentName(content);
+        result.images = options.images;
+        const bool blocks { settings.deflate.independentBlocks };
+        const bool transformed { settings.layout != imbin::Layout::Interleaved || settings.filterRows };
+
+        for (unsigned i = 0; i < options.images; i++)
+        {
+            const std::string name { std::string { contentName(content) } + "-" + std::to_string(i) };
+            const Image source { makeImage(content, options.width, options.height, i + 1) };
+            const std::vector<unsigned char> png { encodePng(source) };
+            const std::filesystem::path pngPath { directory / (name + ".png") };
+            {
+                std::ofstream out { pngPath, std::ios::binary };
+                out.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+            }
+            const std::uint64_t rawBytes { source.pixels.size() };
+            result.pngBytes += png.size();
+            result.rawBytes += rawBytes;
+
+            // the stages of a whole-image conversion one by one
+            Image decoded;
+            addStage(result.stages, "decode png", fastest(options.repeat, [&] { decoded = decodePng(png.data(), png.size()); }), rawBytes);
+
+            ByteBuffer pixels;
+            std::vector<unsigned char> filters;
+            const double transformSeconds { fastest(options.repeat, [&] { pixels = decoded.pixels; }, [&]
+            {
+                transform(pixels, decoded.width, decoded.height, settings.layout, settings.filterRows, settings.deflate.threads, filters);
+            }) };
+            if (transformed)
+            {
+                addStage(result.stages, "transform", transformSeconds, rawBytes);
+            }
+
+            ByteBuffer payload;
+            imbin::BlockIndex blockIndex;
+            addStage(result.stages, "deflate", fastest(options.repeat, [&]
+            {
+                const std::size_t windowSize { static_cast<std::size_t>(1) << settings.deflate.windowBits };
+                blockIndex = imbin::BlockIndex { rawBytes, std::max(settings.deflate.blockSize, windowSize) };
+                payload = deflateBuffer(pixels.data(), pixels.size(), settings.deflate, blocks ? &blockIndex : nullptr);
+            }), rawBytes);
+
+            std::uint64_t fileBytes { 0 };
+            const std::filesystem::path stagePath { directory / (name + ".stages.im.bin") };
+            const double writeSeconds { fastest(options.repeat, [&]
+            {
+                fileBytes = writeOutput(stagePath, decoded.width, decoded.height, settings, filters, blocks ? &blockIndex : nullptr, payload);
+            }) };
+            addStage(result.stages, "write", writeSeconds, fileBytes);
+
+            // whole conversions, with all the settings (tiles and streaming included)
+            const std::filesystem::path output { directory / (name + ".im.bin") };
+            for (InputMethod input : { InputMethod::Mapped, InputMethod::Stream })
+            {
+                ConversionSettings s { settings };
+                s.input = input;
+                ConversionResult converted;
+                const double seconds { fastest(options.repeat, [&] { converted = convertFile(pngPath, output, s); }) };
+                if (!converted.ok)
+                {
+                    throw std::runtime_error(pngPath.string() + ": " + converted.error);
+                }
+                addStage(result.conversions, input == InputMethod::Mapped ? "convert (mmap)" : "convert (stream)", seconds, rawBytes);
+                if (input == InputMethod::Mapped)
+                {
+                    result.outputBytes += converted.outputBytes;
+                    // the last of the repeats, by which time the pool has seen an image of this size
+                    result.allocations += converted.allocations;
+                }
+            }
+
+            // and reading the result back, whole and the middle quarter of it
+            const std::vector<unsigned char> file { readWhole(output) };
+            imbin::Image read;
+            addStage(result.stages, "read im.bin", fastest(options.repeat, [&] { read = imbin::decode(file.data(), file.size()); }), rawBytes);
+            if (!std::equal(read.pixels.begin(), read.pixels.end(), source.pixels.begin(), source.pixels.end()))
+            {
+                throw std::runtime_error(output.string() + " doesn't decode to the source pixels");
+            }
+            const std::uint32_t w { std::max<std::uint32_t>(decoded.width / 2, 1) };
+            const std::uint32_t h { std::max<std::uint32_t>(decoded.height / 2, 1) };
+            addStage(result.stages, "read region", fastest(options.repeat, [&]
+            {
+                read = imbin::decodeRegion(file.data(), file.size(), decoded.width / 4, decoded.height / 4, w, h);
+            }), static_cast<std::uint64_t>(w) * h * 4);
+
+            // how big the payload gets with the other layouts (same deflate settings, no tiles or blocks)
+            DeflateSettings deflate { settings.deflate };
+            deflate.independentBlocks = false;
+            for (imbin::Layout layout : { imbin::Layout::Interleaved, imbin::Layout::PlanarRows })
+            {
+                for (bool filter : { false, true })
+                {
+                    ByteBuffer variant { decoded.pixels };
+                    transform(variant, decoded.width, decoded.height, layout, filter, settings.deflate.threads, filters);
+                    const std::string variantName { std::string { layout == imbin::Layout::PlanarRows ? "planar" : "interleaved" }
+                                                    + (filter ? "+filter" : "") };
+                    addSize(result, variantName, deflateBuffer(variant.data(), variant.size(), deflate).size());
+                }
+            }
+
+            // the block formats, decoded back and compared with the source
+            if (options.blocks)
+            {
+                const std::pair<imbin::PixelFormat, const char*> formats[] {
+                    { imbin::PixelFormat::Bc1, "bc1" }, { imbin::PixelFormat::Bc3, "bc3" }, { imbin::PixelFormat::Bc7, "bc7" } };
+                const std::pair<BlockQuality, const char*> presets[] {
+                    { BlockQuality::Fast, "fast" }, { BlockQuality::Normal, "normal" }, { BlockQuality::Best, "best" } };
+                for (const auto &format : formats)
+                {
+                    for (const auto &preset : presets)
+                    {
+                        ByteBuffer blocks;
+                        const double seconds { fastest(options.repeat, [&]
+                        {
+                            blocks = compressBlocks(decoded, format.first, preset.first, std::max(settings.deflate.threads, 1u));
+                        }) };
+                        imbin::Image encoded;
+                        encoded.width = decoded.width;
+                        encoded.height = decoded.height;
+                        encoded.format = format.first;
+                        encoded.pixels.assign(blocks.begin(), blocks.end());
+                        const imbin::Image back { imbin::decompressBlocks(encoded) };
+                        double squaredError { 0 };
+                        for (std::size_t b = 0; b < back.pixels.size(); b++)
+                        {
+                            const double d { static_cast<double>(back.pixels[b]) - source.pixels[b] };
+                            squaredError += d * d;
+                        }
+                        addBlocks(result, { std::string { format.second } + " " + preset.second, seconds, rawBytes,
+                                            deflateBuffer(blocks.data(), blocks.size(), deflate).size(), squaredError, rawBytes });
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    // the same PNG converted over and over for at least minSeconds: what an image costs beyond its pixels,
+    // with the deflate streams of the thread recycled and with new ones for every image
+    std::vector<OverheadResult> benchOverhead(double minSeconds, const ConversionSettings &settings,
+                                              const std::filesystem::path &directory)
+    {
+        // 1 KB, 64 KB and 4 MB of pixels
+        const std::pair<const char*, std::uint32_t> sizes[] { { "1 KB", 16 }, { "64 KB", 128 }, { "4 MB", 1024 } };
+        std::vector<OverheadResult> results;
+        for (const auto &[name, side] : sizes)
+        {
+            const Image source { makeImage(Content::Sprites, side, side, 1) };
+            const std::vector<unsigned char> png { encodePng(source) };
+            const std::filesystem::path pngPath { directory / ("overhead-" + std::to_string(side) + ".png") };
+            const std::filesystem::path output { directory / ("overhead-" + std::to_string(side) + ".im.bin") };
+            {
+                std::ofstream out { pngPath, std::ios::binary };
+                out.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+            }
+
+            OverheadResult result;
+            result.size = name;
+            result.rawBytes = source.pixels.size();
+            for (bool reuse : { true, false })
+            {
+                ConversionSettings s { settings };
+                s.deflate.reuseStreams = reuse;
+                // the first one sets up the pool and the streams
+                ConversionResult converted { convertFile(pngPath, output, s) };
+                std::uint64_t images { 0 };
+                std::uint64_t allocations { 0 };
+                const auto started { Clock::now() };
+                double seconds { 0 };
+                while (images < 3 || seconds < minSeconds)
+                {
+                    converted = convertFile(pngPath, output, s);
+                    if (!converted.ok)
+                    {
+                        throw std::runtime_error(pngPath.string() + ": " + converted.error);
+                    }
+                    images++;
+                    allocations += converted.allocations;
+                    seconds = std::chrono::duration<double>(Clock::now() - started).count();
+                }
+                (reuse ? result.reusedSeconds : result.freshSeconds) = seconds / static_cast<double>(images);
+                (reuse ? result.reusedAllocations : result.freshAllocations) = static_cast<double>(allocations) / static_cast<double>(images);
+            }
+            results.push_back(result);
+        }
+        return results;
+    }
+
+    std::filesystem::path temporaryDirectory()
+    {
+        const auto stamp { Clock::now().time_since_epoch().count() };
+        return std::filesystem::temp_directory_path() / ("some-bench-" + std::to_string(stamp));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    try
+    {
+        options = parseBenchOptions(argc, argv);
+    }
+    catch (const std::invalid_argument &ex)
+    {
+        std::cerr << ex.what() << std::endl << std::endl;
+        printBenchUsage(std::cerr);
+        return 1;
+    }
+    if (options.help)
+    {
+        printBenchUsage(std::cout);
+        return 0;
+    }
+
+    const ConversionSettings settings { makeSettings(options.conversion, options.images) };
+    const bool temporary { options.workDirectory.empty() };
+    const std::filesystem::path directory { temporary ? temporaryDirectory() : options.workDirectory };
+
+    BenchResult result;
+    result.settings = {
+        { "size", std::to_string(options.width) + "x" + std::to_string(options.height) },
+        { "images", std::to_string(options.images) },
+        { "repeat", std::to_string(options.repeat) },
+        { "deflate", describe(settings.deflate) },
+        { "deflateThreads", std::to_string(settings.deflate.threads) },
+        { "independentBlocks", settings.deflate.independentBlocks ? "yes" : "no" },
+        { "layout", settings.layout == imbin::Layout::PlanarRows ? "planar" : "interleaved" },
+        { "filter", settings.filterRows ? "yes" : "no" },
+        { "tiles", std::to_string(settings.tileWidth) + "x" + std::to_string(settings.tileHeight) },
+        { "stream", settings.streaming ? "yes" : "no" },
+        { "simd", imbin::simdName(imbin::bestSimd()) }
+    };
+
+    int status { 0 };
+    try
+    {
+        std::filesystem::create_directories(directory);
+        for (Content content : options.contents)
+        {
+            result.contents.push_back(benchContent(content, options, settings, directory));
+        }
+        if (options.overheadSeconds > 0)
+        {
+            result.overhead = benchOverhead(options.overheadSeconds, settings, directory);
+        }
+        if (options.kernelSeconds > 0)
+        {
+            result.kernels = runKernels(4096, options.kernelSeconds);
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        status = 2;
+    }
+    result.peakRssBytes = peakRss();
+
+    if (temporary)
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(directory, ec);
+    }
+    if (status != 0)
+    {
+        return status;
+    }
+
+    if (options.json == "-")
+    {
+        writeJson(result, std::cout);
+        return 0;
+    }
+    printText(result, std::cout);
+    if (!options.json.empty())
+    {
+        std::ofstream out { options.json };
+        writeJson(result, out);
+        if (!out)
+        {
+            std::cerr << "couldn't write " << options.json << std::endl;
+            return 2;
+        }
+    }
+    return 0;
+}
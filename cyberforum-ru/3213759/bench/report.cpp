@@ -0,0 +1,245 @@
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+
+#include "json.h"
+#include "report.h"
+
+namespace
+{
+    const double megabyte { 1000.0 * 1000.0 };
+
+    double perSecond(double amount, double seconds)
+    {
+        return seconds > 0 ? amount / seconds : 0;
+    }
+
+    double perImage(std::uint64_t amount, std::size_t images)
+    {
+        return images > 0 ? static_cast<double>(amount) / static_cast<double>(images) : 0;
+    }
+
+    // 100 for no error at all
+    double psnr(const BlockResult &blocks)
+    {
+        if (blocks.squaredError <= 0)
+        {
+            return 100;
+        }
+        return std::min(100.0, 10 * std::log10(255.0 * 255.0 * static_cast<double>(blocks.samples) / blocks.squaredError));
+    }
+
+    // "2.1 MB", "45.3 KB"
+    std::string formatBytes(std::uint64_t bytes)
+    {
+        char buffer[32];
+        if (bytes >= 1000 * 1000)
+        {
+            std::snprintf(buffer, sizeof(buffer), "%.1f MB", bytes / megabyte);
+        }
+        else
+        {
+            std::snprintf(buffer, sizeof(buffer), "%.1f KB", bytes / 1000.0);
+        }
+        return buffer;
+    }
+
+    void writeStages(JsonWriter &json, const char *key, const std::vector<StageResult> &stages, std::size_t images)
+    {
+        json.beginObject(key);
+        for (const StageResult &stage : stages)
+        {
+            json.beginObject(stage.name.c_str());
+            json.value("seconds", stage.seconds);
+            json.value("bytes", stage.bytes);
+            json.value("mbPerSecond", perSecond(stage.bytes / megabyte, stage.seconds));
+            json.value("imagesPerSecond", perSecond(static_cast<double>(images), stage.seconds));
+            json.endObject();
+        }
+        json.endObject();
+    }
+
+    void printStages(std::ostream &out, const std::vector<StageResult> &stages, std::size_t images)
+    {
+        for (const StageResult &stage : stages)
+        {
+            out << "  " << std::left << std::setw(18) << stage.name << std::right
+                << std::setw(10) << stage.seconds * 1000
+                << std::setw(10) << perSecond(stage.bytes / megabyte, stage.seconds)
+                << std::setw(10) << perSecond(static_cast<double>(images), stage.seconds) << "\n";
+        }
+    }
+}
+
+std::uint64_t peakRss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+    #ifdef __APPLE__
+        return static_cast<std::uint64_t>(usage.ru_maxrss); // bytes
+    #else
+        return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024; // kilobytes
+    #endif
+#endif
+}
+
+void printText(const BenchResult &result, std::ostream &out)
+{
+    out << std::fixed << std::setprecision(1);
+    for (std::size_t i = 0; i < result.settings.size(); i++)
+    {
+        out << (i == 0 ? "" : ", ") << result.settings[i].first << " " << result.settings[i].second;
+    }
+    out << "\n";
+
+    for (const ContentResult &content : result.contents)
+    {
+        out << "\n" << content.content << ": " << content.images << " images, "
+            << formatBytes(content.rawBytes) << " of pixels, PNG " << formatBytes(content.pngBytes)
+            << ", im.bin " << formatBytes(content.outputBytes) << " (" << std::setprecision(2)
+            << perSecond(static_cast<double>(content.rawBytes), static_cast<double>(content.outputBytes))
+            << ":1)\n" << std::setprecision(1);
+        out << "  " << std::left << std::setw(18) << "stage" << std::right
+            << std::setw(10) << "ms" << std::setw(10) << "MB/s" << std::setw(10) << "images/s" << "\n";
+        printStages(out, content.stages, content.images);
+        printStages(out, content.conversions, content.images);
+        out << "  allocations per conversion after warm-up: " << std::setprecision(2)
+            << perImage(content.allocations, content.images) << "\n" << std::setprecision(1);
+        out << "  payload:";
+        for (std::size_t i = 0; i < content.layouts.size(); i++)
+        {
+            out << (i == 0 ? " " : ", ") << content.layouts[i].first << " " << formatBytes(content.layouts[i].second);
+        }
+        out << "\n";
+        if (!content.blocks.empty())
+        {
+            out << "  " << std::left << std::setw(18) << "blocks" << std::right
+                << std::setw(10) << "ms" << std::setw(10) << "MB/s" << std::setw(12) << "deflated" << std::setw(10) << "PSNR" << "\n";
+            for (const BlockResult &blocks : content.blocks)
+            {
+                out << "  " << std::left << std::setw(18) << blocks.name << std::right
+                    << std::setw(10) << blocks.seconds * 1000
+                    << std::setw(10) << perSecond(blocks.rawBytes / megabyte, blocks.seconds)
+                    << std::setw(12) << formatBytes(blocks.deflatedBytes)
+                    << std::setw(10) << std::setprecision(2) << psnr(blocks) << std::setprecision(1) << "\n";
+            }
+        }
+    }
+
+    if (!result.overhead.empty())
+    {
+        out << "\nper image, us (allocations), deflate streams reused / new:\n";
+        for (const OverheadResult &overhead : result.overhead)
+        {
+            out << "  " << std::left << std::setw(8) << overhead.size << std::right
+                << std::setw(10) << overhead.reusedSeconds * 1e6 << " (" << overhead.reusedAllocations << ")"
+                << std::setw(10) << overhead.freshSeconds * 1e6 << " (" << overhead.freshAllocations << ")\n";
+        }
+    }
+
+    if (!result.kernels.empty())
+    {
+        out << "\nkernels, GB/s:\n";
+        for (const KernelResult &kernel : result.kernels)
+        {
+            out << "  " << std::left << std::setw(30) << kernel.kernel << std::setw(8) << kernel.simd << std::right
+                << std::setw(8) << kernel.bytesPerSecond / 1e9 << "\n";
+        }
+    }
+
+    out << "\npeak RSS " << formatBytes(result.peakRssBytes) << "\n";
+}
+
+void writeJson(const BenchResult &result, std::ostream &out)
+{
+    JsonWriter json { out };
+    json.beginObject();
+    json.beginObject("settings");
+    for (const auto &setting : result.settings)
+    {
+        json.value(setting.first.c_str(), setting.second);
+    }
+    json.endObject();
+
+    json.beginArray("contents");
+    for (const ContentResult &content : result.contents)
+    {
+        json.beginObject();
+        json.value("content", content.content);
+        json.value("images", static_cast<std::uint64_t>(content.images));
+        json.value("pngBytes", content.pngBytes);
+        json.value("rawBytes", content.rawBytes);
+        json.value("outputBytes", content.outputBytes);
+        writeStages(json, "stages", content.stages, content.images);
+        writeStages(json, "conversions", content.conversions, content.images);
+        json.value("allocationsPerConversion", perImage(content.allocations, content.images));
+        json.beginObject("payloadBytes");
+        for (const auto &layout : content.layouts)
+        {
+            json.value(layout.first.c_str(), layout.second);
+        }
+        json.endObject();
+        json.beginObject("blocks");
+        for (const BlockResult &blocks : content.blocks)
+        {
+            json.beginObject(blocks.name.c_str());
+            json.value("seconds", blocks.seconds);
+            json.value("mbPerSecond", perSecond(blocks.rawBytes / megabyte, blocks.seconds));
+            json.value("deflatedBytes", blocks.deflatedBytes);
+            json.value("psnr", psnr(blocks));
+            json.endObject();
+        }
+        json.endObject();
+        json.endObject();
+    }
+    json.endArray();
+
+    json.beginArray("overhead");
+    for (const OverheadResult &overhead : result.overhead)
+    {
+        json.beginObject();
+        json.value("size", overhead.size);
+        json.value("rawBytes", overhead.rawBytes);
+        json.value("reusedSecondsPerImage", overhead.reusedSeconds);
+        json.value("freshSecondsPerImage", overhead.freshSeconds);
+        json.value("reusedAllocationsPerImage", overhead.reusedAllocations);
+        json.value("freshAllocationsPerImage", overhead.freshAllocations);
+        json.endObject();
+    }
+    json.endArray();
+
+    json.beginArray("kernels");
+    for (const KernelResult &kernel : result.kernels)
+    {
+        json.beginObject();
+        json.value("kernel", kernel.kernel);
+        json.value("simd", kernel.simd);
+        json.value("gbPerSecond", kernel.bytesPerSecond / 1e9);
+        json.endObject();
+    }
+    json.endArray();
+
+    json.value("peakRssBytes", result.peakRssBytes);
+    json.endObject();
+}
@@ -0,0 +1,91 @@
+#ifndef BENCH_REPORT_H
+#define BENCH_REPORT_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// time and bytes of one stage over all the images of a content class (best of the repeats for every image)
+struct StageResult
+{
+    std::string name;
+    double seconds { 0 };
+    // what the throughput is counted in: pixel bytes for most stages, file bytes for writing
+    std::uint64_t bytes { 0 };
+};
+
+// one block format at one preset over all the images of a content class
+struct BlockResult
+{
+    std::string name;
+    double seconds { 0 };
+    std::uint64_t rawBytes { 0 };
+    // deflated the way the converter does it, with the benchmark's settings
+    std::uint64_t deflatedBytes { 0 };
+    // between the source and the decoded blocks, over all four channels
+    double squaredError { 0 };
+    std::uint64_t samples { 0 };
+};
+
+struct ContentResult
+{
+    std::string content;
+    std::size_t images { 0 };
+    std::uint64_t pngBytes { 0 };
+    std::uint64_t rawBytes { 0 };
+    std::uint64_t outputBytes { 0 };
+    // decode, transform, deflate, write, then the reading side
+    std::vector<StageResult> stages;
+    // whole conversions through convertFile(), one per input method
+    std::vector<StageResult> conversions;
+    // blocks the converting thread's pool got from the system in the last mmap conversion of every image
+    std::uint64_t allocations { 0 };
+    // payload size with every layout/filter combination, with the benchmark's deflate settings
+    std::vector<std::pair<std::string, std::uint64_t>> layouts;
+    // only with --blocks
+    std::vector<BlockResult> blocks;
+};
+
+// what converting one image costs at a size, average of many conversions of the same one
+struct OverheadResult
+{
+    std::string size;
+    std::uint64_t rawBytes { 0 };
+    // the thread's deflate streams recycled, and new ones for every image
+    double reusedSeconds { 0 };
+    double freshSeconds { 0 };
+    // blocks the pool got from the system per image
+    double reusedAllocations { 0 };
+    double freshAllocations { 0 };
+};
+
+// throughput of a pixel kernel on one row, for one instruction set
+struct KernelResult
+{
+    std::string kernel;
+    std::string simd;
+    double bytesPerSecond { 0 };
+};
+
+struct BenchResult
+{
+    // the settings the run was made with, as name/value pairs, so runs can be compared
+    std::vector<std::pair<std::string, std::string>> settings;
+    std::vector<ContentResult> contents;
+    std::vector<OverheadResult> overhead;
+    std::vector<KernelResult> kernels;
+    std::uint64_t peakRssBytes { 0 };
+};
+
+// maximum resident set size of the process so far, 0 where it can't be found out
+std::uint64_t peakRss();
+
+// tables for people
+void printText(const BenchResult &result, std::ostream &out);
+
+// the same as one JSON document, for diffing runs between commits
+void writeJson(const BenchResult &result, std::ostream &out);
+
+#endif // BENCH_REPORT_H
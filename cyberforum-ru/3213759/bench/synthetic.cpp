@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef USING_PACKAGE_MANAGER
+    #include <png/png.h>
+#else
+    #include <png.h>
+#endif
+
+#include "synthetic.h"
+
+namespace
+{
+    // splitmix64, good enough for pixels and the same everywhere (unlike std::rand)
+    class Random
+    {
+    public:
+        explicit Random(std::uint64_t seed) : m_state { seed } {}
+
+        std::uint64_t next()
+        {
+            std::uint64_t z { m_state += 0x9E3779B97F4A7C15ull };
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        // in [0, n)
+        std::uint32_t below(std::uint32_t n) { return static_cast<std::uint32_t>(next() % n); }
+
+    private:
+        std::uint64_t m_state;
+    };
+
+    // a random value in [0, 1] for every point of an integer lattice
+    double lattice(std::int64_t x, std::int64_t y, std::uint64_t seed)
+    {
+        Random random { seed ^ (static_cast<std::uint64_t>(x) * 0x8CB92BA72F3D8DD7ull) ^ (static_cast<std::uint64_t>(y) * 0xD6E8FEB86659FD93ull) };
+        return static_cast<double>(random.next() >> 11) / static_cast<double>(1ull << 53);
+    }
+
+    // value noise: the lattice interpolated smoothly between points scale pixels apart
+    double valueNoise(std::uint32_t x, std::uint32_t y, std::uint32_t scale, std::uint64_t seed)
+    {
+        const std::int64_t cx { x / scale };
+        const std::int64_t cy { y / scale };
+        auto smooth = [](double t) { return t * t * (3 - 2 * t); };
+        const double fx { smooth(static_cast<double>(x % scale) / scale) };
+        const double fy { smooth(static_cast<double>(y % scale) / scale) };
+        const double top { lattice(cx, cy, seed) * (1 - fx) + lattice(cx + 1, cy, seed) * fx };
+        const double bottom { lattice(cx, cy + 1, seed) * (1 - fx) + lattice(cx + 1, cy + 1, seed) * fx };
+        return top * (1 - fy) + bottom * fy;
+    }
+
+    unsigned char clampByte(double v)
+    {
+        return static_cast<unsigned char>(std::clamp(v, 0.0, 255.0));
+    }
+
+    void fillNoise(Image &image, Random &random)
+    {
+        for (std::size_t i = 0; i < image.pixels.size(); i += 8)
+        {
+            const std::uint64_t bits { random.next() };
+            for (std::size_t k = 0; k < 8 && i + k < image.pixels.size(); k++)
+            {
+                image.pixels[i + k] = static_cast<unsigned char>(bits >> (k * 8));
+            }
+        }
+    }
+
+    void fillGradient(Image &image, Random &random)
+    {
+        const std::uint32_t phase[3] { random.below(256), random.below(256), random.below(256) };
+        const double sx { 255.0 / std::max<std::uint32_t>(image.width - 1, 1) };
+        const double sy { 255.0 / std::max<std::uint32_t>(image.height - 1, 1) };
+        for (std::uint32_t y = 0; y < image.height; y++)
+        {
+            unsigned char *p { image.pixels.data() + y * image.rowBytes };
+            for (std::uint32_t x = 0; x < image.width; x++, p += 4)
+            {
+                p[0] = static_cast<unsigned char>(static_cast<std::uint32_t>(x * sx) + phase[0]);
+                p[1] = static_cast<unsigned char>(static_cast<std::uint32_t>(y * sy) + phase[1]);
+                p[2] = static_cast<unsigned char>(static_cast<std::uint32_t>((x * sx + y * sy) / 2) + phase[2]);
+                p[3] = 255;
+            }
+        }
+    }
+
+    void fillSprites(Image &image, Random &random)
+    {
+        // transparent black background, then about one shape per 48x48 pixels
+        std::fill(image.pixels.begin(), image.pixels.end(), static_cast<unsigned char>(0));
+        const std::size_t shapes { std::max<std::size_t>(1, static_cast<std::size_t>(image.width) * image.height / (48 * 48)) };
+        for (std::size_t s = 0; s < shapes; s++)
+        {
+            const std::uint32_t w { 8 + random.below(88) };
+            const std::uint32_t h { 8 + random.below(88) };
+            const std::uint32_t x0 { random.below(image.width) };
+            const std::uint32_t y0 { random.below(image.height) };
+            const bool round { random.below(2) == 0 };
+            const unsigned char color[4] {
+                static_cast<unsigned char>(random.below(256)),
+                static_cast<unsigned char>(random.below(256)),
+                static_cast<unsigned char>(random.below(256)),
+                static_cast<unsigned char>(random.below(4) == 0 ? 128 : 255)
+            };
+            const std::uint32_t x1 { std::min(image.width, x0 + w) };
+            const std::uint32_t y1 { std::min(image.height, y0 + h) };
+            for (std::uint32_t y = y0; y < y1; y++)
+            {
+                for (std::uint32_t x = x0; x < x1; x++)
+                {
+                    if (round)
+                    {
+                        // inside the ellipse inscribed in the rectangle
+                        const double dx { (x - x0 + 0.5) / w * 2 - 1 };
+                        const double dy { (y - y0 + 0.5) / h * 2 - 1 };
+                        if (dx * dx + dy * dy > 1) { continue; }
+                    }
+                    std::copy(color, color + 4, image.pixels.data() + y * image.rowBytes + x * 4);
+                }
+            }
+        }
+    }
+
+    void fillPhoto(Image &image, Random &random)
+    {
+        const std::uint64_t seeds[3] { random.next(), random.next(), random.next() };
+        for (std::uint32_t y = 0; y < image.height; y++)
+        {
+            unsigned char *p { image.pixels.data() + y * image.rowBytes };
+            for (std::uint32_t x = 0; x < image.width; x++, p += 4)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    const double v { valueNoise(x, y, 256, seeds[c]) * 160 + valueNoise(x, y, 32, seeds[c] + 1) * 64
+                                     + valueNoise(x, y, 4, seeds[c] + 2) * 16 };
+                    // sensor grain
+                    p[c] = clampByte(v + static_cast<int>(random.below(7)) - 3);
+                }
+                p[3] = 255;
+            }
+        }
+    }
+
+    void writeToVector(png_structp pngPtr, png_bytep data, png_size_t length)
+    {
+        auto *out { reinterpret_cast<std::vector<unsigned char>*>(png_get_io_ptr(pngPtr)) };
+        out->insert(out->end(), data, data + length);
+    }
+
+    void flushNothing(png_structp) {}
+}
+
+const std::vector<Content>& allContents()
+{
+    static const std::vector<Content> contents { Content::Noise, Content::Gradient, Content::Sprites, Content::Photo };
+    return contents;
+}
+
+const char* contentName(Content content)
+{
+    switch (content)
+    {
+    case Content::Noise: return "noise";
+    case Content::Gradient: return "gradient";
+    case Content::Sprites: return "sprites";
+    case Content::Photo: return "photo";
+    }
+    return "unknown";
+}
+
+Content parseContent(const std::string &name)
+{
+    for (Content content : allContents())
+    {
+        if (name == contentName(content))
+        {
+            return content;
+        }
+    }
+    throw std::invalid_argument("unknown content class: " + name);
+}
+
+Image makeImage(Content content, std::uint32_t width, std::uint32_t height, std::uint32_t seed)
+{
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.rowBytes = static_cast<std::size_t>(width) * 4;
+    image.pixels.resize(image.rowBytes * height);
+
+    Random random { (static_cast<std::uint64_t>(content) << 32) | seed };
+    switch (content)
+    {
+    case Content::Noise: fillNoise(image, random); break;
+    case Content::Gradient: fillGradient(image, random); break;
+    case Content::Sprites: fillSprites(image, random); break;
+    case Content::Photo: fillPhoto(image, random); break;
+    }
+    return image;
+}
+
+std::vector<unsigned char> encodePng(const Image &image)
+{
+    std::vector<unsigned char> out;
+    std::vector<png_const_bytep> rows(image.height);
+    for (std::uint32_t y = 0; y < image.height; y++)
+    {
+        rows[y] = image.pixels.data() + y * image.rowBytes;
+    }
+
+    png_structp pngPtr { png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr) };
+    png_infop infoPtr { pngPtr ? png_create_info_struct(pngPtr) : nullptr };
+    if (!infoPtr)
+    {
+        png_destroy_write_struct(&pngPtr, nullptr);
+        throw std::runtime_error("couldn't create PNG write struct");
+    }
+    // nothing with a destructor is created past this point
+    if (setjmp(png_jmpbuf(pngPtr)))
+    {
+        png_destroy_write_struct(&pngPtr, &infoPtr);
+        throw std::runtime_error("couldn't encode the PNG");
+    }
+    png_set_write_fn(pngPtr, &out, writeToVector, flushNothing);
+    png_set_IHDR(pngPtr, infoPtr, image.width, image.height, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(pngPtr, infoPtr);
+    png_write_rows(pngPtr, const_cast<png_bytepp>(rows.data()), image.height);
+    png_write_end(pngPtr, infoPtr);
+    png_destroy_write_struct(&pngPtr, &infoPtr);
+    return out;
+}
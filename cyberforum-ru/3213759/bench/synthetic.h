@@ -0,0 +1,32 @@
+#ifndef BENCH_SYNTHETIC_H
+#define BENCH_SYNTHETIC_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "image.h"
+
+// kinds of images the benchmark generates, so it needs no corpus of its own
+enum class Content
+{
+    Noise, // random bytes, the worst case for deflate
+    Gradient, // smooth ramps in every channel, opaque
+    Sprites, // flat shapes on a transparent background, like UI atlases
+    Photo // smooth shapes at a few scales plus grain, opaque
+};
+
+const std::vector<Content>& allContents();
+// "noise", "gradient", "sprites", "photo"
+const char* contentName(Content content);
+// throws std::invalid_argument for unknown names
+Content parseContent(const std::string &name);
+
+// 8-bit RGBA pixels, always the same for the same content, size and seed
+Image makeImage(Content content, std::uint32_t width, std::uint32_t height, std::uint32_t seed);
+
+// the image as an 8-bit RGBA PNG with libpng's default settings (what most tools would save);
+// throws std::runtime_error
+std::vector<unsigned char> encodePng(const Image &image);
+
+#endif // BENCH_SYNTHETIC_H
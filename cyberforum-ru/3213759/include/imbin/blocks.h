@@ -0,0 +1,18 @@
+#ifndef IMBIN_BLOCKS_H
+#define IMBIN_BLOCKS_H
+
+#include <imbin/export.h>
+#include <imbin/reader.h>
+
+// the block formats (see PixelFormat in format.h) decoded on the CPU, for previews, checks and GPUs that don't take them
+namespace imbin
+{
+    // the pixels of one block, RGBARGBA... row by row
+    IMBIN_EXPORT void decompressBlock(PixelFormat format, const unsigned char *block, unsigned char *rgba);
+
+    // an image of one of the block formats as RGBA8, rows of blocks in parallel on up to options.threads threads;
+    // Rgba8 images come back as they are; throws imbin::Error, for BC7 blocks of any mode but 6 too
+    IMBIN_EXPORT Image decompressBlocks(const Image &image, const DecodeOptions &options = {});
+}
+
+#endif // IMBIN_BLOCKS_H
@@ -0,0 +1,18 @@
+#ifndef IMBIN_EXPORT_H
+#define IMBIN_EXPORT_H
+
+#ifdef imbin_EXPORTS // CMake sets that when building imbin as a shared library
+    #ifdef _MSC_VER
+        #define IMBIN_EXPORT __declspec(dllexport)
+    #endif
+#elif defined(IMBIN_SHARED) // set by the target for its users when it is a shared library
+    #ifdef _MSC_VER
+        #define IMBIN_EXPORT __declspec(dllimport)
+    #endif
+#endif
+
+#ifndef IMBIN_EXPORT
+    #define IMBIN_EXPORT // static library, or a compiler that exports everything anyway
+#endif
+
+#endif // IMBIN_EXPORT_H
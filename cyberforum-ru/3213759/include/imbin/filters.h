@@ -0,0 +1,35 @@
+#ifndef IMBIN_FILTERS_H
+#define IMBIN_FILTERS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <imbin/export.h>
+#include <imbin/simd.h>
+
+// PNG-style prediction filters, applied per row before deflating; the left neighbour of a byte is the byte distance
+// bytes earlier (the pixel size, which in the PlanarRows layout makes it the same plane 4 pixels to the left),
+// the row above is the previous row of the image or the tile, and everything outside of those is 0
+namespace imbin
+{
+    enum class RowFilter : std::uint8_t
+    {
+        None = 0,
+        Sub = 1, // minus the left byte
+        Up = 2, // minus the byte above
+        Average = 3, // minus the rounded down average of those two
+        Paeth = 4 // minus whichever of left, above and above-left is closest to left + above - above-left
+    };
+
+    // filters the row with whichever filter gives the smallest sum of absolute values (as signed bytes) of the result,
+    // previous is the original (not filtered) row above or nullptr for the first one; returns the chosen filter
+    IMBIN_EXPORT RowFilter filterRow(const unsigned char *row, const unsigned char *previous, std::size_t size,
+                                     std::size_t distance, unsigned char *out);
+
+    // undoes the filter in place, previous is the already unfiltered row above or nullptr for the first one;
+    // simd is clamped to what the CPU supports, and only used for the 4-byte distance
+    IMBIN_EXPORT void unfilterRow(RowFilter filter, unsigned char *row, const unsigned char *previous, std::size_t size,
+                                  std::size_t distance, Simd simd = bestSimd());
+}
+
+#endif // IMBIN_FILTERS_H
@@ -0,0 +1,316 @@
+#ifndef IMBIN_FORMAT_H
+#define IMBIN_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <imbin/export.h>
+
+// im.bin v2 container, all the numbers are little-endian:
+//
+//   0  8  magic "\x89IMB\r\n\x1a\n"
+//   8  2  version (2)
+//  10  2  size of this fixed part (64), anything after it up to the chunk table is for future versions
+//  12  4  width
+//  16  4  height
+//  20  1  pixel format
+//  21  1  layout
+//  22  1  codec
+//  23  1  reserved, 0
+//  24  4  flags
+//  28  4  number of chunks
+//  32  8  uncompressed size, what the payload decodes to
+//  40  8  payload offset
+//  48  8  payload size, all ones if it extends to the end of the file
+//  56  8  reserved, 0
+//  64     chunk table: id (4 characters), reserved (4 bytes), offset (8), size (8) for each chunk
+//         chunk data
+//         payload
+//
+// v1 files are just int width, int height (native, so in practice little-endian) and a zlib stream of RGBA8 pixels
+namespace imbin
+{
+    class IMBIN_EXPORT Error : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    const unsigned char magic[8] { 0x89, 'I', 'M', 'B', '\r', '\n', 0x1a, '\n' };
+    const std::uint16_t currentVersion { 2 };
+    const std::size_t headerSize { 64 };
+    const std::size_t chunkEntrySize { 24 };
+    const std::uint64_t payloadToEnd { ~static_cast<std::uint64_t>(0) };
+
+    enum class PixelFormat : std::uint8_t
+    {
+        Rgba8 = 1,
+        // 4x4 blocks of the GPU formats of the same names, row of blocks by row of blocks (the blocks on the right
+        // and bottom edges are padded with copies of the last column and row), for uploading as they are;
+        // decompressBlocks() (blocks.h) turns them back into RGBA8
+        Bc1 = 2, // 8 bytes per block, RGB with 1-bit alpha
+        Bc3 = 3, // 16 bytes per block, RGB plus an interpolated alpha block
+        Bc7 = 4 // 16 bytes per block, mode 6 only (RGBA endpoints with 4-bit indices)
+    };
+
+    enum class Layout : std::uint8_t
+    {
+        Interleaved = 0, // rows of pixels one after another
+        // every row (every row of a tile in tiled files) is split into planes, one per channel:
+        // all the reds of the row, then all the greens and so on; only for Rgba8
+        PlanarRows = 1
+    };
+
+    enum class Codec : std::uint8_t
+    {
+        Zlib = 0, // the payload is one zlib stream
+        ZlibTiles = 1, // every tile is a separate zlib stream, see the TILE chunk
+        // frames of the same size one after another, keyframes and deltas against the frame before them (see the FRMS
+        // chunk); width, height and the uncompressed size are those of one frame, read with SequenceReader (sequence.h)
+        ZlibSequence = 2,
+        Stored = 3 // the payload is what it decodes to, as it is
+    };
+
+    constexpr std::uint32_t chunkId(const char (&id)[5])
+    {
+        return static_cast<std::uint32_t>(static_cast<unsigned char>(id[0]))
+            | static_cast<std::uint32_t>(static_cast<unsigned char>(id[1])) << 8
+            | static_cast<std::uint32_t>(static_cast<unsigned char>(id[2])) << 16
+            | static_cast<std::uint32_t>(static_cast<unsigned char>(id[3])) << 24;
+    }
+
+    // deflate parameters the payload was compressed with, 8 bytes:
+    // level, memLevel, windowBits, strategy (0 default, 1 filtered, 2 rle, 3 huffman), automatically chosen (0/1), 3 reserved
+    const std::uint32_t deflateChunk { chunkId("DEFL") };
+
+    // tile index of the ZlibTiles codec: tile width and height (4 bytes each),
+    // then offset (from the start of the payload) and compressed size (8 bytes each) of every tile, row by row;
+    // tiles on the right and bottom edges are cut to the image, each one decodes to its rows of pixels
+    const std::uint32_t tileChunk { chunkId("TILE") };
+
+    // block index of a Zlib payload made of independently deflated blocks (every block starts with an empty window
+    // and all but the last one end with a sync flush, so together they are still one regular zlib stream):
+    // uncompressed block size (8 bytes), then offset (from the start of the payload) and compressed size (8 bytes each)
+    // of every block; all the blocks but the last one decode to exactly the block size
+    const std::uint32_t blockChunk { chunkId("BLKS") };
+
+    // one RowFilter (see filters.h) per row the payload was filtered in: every row of the image,
+    // or for tiled files every row of every tile, tile by tile in the order of the tile index; goes with flagFilteredRows
+    const std::uint32_t filterChunk { chunkId("FILT") };
+
+    // frame index of the ZlibSequence codec: number of frames, the keyframe interval the writer used, tile width
+    // and height of the deltas (4 bytes each), then for every frame its offset (from the start of the payload) and
+    // size (8 bytes each), kind (0 keyframe, 1 delta) and number of changed tiles (4 bytes each);
+    // a keyframe is a zlib stream of all its pixels, a delta is a bitmap of the tiles that differ from the frame before
+    // (a bit per tile, row by row, lowest bit first, see tileBitmapSize()) and a zlib stream of the XOR of the rows of
+    // those tiles with the frame before, tile by tile, which is left out if no tile changed; the first frame is a keyframe
+    const std::uint32_t frameChunk { chunkId("FRMS") };
+
+    // mip levels below the image, each one half the size of the level above (rounded down, at least 1) down to 1x1,
+    // every pixel the average of the 2x2 block of the level above (for odd sizes the last column or row of the level
+    // above is left out): number of levels and the filter (0 box, 1 box in linear light, sRGB in and out) (4 bytes
+    // each), then width and height (4 bytes each), offset (from the start of the chunk) and size (8 bytes each) of
+    // every level from the biggest one down; each level is a zlib stream of its rows of pixels (always interleaved,
+    // whatever the layout of the image), and they follow the index inside the chunk, so they come before the payload
+    const std::uint32_t mipChunk { chunkId("MIPS") };
+
+    // the colours of an indexed image (flagIndexed): bits per index (1, 2, 4 or 8) and the number of entries (1 to 256,
+    // and no more than the bits can tell apart) (4 bytes each), then the entries, 4 bytes of RGBA8 each
+    const std::uint32_t paletteChunk { chunkId("PLTE") };
+
+    // header flags, a reader has to refuse files with flags it doesn't know, as they change what the payload means
+    const std::uint32_t flagFilteredRows { 1 }; // rows were filtered before deflating, see the FILT chunk
+    // every pixel of the Rgba8 image had the alpha 255, so the payload has just RGB (3 bytes per pixel in the rows,
+    // the tiles and the filters, and in the uncompressed size), readers put the alpha back; Interleaved only
+    const std::uint32_t flagOpaque { 2 };
+    // every pixel of the image is the same, the payload is just that one pixel (Zlib or Stored, no tiles or filters),
+    // readers repeat it; the layout doesn't matter then and is Interleaved
+    const std::uint32_t flagConstant { 4 };
+    // the Rgba8 image has 256 colours at most, the payload is indices into the PLTE chunk: rows of them packed
+    // with the first pixel in the highest bits of a byte (as in PNG), every row starting on a byte, see indexRowBytes();
+    // tiles always take 8 bits, and the filters go over the packed bytes a byte at a time; Interleaved only
+    const std::uint32_t flagIndexed { 8 };
+    const std::uint32_t knownFlags { flagFilteredRows | flagOpaque | flagConstant | flagIndexed };
+
+    // bytes of a row of indices of an indexed image
+    constexpr std::size_t indexRowBytes(std::uint32_t width, std::uint32_t bits)
+    {
+        return (static_cast<std::size_t>(width) * bits + 7) / 8;
+    }
+
+    // throws for the block formats, which don't have whole bytes per pixel
+    IMBIN_EXPORT std::size_t bytesPerPixel(PixelFormat format);
+    IMBIN_EXPORT bool isBlockFormat(PixelFormat format);
+    IMBIN_EXPORT std::size_t bytesPerBlock(PixelFormat format);
+    // what an image of the format takes uncompressed
+    IMBIN_EXPORT std::uint64_t imageSize(PixelFormat format, std::uint32_t width, std::uint32_t height);
+
+    struct TileIndex
+    {
+        struct Entry
+        {
+            std::uint64_t offset { 0 };
+            std::uint64_t size { 0 };
+        };
+
+        std::uint32_t tileWidth { 0 };
+        std::uint32_t tileHeight { 0 };
+        std::uint32_t tilesX { 0 };
+        std::uint32_t tilesY { 0 };
+        std::vector<Entry> tiles;
+
+        // sets up an empty index for the image
+        IMBIN_EXPORT TileIndex(std::uint32_t imageWidth, std::uint32_t imageHeight, std::uint32_t tileWidth, std::uint32_t tileHeight);
+        TileIndex() = default;
+    };
+
+    IMBIN_EXPORT std::vector<unsigned char> serializeTileIndex(const TileIndex &index);
+    // throws imbin::Error
+    IMBIN_EXPORT TileIndex parseTileIndex(const unsigned char *data, std::size_t size, std::uint32_t imageWidth, std::uint32_t imageHeight);
+
+    struct BlockIndex
+    {
+        using Entry = TileIndex::Entry;
+
+        std::uint64_t blockSize { 0 };
+        std::vector<Entry> blocks;
+
+        // sets up an empty index for a payload of that many uncompressed bytes (always at least one block)
+        IMBIN_EXPORT BlockIndex(std::uint64_t uncompressedSize, std::uint64_t blockSize);
+        BlockIndex() = default;
+    };
+
+    IMBIN_EXPORT std::vector<unsigned char> serializeBlockIndex(const BlockIndex &index);
+    // throws imbin::Error
+    IMBIN_EXPORT BlockIndex parseBlockIndex(const unsigned char *data, std::size_t size, std::uint64_t uncompressedSize);
+
+    struct FrameIndex
+    {
+        enum class Kind : std::uint32_t
+        {
+            Key = 0,
+            Delta = 1
+        };
+
+        struct Entry
+        {
+            std::uint64_t offset { 0 };
+            std::uint64_t size { 0 };
+            Kind kind { Kind::Key };
+            std::uint32_t changedTiles { 0 };
+        };
+
+        std::uint32_t keyframeInterval { 0 };
+        std::uint32_t tileWidth { 0 };
+        std::uint32_t tileHeight { 0 };
+        std::vector<Entry> frames;
+    };
+
+    // bytes of the changed tile bitmap of a delta frame
+    constexpr std::size_t tileBitmapSize(std::size_t tiles)
+    {
+        return (tiles + 7) / 8;
+    }
+
+    IMBIN_EXPORT std::vector<unsigned char> serializeFrameIndex(const FrameIndex &index);
+    // throws imbin::Error
+    IMBIN_EXPORT FrameIndex parseFrameIndex(const unsigned char *data, std::size_t size);
+
+    struct MipIndex
+    {
+        enum class Filter : std::uint32_t
+        {
+            Box = 0,
+            LinearBox = 1
+        };
+
+        struct Level
+        {
+            std::uint32_t width { 0 };
+            std::uint32_t height { 0 };
+            std::uint64_t offset { 0 };
+            std::uint64_t size { 0 };
+        };
+
+        Filter filter { Filter::Box };
+        std::vector<Level> levels;
+    };
+
+    // size of the index part of the chunk, before the levels
+    constexpr std::size_t mipIndexSize(std::size_t levels)
+    {
+        return 8 + levels * 24;
+    }
+
+    IMBIN_EXPORT std::vector<unsigned char> serializeMipIndex(const MipIndex &index);
+    // checks that the levels are within the chunk and are the whole chain of halvings of the width x height image
+    // down to 1x1; throws imbin::Error
+    IMBIN_EXPORT MipIndex parseMipIndex(const unsigned char *data, std::size_t size, std::uint32_t width, std::uint32_t height);
+
+    struct Palette
+    {
+        std::uint32_t bits { 8 };
+        // RGBA8, 4 bytes per entry
+        std::vector<unsigned char> entries;
+
+        std::size_t size() const { return entries.size() / 4; }
+    };
+
+    IMBIN_EXPORT std::vector<unsigned char> serializePalette(const Palette &palette);
+    // throws imbin::Error
+    IMBIN_EXPORT Palette parsePalette(const unsigned char *data, std::size_t size);
+
+    struct Chunk
+    {
+        std::uint32_t id { 0 };
+        std::uint64_t offset { 0 }; // from the start of the file
+        std::uint64_t size { 0 };
+    };
+
+    struct Header
+    {
+        std::uint16_t version { currentVersion };
+        std::uint32_t width { 0 };
+        std::uint32_t height { 0 };
+        PixelFormat format { PixelFormat::Rgba8 };
+        Layout layout { Layout::Interleaved };
+        Codec codec { Codec::Zlib };
+        std::uint32_t flags { 0 };
+        std::uint64_t uncompressedSize { 0 };
+        std::uint64_t payloadOffset { 0 };
+        std::uint64_t payloadSize { payloadToEnd };
+        std::vector<Chunk> chunks;
+
+        IMBIN_EXPORT const Chunk* findChunk(std::uint32_t id) const;
+    };
+
+    // what the writer puts into a chunk
+    struct ChunkData
+    {
+        std::uint32_t id { 0 };
+        std::vector<unsigned char> data;
+    };
+
+    // everything that goes before the payload: the fixed part, the chunk table and the chunks;
+    // fills in the chunk table and payloadOffset of the header, payloadSize can be payloadToEnd
+    IMBIN_EXPORT std::vector<unsigned char> serializeHeader(Header &header, const std::vector<ChunkData> &chunks);
+
+    // offset of the payload size field, for patching it once the payload has been written
+    const std::size_t payloadSizeOffset { 48 };
+
+    // parses either a v2 header (with its chunk table) or a v1 one, needs the whole header in memory,
+    // fileSize is used for resolving payloadToEnd; throws imbin::Error
+    IMBIN_EXPORT Header parseHeader(const unsigned char *data, std::size_t size, std::uint64_t fileSize);
+
+    IMBIN_EXPORT void putU16(std::vector<unsigned char> &out, std::uint16_t v);
+    IMBIN_EXPORT void putU32(std::vector<unsigned char> &out, std::uint32_t v);
+    IMBIN_EXPORT void putU64(std::vector<unsigned char> &out, std::uint64_t v);
+    IMBIN_EXPORT std::uint16_t getU16(const unsigned char *p);
+    IMBIN_EXPORT std::uint32_t getU32(const unsigned char *p);
+    IMBIN_EXPORT std::uint64_t getU64(const unsigned char *p);
+}
+
+#endif // IMBIN_FORMAT_H
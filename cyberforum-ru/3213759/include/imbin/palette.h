@@ -0,0 +1,26 @@
+#ifndef IMBIN_PALETTE_H
+#define IMBIN_PALETTE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <imbin/export.h>
+#include <imbin/format.h>
+#include <imbin/simd.h>
+
+// indices of indexed images (flagIndexed, see format.h) to RGBA8, simd is clamped to what the CPU supports
+namespace imbin
+{
+    // the entries of the palette for all 256 indices, 1024 bytes of RGBA8; the ones past the palette are zero,
+    // so an index out of it (in a corrupted file) still reads inside the table
+    IMBIN_EXPORT std::vector<unsigned char> paletteTable(const Palette &palette);
+
+    // pixels indices of a row packed bits (1, 2, 4 or 8) to a byte, from pixel first of the row on -> RGBA8 through
+    // the table; fewer than 8 bits go through byte shuffles with SSSE3 (the indices can't be past 16 entries then),
+    // 8 bits through gathers with AVX2
+    IMBIN_EXPORT void expandIndices(const unsigned char *row, std::size_t first, std::size_t pixels, std::uint32_t bits,
+                                    const unsigned char *table, unsigned char *rgba, Simd simd = bestSimd());
+}
+
+#endif // IMBIN_PALETTE_H
@@ -0,0 +1,19 @@
+#ifndef IMBIN_PARALLEL_H
+#define IMBIN_PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+#include <imbin/export.h>
+
+namespace imbin
+{
+    // the number of threads to use when nothing was requested explicitly
+    IMBIN_EXPORT unsigned defaultThreadCount();
+
+    // runs fn(0) .. fn(count - 1) on up to threadCount threads (the calling one included) and returns when all are done,
+    // rethrows the first exception; meant for splitting one piece of work, safe to call from any thread
+    IMBIN_EXPORT void parallelFor(std::size_t count, unsigned threadCount, const std::function<void(std::size_t)> &fn);
+}
+
+#endif // IMBIN_PARALLEL_H
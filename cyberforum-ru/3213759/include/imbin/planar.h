@@ -0,0 +1,22 @@
+#ifndef IMBIN_PLANAR_H
+#define IMBIN_PLANAR_H
+
+#include <cstddef>
+
+#include <imbin/export.h>
+#include <imbin/simd.h>
+
+// conversions between interleaved RGBA8 pixels and the four planes of the PlanarRows layout,
+// the planes are planeStride bytes apart (the row width for whole rows), simd is clamped to what the CPU supports
+namespace imbin
+{
+    // RGBARGBA... -> RR... GG... BB... AA...
+    IMBIN_EXPORT void deinterleaveRgba(const unsigned char *rgba, std::size_t pixels, unsigned char *planes, std::size_t planeStride,
+                                       Simd simd = bestSimd());
+
+    // RR... GG... BB... AA... -> RGBARGBA...
+    IMBIN_EXPORT void interleaveRgba(const unsigned char *planes, std::size_t planeStride, std::size_t pixels, unsigned char *rgba,
+                                     Simd simd = bestSimd());
+}
+
+#endif // IMBIN_PLANAR_H
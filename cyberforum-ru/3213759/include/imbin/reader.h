@@ -0,0 +1,61 @@
+#ifndef IMBIN_READER_H
+#define IMBIN_READER_H
+
+#include <filesystem>
+
+#include <imbin/export.h>
+#include <imbin/format.h>
+
+namespace imbin
+{
+    struct Image
+    {
+        std::uint32_t width { 0 };
+        std::uint32_t height { 0 };
+        PixelFormat format { PixelFormat::Rgba8 };
+        std::vector<unsigned char> pixels;
+    };
+
+    // what a file decodes to, without decoding it
+    struct Info
+    {
+        std::uint32_t width { 0 };
+        std::uint32_t height { 0 };
+        PixelFormat format { PixelFormat::Rgba8 };
+        std::uint64_t pixelsSize { 0 }; // rows of pixels one after another, without any padding
+    };
+
+    struct DecodeOptions
+    {
+        // tiles and independent blocks are inflated on that many threads (the calling one included),
+        // 0 means all cores; anything else is a single zlib stream and is inflated on the calling thread
+        unsigned threads { 0 };
+    };
+
+    // everything below throws imbin::Error, and works on v1 as well as v2 files already in memory
+
+    IMBIN_EXPORT Info readInfo(const unsigned char *data, std::size_t size);
+
+    // decodes the whole image into the caller's buffer, which has to hold at least Info::pixelsSize bytes
+    IMBIN_EXPORT void decodeInto(const unsigned char *data, std::size_t size, unsigned char *pixels, std::size_t pixelsSize,
+                                 const DecodeOptions &options = {});
+
+    IMBIN_EXPORT Image decode(const unsigned char *data, std::size_t size, const DecodeOptions &options = {});
+
+    // decodes just the given rectangle; for tiled files only the tiles overlapping it are inflated,
+    // for files with independent blocks only the blocks holding its rows, anything else is decoded whole and cropped
+    IMBIN_EXPORT Image decodeRegion(const unsigned char *data, std::size_t size,
+                                    std::uint32_t x, std::uint32_t y, std::uint32_t width, std::uint32_t height,
+                                    const DecodeOptions &options = {});
+
+    // the mip levels below the image in files converted with them (see the MIPS chunk), 0 if there aren't any
+    IMBIN_EXPORT std::uint32_t mipLevelCount(const unsigned char *data, std::size_t size);
+
+    // level 1 (half the size) to mipLevelCount(), level 0 is the image itself; only the level is inflated
+    IMBIN_EXPORT Image decodeMipLevel(const unsigned char *data, std::size_t size, std::uint32_t level,
+                                      const DecodeOptions &options = {});
+
+    IMBIN_EXPORT Image readFile(const std::filesystem::path &path, const DecodeOptions &options = {});
+}
+
+#endif // IMBIN_READER_H
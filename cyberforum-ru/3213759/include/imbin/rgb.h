@@ -0,0 +1,23 @@
+#ifndef IMBIN_RGB_H
+#define IMBIN_RGB_H
+
+#include <cstddef>
+
+#include <imbin/export.h>
+#include <imbin/simd.h>
+
+// conversions between RGBA8 pixels and the RGB ones of opaque images (flagOpaque) and the fill of single-colour
+// ones (flagConstant), see format.h; simd is clamped to what the CPU supports
+namespace imbin
+{
+    // RGBARGBA... -> RGBRGB..., the alpha is dropped; rgb can be rgba itself, to pack in place
+    IMBIN_EXPORT void packRgb(const unsigned char *rgba, std::size_t pixels, unsigned char *rgb, Simd simd = bestSimd());
+
+    // RGBRGB... -> RGBARGBA... with the alpha 255; rgb can also be the last pixels * 3 bytes of rgba, to expand in place
+    IMBIN_EXPORT void expandRgb(const unsigned char *rgb, std::size_t pixels, unsigned char *rgba, Simd simd = bestSimd());
+
+    // the 4 bytes of pixel that many times
+    IMBIN_EXPORT void fillPixels(const unsigned char *pixel, std::size_t pixels, unsigned char *rgba, Simd simd = bestSimd());
+}
+
+#endif // IMBIN_RGB_H
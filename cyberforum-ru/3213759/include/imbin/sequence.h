@@ -0,0 +1,58 @@
+#ifndef IMBIN_SEQUENCE_H
+#define IMBIN_SEQUENCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <imbin/export.h>
+#include <imbin/format.h>
+#include <imbin/reader.h>
+#include <imbin/simd.h>
+
+namespace imbin
+{
+    // target = a ^ b byte by byte, target can be a or b; simd is clamped to what the CPU supports
+    IMBIN_EXPORT void xorBytes(const unsigned char *a, const unsigned char *b, unsigned char *target, std::size_t size,
+                               Simd simd = bestSimd());
+
+    // true if the header says it's a ZlibSequence file, which decode() and the rest of reader.h refuse
+    IMBIN_EXPORT bool isSequence(const unsigned char *data, std::size_t size);
+
+    // plays back a ZlibSequence file (see format.h) kept in memory: going to a frame decodes the nearest keyframe
+    // at or before it and applies the deltas up to it, unless the current frame is already on the way there,
+    // so going forward one frame is inflating and XORing just the tiles that changed; throws imbin::Error
+    class IMBIN_EXPORT SequenceReader
+    {
+    public:
+        explicit SequenceReader(std::vector<unsigned char> file);
+        static SequenceReader open(const std::filesystem::path &path);
+
+        std::uint32_t width() const { return m_header.width; }
+        std::uint32_t height() const { return m_header.height; }
+        std::uint32_t frameCount() const { return static_cast<std::uint32_t>(m_index.frames.size()); }
+        const FrameIndex& index() const { return m_index; }
+        // of the frame frame() and next() returned last, -1 before the first one
+        std::int64_t position() const { return m_position; }
+
+        // the pixels stay valid until the next call
+        const Image& frame(std::uint32_t index);
+        // the one after the current frame, the first one at the start
+        const Image& next();
+
+    private:
+        void decodeKeyframe(std::uint32_t index);
+        void applyDelta(std::uint32_t index);
+
+        std::vector<unsigned char> m_file;
+        Header m_header;
+        FrameIndex m_index;
+        Image m_frame;
+        // the inflated XOR rows of a delta
+        std::vector<unsigned char> m_delta;
+        std::int64_t m_position { -1 };
+    };
+}
+
+#endif // IMBIN_SEQUENCE_H
@@ -0,0 +1,23 @@
+#ifndef IMBIN_SIMD_H
+#define IMBIN_SIMD_H
+
+#include <imbin/export.h>
+
+namespace imbin
+{
+    // instruction sets the pixel kernels come in, every kernel has a scalar version that works anywhere
+    enum class Simd
+    {
+        Scalar,
+        Ssse3,
+        Avx2
+    };
+
+    // the best one the CPU supports (detected once)
+    IMBIN_EXPORT Simd bestSimd();
+    IMBIN_EXPORT bool simdSupported(Simd simd);
+    // "scalar", "ssse3", "avx2"
+    IMBIN_EXPORT const char* simdName(Simd simd);
+}
+
+#endif // IMBIN_SIMD_H
@@ -0,0 +1,479 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "batch.h"
+#include "png_decoder.h"
+#include "stats_report.h"
+#include "thread_pool.h"
+
+namespace
+{
+    bool isPng(const std::filesystem::path &path)
+    {
+        std::string extension { path.extension().string() };
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension == ".png";
+    }
+
+    std::filesystem::path outputFor(const std::filesystem::path &input,
+                                    const std::filesystem::path &relative,
+                                    const Options &options)
+    {
+        std::filesystem::path output { options.outputDirectory.empty()
+            ? input
+            : options.outputDirectory / relative };
+        return output.replace_extension(".im.bin");
+    }
+
+    // two inputs going to one output would have one of them lost (and written by two workers at once), e.g. a/x.png
+    // and b/x.png under the same -o, x.png next to x.PNG, or an input given twice
+    void checkDistinctOutputs(const std::vector<ConversionJob> &jobs)
+    {
+        std::unordered_map<std::string, const ConversionJob*> seen;
+        seen.reserve(jobs.size());
+        for (const auto &job : jobs)
+        {
+            const std::string output { std::filesystem::weakly_canonical(job.output).lexically_normal().string() };
+            const auto [it, inserted] = seen.emplace(output, &job);
+            if (!inserted)
+            {
+                throw std::runtime_error(it->second->input.string() + " and " + job.input.string()
+                                         + " would both be converted to " + job.output.string());
+            }
+        }
+    }
+
+    // pixels to convert, going by the PNG header, 0 if it can't be read (it will fail quickly)
+    std::uint64_t estimateCost(const std::filesystem::path &input)
+    {
+        std::uint32_t width { 0 };
+        std::uint32_t height { 0 };
+        return peekPngSize(input, width, height) ? static_cast<std::uint64_t>(width) * height : 0;
+    }
+
+    void printSummary(std::size_t converted, std::size_t unchanged, std::size_t failed, std::size_t total,
+                      std::uint64_t inputBytes, std::uint64_t rawBytes, std::uint64_t outputBytes, double seconds,
+                      std::ostream &report)
+    {
+        const double megabyte { 1000.0 * 1000.0 };
+        report << "converted " << converted << " of " << total << " images";
+        if (unchanged > 0)
+        {
+            report << " (" << unchanged << " unchanged)";
+        }
+        if (failed > 0)
+        {
+            report << " (" << failed << " failed)";
+        }
+        report << " in " << std::fixed << std::setprecision(3) << seconds << " s" << std::endl;
+        if (seconds > 0)
+        {
+            report << std::setprecision(1)
+                   << converted / seconds << " images/s, "
+                   << inputBytes / megabyte / seconds << " MB/s of PNG, "
+                   << rawBytes / megabyte / seconds << " MB/s of pixels, "
+                   << outputBytes / megabyte << " MB written" << std::endl;
+        }
+    }
+}
+
+ConversionSettings makeSettings(const Options &options, std::size_t jobCount)
+{
+    ConversionSettings settings;
+    settings.deflate = options.deflate;
+    const unsigned workers { options.jobs > 0 ? options.jobs : defaultThreadCount() };
+    if (options.deflateThreads > 0)
+    {
+        settings.deflate.threads = options.deflateThreads;
+    }
+    else
+    {
+        // with fewer images than workers the spare cores go to splitting the images themselves
+        const std::size_t images { std::max<std::size_t>(jobCount, 1) };
+        settings.deflate.threads = images >= workers ? 1 : workers / static_cast<unsigned>(images);
+    }
+    settings.deflate.blockSize = options.blockSize;
+    settings.input = options.input;
+    settings.streaming = options.streaming;
+    settings.layout = options.layout;
+    settings.filterRows = options.filterRows;
+    settings.region = options.region;
+    settings.mips = options.mips;
+    settings.format = options.format;
+    settings.blockQuality = options.blockQuality;
+    settings.storeBlocks = options.storeBlocks;
+    settings.keepRgba = options.keepRgba;
+    settings.verify = options.verify;
+    settings.tileWidth = options.tileWidth;
+    settings.tileHeight = options.tileHeight;
+    settings.recordStages = options.stats != StatsFormat::None || options.trace;
+    settings.keepSpans = options.trace;
+    return settings;
+}
+
+std::uint64_t settingsHash(const Options &options)
+{
+    // the deflate threads only when they are asked for, otherwise the number of images in a run would count
+    std::ostringstream text;
+    text << imbin::currentVersion << ' ' << describe(options.deflate) << ' ' << options.deflate.automatic
+         << ' ' << options.deflate.independentBlocks << ' ' << options.blockSize << ' ' << options.deflateThreads
+         << ' ' << options.streaming << ' ' << static_cast<int>(options.layout) << ' ' << options.filterRows
+         << ' ' << options.tileWidth << 'x' << options.tileHeight
+         << ' ' << options.region.x << ',' << options.region.y << ',' << options.region.width << ',' << options.region.height
+         << ' ' << static_cast<int>(options.mips) << ' ' << static_cast<int>(options.format)
+         << ' ' << static_cast<int>(options.blockQuality) << ' ' << options.storeBlocks << ' ' << options.keepRgba;
+    return hashString(text.str());
+}
+
+std::vector<ConversionJob> collectJobs(const Options &options)
+{
+    std::vector<ConversionJob> jobs;
+    for (const auto &input : options.inputs)
+    {
+        if (std::filesystem::is_directory(input))
+        {
+            std::vector<ConversionJob> found;
+            for (const auto &entry : std::filesystem::recursive_directory_iterator(input))
+            {
+                if (entry.is_regular_file() && isPng(entry.path()))
+                {
+                    found.push_back({
+                        entry.path(),
+                        outputFor(entry.path(), entry.path().lexically_relative(input), options)
+                    });
+                }
+            }
+            // directory iteration order is unspecified, keep runs reproducible
+            std::sort(found.begin(), found.end(),
+                      [](const ConversionJob &a, const ConversionJob &b) { return a.input < b.input; });
+            jobs.insert(jobs.end(), found.begin(), found.end());
+        }
+        else if (std::filesystem::exists(input))
+        {
+            jobs.push_back({ input, outputFor(input, input.filename(), options) });
+        }
+        else
+        {
+            throw std::runtime_error("input doesn't exist: " + input.string());
+        }
+    }
+    // the frames of a sequence all go into the one file, and can repeat
+    if (options.sequenceOutput.empty())
+    {
+        checkDistinctOutputs(jobs);
+    }
+    return jobs;
+}
+
+void reportStats(const std::vector<ConversionJob> &jobs, const std::vector<ConversionResult> &results,
+                 double wallSeconds, const Options &options, const PipelineStats *pipeline)
+{
+    // stdout is taken by the converted images when reading from a pipe
+    std::ostream &out { options.inputFd >= 0 ? std::cerr : std::cout };
+    if (options.stats == StatsFormat::Text)
+    {
+        printStats(jobs, results, wallSeconds, options.verbose, out);
+        if (pipeline)
+        {
+            printPipelineStats(*pipeline, out);
+        }
+    }
+    else if (options.stats == StatsFormat::Json)
+    {
+        writeStatsJson(jobs, results, wallSeconds, out, pipeline);
+    }
+    if (options.trace)
+    {
+        std::ofstream out { options.traceFile };
+        writeChromeTrace(jobs, results, out);
+        out.close();
+        if (!out)
+        {
+            std::cerr << "couldn't write " << options.traceFile.string() << std::endl;
+        }
+    }
+}
+
+std::size_t runBatch(const std::vector<ConversionJob> &jobs, const Options &options, Manifest *manifest)
+{
+    std::atomic<std::size_t> converted { 0 };
+    std::atomic<std::size_t> unchanged { 0 };
+    std::atomic<std::size_t> failed { 0 };
+    std::atomic<std::uint64_t> inputBytes { 0 };
+    std::atomic<std::uint64_t> rawBytes { 0 };
+    std::atomic<std::uint64_t> outputBytes { 0 };
+    std::mutex reportMutex;
+    // JSON stats take stdout for themselves
+    std::ostream &report { options.stats == StatsFormat::Json ? std::cerr : std::cout };
+
+    const ConversionSettings settings { makeSettings(options, jobs.size()) };
+    // every job fills in its own slot, only kept for the stats
+    std::vector<ConversionResult> results(settings.recordStages ? jobs.size() : 0);
+    // the skipped ones aren't in the stats
+    std::vector<char> skipped(settings.recordStages ? jobs.size() : 0);
+    // what the inputs were like before they were converted, to be recorded once they are
+    std::vector<ManifestEntry> entries(manifest ? jobs.size() : 0);
+    const std::uint64_t optionsHash { settingsHash(options) };
+
+    // false if the job can be skipped
+    auto start = [&](std::size_t i)
+    {
+        const ConversionJob &job { jobs[i] };
+        if (manifest && !manifest->needsConversion(job.input, job.output, optionsHash, entries[i]))
+        {
+            unchanged++;
+            if (settings.recordStages)
+            {
+                skipped[i] = 1;
+            }
+            return false;
+        }
+        return true;
+    };
+    auto finished = [&](std::size_t i, ConversionResult &result)
+    {
+        const ConversionJob &job { jobs[i] };
+        if (result.ok)
+        {
+            if (manifest)
+            {
+                manifest->record(job.input, std::move(entries[i]));
+            }
+            converted++;
+            inputBytes += result.inputBytes;
+            rawBytes += result.rawBytes;
+            outputBytes += result.outputBytes;
+            if (options.verbose)
+            {
+                std::lock_guard<std::mutex> lock { reportMutex };
+                report << job.input.string() << ": " << result.width << "x" << result.height
+                       << " -> " << job.output.string() << " (" << describe(result.deflate) << ")" << std::endl;
+            }
+        }
+        else
+        {
+            failed++;
+            std::lock_guard<std::mutex> lock { reportMutex };
+            std::cerr << job.input.string() << ": " << result.error << std::endl;
+        }
+        if (settings.recordStages)
+        {
+            results[i] = std::move(result);
+        }
+    };
+
+    PipelineStats pipelineStats;
+    const auto started { std::chrono::steady_clock::now() };
+    const unsigned workers { options.jobs > 0 ? options.jobs : defaultThreadCount() };
+    const bool largestFirst { options.schedule == Schedule::LargestFirst };
+    // the manifest is checked and the headers read on all the workers before the first conversion
+    std::vector<std::uint64_t> costs(largestFirst ? jobs.size() : 0);
+    std::vector<char> needed(jobs.size(), 1);
+    if (manifest || largestFirst)
+    {
+        parallelFor(jobs.size(), workers, [&](std::size_t i)
+        {
+            needed[i] = start(i);
+            if (needed[i] && largestFirst)
+            {
+                costs[i] = estimateCost(jobs[i].input);
+            }
+        });
+    }
+    std::vector<std::size_t> order;
+    std::uint64_t totalCost { 0 };
+    for (std::size_t i = 0; i < jobs.size(); i++)
+    {
+        if (needed[i])
+        {
+            order.push_back(i);
+            totalCost += largestFirst ? costs[i] : 0;
+        }
+    }
+    if (largestFirst)
+    {
+        std::stable_sort(order.begin(), order.end(), [&costs](std::size_t a, std::size_t b) { return costs[a] > costs[b]; });
+    }
+
+    if (options.pipelined)
+    {
+        const PipelineJobs pipelineJobs {
+            order.size(),
+            [&](std::size_t k, std::filesystem::path &input, std::filesystem::path &output)
+            {
+                input = jobs[order[k]].input;
+                output = jobs[order[k]].output;
+                return true;
+            },
+            [&](std::size_t k, ConversionResult &result) { finished(order[k], result); }
+        };
+        pipelineStats = runPipeline(pipelineJobs, settings, options.pipeline);
+    }
+    else
+    {
+        JobScheduler scheduler { order, costs, workers };
+        scheduler.run([&](std::size_t i)
+        {
+            const ConversionJob &job { jobs[i] };
+            std::error_code ec;
+            if (job.output.has_parent_path())
+            {
+                std::filesystem::create_directories(job.output.parent_path(), ec);
+            }
+
+            ConversionSettings jobSettings { settings };
+            if (options.deflateThreads == 0 && totalCost > 0)
+            {
+                // an image with more than its share of the batch would keep going after the rest is done,
+                // so it gets the cores of as many shares as it has
+                const std::uint64_t shares { (costs[i] * workers + totalCost - 1) / totalCost };
+                jobSettings.deflate.threads = static_cast<unsigned>(std::clamp<std::uint64_t>(shares, 1, workers));
+            }
+            ConversionResult result { convertFile(job.input, job.output, jobSettings) };
+            finished(i, result);
+        });
+    }
+    const double seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count() };
+
+    printSummary(converted, unchanged, failed, jobs.size(), inputBytes, rawBytes, outputBytes, seconds, report);
+    if (manifest)
+    {
+        try
+        {
+            manifest->save();
+        }
+        catch (const std::exception &ex)
+        {
+            std::cerr << ex.what() << std::endl;
+        }
+    }
+    if (settings.recordStages)
+    {
+        const PipelineStats *pipeline { options.pipelined ? &pipelineStats : nullptr };
+        if (unchanged > 0)
+        {
+            std::vector<ConversionJob> convertedJobs;
+            std::vector<ConversionResult> convertedResults;
+            for (std::size_t i = 0; i < jobs.size(); i++)
+            {
+                if (!skipped[i])
+                {
+                    convertedJobs.push_back(jobs[i]);
+                    convertedResults.push_back(std::move(results[i]));
+                }
+            }
+            reportStats(convertedJobs, convertedResults, seconds, options, pipeline);
+        }
+        else
+        {
+            reportStats(jobs, results, seconds, options, pipeline);
+        }
+    }
+    return failed;
+}
+
+std::size_t runStream(const Options &options)
+{
+#ifdef _WIN32
+    // no newline translation in the middle of the images
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    // one image at a time, so it gets every deflate thread asked for (the streaming mode only uses one anyway)
+    const ConversionSettings settings { makeSettings(options, 1) };
+    std::vector<ConversionJob> jobs;
+    std::vector<ConversionResult> results;
+    std::size_t converted { 0 };
+    std::size_t failed { 0 };
+    std::uint64_t inputBytes { 0 };
+    std::uint64_t rawBytes { 0 };
+    std::uint64_t outputBytes { 0 };
+
+    const auto started { std::chrono::steady_clock::now() };
+    const std::size_t count { convertStream(options.inputFd, std::cout, settings, [&](const ConversionResult &result)
+    {
+        // images in a pipe have no names, they are numbered instead
+        const std::string name { "-#" + std::to_string(converted + failed + 1) };
+        if (settings.recordStages)
+        {
+            jobs.push_back({ name, "-" });
+            results.push_back(result);
+        }
+        if (result.ok)
+        {
+            converted++;
+            inputBytes += result.inputBytes;
+            rawBytes += result.rawBytes;
+            outputBytes += result.outputBytes;
+            if (options.verbose)
+            {
+                std::cerr << name << ": " << result.width << "x" << result.height
+                          << " (" << describe(result.deflate) << ")" << std::endl;
+            }
+        }
+        else
+        {
+            failed++;
+            std::cerr << name << ": " << result.error << std::endl;
+        }
+    }) };
+    const double seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count() };
+
+    printSummary(converted, 0, failed, count, inputBytes, rawBytes, outputBytes, seconds, std::cerr);
+    if (settings.recordStages)
+    {
+        reportStats(jobs, results, seconds, options);
+    }
+    return failed;
+}
+
+std::size_t runSequence(const std::vector<ConversionJob> &jobs, const Options &options)
+{
+    std::vector<std::filesystem::path> frames;
+    for (const ConversionJob &job : jobs)
+    {
+        frames.push_back(job.input);
+    }
+    // one file, so every thread asked for goes to its frames
+    const ConversionSettings settings { makeSettings(options, 1) };
+
+    const auto started { std::chrono::steady_clock::now() };
+    const SequenceResult sequence { convertSequence(frames, options.sequenceOutput, settings, options.sequence) };
+    const double seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count() };
+
+    const ConversionResult &result { sequence.total };
+    if (!result.ok)
+    {
+        std::cerr << options.sequenceOutput.string() << ": " << result.error << std::endl;
+        return 1;
+    }
+    printSummary(sequence.frames, 0, 0, frames.size(), result.inputBytes, result.rawBytes, result.outputBytes, seconds, std::cout);
+    std::cout << options.sequenceOutput.string() << ": " << sequence.frames << " frames of " << result.width << "x" << result.height
+              << ", " << sequence.keyframes << " keyframes";
+    if (sequence.tiles > 0)
+    {
+        std::cout << ", the deltas changed " << std::fixed << std::setprecision(1)
+                  << 100.0 * static_cast<double>(sequence.changedTiles) / static_cast<double>(sequence.tiles) << "% of the tiles";
+    }
+    std::cout << std::endl;
+    if (options.verbose)
+    {
+        std::cout << "(" << describe(result.deflate) << ")" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <filesystem>
+#include <vector>
+
+#include "converter.h"
+#include "manifest.h"
+#include "options.h"
+
+struct ConversionJob
+{
+    std::filesystem::path input;
+    std::filesystem::path output;
+};
+
+// expands directories into the PNGs they contain and decides where each result goes,
+// throws std::runtime_error if an input doesn't exist or two inputs would go to the same output
+std::vector<ConversionJob> collectJobs(const Options &options);
+
+// turns command line options into per-image settings, some defaults depend on the size of the batch
+ConversionSettings makeSettings(const Options &options, std::size_t jobCount);
+
+// --stats and --trace of the options for the results of the jobs (one per job, in the same order),
+// with the occupancy of the stages if they were pipelined
+void reportStats(const std::vector<ConversionJob> &jobs, const std::vector<ConversionResult> &results,
+                 double wallSeconds, const Options &options, const PipelineStats *pipeline = nullptr);
+
+// hash of the options that make a difference to the output files, for the manifest
+std::uint64_t settingsHash(const Options &options);
+
+// converts everything on a pool of workers and prints the aggregate throughput (and the stats if asked to),
+// returns the number of images that failed; with a manifest the unchanged inputs are skipped, and the converted
+// ones recorded in it (it's saved at the end)
+std::size_t runBatch(const std::vector<ConversionJob> &jobs, const Options &options, Manifest *manifest = nullptr);
+
+// converts the PNGs coming from options.inputFd into im.bin files on stdout, one after another, with the same
+// summary as runBatch() on stderr; returns the number of images that failed (at most 1, nothing is read after it)
+std::size_t runStream(const Options &options);
+
+// converts the inputs of the jobs into the frames of options.sequenceOutput and prints the summary with the number
+// of keyframes and the share of tiles the deltas had; returns 1 if that failed (on any of the frames), 0 otherwise
+std::size_t runSequence(const std::vector<ConversionJob> &jobs, const Options &options);
+
+#endif // BATCH_H
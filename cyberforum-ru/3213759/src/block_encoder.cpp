@@ -0,0 +1,751 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "block_encoder.h"
+#include "imbin/cpu.h"
+#include "thread_pool.h"
+
+namespace
+{
+    // interpolation weights of the 4-bit BC7 indices, out of 64
+    const unsigned bc7Weights[16] { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    // a block as floats, channel by channel, so that the SIMD search takes four pixels per register
+    struct alignas(16) Block
+    {
+        float c[4][16];
+    };
+
+    // what the decoder makes of the endpoints, in the same form
+    struct alignas(16) Palette
+    {
+        float c[4][16];
+        unsigned count { 0 };
+    };
+
+    struct Endpoints
+    {
+        float e[2][4] {};
+    };
+
+    const std::uint32_t allPixels { 0xffff };
+
+    // the block at (bx, by), the ones on the edges padded with copies of the last column and row
+    void loadBlock(const Image &image, std::uint32_t bx, std::uint32_t by, Block &block)
+    {
+        for (std::uint32_t y = 0; y < 4; y++)
+        {
+            const unsigned char *row { image.pixels.data() + std::min(by * 4 + y, image.height - 1) * image.rowBytes };
+            for (std::uint32_t x = 0; x < 4; x++)
+            {
+                const unsigned char *pixel { row + static_cast<std::size_t>(std::min(bx * 4 + x, image.width - 1)) * 4 };
+                for (int c = 0; c < 4; c++)
+                {
+                    block.c[c][y * 4 + x] = pixel[c];
+                }
+            }
+        }
+    }
+
+    // the nearest entry of the palette for every pixel over the first channels channels, returns the total squared error
+    float selectScalar(const Block &block, const Palette &palette, unsigned channels, unsigned char *indices)
+    {
+        float total { 0 };
+        for (unsigned i = 0; i < 16; i++)
+        {
+            float best { std::numeric_limits<float>::max() };
+            for (unsigned k = 0; k < palette.count; k++)
+            {
+                float d { 0 };
+                for (unsigned c = 0; c < channels; c++)
+                {
+                    const float e { block.c[c][i] - palette.c[c][k] };
+                    d += e * e;
+                }
+                if (d < best)
+                {
+                    best = d;
+                    indices[i] = static_cast<unsigned char>(k);
+                }
+            }
+            total += best;
+        }
+        return total;
+    }
+
+#ifdef IMBIN_X86
+    // the same, four pixels at a time
+    IMBIN_TARGET("sse2")
+    float selectSse2(const Block &block, const Palette &palette, unsigned channels, unsigned char *indices)
+    {
+        __m128 total { _mm_setzero_ps() };
+        for (unsigned i = 0; i < 16; i += 4)
+        {
+            __m128 pixels[4];
+            for (unsigned c = 0; c < channels; c++)
+            {
+                pixels[c] = _mm_load_ps(block.c[c] + i);
+            }
+            __m128 best { _mm_set1_ps(std::numeric_limits<float>::max()) };
+            __m128i bestIndex { _mm_setzero_si128() };
+            for (unsigned k = 0; k < palette.count; k++)
+            {
+                __m128 d { _mm_setzero_ps() };
+                for (unsigned c = 0; c < channels; c++)
+                {
+                    const __m128 e { _mm_sub_ps(pixels[c], _mm_set1_ps(palette.c[c][k])) };
+                    d = _mm_add_ps(d, _mm_mul_ps(e, e));
+                }
+                const __m128i closer { _mm_castps_si128(_mm_cmplt_ps(d, best)) };
+                best = _mm_min_ps(d, best);
+                bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(static_cast<int>(k))), _mm_andnot_si128(closer, bestIndex));
+            }
+            alignas(16) std::int32_t found[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(found), bestIndex);
+            for (unsigned j = 0; j < 4; j++)
+            {
+                indices[i + j] = static_cast<unsigned char>(found[j]);
+            }
+            total = _mm_add_ps(total, best);
+        }
+        alignas(16) float sums[4];
+        _mm_store_ps(sums, total);
+        return sums[0] + sums[1] + sums[2] + sums[3];
+    }
+#endif
+
+    float selectIndices(const Block &block, const Palette &palette, unsigned channels, unsigned char *indices, bool vector)
+    {
+#ifdef IMBIN_X86
+        if (vector)
+        {
+            return selectSse2(block, palette, channels, indices);
+        }
+#else
+        (void)vector;
+#endif
+        return selectScalar(block, palette, channels, indices);
+    }
+
+    float clampChannel(float v)
+    {
+        return std::clamp(v, 0.0f, 255.0f);
+    }
+
+    // the bounding box of the pixels in the mask, with the diagonal turned to go the way the channels go together:
+    // the channel with the widest range leads and the ones that fall as it rises swap their ends
+    Endpoints boundingBox(const Block &block, std::uint32_t mask, unsigned channels)
+    {
+        float mean[4] {};
+        float lo[4];
+        float hi[4];
+        std::fill(std::begin(lo), std::end(lo), 255.0f);
+        std::fill(std::begin(hi), std::end(hi), 0.0f);
+        unsigned count { 0 };
+        for (unsigned i = 0; i < 16; i++)
+        {
+            if (mask >> i & 1)
+            {
+                for (unsigned c = 0; c < channels; c++)
+                {
+                    mean[c] += block.c[c][i];
+                    lo[c] = std::min(lo[c], block.c[c][i]);
+                    hi[c] = std::max(hi[c], block.c[c][i]);
+                }
+                count++;
+            }
+        }
+        unsigned lead { 0 };
+        for (unsigned c = 0; c < channels; c++)
+        {
+            mean[c] /= static_cast<float>(count);
+            if (hi[c] - lo[c] > hi[lead] - lo[lead])
+            {
+                lead = c;
+            }
+        }
+        Endpoints ends;
+        for (unsigned c = 0; c < channels; c++)
+        {
+            float covariance { 0 };
+            for (unsigned i = 0; i < 16; i++)
+            {
+                if (mask >> i & 1)
+                {
+                    covariance += (block.c[lead][i] - mean[lead]) * (block.c[c][i] - mean[c]);
+                }
+            }
+            ends.e[0][c] = covariance < 0 ? hi[c] : lo[c];
+            ends.e[1][c] = covariance < 0 ? lo[c] : hi[c];
+        }
+        return ends;
+    }
+
+    // the pixels in the mask projected onto their principal axis (a few rounds of power iteration on the covariance,
+    // starting from the bounding box diagonal), the ends are where the outermost pixels land
+    Endpoints principalAxis(const Block &block, std::uint32_t mask, unsigned channels)
+    {
+        const Endpoints box { boundingBox(block, mask, channels) };
+        float mean[4] {};
+        unsigned count { 0 };
+        for (unsigned i = 0; i < 16; i++)
+        {
+            if (mask >> i & 1)
+            {
+                for (unsigned c = 0; c < channels; c++)
+                {
+                    mean[c] += block.c[c][i];
+                }
+                count++;
+            }
+        }
+        for (unsigned c = 0; c < channels; c++)
+        {
+            mean[c] /= static_cast<float>(count);
+        }
+        float covariance[4][4] {};
+        for (unsigned i = 0; i < 16; i++)
+        {
+            if (mask >> i & 1)
+            {
+                for (unsigned a = 0; a < channels; a++)
+                {
+                    for (unsigned b = 0; b < channels; b++)
+                    {
+                        covariance[a][b] += (block.c[a][i] - mean[a]) * (block.c[b][i] - mean[b]);
+                    }
+                }
+            }
+        }
+
+        float axis[4] {};
+        float length { 0 };
+        for (unsigned c = 0; c < channels; c++)
+        {
+            axis[c] = box.e[1][c] - box.e[0][c];
+            length = std::max(length, std::abs(axis[c]));
+        }
+        if (length == 0)
+        {
+            // a single colour
+            return box;
+        }
+        for (int round = 0; round < 8; round++)
+        {
+            float next[4] {};
+            float largest { 0 };
+            for (unsigned a = 0; a < channels; a++)
+            {
+                for (unsigned b = 0; b < channels; b++)
+                {
+                    next[a] += covariance[a][b] * axis[b];
+                }
+                largest = std::max(largest, std::abs(next[a]));
+            }
+            if (largest == 0)
+            {
+                break;
+            }
+            for (unsigned c = 0; c < channels; c++)
+            {
+                axis[c] = next[c] / largest;
+            }
+        }
+
+        float norm { 0 };
+        for (unsigned c = 0; c < channels; c++)
+        {
+            norm += axis[c] * axis[c];
+        }
+        float tMin { std::numeric_limits<float>::max() };
+        float tMax { std::numeric_limits<float>::lowest() };
+        for (unsigned i = 0; i < 16; i++)
+        {
+            if (mask >> i & 1)
+            {
+                float t { 0 };
+                for (unsigned c = 0; c < channels; c++)
+                {
+                    t += (block.c[c][i] - mean[c]) * axis[c];
+                }
+                tMin = std::min(tMin, t / norm);
+                tMax = std::max(tMax, t / norm);
+            }
+        }
+        Endpoints ends;
+        for (unsigned c = 0; c < channels; c++)
+        {
+            ends.e[0][c] = clampChannel(mean[c] + tMin * axis[c]);
+            ends.e[1][c] = clampChannel(mean[c] + tMax * axis[c]);
+        }
+        return ends;
+    }
+
+    // the endpoints that come closest to the pixels in the mask with the weights they have (0 is all the first
+    // endpoint, 1 all the second), least squares; false if the weights are all the same, which doesn't pin them down
+    bool fitEndpoints(const Block &block, std::uint32_t mask, unsigned channels, const float *weights, Endpoints &ends)
+    {
+        float aa { 0 };
+        float bb { 0 };
+        float ab { 0 };
+        float ap[4] {};
+        float bp[4] {};
+        for (unsigned i = 0; i < 16; i++)
+        {
+            if (mask >> i & 1)
+            {
+                const float w { weights[i] };
+                aa += (1 - w) * (1 - w);
+                bb += w * w;
+                ab += (1 - w) * w;
+                for (unsigned c = 0; c < channels; c++)
+                {
+                    ap[c] += (1 - w) * block.c[c][i];
+                    bp[c] += w * block.c[c][i];
+                }
+            }
+        }
+        const float determinant { aa * bb - ab * ab };
+        if (std::abs(determinant) < 1e-4f)
+        {
+            return false;
+        }
+        for (unsigned c = 0; c < channels; c++)
+        {
+            ends.e[0][c] = clampChannel((bb * ap[c] - ab * bp[c]) / determinant);
+            ends.e[1][c] = clampChannel((aa * bp[c] - ab * ap[c]) / determinant);
+        }
+        return true;
+    }
+
+    Endpoints findEndpoints(const Block &block, std::uint32_t mask, unsigned channels, BlockQuality quality)
+    {
+        return quality == BlockQuality::Fast ? boundingBox(block, mask, channels) : principalAxis(block, mask, channels);
+    }
+
+    void putU16(unsigned char *out, unsigned v)
+    {
+        out[0] = static_cast<unsigned char>(v);
+        out[1] = static_cast<unsigned char>(v >> 8);
+    }
+
+    // --- BC1 colours, also the colour half of BC3 ---
+
+    struct ColorBlock
+    {
+        unsigned c0 { 0 };
+        unsigned c1 { 0 };
+        unsigned char indices[16] {};
+        float error { std::numeric_limits<float>::max() };
+    };
+
+    unsigned to565(const float *rgb)
+    {
+        const auto quantize { [](float v, float levels) { return static_cast<unsigned>(std::lround(clampChannel(v) * levels / 255.0f)); } };
+        return quantize(rgb[0], 31) << 11 | quantize(rgb[1], 63) << 5 | quantize(rgb[2], 31);
+    }
+
+    // the palette decoders build out of the two colours, the same integer arithmetic as decompressBlock()
+    void colorPalette(unsigned c0, unsigned c1, bool fourColors, Palette &palette)
+    {
+        int e[2][3];
+        for (int i = 0; i < 2; i++)
+        {
+            const unsigned color { i == 0 ? c0 : c1 };
+            const unsigned r { color >> 11 & 31 };
+            const unsigned g { color >> 5 & 63 };
+            const unsigned b { color & 31 };
+            e[i][0] = static_cast<int>(r << 3 | r >> 2);
+            e[i][1] = static_cast<int>(g << 2 | g >> 4);
+            e[i][2] = static_cast<int>(b << 3 | b >> 2);
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            palette.c[c][0] = static_cast<float>(e[0][c]);
+            palette.c[c][1] = static_cast<float>(e[1][c]);
+            if (fourColors)
+            {
+                palette.c[c][2] = static_cast<float>((2 * e[0][c] + e[1][c] + 1) / 3);
+                palette.c[c][3] = static_cast<float>((e[0][c] + 2 * e[1][c] + 1) / 3);
+            }
+            else
+            {
+                palette.c[c][2] = static_cast<float>((e[0][c] + e[1][c] + 1) / 2);
+            }
+        }
+        palette.count = fourColors ? 4 : 3;
+    }
+
+    // the endpoints quantized to 565 and put in the order that selects the mode: c0 > c1 for four colours,
+    // c0 <= c1 for three and transparent black (BC1 only, for blocks with transparent pixels; opaque blocks whose
+    // endpoints quantize to the same colour get three colours as well, which is all they need)
+    ColorBlock evaluateColor(const Block &block, std::uint32_t opaque, const Endpoints &ends, bool bc1, bool vector)
+    {
+        ColorBlock result;
+        result.c0 = to565(ends.e[0]);
+        result.c1 = to565(ends.e[1]);
+        const bool transparent { opaque != allPixels };
+        if (transparent ? result.c0 > result.c1 : result.c0 < result.c1)
+        {
+            std::swap(result.c0, result.c1);
+        }
+        const bool fourColors { !bc1 || result.c0 > result.c1 };
+        Palette palette;
+        colorPalette(result.c0, result.c1, fourColors, palette);
+        if (!transparent)
+        {
+            result.error = selectIndices(block, palette, 3, result.indices, vector);
+            return result;
+        }
+        // the transparent pixels take the first endpoint for the search, which costs nothing, and index 3 after it
+        Block opaqueBlock { block };
+        for (unsigned i = 0; i < 16; i++)
+        {
+            if (!(opaque >> i & 1))
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    opaqueBlock.c[c][i] = palette.c[c][0];
+                }
+            }
+        }
+        result.error = selectIndices(opaqueBlock, palette, 3, result.indices, vector);
+        for (unsigned i = 0; i < 16; i++)
+        {
+            if (!(opaque >> i & 1))
+            {
+                result.indices[i] = 3;
+            }
+        }
+        return result;
+    }
+
+    ColorBlock encodeColor(const Block &block, bool bc1, BlockQuality quality, bool vector)
+    {
+        std::uint32_t opaque { allPixels };
+        if (bc1)
+        {
+            for (unsigned i = 0; i < 16; i++)
+            {
+                if (block.c[3][i] < 128)
+                {
+                    opaque &= ~(1u << i);
+                }
+            }
+            if (opaque == 0)
+            {
+                ColorBlock result;
+                std::fill(std::begin(result.indices), std::end(result.indices), 3);
+                result.error = 0;
+                return result;
+            }
+        }
+        ColorBlock best { evaluateColor(block, opaque, findEndpoints(block, opaque, 3, quality), bc1, vector) };
+        if (quality != BlockQuality::Best)
+        {
+            return best;
+        }
+        for (int round = 0; round < 2 && best.error > 0; round++)
+        {
+            const bool fourColors { !bc1 || best.c0 > best.c1 };
+            const float fourWeights[4] { 0, 1, 1.0f / 3, 2.0f / 3 };
+            const float threeWeights[4] { 0, 1, 0.5f, 0 };
+            float weights[16];
+            for (unsigned i = 0; i < 16; i++)
+            {
+                weights[i] = (fourColors ? fourWeights : threeWeights)[best.indices[i]];
+            }
+            Endpoints ends;
+            if (!fitEndpoints(block, opaque, 3, weights, ends))
+            {
+                break;
+            }
+            const ColorBlock refined { evaluateColor(block, opaque, ends, bc1, vector) };
+            if (refined.error >= best.error)
+            {
+                break;
+            }
+            best = refined;
+        }
+        return best;
+    }
+
+    void writeColor(const ColorBlock &color, unsigned char *out)
+    {
+        putU16(out, color.c0);
+        putU16(out + 2, color.c1);
+        std::uint32_t indices { 0 };
+        for (unsigned i = 0; i < 16; i++)
+        {
+            indices |= static_cast<std::uint32_t>(color.indices[i]) << (i * 2);
+        }
+        for (unsigned i = 0; i < 4; i++)
+        {
+            out[4 + i] = static_cast<unsigned char>(indices >> (i * 8));
+        }
+    }
+
+    // --- the alpha half of BC3 ---
+
+    struct AlphaBlock
+    {
+        unsigned a0 { 0 };
+        unsigned a1 { 0 };
+        unsigned char indices[16] {};
+        float error { std::numeric_limits<float>::max() };
+    };
+
+    // alpha goes into the first channel of alphas, so the search looks at just that one
+    AlphaBlock evaluateAlpha(const Block &alphas, unsigned a0, unsigned a1, bool vector)
+    {
+        Palette palette;
+        palette.c[0][0] = static_cast<float>(a0);
+        palette.c[0][1] = static_cast<float>(a1);
+        if (a0 > a1)
+        {
+            for (unsigned k = 1; k <= 6; k++)
+            {
+                palette.c[0][k + 1] = static_cast<float>(((7 - k) * a0 + k * a1 + 3) / 7);
+            }
+        }
+        else
+        {
+            for (unsigned k = 1; k <= 4; k++)
+            {
+                palette.c[0][k + 1] = static_cast<float>(((5 - k) * a0 + k * a1 + 2) / 5);
+            }
+            palette.c[0][6] = 0;
+            palette.c[0][7] = 255;
+        }
+        palette.count = 8;
+        AlphaBlock result;
+        result.a0 = a0;
+        result.a1 = a1;
+        result.error = selectIndices(alphas, palette, 1, result.indices, vector);
+        return result;
+    }
+
+    AlphaBlock encodeAlpha(const Block &block, BlockQuality quality, bool vector)
+    {
+        Block alphas;
+        std::copy(std::begin(block.c[3]), std::end(block.c[3]), std::begin(alphas.c[0]));
+        const auto [lo, hi] { std::minmax_element(std::begin(alphas.c[0]), std::end(alphas.c[0])) };
+        // 8 levels from the top down
+        AlphaBlock best { evaluateAlpha(alphas, static_cast<unsigned>(*hi), static_cast<unsigned>(*lo), vector) };
+        if (quality == BlockQuality::Best && best.error > 0)
+        {
+            // 6 levels between the values that aren't 0 or 255, which come for free
+            unsigned inner[2] { 255, 0 };
+            for (float a : alphas.c[0])
+            {
+                if (a > 0 && a < 255)
+                {
+                    inner[0] = std::min(inner[0], static_cast<unsigned>(a));
+                    inner[1] = std::max(inner[1], static_cast<unsigned>(a));
+                }
+            }
+            const AlphaBlock six { inner[0] <= inner[1] ? evaluateAlpha(alphas, inner[0], inner[1], vector) : evaluateAlpha(alphas, 0, 0, vector) };
+            if (six.error < best.error)
+            {
+                best = six;
+            }
+        }
+        return best;
+    }
+
+    void writeAlpha(const AlphaBlock &alpha, unsigned char *out)
+    {
+        out[0] = static_cast<unsigned char>(alpha.a0);
+        out[1] = static_cast<unsigned char>(alpha.a1);
+        std::uint64_t indices { 0 };
+        for (unsigned i = 0; i < 16; i++)
+        {
+            indices |= static_cast<std::uint64_t>(alpha.indices[i]) << (i * 3);
+        }
+        for (unsigned i = 0; i < 6; i++)
+        {
+            out[2 + i] = static_cast<unsigned char>(indices >> (i * 8));
+        }
+    }
+
+    // --- BC7 mode 6 ---
+
+    struct Mode6Block
+    {
+        // 7 bits per channel and a p-bit per endpoint
+        unsigned e[2][4] {};
+        unsigned p[2] {};
+        unsigned char indices[16] {};
+        float error { std::numeric_limits<float>::max() };
+    };
+
+    // the endpoints with the given p-bits, and the indices that go best with them
+    Mode6Block quantizeMode6(const Block &block, const Endpoints &ends, const unsigned *p, bool vector)
+    {
+        Mode6Block result;
+        unsigned values[2][4];
+        for (int e = 0; e < 2; e++)
+        {
+            result.p[e] = p[e];
+            for (int c = 0; c < 4; c++)
+            {
+                const float v { clampChannel(ends.e[e][c]) };
+                result.e[e][c] = static_cast<unsigned>(std::clamp(std::lround((v - static_cast<float>(p[e])) / 2), 0l, 127l));
+                values[e][c] = result.e[e][c] << 1 | p[e];
+            }
+        }
+        Palette palette;
+        for (unsigned k = 0; k < 16; k++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                palette.c[c][k] = static_cast<float>(((64 - bc7Weights[k]) * values[0][c] + bc7Weights[k] * values[1][c] + 32) >> 6);
+            }
+        }
+        palette.count = 16;
+        result.error = selectIndices(block, palette, 4, result.indices, vector);
+        return result;
+    }
+
+    // opaque blocks need both p-bits set to stay opaque (alpha 255 is odd), whatever that costs the colours;
+    // otherwise fast gives every endpoint the p-bit its own channels come closest with, and the others try all four
+    // pairs on the whole block
+    Mode6Block evaluateMode6(const Block &block, const Endpoints &ends, BlockQuality quality, bool vector)
+    {
+        if (std::all_of(std::begin(block.c[3]), std::end(block.c[3]), [](float a) { return a == 255; }))
+        {
+            const unsigned p[2] { 1, 1 };
+            return quantizeMode6(block, ends, p, vector);
+        }
+        if (quality != BlockQuality::Fast)
+        {
+            Mode6Block best;
+            for (unsigned pair = 0; pair < 4; pair++)
+            {
+                const unsigned p[2] { pair & 1, pair >> 1 };
+                const Mode6Block candidate { quantizeMode6(block, ends, p, vector) };
+                if (candidate.error < best.error)
+                {
+                    best = candidate;
+                }
+            }
+            return best;
+        }
+        unsigned p[2] {};
+        for (int e = 0; e < 2; e++)
+        {
+            float errors[2] {};
+            for (unsigned bit = 0; bit < 2; bit++)
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    const float v { clampChannel(ends.e[e][c]) };
+                    const long q { std::clamp(std::lround((v - static_cast<float>(bit)) / 2), 0l, 127l) };
+                    const float d { static_cast<float>(q << 1 | static_cast<long>(bit)) - v };
+                    errors[bit] += d * d;
+                }
+            }
+            p[e] = errors[1] < errors[0] ? 1 : 0;
+        }
+        return quantizeMode6(block, ends, p, vector);
+    }
+
+    Mode6Block encodeMode6(const Block &block, BlockQuality quality, bool vector)
+    {
+        Mode6Block best { evaluateMode6(block, findEndpoints(block, allPixels, 4, quality), quality, vector) };
+        for (int round = 0; quality == BlockQuality::Best && round < 2 && best.error > 0; round++)
+        {
+            float weights[16];
+            for (unsigned i = 0; i < 16; i++)
+            {
+                weights[i] = static_cast<float>(bc7Weights[best.indices[i]]) / 64;
+            }
+            Endpoints ends;
+            if (!fitEndpoints(block, allPixels, 4, weights, ends))
+            {
+                break;
+            }
+            const Mode6Block refined { evaluateMode6(block, ends, quality, vector) };
+            if (refined.error >= best.error)
+            {
+                break;
+            }
+            best = refined;
+        }
+        // the top bit of the first index isn't stored, so it has to be 0
+        if (best.indices[0] >= 8)
+        {
+            std::swap(best.e[0], best.e[1]);
+            std::swap(best.p[0], best.p[1]);
+            for (unsigned char &index : best.indices)
+            {
+                index = static_cast<unsigned char>(15 - index);
+            }
+        }
+        return best;
+    }
+
+    void writeMode6(const Mode6Block &mode6, unsigned char *out)
+    {
+        std::uint64_t bits[2] {};
+        unsigned offset { 0 };
+        const auto put { [&](unsigned value, unsigned count)
+        {
+            for (unsigned b = 0; b < count; b++, offset++)
+            {
+                bits[offset / 64] |= static_cast<std::uint64_t>(value >> b & 1) << (offset % 64);
+            }
+        } };
+        put(1u << 6, 7);
+        for (int c = 0; c < 4; c++)
+        {
+            put(mode6.e[0][c], 7);
+            put(mode6.e[1][c], 7);
+        }
+        put(mode6.p[0], 1);
+        put(mode6.p[1], 1);
+        for (unsigned i = 0; i < 16; i++)
+        {
+            put(mode6.indices[i], i == 0 ? 3 : 4);
+        }
+        for (unsigned i = 0; i < 16; i++)
+        {
+            out[i] = static_cast<unsigned char>(bits[i / 8] >> (i % 8 * 8));
+        }
+    }
+}
+
+ByteBuffer compressBlocks(const Image &image, imbin::PixelFormat format, BlockQuality quality, unsigned threads, imbin::Simd simd)
+{
+    const std::uint32_t blocksX { (image.width + 3) / 4 };
+    const std::size_t blockBytes { imbin::bytesPerBlock(format) };
+    ByteBuffer blocks(static_cast<std::size_t>(imbin::imageSize(format, image.width, image.height)));
+    const bool vector { simd != imbin::Simd::Scalar && imbin::simdSupported(imbin::Simd::Ssse3) };
+    parallelFor((image.height + 3) / 4, threads, [&](std::size_t by)
+    {
+        Block block;
+        for (std::uint32_t bx = 0; bx < blocksX; bx++)
+        {
+            loadBlock(image, bx, static_cast<std::uint32_t>(by), block);
+            unsigned char *out { blocks.data() + (by * blocksX + bx) * blockBytes };
+            switch (format)
+            {
+            case imbin::PixelFormat::Bc1:
+                writeColor(encodeColor(block, true, quality, vector), out);
+                break;
+            case imbin::PixelFormat::Bc3:
+                writeAlpha(encodeAlpha(block, quality, vector), out);
+                writeColor(encodeColor(block, false, quality, vector), out + 8);
+                break;
+            case imbin::PixelFormat::Bc7:
+                writeMode6(encodeMode6(block, quality, vector), out);
+                break;
+            case imbin::PixelFormat::Rgba8:
+                break;
+            }
+        }
+    });
+    return blocks;
+}
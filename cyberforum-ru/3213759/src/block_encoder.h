@@ -0,0 +1,22 @@
+#ifndef BLOCK_ENCODER_H
+#define BLOCK_ENCODER_H
+
+#include "image.h"
+#include "memory_pool.h"
+#include <imbin/format.h>
+#include <imbin/simd.h>
+
+enum class BlockQuality
+{
+    Fast, // endpoints at the corners of the bounding box of the block
+    Normal, // endpoints at the ends of the principal axis of the block
+    Best // and then refined by least squares over the indices they got; BC3 alpha also tries the 6-level mode
+};
+
+// the RGBA8 image as blocks of a block format (Bc1, Bc3 or Bc7, see PixelFormat in include/imbin/format.h),
+// rows of blocks in parallel on up to threads threads; with simd above Scalar the indices are picked with SSE2,
+// four pixels at a time against every entry of the palette
+ByteBuffer compressBlocks(const Image &image, imbin::PixelFormat format, BlockQuality quality, unsigned threads,
+                          imbin::Simd simd = imbin::bestSimd());
+
+#endif // BLOCK_ENCODER_H
@@ -0,0 +1,325 @@
+#include <cstring>
+#include <string>
+
+#include "color_convert.h"
+#include "errors.h"
+#include "imbin/cpu.h"
+
+namespace
+{
+    // sample number index of a row, as it is (not scaled to 8 bits)
+    template<int Depth>
+    unsigned sample(const unsigned char *row, std::size_t index)
+    {
+        if constexpr (Depth == 16)
+        {
+            return static_cast<unsigned>(row[index * 2] << 8 | row[index * 2 + 1]);
+        }
+        else if constexpr (Depth == 8)
+        {
+            return row[index];
+        }
+        else
+        {
+            const std::size_t bit { index * Depth };
+            return (row[bit / 8] >> (8 - Depth - bit % 8)) & ((1u << Depth) - 1);
+        }
+    }
+
+    // 16-bit samples lose the low byte (as with png_set_strip_16), sub-byte ones are scaled up to the full range
+    template<int Depth>
+    unsigned char to8(unsigned value)
+    {
+        if constexpr (Depth == 16)
+        {
+            return static_cast<unsigned char>(value >> 8);
+        }
+        else
+        {
+            return static_cast<unsigned char>(value * (255 / ((1u << Depth) - 1)));
+        }
+    }
+
+    template<imbin::PixelFormat Target>
+    void store(unsigned char *out, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+    {
+        static_assert(Target == imbin::PixelFormat::Rgba8, "no other target formats yet");
+        out[0] = r;
+        out[1] = g;
+        out[2] = b;
+        out[3] = a;
+    }
+
+#ifdef IMBIN_X86
+    // SSSE3 shuffles to RGBA8 for the byte-aligned types without a colour key, each returns how many pixels it did;
+    // 16-bit samples are big-endian, so their high byte is the first one
+
+    IMBIN_TARGET("ssse3")
+    std::uint32_t gray8Ssse3(const unsigned char *source, std::uint32_t width, unsigned char *out)
+    {
+        const __m128i alpha { _mm_set1_epi32(static_cast<int>(0xFF000000u)) };
+        const __m128i spread[4] {
+            _mm_setr_epi8(0, 0, 0, -1, 1, 1, 1, -1, 2, 2, 2, -1, 3, 3, 3, -1),
+            _mm_setr_epi8(4, 4, 4, -1, 5, 5, 5, -1, 6, 6, 6, -1, 7, 7, 7, -1),
+            _mm_setr_epi8(8, 8, 8, -1, 9, 9, 9, -1, 10, 10, 10, -1, 11, 11, 11, -1),
+            _mm_setr_epi8(12, 12, 12, -1, 13, 13, 13, -1, 14, 14, 14, -1, 15, 15, 15, -1)
+        };
+        std::uint32_t x { 0 };
+        for (; x + 16 <= width; x += 16)
+        {
+            const __m128i g { _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x)) };
+            __m128i *o { reinterpret_cast<__m128i*>(out + x * 4) };
+            for (int i = 0; i < 4; i++)
+            {
+                _mm_storeu_si128(o + i, _mm_or_si128(_mm_shuffle_epi8(g, spread[i]), alpha));
+            }
+        }
+        return x;
+    }
+
+    IMBIN_TARGET("ssse3")
+    std::uint32_t grayAlpha8Ssse3(const unsigned char *source, std::uint32_t width, unsigned char *out)
+    {
+        const __m128i low { _mm_setr_epi8(0, 0, 0, 1, 2, 2, 2, 3, 4, 4, 4, 5, 6, 6, 6, 7) };
+        const __m128i high { _mm_setr_epi8(8, 8, 8, 9, 10, 10, 10, 11, 12, 12, 12, 13, 14, 14, 14, 15) };
+        std::uint32_t x { 0 };
+        for (; x + 8 <= width; x += 8)
+        {
+            const __m128i ga { _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x * 2)) };
+            __m128i *o { reinterpret_cast<__m128i*>(out + x * 4) };
+            _mm_storeu_si128(o, _mm_shuffle_epi8(ga, low));
+            _mm_storeu_si128(o + 1, _mm_shuffle_epi8(ga, high));
+        }
+        return x;
+    }
+
+    IMBIN_TARGET("ssse3")
+    std::uint32_t rgb8Ssse3(const unsigned char *source, std::uint32_t width, unsigned char *out)
+    {
+        const __m128i alpha { _mm_set1_epi32(static_cast<int>(0xFF000000u)) };
+        const __m128i spread { _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1) };
+        std::uint32_t x { 0 };
+        // 4 pixels are 12 bytes, but 16 are loaded
+        for (; x + 6 <= width; x += 4)
+        {
+            const __m128i rgb { _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x * 3)) };
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_or_si128(_mm_shuffle_epi8(rgb, spread), alpha));
+        }
+        return x;
+    }
+
+    IMBIN_TARGET("ssse3")
+    std::uint32_t gray16Ssse3(const unsigned char *source, std::uint32_t width, unsigned char *out)
+    {
+        const __m128i alpha { _mm_set1_epi32(static_cast<int>(0xFF000000u)) };
+        const __m128i low { _mm_setr_epi8(0, 0, 0, -1, 2, 2, 2, -1, 4, 4, 4, -1, 6, 6, 6, -1) };
+        const __m128i high { _mm_setr_epi8(8, 8, 8, -1, 10, 10, 10, -1, 12, 12, 12, -1, 14, 14, 14, -1) };
+        std::uint32_t x { 0 };
+        for (; x + 8 <= width; x += 8)
+        {
+            const __m128i g { _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x * 2)) };
+            __m128i *o { reinterpret_cast<__m128i*>(out + x * 4) };
+            _mm_storeu_si128(o, _mm_or_si128(_mm_shuffle_epi8(g, low), alpha));
+            _mm_storeu_si128(o + 1, _mm_or_si128(_mm_shuffle_epi8(g, high), alpha));
+        }
+        return x;
+    }
+
+    IMBIN_TARGET("ssse3")
+    std::uint32_t grayAlpha16Ssse3(const unsigned char *source, std::uint32_t width, unsigned char *out)
+    {
+        const __m128i spread { _mm_setr_epi8(0, 0, 0, 2, 4, 4, 4, 6, 8, 8, 8, 10, 12, 12, 12, 14) };
+        std::uint32_t x { 0 };
+        for (; x + 4 <= width; x += 4)
+        {
+            const __m128i ga { _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x * 4)) };
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_shuffle_epi8(ga, spread));
+        }
+        return x;
+    }
+
+    IMBIN_TARGET("ssse3")
+    std::uint32_t rgb16Ssse3(const unsigned char *source, std::uint32_t width, unsigned char *out)
+    {
+        const __m128i alpha { _mm_set1_epi32(static_cast<int>(0xFF000000u)) };
+        const __m128i low { _mm_setr_epi8(0, 2, 4, -1, 6, 8, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1) };
+        const __m128i high { _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 0, 2, 4, -1, 6, 8, 10, -1) };
+        std::uint32_t x { 0 };
+        // 4 pixels are 24 bytes, loaded as 16 at 0 and 16 at 12
+        for (; x + 5 <= width; x += 4)
+        {
+            const unsigned char *p { source + x * 6 };
+            const __m128i first { _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)) };
+            const __m128i second { _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)) };
+            const __m128i rgba { _mm_or_si128(_mm_shuffle_epi8(first, low), _mm_shuffle_epi8(second, high)) };
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_or_si128(rgba, alpha));
+        }
+        return x;
+    }
+
+    IMBIN_TARGET("ssse3")
+    std::uint32_t rgba16Ssse3(const unsigned char *source, std::uint32_t width, unsigned char *out)
+    {
+        const __m128i highBytes { _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1) };
+        std::uint32_t x { 0 };
+        for (; x + 4 <= width; x += 4)
+        {
+            const __m128i *p { reinterpret_cast<const __m128i*>(source + x * 8) };
+            const __m128i first { _mm_shuffle_epi8(_mm_loadu_si128(p), highBytes) };
+            const __m128i second { _mm_shuffle_epi8(_mm_loadu_si128(p + 1), highBytes) };
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_unpacklo_epi64(first, second));
+        }
+        return x;
+    }
+#endif
+
+    // the part of the row a SIMD kernel does, 0 if there's none for the combination
+    template<SourceColor Color, int Depth>
+    std::uint32_t convertVector(const unsigned char *source, std::uint32_t width, unsigned char *out)
+    {
+#ifdef IMBIN_X86
+        if constexpr (Color == SourceColor::Gray && Depth == 8) { return gray8Ssse3(source, width, out); }
+        if constexpr (Color == SourceColor::Gray && Depth == 16) { return gray16Ssse3(source, width, out); }
+        if constexpr (Color == SourceColor::GrayAlpha && Depth == 8) { return grayAlpha8Ssse3(source, width, out); }
+        if constexpr (Color == SourceColor::GrayAlpha && Depth == 16) { return grayAlpha16Ssse3(source, width, out); }
+        if constexpr (Color == SourceColor::Rgb && Depth == 8) { return rgb8Ssse3(source, width, out); }
+        if constexpr (Color == SourceColor::Rgb && Depth == 16) { return rgb16Ssse3(source, width, out); }
+        if constexpr (Color == SourceColor::Rgba && Depth == 16) { return rgba16Ssse3(source, width, out); }
+#endif
+        (void)source;
+        (void)width;
+        (void)out;
+        return 0;
+    }
+
+    template<SourceColor Color, int Depth, bool Keyed, imbin::PixelFormat Target, bool Vector>
+    void convertRow(const unsigned char *source, std::uint32_t width, unsigned char *target, const SourceInfo &info)
+    {
+        if constexpr (Color == SourceColor::Rgba && Depth == 8 && Target == imbin::PixelFormat::Rgba8)
+        {
+            std::memcpy(target, source, static_cast<std::size_t>(width) * 4);
+            return;
+        }
+
+        std::uint32_t x { 0 };
+        if constexpr (Vector && !Keyed)
+        {
+            x = convertVector<Color, Depth>(source, width, target);
+        }
+        for (; x < width; x++)
+        {
+            unsigned char *out { target + static_cast<std::size_t>(x) * 4 };
+            if constexpr (Color == SourceColor::Gray)
+            {
+                const unsigned v { sample<Depth>(source, x) };
+                const unsigned char g { to8<Depth>(v) };
+                store<Target>(out, g, g, g, Keyed && v == info.key[0] ? 0 : 255);
+            }
+            else if constexpr (Color == SourceColor::GrayAlpha)
+            {
+                const unsigned char g { to8<Depth>(sample<Depth>(source, x * 2)) };
+                store<Target>(out, g, g, g, to8<Depth>(sample<Depth>(source, x * 2 + 1)));
+            }
+            else if constexpr (Color == SourceColor::Rgb)
+            {
+                const unsigned r { sample<Depth>(source, x * 3) };
+                const unsigned g { sample<Depth>(source, x * 3 + 1) };
+                const unsigned b { sample<Depth>(source, x * 3 + 2) };
+                const bool transparent { Keyed && r == info.key[0] && g == info.key[1] && b == info.key[2] };
+                store<Target>(out, to8<Depth>(r), to8<Depth>(g), to8<Depth>(b), transparent ? 0 : 255);
+            }
+            else if constexpr (Color == SourceColor::Rgba)
+            {
+                store<Target>(out, to8<Depth>(sample<Depth>(source, x * 4)), to8<Depth>(sample<Depth>(source, x * 4 + 1)),
+                              to8<Depth>(sample<Depth>(source, x * 4 + 2)), to8<Depth>(sample<Depth>(source, x * 4 + 3)));
+            }
+            else
+            {
+                // the entries are already in the target format
+                std::memcpy(out, &info.palette[sample<Depth>(source, x)], 4);
+            }
+        }
+    }
+
+    template<SourceColor Color, int Depth>
+    RowConverter pick(bool colorKey, bool vector)
+    {
+        constexpr imbin::PixelFormat Rgba8 { imbin::PixelFormat::Rgba8 };
+        if (colorKey)
+        {
+            return convertRow<Color, Depth, true, Rgba8, false>;
+        }
+        return vector ? convertRow<Color, Depth, false, Rgba8, true> : convertRow<Color, Depth, false, Rgba8, false>;
+    }
+}
+
+RowConverter findRowConverter(SourceColor color, int bitDepth, bool colorKey, imbin::PixelFormat target, imbin::Simd simd)
+{
+    if (target != imbin::PixelFormat::Rgba8)
+    {
+        throw ConversionError("unsupported target pixel format");
+    }
+    // only grey and RGB images have colour keys
+    colorKey = colorKey && (color == SourceColor::Gray || color == SourceColor::Rgb);
+    const bool vector { simd != imbin::Simd::Scalar && imbin::simdSupported(imbin::Simd::Ssse3) };
+
+    switch (color)
+    {
+    case SourceColor::Gray:
+        switch (bitDepth)
+        {
+        case 1: return pick<SourceColor::Gray, 1>(colorKey, vector);
+        case 2: return pick<SourceColor::Gray, 2>(colorKey, vector);
+        case 4: return pick<SourceColor::Gray, 4>(colorKey, vector);
+        case 8: return pick<SourceColor::Gray, 8>(colorKey, vector);
+        case 16: return pick<SourceColor::Gray, 16>(colorKey, vector);
+        }
+        break;
+    case SourceColor::Palette:
+        switch (bitDepth)
+        {
+        case 1: return pick<SourceColor::Palette, 1>(false, vector);
+        case 2: return pick<SourceColor::Palette, 2>(false, vector);
+        case 4: return pick<SourceColor::Palette, 4>(false, vector);
+        case 8: return pick<SourceColor::Palette, 8>(false, vector);
+        }
+        break;
+    case SourceColor::Rgb:
+        switch (bitDepth)
+        {
+        case 8: return pick<SourceColor::Rgb, 8>(colorKey, vector);
+        case 16: return pick<SourceColor::Rgb, 16>(colorKey, vector);
+        }
+        break;
+    case SourceColor::GrayAlpha:
+        switch (bitDepth)
+        {
+        case 8: return pick<SourceColor::GrayAlpha, 8>(false, vector);
+        case 16: return pick<SourceColor::GrayAlpha, 16>(false, vector);
+        }
+        break;
+    case SourceColor::Rgba:
+        switch (bitDepth)
+        {
+        case 8: return pick<SourceColor::Rgba, 8>(false, vector);
+        case 16: return pick<SourceColor::Rgba, 16>(false, vector);
+        }
+        break;
+    }
+    throw ConversionError("invalid PNG: " + describeSource(color, bitDepth));
+}
+
+std::string describeSource(SourceColor color, int bitDepth)
+{
+    const char *name { nullptr };
+    switch (color)
+    {
+    case SourceColor::Gray: name = "grey"; break;
+    case SourceColor::Rgb: name = "RGB"; break;
+    case SourceColor::Palette: name = "palette"; break;
+    case SourceColor::GrayAlpha: name = "grey+alpha"; break;
+    case SourceColor::Rgba: name = "RGBA"; break;
+    default: return "colour type " + std::to_string(static_cast<int>(color)) + ", " + std::to_string(bitDepth) + "-bit";
+    }
+    return std::string(name) + " " + std::to_string(bitDepth) + "-bit";
+}
@@ -0,0 +1,43 @@
+#ifndef COLOR_CONVERT_H
+#define COLOR_CONVERT_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include <imbin/format.h>
+#include <imbin/simd.h>
+
+// colour types of PNG (the same values as PNG_COLOR_TYPE_*)
+enum class SourceColor
+{
+    Gray = 0,
+    Rgb = 2,
+    Palette = 3,
+    GrayAlpha = 4,
+    Rgba = 6
+};
+
+// what a converter needs to know about the source besides its type and depth
+struct SourceInfo
+{
+    // palette entries as RGBA8 (with the alpha from tRNS), entries past the end of the palette are opaque black
+    std::array<std::uint32_t, 256> palette {};
+    // tRNS of grey and RGB images: pixels equal to the key (compared before the depth is reduced) become transparent
+    bool colorKey { false };
+    std::uint16_t key[3] {};
+};
+
+// rows as libpng stores them (big-endian 16-bit samples, sub-byte samples packed from the high bits)
+// to rows of the target format
+using RowConverter = void (*)(const unsigned char *source, std::uint32_t width, unsigned char *target, const SourceInfo &info);
+
+// a converter specialized at compile time for the combination, with SIMD inner loops where the CPU has them
+// (simd is clamped to what it supports); throws ConversionError for combinations PNG doesn't allow
+RowConverter findRowConverter(SourceColor color, int bitDepth, bool colorKey, imbin::PixelFormat target,
+                              imbin::Simd simd = imbin::bestSimd());
+
+// "palette 4-bit", "RGB 16-bit", ...
+std::string describeSource(SourceColor color, int bitDepth);
+
+#endif // COLOR_CONVERT_H
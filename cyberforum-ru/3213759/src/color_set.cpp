@@ -0,0 +1,67 @@
+#include <cstring>
+
+#include "color_set.h"
+
+void ColorSet::clear()
+{
+    m_slots.fill(0);
+    m_count = 0;
+    m_overflowed = false;
+    m_lastIndex = maxColors;
+}
+
+// the first empty slot or the one of the colour, probing linearly from its hash; there are always empty ones
+// with twice as many slots as colours
+std::size_t ColorSet::slotOf(std::uint32_t color) const
+{
+    // a multiply alone leaves the colours of smooth rows (which differ by the same amount in every channel)
+    // in long clusters, the shift folds the high bits back in before the second one
+    std::uint32_t hash { color * 2654435761u };
+    hash ^= hash >> 15;
+    std::size_t slot { (hash * 0x2c1b3c6du) >> 23 };
+    while (m_slots[slot] != 0 && m_colors[m_slots[slot] - 1u] != color)
+    {
+        slot = (slot + 1) % slotCount;
+    }
+    return slot;
+}
+
+bool ColorSet::add(const unsigned char *rgba, std::size_t pixels)
+{
+    if (m_overflowed)
+    {
+        return false;
+    }
+    for (std::size_t i = 0; i < pixels; i++)
+    {
+        std::uint32_t color;
+        std::memcpy(&color, rgba + i * 4, 4);
+        if (color == m_last && m_lastIndex < maxColors)
+        {
+            continue;
+        }
+        const std::size_t slot { slotOf(color) };
+        if (m_slots[slot] == 0)
+        {
+            if (m_count == maxColors)
+            {
+                m_overflowed = true;
+                return false;
+            }
+            m_colors[m_count] = color;
+            m_slots[slot] = static_cast<std::uint16_t>(++m_count);
+        }
+        m_last = color;
+        m_lastIndex = m_slots[slot] - 1u;
+    }
+    return true;
+}
+
+unsigned ColorSet::indexOf(std::uint32_t color) const
+{
+    if (color == m_last && m_lastIndex < maxColors)
+    {
+        return m_lastIndex;
+    }
+    return m_slots[slotOf(color)] - 1u;
+}
@@ -0,0 +1,43 @@
+#ifndef COLOR_SET_H
+#define COLOR_SET_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// the distinct RGBA8 colours of an image as long as there are no more than maxColors of them, in the order they
+// first appear; a small open-addressing table over the colours, with the colour of the last pixel looked at kept
+// aside, since pixels of images that few colours mostly come in runs; nothing is allocated
+class ColorSet
+{
+public:
+    static constexpr std::size_t maxColors { 256 };
+
+    void clear();
+
+    // false (and from then on) once the pixels added so far have more than maxColors colours
+    bool add(const unsigned char *rgba, std::size_t pixels);
+    bool overflowed() const { return m_overflowed; }
+
+    std::size_t size() const { return m_count; }
+    // colours as 4 bytes in memory order, i.e. read from the pixels with memcpy
+    const std::uint32_t *colors() const { return m_colors.data(); }
+
+    // the position of a colour that was added
+    unsigned indexOf(std::uint32_t color) const;
+
+private:
+    static constexpr std::size_t slotCount { 512 };
+
+    std::size_t slotOf(std::uint32_t color) const;
+
+    std::array<std::uint32_t, maxColors> m_colors {};
+    // index + 1 of the colour in every slot, 0 for an empty slot
+    std::array<std::uint16_t, slotCount> m_slots {};
+    std::size_t m_count { 0 };
+    bool m_overflowed { false };
+    std::uint32_t m_last { 0 };
+    unsigned m_lastIndex { maxColors };
+};
+
+#endif // COLOR_SET_H
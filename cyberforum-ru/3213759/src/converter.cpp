@@ -0,0 +1,1129 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#ifdef USING_PACKAGE_MANAGER
+    #include <zlib/zlib.h>
+#else
+    #include <zlib.h>
+#endif
+
+#include "color_set.h"
+#include "converter.h"
+#include "errors.h"
+#include <imbin/reader.h>
+#include "input.h"
+#include "memory_pool.h"
+#include "png_decoder.h"
+#include <imbin/sequence.h>
+#include "thread_pool.h"
+#include "tiles.h"
+#include "transform.h"
+
+namespace
+{
+    std::vector<unsigned char> deflateChunkData(const DeflateSettings &settings)
+    {
+        return {
+            static_cast<unsigned char>(settings.level),
+            static_cast<unsigned char>(settings.memLevel),
+            static_cast<unsigned char>(settings.windowBits),
+            static_cast<unsigned char>(settings.strategy),
+            static_cast<unsigned char>(settings.automatic ? 1 : 0),
+            0, 0, 0
+        };
+    }
+
+    // where encode() puts the im.bin: the header with the chunks, then the payload as it is produced;
+    // chunks that depend on the payload are reserved with the right size and patched in at the end
+    class Output
+    {
+    public:
+        virtual ~Output() = default;
+        virtual void write(const unsigned char *data, std::size_t size) = 0;
+        virtual void patchChunk(std::uint32_t id, const std::vector<unsigned char> &data) = 0;
+        // returns the size of the file
+        virtual std::uint64_t finish() = 0;
+    };
+
+    // writes the header up front and seeks back to patch the payload size and the chunks; into a temporary file
+    // next to the output, renamed over it by finish(), so a conversion that fails halfway leaves the old file alone
+    class OutputFile : public Output
+    {
+    public:
+        OutputFile(const std::filesystem::path &path, imbin::Header header, const std::vector<imbin::ChunkData> &chunks)
+            : m_path { path },
+              m_temporary { path },
+              m_header { std::move(header) }
+        {
+            StageScope scope { Stage::Write };
+            m_header.payloadSize = imbin::payloadToEnd;
+            const std::vector<unsigned char> bytes { imbin::serializeHeader(m_header, chunks) };
+            m_temporary += ".tmp";
+            m_out.open(m_temporary, std::ios::binary);
+            if (!m_out)
+            {
+                throw ConversionError("couldn't open " + m_temporary.string() + " for writing");
+            }
+            m_out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        }
+
+        ~OutputFile() override
+        {
+            if (!m_finished)
+            {
+                m_out.close();
+                std::error_code ec;
+                std::filesystem::remove(m_temporary, ec);
+            }
+        }
+
+        void write(const unsigned char *data, std::size_t size) override
+        {
+            StageScope scope { Stage::Write };
+            m_out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+            m_payloadSize += size;
+        }
+
+        void patchChunk(std::uint32_t id, const std::vector<unsigned char> &data) override
+        {
+            const imbin::Chunk *chunk { m_header.findChunk(id) };
+            if (!chunk || chunk->size != data.size())
+            {
+                throw ConversionError("internal error: chunk to patch doesn't match");
+            }
+            patch(chunk->offset, data);
+        }
+
+        std::uint64_t finish() override
+        {
+            StageScope scope { Stage::Write };
+            std::vector<unsigned char> payloadSize;
+            imbin::putU64(payloadSize, m_payloadSize);
+            patch(imbin::payloadSizeOffset, payloadSize);
+            m_out.close();
+            if (!m_out)
+            {
+                throw ConversionError("couldn't write " + m_temporary.string());
+            }
+            std::error_code ec;
+            std::filesystem::rename(m_temporary, m_path, ec);
+            if (ec)
+            {
+                throw ConversionError("couldn't replace " + m_path.string() + ": " + ec.message());
+            }
+            m_finished = true;
+            return m_header.payloadOffset + m_payloadSize;
+        }
+
+    private:
+        void patch(std::uint64_t offset, const std::vector<unsigned char> &data)
+        {
+            StageScope scope { Stage::Write };
+            const auto position { m_out.tellp() };
+            m_out.seekp(static_cast<std::streamoff>(offset));
+            m_out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            m_out.seekp(position);
+        }
+
+        std::filesystem::path m_path;
+        std::filesystem::path m_temporary;
+        std::ofstream m_out;
+        imbin::Header m_header;
+        std::uint64_t m_payloadSize { 0 };
+        bool m_finished { false };
+    };
+
+    // the whole file in memory: the payload is kept until the end, and then the header is made with the real
+    // payload size and the patched chunks, so it can go in front of it; moved to result, if there is one, at the end
+    class OutputMemory : public Output
+    {
+    public:
+        OutputMemory(imbin::Header header, std::vector<imbin::ChunkData> chunks, EncodedImage *result = nullptr)
+            : m_header { std::move(header) },
+              m_chunks { std::move(chunks) },
+              m_result { result }
+        {}
+
+        void write(const unsigned char *data, std::size_t size) override
+        {
+            m_encoded.payload.insert(m_encoded.payload.end(), data, data + size);
+        }
+
+        void patchChunk(std::uint32_t id, const std::vector<unsigned char> &data) override
+        {
+            for (imbin::ChunkData &chunk : m_chunks)
+            {
+                if (chunk.id == id && chunk.data.size() == data.size())
+                {
+                    chunk.data = data;
+                    return;
+                }
+            }
+            throw ConversionError("internal error: chunk to patch doesn't match");
+        }
+
+        std::uint64_t finish() override
+        {
+            m_header.payloadSize = m_encoded.payload.size();
+            m_encoded.header = imbin::serializeHeader(m_header, m_chunks);
+            const std::uint64_t size { m_encoded.header.size() + m_encoded.payload.size() };
+            if (m_result)
+            {
+                *m_result = std::move(m_encoded);
+            }
+            return size;
+        }
+
+    protected:
+        imbin::Header m_header;
+        std::vector<imbin::ChunkData> m_chunks;
+        EncodedImage m_encoded;
+        EncodedImage *m_result;
+    };
+
+    // for streams that can't seek (stdout into a pipe), so the files can follow one another
+    class OutputStream : public OutputMemory
+    {
+    public:
+        OutputStream(std::ostream &out, imbin::Header header, std::vector<imbin::ChunkData> chunks)
+            : OutputMemory { std::move(header), std::move(chunks) },
+              m_out { out }
+        {}
+
+        std::uint64_t finish() override
+        {
+            const std::uint64_t size { OutputMemory::finish() };
+            StageScope scope { Stage::Write };
+            m_out.write(reinterpret_cast<const char*>(m_encoded.header.data()), static_cast<std::streamsize>(m_encoded.header.size()));
+            m_out.write(reinterpret_cast<const char*>(m_encoded.payload.data()), static_cast<std::streamsize>(m_encoded.payload.size()));
+            m_out.flush();
+            if (!m_out)
+            {
+                throw ConversionError("couldn't write the output");
+            }
+            return size;
+        }
+
+    private:
+        std::ostream &m_out;
+    };
+
+    // makes the output once the header and the chunks are known
+    using OpenOutput = std::function<std::unique_ptr<Output>(const imbin::Header&, const std::vector<imbin::ChunkData>&)>;
+
+    // hands out the rows of an image top to bottom, either straight from memory or decoding them on demand
+    class RowSource
+    {
+    public:
+        virtual ~RowSource() = default;
+        // the next count rows one after another, valid (and free to be modified in place) until the next call
+        virtual unsigned char* next(std::uint32_t count) = 0;
+    };
+
+    class ImageRows : public RowSource
+    {
+    public:
+        explicit ImageRows(Image &image) : m_image { image } {}
+
+        unsigned char* next(std::uint32_t count) override
+        {
+            unsigned char *rows { m_image.pixels.data() + m_y * m_image.rowBytes };
+            m_y += count;
+            return rows;
+        }
+
+    private:
+        Image &m_image;
+        std::size_t m_y { 0 };
+    };
+
+    // the rows of a PNG decoded on demand, cropped to the columns of the region (the rows above it are skipped
+    // before the first one is handed out)
+    class PngRows : public RowSource
+    {
+    public:
+        PngRows(PngReader &reader, const Region &region) : m_reader { reader }, m_region { region } {}
+
+        unsigned char* next(std::uint32_t count) override
+        {
+            StageScope scope { Stage::Decode };
+            if (!m_started)
+            {
+                m_reader.skipRows(m_region.y);
+                m_started = true;
+            }
+            const std::size_t rowBytes { static_cast<std::size_t>(m_region.width) * 4 };
+            m_rows.resize(count * rowBytes);
+            for (std::uint32_t i = 0; i < count; i++)
+            {
+                m_reader.readRow(m_rows.data() + i * rowBytes, m_region.x, m_region.width);
+            }
+            return m_rows.data();
+        }
+
+    private:
+        PngReader &m_reader;
+        Region m_region;
+        bool m_started { false };
+        ByteBuffer m_rows;
+    };
+
+    // hands the reader the next piece of the input, reading more of it if everything read has been fed already;
+    // false at the end of the input
+    bool feedMore(PngPushReader &reader, PipeInput &input)
+    {
+        if (input.size() == 0)
+        {
+            StageScope scope { Stage::Read };
+            if (!input.fill())
+            {
+                return false;
+            }
+        }
+        // small pieces, so a well-compressed piece doesn't turn into many MB of rows at once
+        const std::size_t piece { std::min<std::size_t>(input.size(), 8 * 1024) };
+        StageScope scope { Stage::Decode };
+        input.consume(reader.feed(input.data(), piece));
+        return true;
+    }
+
+    // the rows of a PNG coming through a pipe, decoded as its bytes arrive
+    class PushRows : public RowSource
+    {
+    public:
+        PushRows(PngPushReader &reader, PipeInput &input) : m_reader { reader }, m_input { input } {}
+
+        unsigned char* next(std::uint32_t count) override
+        {
+            // the rows handed out last time are done with now
+            m_reader.take(m_taken);
+            m_taken = count;
+            while (m_reader.rowsReady() < count)
+            {
+                if (m_reader.finished() || !feedMore(m_reader, m_input))
+                {
+                    throw ConversionError("unexpected end of input");
+                }
+            }
+            return m_reader.rows();
+        }
+
+    private:
+        PngPushReader &m_reader;
+        PipeInput &m_input;
+        std::uint32_t m_taken { 0 };
+    };
+
+    // the part of the image the settings ask for, the whole image without a region
+    Region cropRegion(const Region &region, std::uint32_t width, std::uint32_t height)
+    {
+        if (region.empty())
+        {
+            return { 0, 0, width, height };
+        }
+        if (region.x >= width || region.y >= height)
+        {
+            throw ConversionError("the region is outside the " + std::to_string(width) + "x" + std::to_string(height) + " image");
+        }
+        return { region.x, region.y, std::min(region.width, width - region.x), std::min(region.height, height - region.y) };
+    }
+
+    // decodes what was just written and compares it with the checksum of the source pixels,
+    // the mip levels are only checked to inflate
+    void verifyOutput(const std::filesystem::path &output, uLong expectedChecksum)
+    {
+        StageScope scope { Stage::Verify };
+        const MappedFile file { output };
+        const imbin::Image written { imbin::decode(file.data(), file.size()) };
+        const uLong checksum { adler32_z(adler32(0, nullptr, 0), written.pixels.data(), written.pixels.size()) };
+        if (checksum != expectedChecksum)
+        {
+            throw ConversionError("verification failed: decoded pixels differ from the source");
+        }
+        const std::uint32_t levels { imbin::mipLevelCount(file.data(), file.size()) };
+        for (std::uint32_t level = 1; level <= levels; level++)
+        {
+            imbin::decodeMipLevel(file.data(), file.size(), level);
+        }
+    }
+
+    // the MIPS chunk if the settings ask for one, from the pixels as they were decoded
+    std::vector<imbin::ChunkData> mipChunks(const Image &image, const ConversionSettings &settings)
+    {
+        if (settings.mips == MipFilter::None)
+        {
+            return {};
+        }
+        return { makeMipChunk(image, settings.mips, settings.deflate, std::max(settings.deflate.threads, 1u)) };
+    }
+
+    // compresses the rows from the source into the output open makes; in the streaming mode the rows are pulled
+    // in small bands, otherwise the whole image is taken at once (so it can be deflated in parallel blocks);
+    // the rows of an opaque image lose their alpha unless the settings keep it or the layout is planar, the ones
+    // of an image of few colours (with those colours, nullptr otherwise) become indices into them whatever the layout;
+    // returns the checksum of the source rows for verification (only computed if the settings ask for it)
+    uLong encode(RowSource &source, std::uint32_t width, std::uint32_t height, std::size_t rowBytes, bool opaque,
+                 const ColorSet *colors, const OpenOutput &open, const ConversionSettings &settings, ConversionResult &result,
+                 std::vector<imbin::ChunkData> extraChunks = {})
+    {
+        const bool tiled { settings.tileWidth > 0 && settings.tileHeight > 0 };
+        // the first band is also what the deflate settings are picked on in the automatic mode:
+        // a row of tiles, the first 1 MB of rows when streaming, the whole image otherwise
+        std::uint32_t bandRows { height };
+        if (tiled)
+        {
+            bandRows = settings.tileHeight;
+        }
+        else if (settings.streaming)
+        {
+            bandRows = static_cast<std::uint32_t>(std::max<std::size_t>(1, (1024 * 1024) / std::max<std::size_t>(rowBytes, 1)));
+        }
+        bandRows = std::min(bandRows, height);
+
+        // indices are always interleaved, there's nothing to split into planes
+        const bool indexed { colors != nullptr };
+        const imbin::Layout layout { indexed ? imbin::Layout::Interleaved : settings.layout };
+        // tiles are split into planes and filtered by the compressor, as that goes per row of a tile
+        const bool planarRows { layout == imbin::Layout::PlanarRows && !tiled };
+        const bool filterImageRows { settings.filterRows && !tiled };
+        // from prepare() on the rows are what goes into the file; tiles take a whole byte per index, so that a tile
+        // column never starts in the middle of one
+        const bool rgb { !indexed && opaque && !settings.keepRgba && layout == imbin::Layout::Interleaved };
+        const std::uint32_t indexBits { !indexed || tiled ? 8u
+                                        : colors->size() <= 2 ? 1u
+                                        : colors->size() <= 4 ? 2u
+                                        : colors->size() <= 16 ? 4u : 8u };
+        std::size_t storedRowBytes { rowBytes };
+        std::size_t bytesPerPixel { 4 };
+        if (indexed)
+        {
+            storedRowBytes = imbin::indexRowBytes(width, indexBits);
+            bytesPerPixel = 1;
+        }
+        else if (rgb)
+        {
+            storedRowBytes = static_cast<std::size_t>(width) * 3;
+            bytesPerPixel = 3;
+        }
+        std::vector<unsigned char> filters(filterImageRows ? height : 0);
+        ByteBuffer previousRow;
+        std::uint32_t preparedRows { 0 };
+        uLong checksum { adler32(0, nullptr, 0) };
+        // checksums the source rows and rearranges them for the layout
+        auto prepare = [&](unsigned char *rows, std::uint32_t count)
+        {
+            if (settings.verify)
+            {
+                StageScope scope { Stage::Verify };
+                checksum = adler32_z(checksum, rows, count * rowBytes);
+            }
+            StageScope scope { Stage::Transform };
+            if (rgb)
+            {
+                toRgbRows(rows, count, width);
+            }
+            if (indexed)
+            {
+                toIndexRows(rows, count, width, *colors, indexBits);
+            }
+            if (planarRows)
+            {
+                toPlanarRows(rows, count, width, settings.deflate.threads);
+            }
+            if (filterImageRows)
+            {
+                filterRows(rows, count, storedRowBytes, bytesPerPixel, previousRow, filters.data() + preparedRows, settings.deflate.threads);
+            }
+            preparedRows += count;
+        };
+
+        std::uint32_t y { bandRows };
+        unsigned char *band { height > 0 ? source.next(bandRows) : nullptr };
+        if (band)
+        {
+            prepare(band, bandRows);
+        }
+
+        {
+            StageScope scope { Stage::Deflate };
+            result.deflate = settings.deflate.automatic && band
+                ? chooseDeflateSettings(band, storedRowBytes, bandRows, settings.deflate)
+                : settings.deflate;
+        }
+
+        imbin::Header header;
+        header.width = width;
+        header.height = height;
+        header.format = imbin::PixelFormat::Rgba8;
+        header.layout = layout;
+        header.flags = (settings.filterRows ? imbin::flagFilteredRows : 0) | (rgb ? imbin::flagOpaque : 0)
+            | (indexed ? imbin::flagIndexed : 0);
+        header.codec = tiled ? imbin::Codec::ZlibTiles : imbin::Codec::Zlib;
+        header.uncompressedSize = static_cast<std::uint64_t>(height) * storedRowBytes;
+        std::vector<imbin::ChunkData> chunks { { imbin::deflateChunk, deflateChunkData(result.deflate) } };
+        if (indexed)
+        {
+            imbin::Palette palette;
+            palette.bits = indexBits;
+            palette.entries.resize(colors->size() * 4);
+            std::memcpy(palette.entries.data(), colors->colors(), palette.entries.size());
+            chunks.push_back({ imbin::paletteChunk, imbin::serializePalette(palette) });
+        }
+        std::unique_ptr<TiledCompressor> tiles;
+        Output *outPtr { nullptr };
+        if (tiled)
+        {
+            tiles = std::make_unique<TiledCompressor>(width, height, bytesPerPixel, settings.tileWidth, settings.tileHeight,
+                                                      layout, settings.filterRows, result.deflate,
+                                                      [&outPtr](const unsigned char *data, std::size_t size) { outPtr->write(data, size); });
+            // written empty, patched once all the tiles are compressed
+            chunks.push_back({ imbin::tileChunk, imbin::serializeTileIndex(tiles->index()) });
+        }
+        if (settings.filterRows)
+        {
+            // written empty too, the filters are chosen as the rows come
+            chunks.push_back({ imbin::filterChunk, tiled ? tiles->filters() : filters });
+        }
+        // only the whole image can be split into independent blocks, streaming makes one stream
+        const bool blocks { !tiled && !settings.streaming && result.deflate.independentBlocks };
+        imbin::BlockIndex blockIndex;
+        if (blocks)
+        {
+            const std::size_t windowSize { static_cast<std::size_t>(1) << result.deflate.windowBits };
+            blockIndex = imbin::BlockIndex { header.uncompressedSize, std::max(result.deflate.blockSize, windowSize) };
+            // written empty, patched once the blocks are compressed
+            chunks.push_back({ imbin::blockChunk, imbin::serializeBlockIndex(blockIndex) });
+        }
+        // made by the caller before anything was transformed
+        for (imbin::ChunkData &chunk : extraChunks)
+        {
+            chunks.push_back(std::move(chunk));
+        }
+        const std::unique_ptr<Output> outFile { open(header, chunks) };
+        Output &out { *outFile };
+        outPtr = &out;
+
+        if (tiled)
+        {
+            for (;;)
+            {
+                {
+                    // tiles are split into planes and filtered in there too, it's all one pass over the tile
+                    StageScope scope { Stage::Deflate };
+                    tiles->addBand(band);
+                }
+                if (y >= height) { break; }
+                bandRows = std::min(settings.tileHeight, height - y);
+                band = source.next(bandRows);
+                prepare(band, bandRows);
+                y += bandRows;
+            }
+            out.patchChunk(imbin::tileChunk, imbin::serializeTileIndex(tiles->index()));
+        }
+        else if (settings.streaming)
+        {
+            StreamingDeflater deflater { result.deflate, [&out](const unsigned char *data, std::size_t size) { out.write(data, size); } };
+            // small bands keep the memory independent of the image height
+            const std::uint32_t rowsPerRead { static_cast<std::uint32_t>(std::max<std::size_t>(1, (64 * 1024) / std::max<std::size_t>(rowBytes, 1))) };
+            for (;;)
+            {
+                {
+                    StageScope scope { Stage::Deflate };
+                    deflater.write(band, bandRows * storedRowBytes);
+                }
+                if (y >= height) { break; }
+                bandRows = std::min(rowsPerRead, height - y);
+                band = source.next(bandRows);
+                prepare(band, bandRows);
+                y += bandRows;
+            }
+            StageScope scope { Stage::Deflate };
+            deflater.finish();
+        }
+        else
+        {
+            ByteBuffer zip;
+            {
+                StageScope scope { Stage::Deflate };
+                zip = deflateBuffer(band, static_cast<std::size_t>(height) * storedRowBytes, result.deflate, blocks ? &blockIndex : nullptr);
+            }
+            out.write(zip.data(), zip.size());
+            if (blocks)
+            {
+                out.patchChunk(imbin::blockChunk, imbin::serializeBlockIndex(blockIndex));
+            }
+        }
+        if (settings.filterRows)
+        {
+            out.patchChunk(imbin::filterChunk, tiled ? tiles->filters() : filters);
+        }
+        result.outputBytes = out.finish();
+        return checksum;
+    }
+
+    // the image as blocks of the format of the settings, in one zlib stream (or independent blocks) or stored;
+    // returns the checksum of the blocks for verification, as that is what the file decodes to
+    uLong encodeBlocks(const Image &image, const OpenOutput &open, const ConversionSettings &settings, ConversionResult &result)
+    {
+        ByteBuffer blocks;
+        {
+            StageScope scope { Stage::Transform };
+            blocks = compressBlocks(image, settings.format, settings.blockQuality, std::max(settings.deflate.threads, 1u));
+        }
+        uLong checksum { adler32(0, nullptr, 0) };
+        if (settings.verify)
+        {
+            StageScope scope { Stage::Verify };
+            checksum = adler32_z(checksum, blocks.data(), blocks.size());
+        }
+
+        imbin::Header header;
+        header.width = image.width;
+        header.height = image.height;
+        header.format = settings.format;
+        header.codec = settings.storeBlocks ? imbin::Codec::Stored : imbin::Codec::Zlib;
+        header.uncompressedSize = blocks.size();
+        std::vector<imbin::ChunkData> chunks;
+        result.deflate = settings.deflate;
+        if (!settings.storeBlocks)
+        {
+            if (settings.deflate.automatic)
+            {
+                // a row of blocks is what the sampling takes for a row
+                StageScope scope { Stage::Deflate };
+                const std::size_t rowBytes { static_cast<std::size_t>((image.width + 3) / 4) * imbin::bytesPerBlock(settings.format) };
+                result.deflate = chooseDeflateSettings(blocks.data(), rowBytes, (image.height + 3) / 4, settings.deflate);
+            }
+            chunks.push_back({ imbin::deflateChunk, deflateChunkData(result.deflate) });
+        }
+        const bool indexed { !settings.storeBlocks && result.deflate.independentBlocks };
+        imbin::BlockIndex blockIndex;
+        if (indexed)
+        {
+            const std::size_t windowSize { static_cast<std::size_t>(1) << result.deflate.windowBits };
+            blockIndex = imbin::BlockIndex { header.uncompressedSize, std::max(result.deflate.blockSize, windowSize) };
+            chunks.push_back({ imbin::blockChunk, imbin::serializeBlockIndex(blockIndex) });
+        }
+        const std::unique_ptr<Output> out { open(header, chunks) };
+        if (settings.storeBlocks)
+        {
+            out->write(blocks.data(), blocks.size());
+        }
+        else
+        {
+            ByteBuffer zip;
+            {
+                StageScope scope { Stage::Deflate };
+                zip = deflateBuffer(blocks.data(), blocks.size(), result.deflate, indexed ? &blockIndex : nullptr);
+            }
+            out->write(zip.data(), zip.size());
+            if (indexed)
+            {
+                out->patchChunk(imbin::blockChunk, imbin::serializeBlockIndex(blockIndex));
+            }
+        }
+        result.outputBytes = out->finish();
+        return checksum;
+    }
+
+    // a single-colour image as just its pixel, stored (deflating 4 bytes would only add to them);
+    // returns the checksum of all the pixels for verification, as that is what the file decodes to
+    uLong encodeConstant(const Image &image, const OpenOutput &open, const ConversionSettings &settings, ConversionResult &result,
+                         const std::vector<imbin::ChunkData> &extraChunks)
+    {
+        uLong checksum { adler32(0, nullptr, 0) };
+        if (settings.verify)
+        {
+            StageScope scope { Stage::Verify };
+            checksum = adler32_z(checksum, image.pixels.data(), image.height * image.rowBytes);
+        }
+        imbin::Header header;
+        header.width = image.width;
+        header.height = image.height;
+        header.format = imbin::PixelFormat::Rgba8;
+        header.codec = imbin::Codec::Stored;
+        header.flags = imbin::flagConstant;
+        header.uncompressedSize = 4;
+        result.deflate = settings.deflate;
+        const std::unique_ptr<Output> out { open(header, extraChunks) };
+        out->write(image.pixels.data(), 4);
+        result.outputBytes = out->finish();
+        return checksum;
+    }
+
+    // a decoded image as the settings and its pixels make it: blocks, a single pixel, or rows (indices if it has
+    // few colours, RGB if it's opaque)
+    uLong encodeWhole(Image &image, const OpenOutput &open, const ConversionSettings &settings, ConversionResult &result)
+    {
+        if (imbin::isBlockFormat(settings.format))
+        {
+            return encodeBlocks(image, open, settings, result);
+        }
+        if (image.constant && !settings.keepRgba)
+        {
+            return encodeConstant(image, open, settings, result, mipChunks(image, settings));
+        }
+        ImageRows rows { image };
+        if (!image.palette.empty() && !settings.keepRgba)
+        {
+            // the colours in the order the decoder found them, which the indices follow
+            ColorSet colors;
+            colors.add(reinterpret_cast<const unsigned char*>(image.palette.data()), image.palette.size());
+            return encode(rows, image.width, image.height, image.rowBytes, image.opaque, &colors, open, settings, result,
+                          mipChunks(image, settings));
+        }
+        return encode(rows, image.width, image.height, image.rowBytes, image.opaque, nullptr, open, settings, result,
+                      mipChunks(image, settings));
+    }
+
+    // a frame of a sequence between its PNG and the file
+    struct SequenceFrame
+    {
+        ConversionResult result;
+        Image image;
+        uLong checksum { 0 };
+        std::uint32_t changedTiles { 0 };
+        std::vector<unsigned char> bitmap;
+        ByteBuffer delta;
+        bool key { false };
+        ByteBuffer zip;
+    };
+
+    // reads every frame back and compares it with the checksum of its source pixels
+    void verifySequence(const std::filesystem::path &output, const std::vector<uLong> &checksums)
+    {
+        StageScope scope { Stage::Verify };
+        imbin::SequenceReader reader { imbin::SequenceReader::open(output) };
+        if (reader.frameCount() != checksums.size())
+        {
+            throw ConversionError("verification failed: the number of frames differs from the source");
+        }
+        for (std::size_t i = 0; i < checksums.size(); i++)
+        {
+            const imbin::Image &frame { reader.next() };
+            if (adler32_z(adler32(0, nullptr, 0), frame.pixels.data(), frame.pixels.size()) != checksums[i])
+            {
+                throw ConversionError("verification failed: decoded pixels of frame " + std::to_string(i) + " differ from the source");
+            }
+        }
+    }
+}
+
+ConversionResult convertFile(const std::filesystem::path &input, const std::filesystem::path &output,
+                             const ConversionSettings &settings)
+{
+    ConversionResult result;
+    const std::uint64_t allocatedBefore { threadAllocationCounts().system };
+    StageRecorder recorder { settings.keepSpans };
+    if (settings.recordStages)
+    {
+        recorder.start();
+    }
+    try
+    {
+        std::ifstream file;
+        std::unique_ptr<MappedFile> mapped;
+        std::unique_ptr<PngReader> readerPtr;
+        if (settings.input == InputMethod::Mapped)
+        {
+            {
+                StageScope scope { Stage::Read };
+                mapped = std::make_unique<MappedFile>(input);
+            }
+            StageScope scope { Stage::Decode };
+            readerPtr = std::make_unique<PngReader>(mapped->data(), mapped->size());
+            result.inputBytes = mapped->size();
+        }
+        else
+        {
+            {
+                StageScope scope { Stage::Read };
+                file.open(input, std::ios::binary);
+                if (!file)
+                {
+                    throw ConversionError("couldn't open the file");
+                }
+            }
+            StageScope scope { Stage::Decode };
+            readerPtr = std::make_unique<PngReader>(file);
+            result.inputBytes = std::filesystem::file_size(input);
+        }
+        PngReader &reader { *readerPtr };
+        const Region crop { cropRegion(settings.region, reader.width(), reader.height()) };
+        const std::size_t rowBytes { static_cast<std::size_t>(crop.width) * 4 };
+        result.width = crop.width;
+        result.height = crop.height;
+        result.rawBytes = static_cast<std::uint64_t>(crop.height) * rowBytes;
+
+        const OpenOutput open { [&output](const imbin::Header &header, const std::vector<imbin::ChunkData> &chunks)
+        {
+            return std::unique_ptr<Output> { std::make_unique<OutputFile>(output, header, chunks) };
+        } };
+        uLong checksum { 0 };
+        if (settings.streaming && !reader.interlaced() && !imbin::isBlockFormat(settings.format))
+        {
+            PngRows rows { reader, crop };
+            checksum = encode(rows, crop.width, crop.height, rowBytes, reader.opaqueSource(), nullptr, open, settings, result);
+        }
+        else
+        {
+            Image image;
+            {
+                StageScope scope { Stage::Decode };
+                reader.readRegion(image, crop.x, crop.y, crop.width, crop.height);
+                readerPtr.reset();
+                mapped.reset();
+                file.close();
+            }
+            checksum = encodeWhole(image, open, settings, result);
+        }
+        if (settings.verify)
+        {
+            verifyOutput(output, checksum);
+        }
+        result.ok = true;
+    }
+    catch (const std::exception &ex) // std::bad_alloc and filesystem errors shouldn't take the whole batch down either
+    {
+        result.error = ex.what();
+    }
+    if (settings.recordStages)
+    {
+        recorder.stop();
+        result.times = recorder.times();
+    }
+    result.allocations = threadAllocationCounts().system - allocatedBefore;
+    return result;
+}
+
+ByteBuffer readPng(const std::filesystem::path &input, ConversionResult &result)
+{
+    StageScope scope { Stage::Read };
+    std::ifstream file { input, std::ios::binary | std::ios::ate };
+    if (!file)
+    {
+        throw ConversionError("couldn't open the file");
+    }
+    ByteBuffer png(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(png.data()), static_cast<std::streamsize>(png.size())))
+    {
+        throw ConversionError("couldn't read the file");
+    }
+    result.inputBytes = png.size();
+    return png;
+}
+
+Image decodeImage(const ByteBuffer &png, const ConversionSettings &settings, ConversionResult &result)
+{
+    StageScope scope { Stage::Decode };
+    PngReader reader { png.data(), png.size() };
+    const Region crop { cropRegion(settings.region, reader.width(), reader.height()) };
+    Image image;
+    reader.readRegion(image, crop.x, crop.y, crop.width, crop.height);
+    result.width = image.width;
+    result.height = image.height;
+    result.rawBytes = static_cast<std::uint64_t>(image.height) * image.rowBytes;
+    return image;
+}
+
+EncodedImage encodeImage(Image &image, const ConversionSettings &settings, ConversionResult &result)
+{
+    EncodedImage encoded;
+    const OpenOutput open { [&encoded](const imbin::Header &header, const std::vector<imbin::ChunkData> &chunks)
+    {
+        return std::unique_ptr<Output> { std::make_unique<OutputMemory>(header, chunks, &encoded) };
+    } };
+    const uLong checksum { encodeWhole(image, open, settings, result) };
+    encoded.sourceChecksum = static_cast<std::uint32_t>(checksum);
+    return encoded;
+}
+
+void writeEncoded(const std::filesystem::path &output, const EncodedImage &encoded, const ConversionSettings &settings)
+{
+    {
+        StageScope scope { Stage::Write };
+        std::ofstream out { output, std::ios::binary };
+        if (!out)
+        {
+            throw ConversionError("couldn't open " + output.string() + " for writing");
+        }
+        out.write(reinterpret_cast<const char*>(encoded.header.data()), static_cast<std::streamsize>(encoded.header.size()));
+        out.write(reinterpret_cast<const char*>(encoded.payload.data()), static_cast<std::streamsize>(encoded.payload.size()));
+        out.close();
+        if (!out)
+        {
+            throw ConversionError("couldn't write " + output.string());
+        }
+    }
+    if (settings.verify)
+    {
+        verifyOutput(output, encoded.sourceChecksum);
+    }
+}
+
+std::size_t convertStream(int fd, std::ostream &out, const ConversionSettings &settings,
+                          const std::function<void(const ConversionResult&)> &converted)
+{
+    ConversionSettings streaming { settings };
+    streaming.streaming = true;
+    streaming.verify = false;
+    PipeInput input { fd };
+    std::size_t count { 0 };
+    for (;;)
+    {
+        // nothing is timed while waiting for the first byte of the next image
+        if (input.size() == 0 && !input.fill())
+        {
+            return count;
+        }
+
+        ConversionResult result;
+        const std::uint64_t consumedBefore { input.consumed() };
+        const std::uint64_t allocatedBefore { threadAllocationCounts().system };
+        StageRecorder recorder { streaming.keepSpans };
+        if (streaming.recordStages)
+        {
+            recorder.start();
+        }
+        try
+        {
+            PngPushReader reader;
+            {
+                StageScope scope { Stage::Decode };
+                while (!reader.started())
+                {
+                    if (!feedMore(reader, input))
+                    {
+                        throw ConversionError("unexpected end of input");
+                    }
+                }
+            }
+            result.width = reader.width();
+            result.height = reader.height();
+            result.rawBytes = static_cast<std::uint64_t>(reader.height()) * reader.rowBytes();
+
+            PushRows rows { reader, input };
+            encode(rows, reader.width(), reader.height(), reader.rowBytes(), reader.opaqueSource(), nullptr,
+                   [&out](const imbin::Header &header, const std::vector<imbin::ChunkData> &chunks)
+                   {
+                       return std::unique_ptr<Output> { std::make_unique<OutputStream>(out, header, chunks) };
+                   },
+                   streaming, result);
+            // chunks after the last row, up to IEND
+            StageScope scope { Stage::Decode };
+            while (!reader.finished())
+            {
+                if (!feedMore(reader, input))
+                {
+                    throw ConversionError("unexpected end of input");
+                }
+            }
+            result.ok = true;
+        }
+        catch (const std::exception &ex)
+        {
+            result.error = ex.what();
+        }
+        if (streaming.recordStages)
+        {
+            recorder.stop();
+            result.times = recorder.times();
+        }
+        result.inputBytes = input.consumed() - consumedBefore;
+        result.allocations = threadAllocationCounts().system - allocatedBefore;
+        count++;
+        converted(result);
+        if (!result.ok)
+        {
+            // there's no telling where the next image would start
+            return count;
+        }
+    }
+}
+
+SequenceResult convertSequence(const std::vector<std::filesystem::path> &frames, const std::filesystem::path &output,
+                               const ConversionSettings &settings, const SequenceSettings &sequence)
+{
+    SequenceResult sequenceResult;
+    ConversionResult &result { sequenceResult.total };
+    const std::uint64_t allocatedBefore { threadAllocationCounts().system };
+    try
+    {
+        if (frames.empty())
+        {
+            throw ConversionError("no frames");
+        }
+        const unsigned threads { std::max(settings.deflate.threads, 1u) };
+        // every frame is a single stream, the frames are what's done in parallel
+        DeflateSettings deflate { settings.deflate };
+        deflate.threads = 1;
+        deflate.independentBlocks = false;
+
+        // a window of frames at a time, and the last one of the window before for the first delta
+        std::vector<SequenceFrame> window(threads);
+        Image previous;
+        std::unique_ptr<Output> out;
+        imbin::FrameIndex index;
+        index.keyframeInterval = std::max(sequence.keyframeInterval, 1u);
+        index.tileWidth = sequence.tileWidth;
+        index.tileHeight = sequence.tileHeight;
+        index.frames.resize(frames.size());
+        std::size_t tiles { 0 };
+        std::uint32_t sinceKeyframe { 0 };
+        std::uint64_t payloadSize { 0 };
+        std::vector<uLong> checksums;
+
+        for (std::size_t start = 0; start < frames.size(); start += threads)
+        {
+            const std::size_t count { std::min<std::size_t>(threads, frames.size() - start) };
+            parallelFor(count, threads, [&](std::size_t i)
+            {
+                SequenceFrame &frame { window[i] };
+                frame.result = {};
+                try
+                {
+                    const ByteBuffer png { readPng(frames[start + i], frame.result) };
+                    frame.image = decodeImage(png, settings, frame.result);
+                }
+                catch (const std::exception &ex)
+                {
+                    frame.result.error = ex.what();
+                }
+            });
+            for (std::size_t i = 0; i < count; i++)
+            {
+                SequenceFrame &frame { window[i] };
+                const std::string name { frames[start + i].string() };
+                if (!frame.result.error.empty())
+                {
+                    throw ConversionError(name + ": " + frame.result.error);
+                }
+                if (start + i == 0)
+                {
+                    result.width = frame.image.width;
+                    result.height = frame.image.height;
+                    tiles = static_cast<std::size_t>((result.width + index.tileWidth - 1) / index.tileWidth)
+                        * ((result.height + index.tileHeight - 1) / index.tileHeight);
+                }
+                else if (frame.image.width != result.width || frame.image.height != result.height)
+                {
+                    throw ConversionError(name + ": " + std::to_string(frame.image.width) + "x" + std::to_string(frame.image.height)
+                        + " isn't the size of the first frame");
+                }
+                result.inputBytes += frame.result.inputBytes;
+                result.rawBytes += frame.result.rawBytes;
+                if (settings.verify)
+                {
+                    StageScope scope { Stage::Verify };
+                    checksums.push_back(adler32_z(adler32(0, nullptr, 0), frame.image.pixels.data(), frame.result.rawBytes));
+                }
+            }
+
+            if (!out)
+            {
+                const Image &first { window[0].image };
+                {
+                    StageScope scope { Stage::Deflate };
+                    result.deflate = deflate.automatic ? chooseDeflateSettings(first.pixels.data(), first.rowBytes, first.height, deflate) : deflate;
+                }
+                result.deflate.threads = 1;
+                result.deflate.independentBlocks = false;
+                imbin::Header header;
+                header.width = result.width;
+                header.height = result.height;
+                header.format = imbin::PixelFormat::Rgba8;
+                header.codec = imbin::Codec::ZlibSequence;
+                header.uncompressedSize = static_cast<std::uint64_t>(first.height) * first.rowBytes;
+                // written empty, patched once all the frames are compressed
+                out = std::make_unique<OutputFile>(output, header, std::vector<imbin::ChunkData> {
+                    { imbin::deflateChunk, deflateChunkData(result.deflate) },
+                    { imbin::frameChunk, imbin::serializeFrameIndex(index) }
+                });
+            }
+
+            // the deltas don't depend on one another, only on the decoded frames
+            parallelFor(count, threads, [&](std::size_t i)
+            {
+                SequenceFrame &frame { window[i] };
+                if (start + i > 0)
+                {
+                    StageScope scope { Stage::Transform };
+                    const Image &before { i > 0 ? window[i - 1].image : previous };
+                    frame.changedTiles = frameDelta(frame.image.pixels.data(), before.pixels.data(), result.width, result.height,
+                                                    index.tileWidth, index.tileHeight, frame.bitmap, frame.delta);
+                }
+            });
+            // a cut (most of the tiles changed) is cheaper as a keyframe, and the interval counts from there
+            for (std::size_t i = 0; i < count; i++)
+            {
+                SequenceFrame &frame { window[i] };
+                frame.key = start + i == 0 || sinceKeyframe + 1 >= index.keyframeInterval
+                    || static_cast<std::size_t>(frame.changedTiles) * 4 > tiles * 3;
+                sinceKeyframe = frame.key ? 0 : sinceKeyframe + 1;
+            }
+            parallelFor(count, threads, [&](std::size_t i)
+            {
+                SequenceFrame &frame { window[i] };
+                StageScope scope { Stage::Deflate };
+                if (frame.key)
+                {
+                    frame.zip = deflateBuffer(frame.image.pixels.data(), static_cast<std::size_t>(frame.result.rawBytes), result.deflate);
+                }
+                else if (frame.changedTiles > 0)
+                {
+                    frame.zip = deflateBuffer(frame.delta.data(), frame.delta.size(), result.deflate);
+                }
+                else
+                {
+                    frame.zip.clear();
+                }
+            });
+
+            for (std::size_t i = 0; i < count; i++)
+            {
+                SequenceFrame &frame { window[i] };
+                imbin::FrameIndex::Entry &entry { index.frames[start + i] };
+                entry.offset = payloadSize;
+                if (frame.key)
+                {
+                    entry.kind = imbin::FrameIndex::Kind::Key;
+                    sequenceResult.keyframes++;
+                }
+                else
+                {
+                    entry.kind = imbin::FrameIndex::Kind::Delta;
+                    entry.changedTiles = frame.changedTiles;
+                    sequenceResult.tiles += tiles;
+                    sequenceResult.changedTiles += frame.changedTiles;
+                    out->write(frame.bitmap.data(), frame.bitmap.size());
+                    payloadSize += frame.bitmap.size();
+                }
+                out->write(frame.zip.data(), frame.zip.size());
+                payloadSize += frame.zip.size();
+                entry.size = payloadSize - entry.offset;
+            }
+            std::swap(previous, window[count - 1].image);
+            sequenceResult.frames += static_cast<std::uint32_t>(count);
+        }
+
+        out->patchChunk(imbin::frameChunk, imbin::serializeFrameIndex(index));
+        result.outputBytes = out->finish();
+        out.reset();
+        if (settings.verify)
+        {
+            verifySequence(output, checksums);
+        }
+        result.ok = true;
+    }
+    catch (const std::exception &ex)
+    {
+        result.error = ex.what();
+    }
+    result.allocations = threadAllocationCounts().system - allocatedBefore;
+    return sequenceResult;
+}
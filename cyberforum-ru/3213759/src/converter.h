@@ -0,0 +1,162 @@
+#ifndef CONVERTER_H
+#define CONVERTER_H
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "block_encoder.h"
+#include "deflate.h"
+#include "image.h"
+#include "memory_pool.h"
+#include "mipmap.h"
+#include "stats.h"
+#include <imbin/format.h>
+
+enum class InputMethod
+{
+    Mapped, // the whole file is memory-mapped and libpng reads straight from the mapping
+    Stream // std::ifstream, for filesystems where mapping isn't a good idea
+};
+
+// a rectangle of an image in pixels, empty for the whole image
+struct Region
+{
+    std::uint32_t x { 0 };
+    std::uint32_t y { 0 };
+    std::uint32_t width { 0 };
+    std::uint32_t height { 0 };
+
+    bool empty() const { return width == 0 || height == 0; }
+};
+
+struct ConversionSettings
+{
+    InputMethod input { InputMethod::Mapped };
+    DeflateSettings deflate;
+    // decode row by row straight into an incremental deflate, so memory doesn't depend on the image height;
+    // interlaced images still have to be decoded whole
+    bool streaming { false };
+    // PlanarRows puts the channels of every row one after another, which deflate finds longer matches in
+    imbin::Layout layout { imbin::Layout::Interleaved };
+    // PNG-style prediction filters, picked per row (per row of a tile when tiled)
+    bool filterRows { false };
+    // only this part of every image is converted (cut to the image, it's an error if none of it is inside):
+    // the rows above it are decoded and dropped, the ones below aren't decoded at all, and only its columns are
+    // converted to RGBA; width and height in the results are those of the part
+    Region region;
+    // non-zero for tiled output, every tile is compressed on its own so readers can decode just a region
+    std::uint32_t tileWidth { 0 };
+    std::uint32_t tileHeight { 0 };
+    // the mip levels of every image down to 1x1, made from the decoded pixels and stored in front of the payload;
+    // needs the whole image, so it doesn't go with streaming
+    MipFilter mips { MipFilter::None };
+    // Rgba8, or one of the block formats for GPUs, which are encoded from the whole image (so it isn't streamed),
+    // as a single stream that isn't tiled, split into planes or filtered, and can go without mips
+    imbin::PixelFormat format { imbin::PixelFormat::Rgba8 };
+    BlockQuality blockQuality { BlockQuality::Normal };
+    // the blocks go into the file as they are (the Stored codec), so they can be uploaded straight from a mapping
+    bool storeBlocks { false };
+    // Rgba8 images found to be opaque while decoding (or known to be from the colour type of the PNG, which is
+    // all there is to go by when streaming) are stored as RGB (flagOpaque, not with the planar layout), and the ones
+    // found to be a single colour as just that pixel (flagConstant, whatever the tiles, layout and filters), and
+    // the ones with 256 colours or fewer as indices into a palette (flagIndexed, whole images only, the layout is
+    // interleaved then); this keeps every pixel as RGBA, for readers that don't know those flags
+    bool keepRgba { false };
+    // read the result back and compare it with the source pixels
+    bool verify { false };
+    // time every stage into ConversionResult::times, with a span for every one of them if asked to
+    bool recordStages { false };
+    bool keepSpans { false };
+};
+
+// outcome of converting one PNG, failures are reported here instead of being thrown
+struct ConversionResult
+{
+    bool ok { false };
+    std::string error;
+
+    std::uint32_t width { 0 };
+    std::uint32_t height { 0 };
+    std::uint64_t inputBytes { 0 };
+    std::uint64_t rawBytes { 0 };
+    std::uint64_t outputBytes { 0 };
+    // what the image was actually compressed with (differs from the requested settings in the automatic mode)
+    DeflateSettings deflate;
+    // only with ConversionSettings::recordStages
+    StageTimes times;
+    // blocks the memory pool of the converting thread had to get from the system (see memory_pool.h),
+    // close to none once the thread has converted an image of the same size; parallel helpers aren't counted
+    std::uint64_t allocations { 0 };
+};
+
+// PNG -> im.bin v2 (see include/imbin/format.h)
+ConversionResult convertFile(const std::filesystem::path &input, const std::filesystem::path &output,
+                             const ConversionSettings &settings);
+
+// a whole im.bin file in memory
+struct EncodedImage
+{
+    // with the chunk table and the chunks
+    std::vector<unsigned char> header;
+    ByteBuffer payload;
+    // adler32 of the source pixels, for verifying the written file
+    std::uint32_t sourceChecksum { 0 };
+};
+
+// convertFile() split into its stages, so they can run on different threads one image after another (see
+// pipeline.h); every one of them throws ConversionError and fills in its part of the result, and is timed
+// by the StageRecorder running on its thread, if there is one
+
+// the whole file, with plain reads (no mapping), so it can be fetched ahead of the decoding
+ByteBuffer readPng(const std::filesystem::path &input, ConversionResult &result);
+// just the region of the settings, if there is one
+Image decodeImage(const ByteBuffer &png, const ConversionSettings &settings, ConversionResult &result);
+// transformed and deflated into memory, the pixels are modified in place
+EncodedImage encodeImage(Image &image, const ConversionSettings &settings, ConversionResult &result);
+// and verified, if the settings ask for it
+void writeEncoded(const std::filesystem::path &output, const EncodedImage &encoded, const ConversionSettings &settings);
+
+// PNGs one after another from a descriptor that doesn't have to be seekable (a pipe, stdin), each one decoded
+// with libpng's progressive reader as its bytes arrive and deflated row by row (always in the streaming mode),
+// written to out as complete im.bin files one after another; as the header in front of the payload has its size
+// and the chunks that are only known at the end, the compressed payload of an image is kept until its last row;
+// converted gets the result of every PNG as soon as it's written, failures included, and nothing is converted after
+// a failure (there's no telling where the next image would start); returns the number of PNGs, no verification
+std::size_t convertStream(int fd, std::ostream &out, const ConversionSettings &settings,
+                          const std::function<void(const ConversionResult&)> &converted);
+
+struct SequenceSettings
+{
+    // a keyframe at least every that many frames, which is as far as random access has to go back;
+    // a frame where most of the tiles changed (a cut) is a keyframe too, and starts the count again
+    std::uint32_t keyframeInterval { 30 };
+    // the deltas are made of the tiles that differ from the frame before
+    std::uint32_t tileWidth { 64 };
+    std::uint32_t tileHeight { 64 };
+};
+
+struct SequenceResult
+{
+    // everything summed up over the frames, width and height of every one of them
+    ConversionResult total;
+    std::uint32_t frames { 0 };
+    std::uint32_t keyframes { 0 };
+    // of the delta frames
+    std::uint64_t tiles { 0 };
+    std::uint64_t changedTiles { 0 };
+};
+
+// PNGs of the same size -> one ZlibSequence im.bin (see include/imbin/format.h) with the frames in the given order,
+// keyframes deflated whole and the frames between them as deltas against the frame before; a few frames at a time
+// are decoded, diffed and deflated in parallel, on as many threads as the deflate settings have (every frame is one
+// zlib stream), so the memory is a few frames whatever the length; the tile size, layout, filters and streaming
+// mode of the settings don't apply, and in the automatic mode the deflate settings are picked on the first frame;
+// a frame that fails fails the whole sequence
+SequenceResult convertSequence(const std::vector<std::filesystem::path> &frames, const std::filesystem::path &output,
+                               const ConversionSettings &settings, const SequenceSettings &sequence);
+
+#endif // CONVERTER_H
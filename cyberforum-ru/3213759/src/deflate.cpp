@@ -0,0 +1,495 @@
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+#ifdef USING_PACKAGE_MANAGER
+    #include <zlib/zlib.h>
+#else
+    #include <zlib.h>
+#endif
+
+#include "deflate.h"
+#include "errors.h"
+#include "memory_pool.h"
+#include "thread_pool.h"
+
+namespace
+{
+    int zlibStrategy(DeflateStrategy strategy)
+    {
+        switch (strategy)
+        {
+        case DeflateStrategy::Filtered: return Z_FILTERED;
+        case DeflateStrategy::Rle: return Z_RLE;
+        case DeflateStrategy::HuffmanOnly: return Z_HUFFMAN_ONLY;
+        default: return Z_DEFAULT_STRATEGY;
+        }
+    }
+
+    // the window, the hash chains and the pending buffer of every stream come from the thread's pool
+    voidpf zlibAlloc(voidpf, uInt items, uInt size)
+    {
+        return poolAllocate(static_cast<std::size_t>(items) * size);
+    }
+
+    void zlibFree(voidpf, voidpf block)
+    {
+        poolFree(block);
+    }
+
+    // windowBits > 0 for a zlib stream, < 0 for raw deflate
+    void initDeflate(z_stream &stream, const DeflateSettings &settings, int windowBits)
+    {
+        stream.zalloc = zlibAlloc;
+        stream.zfree = zlibFree;
+        stream.opaque = nullptr;
+        int r { deflateInit2(&stream, settings.level, Z_DEFLATED, windowBits, settings.memLevel,
+                             zlibStrategy(settings.strategy)) };
+        if (r != Z_OK)
+        {
+            throw ConversionError("deflateInit2 error " + std::to_string(r));
+        }
+    }
+
+    // a window and a hash table bigger than the input only cost clearing them, which is most of the time of
+    // deflating a few KB; the output is the same as long as the whole input fits in the window and the
+    // literal buffer (memLevel + 6 bits) holds as many symbols as there are bytes, so blocks aren't split more often
+    DeflateSettings fitToInput(DeflateSettings settings, std::size_t size)
+    {
+        // deflate keeps MIN_LOOKAHEAD (262) bytes of the window free
+        int bits { 9 };
+        while (bits < settings.windowBits && (static_cast<std::size_t>(1) << bits) < size + 262)
+        {
+            bits++;
+        }
+        settings.memLevel = std::min(settings.memLevel, std::max(1, bits - 6));
+        settings.windowBits = bits;
+        return settings;
+    }
+
+    // the deflate streams of the calling thread, kept between images: deflateReset() leaves the state allocated
+    // and only clears the hash table, so taking a stream that was set up with the same parameters before skips
+    // the deflateInit2()/deflateEnd() pair, which is most of the cost of compressing an image of a few KB
+    class StreamCache
+    {
+    public:
+        StreamCache()
+        {
+            // the streams free their state into the pool when the thread ends, so the pool has to outlive the cache
+            threadAllocationCounts();
+        }
+
+        ~StreamCache()
+        {
+            for (const auto &entry : m_entries)
+            {
+                deflateEnd(&entry->stream);
+            }
+        }
+
+        StreamCache(const StreamCache&) = delete;
+        StreamCache& operator=(const StreamCache&) = delete;
+
+        z_stream* acquire(const DeflateSettings &settings, int windowBits)
+        {
+            const int strategy { zlibStrategy(settings.strategy) };
+            for (std::size_t i = 0; settings.reuseStreams && i < m_entries.size(); i++)
+            {
+                Entry &entry { *m_entries[i] };
+                if (entry.busy || entry.level != settings.level || entry.memLevel != settings.memLevel
+                    || entry.windowBits != windowBits || entry.strategy != strategy)
+                {
+                    continue;
+                }
+                if (deflateReset(&entry.stream) != Z_OK)
+                {
+                    // not supposed to happen, but a stream zlib doesn't like isn't worth keeping
+                    remove(i);
+                    break;
+                }
+                entry.busy = true;
+                return &entry.stream;
+            }
+
+            auto entry { std::make_unique<Entry>() };
+            initDeflate(entry->stream, settings, windowBits);
+            entry->level = settings.level;
+            entry->memLevel = settings.memLevel;
+            entry->windowBits = windowBits;
+            entry->strategy = strategy;
+            entry->busy = true;
+            entry->keep = settings.reuseStreams;
+            // the automatic mode tries a few parameter sets per image, more than that are unlikely to come back
+            for (std::size_t i = 0; m_entries.size() >= maxEntries && i < m_entries.size();)
+            {
+                if (m_entries[i]->busy) { i++; } else { remove(i); }
+            }
+            m_entries.push_back(std::move(entry));
+            return &m_entries.back()->stream;
+        }
+
+        void release(z_stream *stream)
+        {
+            for (std::size_t i = 0; i < m_entries.size(); i++)
+            {
+                if (&m_entries[i]->stream == stream)
+                {
+                    m_entries[i]->busy = false;
+                    if (!m_entries[i]->keep)
+                    {
+                        remove(i);
+                    }
+                    return;
+                }
+            }
+        }
+
+    private:
+        struct Entry
+        {
+            z_stream stream {};
+            int level { 0 };
+            int memLevel { 0 };
+            int windowBits { 0 };
+            int strategy { 0 };
+            bool busy { false };
+            bool keep { true };
+        };
+
+        static constexpr std::size_t maxEntries { 8 };
+
+        void remove(std::size_t i)
+        {
+            deflateEnd(&m_entries[i]->stream);
+            m_entries.erase(m_entries.begin() + static_cast<std::ptrdiff_t>(i));
+        }
+
+        std::vector<std::unique_ptr<Entry>> m_entries;
+    };
+
+    thread_local StreamCache streams;
+
+    // a stream of the thread's cache for the length of a scope, ready to compress
+    class ScopedStream
+    {
+    public:
+        ScopedStream(const DeflateSettings &settings, int windowBits)
+            : m_stream { streams.acquire(settings, windowBits) }
+        {}
+
+        ~ScopedStream()
+        {
+            streams.release(m_stream);
+        }
+
+        ScopedStream(const ScopedStream&) = delete;
+        ScopedStream& operator=(const ScopedStream&) = delete;
+
+        z_stream* get() const { return m_stream; }
+
+    private:
+        z_stream *m_stream;
+    };
+
+    // same as compress2(), but with all the parameters
+    ByteBuffer compressWhole(const unsigned char *data, std::size_t size, const DeflateSettings &settings)
+    {
+        const DeflateSettings fitted { fitToInput(settings, size) };
+        ScopedStream scoped { fitted, fitted.windowBits };
+        z_stream &stream { *scoped.get() };
+        ByteBuffer zip(deflateBound(&stream, static_cast<uLong>(size)));
+        stream.next_in = const_cast<Bytef*>(data);
+        stream.avail_in = 0;
+        stream.next_out = zip.data();
+        stream.avail_out = 0;
+        // avail_in and avail_out are 32-bit, so 4 GB and more (a big tile or mip level) go in slices
+        const std::size_t chunk { 1u << 30 };
+        std::size_t inputLeft { size };
+        std::size_t outputLeft { zip.size() };
+        int r { Z_OK };
+        do
+        {
+            if (stream.avail_in == 0 && inputLeft > 0)
+            {
+                stream.avail_in = static_cast<uInt>(std::min(inputLeft, chunk));
+                inputLeft -= stream.avail_in;
+            }
+            if (stream.avail_out == 0 && outputLeft > 0)
+            {
+                stream.avail_out = static_cast<uInt>(std::min(outputLeft, chunk));
+                outputLeft -= stream.avail_out;
+            }
+            r = deflate(&stream, inputLeft == 0 ? Z_FINISH : Z_NO_FLUSH);
+        }
+        while (r == Z_OK);
+        zip.resize(zip.size() - outputLeft - stream.avail_out);
+        if (r != Z_STREAM_END)
+        {
+            throw ConversionError("compression error " + std::to_string(r));
+        }
+        return zip;
+    }
+
+    // CPU time of the calling thread, so other workers don't skew the measurement
+    double threadCpuSeconds()
+    {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+        const auto ticks { [](const FILETIME &t) { return (static_cast<unsigned long long>(t.dwHighDateTime) << 32) | t.dwLowDateTime; } };
+        return (ticks(kernel) + ticks(user)) * 1e-7;
+#else
+        timespec t;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+        return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+    }
+
+    // raw deflate of one block, primed with the tail of the previous block so matches can cross the boundary;
+    // every block but the last one is ended with a sync flush, which byte-aligns it, so the pieces can be concatenated
+    ByteBuffer compressBlock(const unsigned char *data, std::size_t size,
+                             const unsigned char *dictionary, std::size_t dictionarySize,
+                             bool last, const DeflateSettings &settings)
+    {
+        // the zlib header of the whole stream has the full window, which is fine for blocks that use less of it
+        const DeflateSettings fitted { fitToInput(settings, dictionarySize + size) };
+        ScopedStream scoped { fitted, -fitted.windowBits };
+        z_stream &stream { *scoped.get() };
+        if (dictionarySize > 0)
+        {
+            deflateSetDictionary(&stream, dictionary, static_cast<uInt>(dictionarySize));
+        }
+
+        // a sync flush adds an empty stored block on top of the bound
+        ByteBuffer out(deflateBound(&stream, static_cast<uLong>(size)) + 16);
+        stream.next_in = const_cast<Bytef*>(data);
+        stream.avail_in = static_cast<uInt>(size);
+        stream.next_out = out.data();
+        stream.avail_out = static_cast<uInt>(out.size());
+        int r { deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH) };
+        const bool done { last ? r == Z_STREAM_END : (r == Z_OK && stream.avail_in == 0 && stream.avail_out > 0) };
+        out.resize(stream.total_out);
+        if (!done)
+        {
+            throw ConversionError("deflate error " + std::to_string(r));
+        }
+        return out;
+    }
+
+    // the 2-byte zlib header deflate() would have written for these settings
+    void putZlibHeader(ByteBuffer &out, const DeflateSettings &settings)
+    {
+        const unsigned cmf { static_cast<unsigned>((settings.windowBits - 8) << 4) | Z_DEFLATED };
+        const int level { settings.level == Z_DEFAULT_COMPRESSION ? 6 : settings.level };
+        unsigned flevel { settings.strategy == DeflateStrategy::Rle || settings.strategy == DeflateStrategy::HuffmanOnly || level < 2 ? 0u
+            : level < 6 ? 1u
+            : level == 6 ? 2u
+            : 3u };
+        unsigned flg { flevel << 6 };
+        flg += 31 - (cmf * 256 + flg) % 31;
+        out.push_back(static_cast<unsigned char>(cmf));
+        out.push_back(static_cast<unsigned char>(flg));
+    }
+}
+
+std::string describe(const DeflateSettings &settings)
+{
+    const char *strategies[] { "default", "filtered", "rle", "huffman" };
+    return "level " + std::to_string(settings.level)
+        + ", memLevel " + std::to_string(settings.memLevel)
+        + ", windowBits " + std::to_string(settings.windowBits)
+        + ", strategy " + strategies[static_cast<int>(settings.strategy)];
+}
+
+DeflateSettings chooseDeflateSettings(const unsigned char *data, std::size_t rowBytes, std::size_t rows,
+                                      const DeflateSettings &base)
+{
+    const DeflateStrategy D { DeflateStrategy::Default };
+    const DeflateStrategy F { DeflateStrategy::Filtered };
+    const DeflateStrategy R { DeflateStrategy::Rle };
+    const std::pair<int, DeflateStrategy> candidates[] {
+        { 1, D }, { 6, D }, { 9, D }, { 6, F }, { 9, F }, { 6, R }
+    };
+    // output this much bigger than the smallest one isn't worth any speed
+    const double sizeTolerance { 1.05 };
+
+    // up to 8 bands of rows, 256 KB in total, spread evenly so both the top and the bottom are represented
+    const std::size_t bands { std::min<std::size_t>(8, rows) };
+    const std::size_t rowsPerBand { std::max<std::size_t>(1, std::min(rows / std::max<std::size_t>(bands, 1),
+        (256 * 1024) / std::max<std::size_t>(bands * rowBytes, 1))) };
+    ByteBuffer sample;
+    sample.reserve(bands * rowsPerBand * rowBytes);
+    for (std::size_t b = 0; b < bands; b++)
+    {
+        const std::size_t firstRow { b * rows / bands };
+        const std::size_t n { std::min(rowsPerBand, rows - firstRow) };
+        sample.insert(sample.end(), data + firstRow * rowBytes, data + (firstRow + n) * rowBytes);
+    }
+
+    DeflateSettings chosen { base };
+    if (sample.empty())
+    {
+        return chosen;
+    }
+
+    struct Trial
+    {
+        DeflateSettings settings;
+        std::size_t size;
+        double seconds;
+    };
+    std::vector<Trial> trials;
+    std::size_t smallest { SIZE_MAX };
+    for (const auto &[level, strategy] : candidates)
+    {
+        DeflateSettings candidate { chosen };
+        candidate.level = level;
+        candidate.strategy = strategy;
+        const double started { threadCpuSeconds() };
+        const std::size_t size { compressWhole(sample.data(), sample.size(), candidate).size() };
+        trials.push_back({ candidate, size, threadCpuSeconds() - started });
+        smallest = std::min(smallest, size);
+    }
+
+    double bestScore { -1 };
+    for (const auto &trial : trials)
+    {
+        if (trial.size > smallest * sizeTolerance) { continue; }
+        const double ratio { static_cast<double>(sample.size()) / trial.size };
+        // clock resolution can make tiny samples look free
+        const double score { ratio / std::max(trial.seconds, 1e-6) };
+        if (score > bestScore)
+        {
+            bestScore = score;
+            chosen = trial.settings;
+        }
+    }
+    return chosen;
+}
+
+ByteBuffer deflateBuffer(const unsigned char *data, std::size_t size, const DeflateSettings &settings,
+                         imbin::BlockIndex *index)
+{
+    const std::size_t windowSize { static_cast<std::size_t>(1) << settings.windowBits };
+    const std::size_t blockSize { std::max(settings.blockSize, windowSize) };
+    if (!settings.independentBlocks && (settings.threads <= 1 || size <= blockSize))
+    {
+        return compressWhole(data, size, settings);
+    }
+
+    const std::size_t blockCount { std::max<std::size_t>(1, (size + blockSize - 1) / blockSize) };
+    std::vector<ByteBuffer> blocks(blockCount);
+    std::vector<uLong> checksums(blockCount);
+    parallelFor(blockCount, settings.threads, [&](std::size_t i)
+    {
+        const std::size_t offset { i * blockSize };
+        const std::size_t length { std::min(blockSize, size - offset) };
+        const std::size_t dictionarySize { settings.independentBlocks ? 0 : std::min(offset, windowSize) };
+        blocks[i] = compressBlock(data + offset, length, data + offset - dictionarySize, dictionarySize,
+                                  i + 1 == blockCount, settings);
+        checksums[i] = adler32(adler32(0, nullptr, 0), data + offset, static_cast<uInt>(length));
+    });
+
+    std::size_t total { 2 + 4 };
+    for (const auto &block : blocks)
+    {
+        total += block.size();
+    }
+    ByteBuffer out;
+    out.reserve(total);
+    putZlibHeader(out, settings);
+
+    if (index && settings.independentBlocks)
+    {
+        *index = imbin::BlockIndex { size, blockSize };
+    }
+    uLong checksum { checksums[0] };
+    for (std::size_t i = 0; i < blockCount; i++)
+    {
+        if (index && settings.independentBlocks)
+        {
+            index->blocks[i] = { out.size(), blocks[i].size() };
+        }
+        out.insert(out.end(), blocks[i].begin(), blocks[i].end());
+        if (i > 0)
+        {
+            const std::size_t length { std::min(blockSize, size - i * blockSize) };
+            checksum = adler32_combine(checksum, checksums[i], static_cast<z_off_t>(length));
+        }
+    }
+    // zlib trailer is big-endian
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        out.push_back(static_cast<unsigned char>((checksum >> shift) & 0xFF));
+    }
+    return out;
+}
+
+StreamingDeflater::StreamingDeflater(const DeflateSettings &settings, Sink sink, std::size_t bufferSize)
+    : m_sink { std::move(sink) },
+      m_buffer(bufferSize)
+{
+    // last, nothing can throw after it
+    m_stream = streams.acquire(settings, settings.windowBits);
+}
+
+StreamingDeflater::~StreamingDeflater()
+{
+    streams.release(static_cast<z_stream*>(m_stream));
+}
+
+void StreamingDeflater::write(const unsigned char *data, std::size_t size)
+{
+    z_stream *stream { static_cast<z_stream*>(m_stream) };
+    // avail_in is 32-bit
+    const std::size_t chunk { 1u << 30 };
+    while (size > 0)
+    {
+        const std::size_t length { std::min(size, chunk) };
+        stream->next_in = const_cast<Bytef*>(data);
+        stream->avail_in = static_cast<uInt>(length);
+        run(Z_NO_FLUSH);
+        data += length;
+        size -= length;
+    }
+}
+
+void StreamingDeflater::finish()
+{
+    z_stream *stream { static_cast<z_stream*>(m_stream) };
+    stream->next_in = nullptr;
+    stream->avail_in = 0;
+    run(Z_FINISH);
+}
+
+void StreamingDeflater::run(int flush)
+{
+    z_stream *stream { static_cast<z_stream*>(m_stream) };
+    int r;
+    do
+    {
+        stream->next_out = m_buffer.data();
+        stream->avail_out = static_cast<uInt>(m_buffer.size());
+        r = deflate(stream, flush);
+        if (r == Z_STREAM_ERROR)
+        {
+            throw ConversionError("deflate error " + std::to_string(r));
+        }
+        const std::size_t produced { m_buffer.size() - stream->avail_out };
+        if (produced > 0)
+        {
+            m_sink(m_buffer.data(), produced);
+            m_totalOut += produced;
+        }
+    }
+    while (stream->avail_out == 0 || (flush == Z_FINISH && r != Z_STREAM_END));
+}
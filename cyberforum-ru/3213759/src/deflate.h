@@ -0,0 +1,83 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "memory_pool.h"
+#include <imbin/format.h>
+
+enum class DeflateStrategy
+{
+    Default,
+    Filtered,
+    Rle,
+    HuffmanOnly
+};
+
+struct DeflateSettings
+{
+    int level { 9 }; // Z_BEST_COMPRESSION
+    int memLevel { 8 };
+    int windowBits { 15 };
+    DeflateStrategy strategy { DeflateStrategy::Default };
+    // pick the parameters above per image by trying a few candidates on a sample of it,
+    // in the chosen settings it says that they were picked that way
+    bool automatic { false };
+    // more than one splits the input into blocks that are deflated concurrently
+    unsigned threads { 1 };
+    std::size_t blockSize { 128 * 1024 };
+    // blocks aren't primed with the end of the previous one (and the input is split even on one thread),
+    // so readers can inflate them in parallel at the cost of a bit of ratio
+    bool independentBlocks { false };
+    // take the zlib streams from the ones the thread keeps between images (recycled with deflateReset())
+    // instead of setting up new ones, off only to measure what that saves
+    bool reuseStreams { true };
+};
+
+// "level 9, memLevel 8, windowBits 15, strategy default"
+std::string describe(const DeflateSettings &settings);
+
+// tries the candidate settings on a few bands of rows spread over the image and returns the one
+// with the best compression ratio per CPU second, among the ones within a few percent of the smallest output;
+// everything but the zlib parameters is taken from the base settings
+DeflateSettings chooseDeflateSettings(const unsigned char *data, std::size_t rowBytes, std::size_t rows,
+                                      const DeflateSettings &base);
+
+// produces a single zlib stream (the same thing compress2() makes), so uncompress() can read it either way;
+// with independent blocks their positions go to the index, if one is given; throws ConversionError
+ByteBuffer deflateBuffer(const unsigned char *data, std::size_t size, const DeflateSettings &settings,
+                         imbin::BlockIndex *index = nullptr);
+
+// incremental zlib compression for when the input doesn't fit in memory (or shouldn't be kept there),
+// compressed bytes are handed to the sink as soon as zlib produces them; throws ConversionError;
+// the stream is one of the calling thread's, so it has to be destroyed on the thread that created it
+class StreamingDeflater
+{
+public:
+    using Sink = std::function<void(const unsigned char *data, std::size_t size)>;
+
+    StreamingDeflater(const DeflateSettings &settings, Sink sink, std::size_t bufferSize = 64 * 1024);
+    ~StreamingDeflater();
+
+    StreamingDeflater(const StreamingDeflater&) = delete;
+    StreamingDeflater& operator=(const StreamingDeflater&) = delete;
+
+    void write(const unsigned char *data, std::size_t size);
+    // flushes everything that's left and writes the trailer
+    void finish();
+
+    std::size_t totalOut() const { return m_totalOut; }
+
+private:
+    void run(int flush);
+
+    void *m_stream { nullptr };
+    Sink m_sink;
+    ByteBuffer m_buffer;
+    std::size_t m_totalOut { 0 };
+};
+
+#endif // DEFLATE_H
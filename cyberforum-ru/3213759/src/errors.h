@@ -0,0 +1,13 @@
+#ifndef ERRORS_H
+#define ERRORS_H
+
+#include <stdexcept>
+
+// thrown for anything wrong with a particular input file, so a batch can carry on with the next one
+class ConversionError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+#endif // ERRORS_H
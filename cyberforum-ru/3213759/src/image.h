@@ -0,0 +1,25 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "memory_pool.h"
+
+// decoded 8-bit RGBA pixels, rows are stored one after another without padding;
+// the pixels come from the pool, so the next image decoded on the thread gets the same memory back
+struct Image
+{
+    std::uint32_t width { 0 };
+    std::uint32_t height { 0 };
+    std::size_t rowBytes { 0 };
+    ByteBuffer pixels;
+    // what the decoder noticed while converting the rows: every alpha is 255, every pixel is the same, and the
+    // colours when there are no more than 256 of them (in the order they first appear, empty otherwise)
+    bool opaque { false };
+    bool constant { false };
+    std::vector<std::uint32_t> palette;
+};
+
+#endif // IMAGE_H
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cstring>
+
+#include <imbin/blocks.h>
+#include <imbin/parallel.h>
+
+namespace imbin
+{
+    namespace
+    {
+        // interpolation weights of the 4-bit BC7 indices, out of 64
+        const unsigned bc7Weights[16] { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+        std::uint64_t getU64(const unsigned char *p)
+        {
+            std::uint64_t v { 0 };
+            for (int i = 7; i >= 0; i--)
+            {
+                v = v << 8 | p[i];
+            }
+            return v;
+        }
+
+        void expand565(unsigned color, unsigned char *rgb)
+        {
+            const unsigned r { color >> 11 & 31 };
+            const unsigned g { color >> 5 & 63 };
+            const unsigned b { color & 31 };
+            rgb[0] = static_cast<unsigned char>(r << 3 | r >> 2);
+            rgb[1] = static_cast<unsigned char>(g << 2 | g >> 4);
+            rgb[2] = static_cast<unsigned char>(b << 3 | b >> 2);
+        }
+
+        // the colour half of BC1 and BC3 blocks; BC3 ones always have four colours and leave the alpha alone
+        void decodeColor(const unsigned char *block, unsigned char *rgba, bool bc1)
+        {
+            const unsigned c0 { block[0] | static_cast<unsigned>(block[1]) << 8 };
+            const unsigned c1 { block[2] | static_cast<unsigned>(block[3]) << 8 };
+            unsigned char palette[4][4] {};
+            expand565(c0, palette[0]);
+            expand565(c1, palette[1]);
+            palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+            for (int c = 0; c < 3; c++)
+            {
+                const unsigned a { palette[0][c] };
+                const unsigned b { palette[1][c] };
+                if (c0 > c1 || !bc1)
+                {
+                    palette[2][c] = static_cast<unsigned char>((2 * a + b + 1) / 3);
+                    palette[3][c] = static_cast<unsigned char>((a + 2 * b + 1) / 3);
+                }
+                else
+                {
+                    palette[2][c] = static_cast<unsigned char>((a + b + 1) / 2);
+                }
+            }
+            if (c0 <= c1 && bc1)
+            {
+                // transparent black
+                palette[3][3] = 0;
+            }
+            const std::uint32_t indices { block[4] | static_cast<std::uint32_t>(block[5]) << 8
+                | static_cast<std::uint32_t>(block[6]) << 16 | static_cast<std::uint32_t>(block[7]) << 24 };
+            for (int i = 0; i < 16; i++)
+            {
+                std::memcpy(rgba + i * 4, palette[indices >> (i * 2) & 3], bc1 ? 4 : 3);
+            }
+        }
+
+        // the alpha half of BC3 blocks: 8 levels between the endpoints, or 6 and 0 and 255 if the first one isn't bigger
+        void decodeAlpha(const unsigned char *block, unsigned char *rgba)
+        {
+            const unsigned a0 { block[0] };
+            const unsigned a1 { block[1] };
+            unsigned char levels[8] { static_cast<unsigned char>(a0), static_cast<unsigned char>(a1) };
+            if (a0 > a1)
+            {
+                for (unsigned k = 1; k <= 6; k++)
+                {
+                    levels[k + 1] = static_cast<unsigned char>(((7 - k) * a0 + k * a1 + 3) / 7);
+                }
+            }
+            else
+            {
+                for (unsigned k = 1; k <= 4; k++)
+                {
+                    levels[k + 1] = static_cast<unsigned char>(((5 - k) * a0 + k * a1 + 2) / 5);
+                }
+                levels[6] = 0;
+                levels[7] = 255;
+            }
+            const std::uint64_t indices { getU64(block) >> 16 };
+            for (int i = 0; i < 16; i++)
+            {
+                rgba[i * 4 + 3] = levels[indices >> (i * 3) & 7];
+            }
+        }
+
+        void decodeBc7(const unsigned char *block, unsigned char *rgba)
+        {
+            if ((block[0] & 0x7f) != 0x40)
+            {
+                int mode { 0 };
+                while (mode < 8 && !(block[0] >> mode & 1))
+                {
+                    mode++;
+                }
+                throw Error("BC7 mode " + std::to_string(mode) + " isn't supported, only mode 6 is");
+            }
+            const std::uint64_t lo { getU64(block) };
+            const std::uint64_t hi { getU64(block + 8) };
+            const auto bits { [lo, hi](unsigned offset, unsigned count)
+            {
+                const std::uint64_t v { offset >= 64 ? hi >> (offset - 64) : lo >> offset | (offset > 0 ? hi << (64 - offset) : 0) };
+                return static_cast<unsigned>(v & ((1u << count) - 1));
+            } };
+
+            // R0 R1 G0 G1 B0 B1 A0 A1, 7 bits each after the mode, then a p-bit per endpoint as their lowest bit
+            unsigned endpoints[2][4];
+            for (unsigned c = 0; c < 4; c++)
+            {
+                for (unsigned e = 0; e < 2; e++)
+                {
+                    endpoints[e][c] = bits(7 + (c * 2 + e) * 7, 7) << 1 | bits(63 + e, 1);
+                }
+            }
+            // the first index (the anchor) is 3 bits, its top bit always 0
+            unsigned offset { 65 };
+            for (int i = 0; i < 16; i++)
+            {
+                const unsigned count { i == 0 ? 3u : 4u };
+                const unsigned w { bc7Weights[bits(offset, count)] };
+                offset += count;
+                for (int c = 0; c < 4; c++)
+                {
+                    rgba[i * 4 + c] = static_cast<unsigned char>(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+                }
+            }
+        }
+    }
+
+    void decompressBlock(PixelFormat format, const unsigned char *block, unsigned char *rgba)
+    {
+        switch (format)
+        {
+        case PixelFormat::Bc1:
+            decodeColor(block, rgba, true);
+            return;
+        case PixelFormat::Bc3:
+            decodeColor(block + 8, rgba, false);
+            decodeAlpha(block, rgba);
+            return;
+        case PixelFormat::Bc7:
+            decodeBc7(block, rgba);
+            return;
+        case PixelFormat::Rgba8:
+            break;
+        }
+        throw Error("pixel format " + std::to_string(static_cast<int>(format)) + " isn't made of blocks");
+    }
+
+    Image decompressBlocks(const Image &image, const DecodeOptions &options)
+    {
+        if (!isBlockFormat(image.format))
+        {
+            return image;
+        }
+        if (image.pixels.size() != imageSize(image.format, image.width, image.height))
+        {
+            throw Error("the blocks don't match the dimensions");
+        }
+        Image out;
+        out.width = image.width;
+        out.height = image.height;
+        out.pixels.resize(static_cast<std::size_t>(image.width) * image.height * 4);
+        const std::uint32_t blocksX { (image.width + 3) / 4 };
+        const std::size_t blockBytes { bytesPerBlock(image.format) };
+        const std::size_t rowBytes { static_cast<std::size_t>(image.width) * 4 };
+        parallelFor((image.height + 3) / 4, options.threads > 0 ? options.threads : defaultThreadCount(), [&](std::size_t by)
+        {
+            unsigned char rgba[64];
+            const std::size_t rows { std::min<std::size_t>(4, image.height - by * 4) };
+            for (std::uint32_t bx = 0; bx < blocksX; bx++)
+            {
+                decompressBlock(image.format, image.pixels.data() + (by * blocksX + bx) * blockBytes, rgba);
+                // the padding of edge blocks is dropped
+                const std::size_t columns { std::min<std::size_t>(4, image.width - bx * 4) };
+                for (std::size_t y = 0; y < rows; y++)
+                {
+                    std::memcpy(out.pixels.data() + (by * 4 + y) * rowBytes + bx * 16, rgba + y * 16, columns * 4);
+                }
+            }
+        });
+        return out;
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef IMBIN_CPU_H
+#define IMBIN_CPU_H
+
+// kernels for newer instruction sets are compiled with function attributes (GCC and Clang) rather than global flags,
+// so one binary runs everywhere and picks them at runtime; MSVC allows the intrinsics anywhere anyway
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define IMBIN_X86
+    #include <immintrin.h>
+    #if defined(__GNUC__) || defined(__clang__)
+        #define IMBIN_TARGET(isa) __attribute__((target(isa)))
+    #else
+        #define IMBIN_TARGET(isa)
+    #endif
+#endif
+
+#endif // IMBIN_CPU_H
@@ -0,0 +1,251 @@
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include <imbin/filters.h>
+#include <imbin/format.h>
+
+#include "cpu.h"
+
+namespace imbin
+{
+    namespace
+    {
+        unsigned char paeth(int left, int above, int aboveLeft)
+        {
+            const int pa { std::abs(above - aboveLeft) };
+            const int pb { std::abs(left - aboveLeft) };
+            const int pc { std::abs(above + left - 2 * aboveLeft) };
+            if (pa <= pb && pa <= pc) { return static_cast<unsigned char>(left); }
+            return static_cast<unsigned char>(pb <= pc ? above : aboveLeft);
+        }
+
+        // the predictions are the same both ways, filtering subtracts them from the original bytes
+        // and unfiltering adds them to the filtered ones (in order, so the left bytes are already restored);
+        // one loop per filter, so there's no branching on it per byte
+        template<bool Unfilter, RowFilter Filter>
+        void applyScalar(const unsigned char *row, const unsigned char *previous, std::size_t size,
+                         std::size_t distance, unsigned char *out, std::size_t from)
+        {
+            // while unfiltering in place the left bytes come from the output
+            const unsigned char *restored { Unfilter ? out : row };
+            for (std::size_t i = from; i < size; i++)
+            {
+                const int left { i >= distance ? restored[i - distance] : 0 };
+                const int above { previous ? previous[i] : 0 };
+                int prediction { 0 };
+                if constexpr (Filter == RowFilter::Sub) { prediction = left; }
+                else if constexpr (Filter == RowFilter::Up) { prediction = above; }
+                else if constexpr (Filter == RowFilter::Average) { prediction = (left + above) >> 1; }
+                else if constexpr (Filter == RowFilter::Paeth)
+                {
+                    prediction = paeth(left, above, previous && i >= distance ? previous[i - distance] : 0);
+                }
+                out[i] = static_cast<unsigned char>(Unfilter ? row[i] + prediction : row[i] - prediction);
+            }
+        }
+
+        template<bool Unfilter>
+        void applyScalar(RowFilter filter, const unsigned char *row, const unsigned char *previous, std::size_t size,
+                         std::size_t distance, unsigned char *out, std::size_t from = 0)
+        {
+            switch (filter)
+            {
+            case RowFilter::Sub: applyScalar<Unfilter, RowFilter::Sub>(row, previous, size, distance, out, from); break;
+            case RowFilter::Up: applyScalar<Unfilter, RowFilter::Up>(row, previous, size, distance, out, from); break;
+            case RowFilter::Average: applyScalar<Unfilter, RowFilter::Average>(row, previous, size, distance, out, from); break;
+            case RowFilter::Paeth: applyScalar<Unfilter, RowFilter::Paeth>(row, previous, size, distance, out, from); break;
+            default: applyScalar<Unfilter, RowFilter::None>(row, previous, size, distance, out, from); break;
+            }
+        }
+
+        std::uint64_t absoluteSum(const unsigned char *data, std::size_t size)
+        {
+            std::uint64_t sum { 0 };
+            for (std::size_t i = 0; i < size; i++)
+            {
+                sum += static_cast<std::uint64_t>(std::abs(static_cast<int>(static_cast<signed char>(data[i]))));
+            }
+            return sum;
+        }
+
+#ifdef IMBIN_X86
+        // the SIMD kernels are for 4-byte pixels and return how many bytes they did, the scalar code finishes the rest;
+        // Up is independent for every byte, the others depend on the pixel to the left, so they go a pixel at a time
+
+        IMBIN_TARGET("avx2")
+        std::size_t unfilterUpAvx2(unsigned char *row, const unsigned char *previous, std::size_t size)
+        {
+            std::size_t i { 0 };
+            for (; i + 32 <= size; i += 32)
+            {
+                const __m256i x { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i)) };
+                const __m256i b { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(previous + i)) };
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(row + i), _mm256_add_epi8(x, b));
+            }
+            return i;
+        }
+
+        IMBIN_TARGET("ssse3")
+        std::size_t unfilterUpSsse3(unsigned char *row, const unsigned char *previous, std::size_t size)
+        {
+            std::size_t i { 0 };
+            for (; i + 16 <= size; i += 16)
+            {
+                const __m128i x { _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)) };
+                const __m128i b { _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + i)) };
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), _mm_add_epi8(x, b));
+            }
+            return i;
+        }
+
+        // a prefix sum of 4-byte pixels: 16 bytes are summed in two shifted adds, plus the last pixel of the previous 16
+        IMBIN_TARGET("ssse3")
+        std::size_t unfilterSubSsse3(unsigned char *row, std::size_t size)
+        {
+            __m128i carry { _mm_setzero_si128() };
+            std::size_t i { 0 };
+            for (; i + 16 <= size; i += 16)
+            {
+                __m128i x { _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)) };
+                x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+                x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+                x = _mm_add_epi8(x, carry);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), x);
+                carry = _mm_shuffle_epi32(x, 0xFF);
+            }
+            return i;
+        }
+
+        IMBIN_TARGET("ssse3")
+        inline __m128i loadPixel(const unsigned char *p)
+        {
+            int v;
+            std::memcpy(&v, p, 4);
+            return _mm_cvtsi32_si128(v);
+        }
+
+        IMBIN_TARGET("ssse3")
+        inline void storePixel(unsigned char *p, __m128i x)
+        {
+            const int v { _mm_cvtsi128_si32(x) };
+            std::memcpy(p, &v, 4);
+        }
+
+        IMBIN_TARGET("ssse3")
+        std::size_t unfilterAverageSsse3(unsigned char *row, const unsigned char *previous, std::size_t size)
+        {
+            const __m128i one { _mm_set1_epi8(1) };
+            __m128i a { _mm_setzero_si128() };
+            std::size_t i { 0 };
+            for (; i + 4 <= size; i += 4)
+            {
+                const __m128i b { loadPixel(previous + i) };
+                // pavgb rounds up, the filter rounds down
+                const __m128i average { _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one)) };
+                a = _mm_add_epi8(loadPixel(row + i), average);
+                storePixel(row + i, a);
+            }
+            return i;
+        }
+
+        IMBIN_TARGET("ssse3")
+        std::size_t unfilterPaethSsse3(unsigned char *row, const unsigned char *previous, std::size_t size)
+        {
+            // 16-bit lanes, so the differences don't overflow
+            const __m128i zero { _mm_setzero_si128() };
+            __m128i a { zero };
+            __m128i c { zero };
+            std::size_t i { 0 };
+            for (; i + 4 <= size; i += 4)
+            {
+                const __m128i b { _mm_unpacklo_epi8(loadPixel(previous + i), zero) };
+                const __m128i bc { _mm_sub_epi16(b, c) };
+                const __m128i ac { _mm_sub_epi16(a, c) };
+                const __m128i pa { _mm_abs_epi16(bc) };
+                const __m128i pb { _mm_abs_epi16(ac) };
+                const __m128i pc { _mm_abs_epi16(_mm_add_epi16(bc, ac)) };
+                const __m128i smallest { _mm_min_epi16(pc, _mm_min_epi16(pa, pb)) };
+                // a if pa is the smallest, otherwise b if pb is, otherwise c
+                const __m128i useA { _mm_cmpeq_epi16(smallest, pa) };
+                const __m128i useB { _mm_andnot_si128(useA, _mm_cmpeq_epi16(smallest, pb)) };
+                const __m128i useC { _mm_andnot_si128(_mm_or_si128(useA, useB), _mm_set1_epi16(-1)) };
+                const __m128i prediction { _mm_or_si128(_mm_or_si128(_mm_and_si128(useA, a), _mm_and_si128(useB, b)), _mm_and_si128(useC, c)) };
+                const __m128i x { _mm_add_epi8(loadPixel(row + i), _mm_packus_epi16(prediction, prediction)) };
+                storePixel(row + i, x);
+                a = _mm_unpacklo_epi8(x, zero);
+                c = b;
+            }
+            return i;
+        }
+
+        Simd usable(Simd simd)
+        {
+            return simdSupported(simd) ? simd : bestSimd();
+        }
+#endif
+    }
+
+    RowFilter filterRow(const unsigned char *row, const unsigned char *previous, std::size_t size,
+                        std::size_t distance, unsigned char *out)
+    {
+        // without a row above Up is None, and Average and Paeth are about the same as Sub
+        const RowFilter candidates[] { RowFilter::None, RowFilter::Sub, RowFilter::Up, RowFilter::Average, RowFilter::Paeth };
+        const std::size_t count { previous ? std::size(candidates) : 2 };
+
+        thread_local std::vector<unsigned char> trial;
+        trial.resize(size);
+        RowFilter best { RowFilter::None };
+        std::uint64_t bestSum { absoluteSum(row, size) };
+        std::memcpy(out, row, size);
+        for (std::size_t f = 1; f < count; f++)
+        {
+            applyScalar<false>(candidates[f], row, previous, size, distance, trial.data());
+            const std::uint64_t sum { absoluteSum(trial.data(), size) };
+            if (sum < bestSum)
+            {
+                bestSum = sum;
+                best = candidates[f];
+                std::memcpy(out, trial.data(), size);
+            }
+        }
+        return best;
+    }
+
+    void unfilterRow(RowFilter filter, unsigned char *row, const unsigned char *previous, std::size_t size,
+                     std::size_t distance, Simd simd)
+    {
+        if (filter == RowFilter::None || (filter == RowFilter::Up && !previous))
+        {
+            return;
+        }
+        if (static_cast<int>(filter) > static_cast<int>(RowFilter::Paeth))
+        {
+            throw Error("unknown row filter " + std::to_string(static_cast<int>(filter)));
+        }
+#ifdef IMBIN_X86
+        if (distance == 4 && usable(simd) != Simd::Scalar)
+        {
+            std::size_t done { 0 };
+            switch (filter)
+            {
+            case RowFilter::Sub: done = unfilterSubSsse3(row, size); break;
+            case RowFilter::Up: done = usable(simd) == Simd::Avx2 ? unfilterUpAvx2(row, previous, size) : unfilterUpSsse3(row, previous, size); break;
+            case RowFilter::Average: done = previous ? unfilterAverageSsse3(row, previous, size) : 0; break;
+            case RowFilter::Paeth: done = previous ? unfilterPaethSsse3(row, previous, size) : 0; break;
+            default: break;
+            }
+            // the rest depends on the bytes done above, which are in their final state already
+            if (done > 0)
+            {
+                applyScalar<true>(filter, row, previous, size, distance, row, done);
+                return;
+            }
+        }
+#else
+        (void)simd;
+#endif
+        applyScalar<true>(filter, row, previous, size, distance, row);
+    }
+}
@@ -0,0 +1,449 @@
+#include <algorithm>
+#include <cstring>
+
+#include <imbin/format.h>
+
+namespace imbin
+{
+    std::size_t bytesPerPixel(PixelFormat format)
+    {
+        switch (format)
+        {
+        case PixelFormat::Rgba8: return 4;
+        case PixelFormat::Bc1:
+        case PixelFormat::Bc3:
+        case PixelFormat::Bc7: throw Error("pixel format " + std::to_string(static_cast<int>(format)) + " is made of blocks");
+        }
+        throw Error("unknown pixel format " + std::to_string(static_cast<int>(format)));
+    }
+
+    bool isBlockFormat(PixelFormat format)
+    {
+        return format == PixelFormat::Bc1 || format == PixelFormat::Bc3 || format == PixelFormat::Bc7;
+    }
+
+    std::size_t bytesPerBlock(PixelFormat format)
+    {
+        switch (format)
+        {
+        case PixelFormat::Bc1: return 8;
+        case PixelFormat::Bc3:
+        case PixelFormat::Bc7: return 16;
+        case PixelFormat::Rgba8: break;
+        }
+        throw Error("pixel format " + std::to_string(static_cast<int>(format)) + " isn't made of blocks");
+    }
+
+    std::uint64_t imageSize(PixelFormat format, std::uint32_t width, std::uint32_t height)
+    {
+        if (isBlockFormat(format))
+        {
+            const std::uint64_t blocksX { (static_cast<std::uint64_t>(width) + 3) / 4 };
+            const std::uint64_t blocksY { (static_cast<std::uint64_t>(height) + 3) / 4 };
+            return blocksX * blocksY * bytesPerBlock(format);
+        }
+        return static_cast<std::uint64_t>(width) * height * bytesPerPixel(format);
+    }
+
+    TileIndex::TileIndex(std::uint32_t imageWidth, std::uint32_t imageHeight, std::uint32_t tileWidth, std::uint32_t tileHeight)
+        : tileWidth { tileWidth },
+          tileHeight { tileHeight },
+          tilesX { (imageWidth + tileWidth - 1) / tileWidth },
+          tilesY { (imageHeight + tileHeight - 1) / tileHeight },
+          tiles(static_cast<std::size_t>(tilesX) * tilesY)
+    {}
+
+    std::vector<unsigned char> serializeTileIndex(const TileIndex &index)
+    {
+        std::vector<unsigned char> out;
+        out.reserve(8 + index.tiles.size() * 16);
+        putU32(out, index.tileWidth);
+        putU32(out, index.tileHeight);
+        for (const auto &tile : index.tiles)
+        {
+            putU64(out, tile.offset);
+            putU64(out, tile.size);
+        }
+        return out;
+    }
+
+    TileIndex parseTileIndex(const unsigned char *data, std::size_t size, std::uint32_t imageWidth, std::uint32_t imageHeight)
+    {
+        if (size < 8)
+        {
+            throw Error("truncated tile index");
+        }
+        const std::uint32_t tileWidth { getU32(data) };
+        const std::uint32_t tileHeight { getU32(data + 4) };
+        if (tileWidth == 0 || tileHeight == 0)
+        {
+            throw Error("invalid tile size");
+        }
+        TileIndex index { imageWidth, imageHeight, tileWidth, tileHeight };
+        if (size < 8 + index.tiles.size() * 16)
+        {
+            throw Error("truncated tile index");
+        }
+        for (std::size_t i = 0; i < index.tiles.size(); i++)
+        {
+            index.tiles[i].offset = getU64(data + 8 + i * 16);
+            index.tiles[i].size = getU64(data + 16 + i * 16);
+        }
+        return index;
+    }
+
+    BlockIndex::BlockIndex(std::uint64_t uncompressedSize, std::uint64_t blockSize)
+        : blockSize { blockSize },
+          blocks(static_cast<std::size_t>(std::max<std::uint64_t>(1, (uncompressedSize + blockSize - 1) / blockSize)))
+    {}
+
+    std::vector<unsigned char> serializeBlockIndex(const BlockIndex &index)
+    {
+        std::vector<unsigned char> out;
+        out.reserve(8 + index.blocks.size() * 16);
+        putU64(out, index.blockSize);
+        for (const auto &block : index.blocks)
+        {
+            putU64(out, block.offset);
+            putU64(out, block.size);
+        }
+        return out;
+    }
+
+    BlockIndex parseBlockIndex(const unsigned char *data, std::size_t size, std::uint64_t uncompressedSize)
+    {
+        if (size < 8)
+        {
+            throw Error("truncated block index");
+        }
+        const std::uint64_t blockSize { getU64(data) };
+        if (blockSize == 0)
+        {
+            throw Error("invalid block size");
+        }
+        const std::uint64_t count { std::max<std::uint64_t>(1, uncompressedSize / blockSize + (uncompressedSize % blockSize != 0)) };
+        if (count != (size - 8) / 16 || (size - 8) % 16 != 0)
+        {
+            throw Error("block index doesn't match the payload");
+        }
+        BlockIndex index { uncompressedSize, blockSize };
+        for (std::size_t i = 0; i < index.blocks.size(); i++)
+        {
+            index.blocks[i].offset = getU64(data + 8 + i * 16);
+            index.blocks[i].size = getU64(data + 16 + i * 16);
+        }
+        return index;
+    }
+
+    std::vector<unsigned char> serializeFrameIndex(const FrameIndex &index)
+    {
+        std::vector<unsigned char> out;
+        out.reserve(16 + index.frames.size() * 24);
+        putU32(out, static_cast<std::uint32_t>(index.frames.size()));
+        putU32(out, index.keyframeInterval);
+        putU32(out, index.tileWidth);
+        putU32(out, index.tileHeight);
+        for (const auto &frame : index.frames)
+        {
+            putU64(out, frame.offset);
+            putU64(out, frame.size);
+            putU32(out, static_cast<std::uint32_t>(frame.kind));
+            putU32(out, frame.changedTiles);
+        }
+        return out;
+    }
+
+    FrameIndex parseFrameIndex(const unsigned char *data, std::size_t size)
+    {
+        if (size < 16)
+        {
+            throw Error("truncated frame index");
+        }
+        const std::uint32_t count { getU32(data) };
+        FrameIndex index;
+        index.keyframeInterval = getU32(data + 4);
+        index.tileWidth = getU32(data + 8);
+        index.tileHeight = getU32(data + 12);
+        if (index.tileWidth == 0 || index.tileHeight == 0)
+        {
+            throw Error("invalid tile size");
+        }
+        if ((size - 16) / 24 != count || (size - 16) % 24 != 0)
+        {
+            throw Error("frame index doesn't match the number of frames");
+        }
+        index.frames.resize(count);
+        for (std::size_t i = 0; i < index.frames.size(); i++)
+        {
+            const unsigned char *entry { data + 16 + i * 24 };
+            index.frames[i].offset = getU64(entry);
+            index.frames[i].size = getU64(entry + 8);
+            const std::uint32_t kind { getU32(entry + 16) };
+            if (kind > static_cast<std::uint32_t>(FrameIndex::Kind::Delta))
+            {
+                throw Error("unknown frame kind " + std::to_string(kind));
+            }
+            index.frames[i].kind = static_cast<FrameIndex::Kind>(kind);
+            index.frames[i].changedTiles = getU32(entry + 20);
+        }
+        return index;
+    }
+
+    std::vector<unsigned char> serializeMipIndex(const MipIndex &index)
+    {
+        std::vector<unsigned char> out;
+        out.reserve(mipIndexSize(index.levels.size()));
+        putU32(out, static_cast<std::uint32_t>(index.levels.size()));
+        putU32(out, static_cast<std::uint32_t>(index.filter));
+        for (const auto &level : index.levels)
+        {
+            putU32(out, level.width);
+            putU32(out, level.height);
+            putU64(out, level.offset);
+            putU64(out, level.size);
+        }
+        return out;
+    }
+
+    MipIndex parseMipIndex(const unsigned char *data, std::size_t size, std::uint32_t width, std::uint32_t height)
+    {
+        if (size < 8)
+        {
+            throw Error("truncated mip index");
+        }
+        const std::uint32_t count { getU32(data) };
+        const std::uint32_t filter { getU32(data + 4) };
+        if (filter > static_cast<std::uint32_t>(MipIndex::Filter::LinearBox))
+        {
+            throw Error("unknown mip filter " + std::to_string(filter));
+        }
+        if (count > 64 || size < mipIndexSize(count))
+        {
+            throw Error("truncated mip index");
+        }
+        // the levels halve the image (rounding down, but never below 1) all the way down to 1x1
+        std::uint32_t chain { 0 };
+        for (std::uint32_t w = width, h = height; w > 1 || h > 1; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u))
+        {
+            chain++;
+        }
+        if (count != chain)
+        {
+            throw Error("the mip index has " + std::to_string(count) + " levels, a " + std::to_string(width) + "x" +
+                        std::to_string(height) + " image has " + std::to_string(chain));
+        }
+        MipIndex index;
+        index.filter = static_cast<MipIndex::Filter>(filter);
+        index.levels.resize(count);
+        for (std::size_t i = 0; i < index.levels.size(); i++)
+        {
+            const unsigned char *entry { data + 8 + i * 24 };
+            MipIndex::Level &level { index.levels[i] };
+            level.width = getU32(entry);
+            level.height = getU32(entry + 4);
+            level.offset = getU64(entry + 8);
+            level.size = getU64(entry + 16);
+            const std::uint32_t expectedWidth { std::max(width >> (i + 1), 1u) };
+            const std::uint32_t expectedHeight { std::max(height >> (i + 1), 1u) };
+            if (level.width != expectedWidth || level.height != expectedHeight || level.offset > size || level.size > size - level.offset)
+            {
+                throw Error("invalid mip level " + std::to_string(i + 1));
+            }
+        }
+        return index;
+    }
+
+    const Chunk* Header::findChunk(std::uint32_t id) const
+    {
+        for (const auto &chunk : chunks)
+        {
+            if (chunk.id == id) { return &chunk; }
+        }
+        return nullptr;
+    }
+
+    std::vector<unsigned char> serializePalette(const Palette &palette)
+    {
+        std::vector<unsigned char> out;
+        out.reserve(8 + palette.entries.size());
+        putU32(out, palette.bits);
+        putU32(out, static_cast<std::uint32_t>(palette.size()));
+        out.insert(out.end(), palette.entries.begin(), palette.entries.end());
+        return out;
+    }
+
+    Palette parsePalette(const unsigned char *data, std::size_t size)
+    {
+        if (size < 8)
+        {
+            throw Error("truncated palette");
+        }
+        Palette palette;
+        palette.bits = getU32(data);
+        const std::uint32_t count { getU32(data + 4) };
+        if (palette.bits != 1 && palette.bits != 2 && palette.bits != 4 && palette.bits != 8)
+        {
+            throw Error("unsupported bits per index " + std::to_string(palette.bits));
+        }
+        if (count == 0 || count > (1u << palette.bits) || size != 8 + static_cast<std::size_t>(count) * 4)
+        {
+            throw Error("invalid palette");
+        }
+        palette.entries.assign(data + 8, data + size);
+        return palette;
+    }
+
+    std::vector<unsigned char> serializeHeader(Header &header, const std::vector<ChunkData> &chunks)
+    {
+        std::uint64_t offset { headerSize + chunkEntrySize * chunks.size() };
+        header.chunks.clear();
+        for (const auto &chunk : chunks)
+        {
+            header.chunks.push_back({ chunk.id, offset, chunk.data.size() });
+            offset += chunk.data.size();
+        }
+        header.payloadOffset = offset;
+
+        std::vector<unsigned char> out(std::begin(magic), std::end(magic));
+        out.reserve(static_cast<std::size_t>(offset));
+        putU16(out, header.version);
+        putU16(out, static_cast<std::uint16_t>(headerSize));
+        putU32(out, header.width);
+        putU32(out, header.height);
+        out.push_back(static_cast<unsigned char>(header.format));
+        out.push_back(static_cast<unsigned char>(header.layout));
+        out.push_back(static_cast<unsigned char>(header.codec));
+        out.push_back(0);
+        putU32(out, header.flags);
+        putU32(out, static_cast<std::uint32_t>(chunks.size()));
+        putU64(out, header.uncompressedSize);
+        putU64(out, header.payloadOffset);
+        putU64(out, header.payloadSize);
+        putU64(out, 0);
+
+        for (const auto &chunk : header.chunks)
+        {
+            putU32(out, chunk.id);
+            putU32(out, 0);
+            putU64(out, chunk.offset);
+            putU64(out, chunk.size);
+        }
+        for (const auto &chunk : chunks)
+        {
+            out.insert(out.end(), chunk.data.begin(), chunk.data.end());
+        }
+        return out;
+    }
+
+    Header parseHeader(const unsigned char *data, std::size_t size, std::uint64_t fileSize)
+    {
+        Header header;
+        if (size < 8)
+        {
+            throw Error("file is too small to be an im.bin");
+        }
+
+        if (std::memcmp(data, magic, sizeof(magic)) != 0)
+        {
+            // v1: two ints and a zlib stream
+            header.version = 1;
+            header.width = getU32(data);
+            header.height = getU32(data + 4);
+            // nothing but the zlib header to tell a v1 file from garbage
+            const bool zlibHeader { size >= 10 && (data[8] & 0x0F) == 8 && (data[8] * 256 + data[9]) % 31 == 0 };
+            if (!zlibHeader || static_cast<std::int32_t>(header.width) < 0 || static_cast<std::int32_t>(header.height) < 0)
+            {
+                throw Error("not an im.bin file");
+            }
+            header.uncompressedSize = static_cast<std::uint64_t>(header.width) * header.height * 4;
+            header.payloadOffset = 8;
+            header.payloadSize = fileSize - 8;
+            return header;
+        }
+
+        if (size < headerSize)
+        {
+            throw Error("truncated header");
+        }
+        header.version = getU16(data + 8);
+        const std::uint16_t fixedSize { getU16(data + 10) };
+        if (header.version < 2 || fixedSize < headerSize)
+        {
+            throw Error("unsupported im.bin version " + std::to_string(header.version));
+        }
+        header.width = getU32(data + 12);
+        header.height = getU32(data + 16);
+        header.format = static_cast<PixelFormat>(data[20]);
+        header.layout = static_cast<Layout>(data[21]);
+        header.codec = static_cast<Codec>(data[22]);
+        header.flags = getU32(data + 24);
+        const std::uint32_t chunkCount { getU32(data + 28) };
+        header.uncompressedSize = getU64(data + 32);
+        header.payloadOffset = getU64(data + 40);
+        header.payloadSize = getU64(data + 48);
+
+        if (header.payloadOffset > fileSize)
+        {
+            throw Error("payload offset is past the end of the file");
+        }
+        if (header.payloadSize == payloadToEnd)
+        {
+            header.payloadSize = fileSize - header.payloadOffset;
+        }
+        else if (header.payloadSize > fileSize - header.payloadOffset)
+        {
+            throw Error("truncated payload");
+        }
+
+        const std::uint64_t tableEnd { fixedSize + static_cast<std::uint64_t>(chunkCount) * chunkEntrySize };
+        if (tableEnd > size)
+        {
+            throw Error("truncated chunk table");
+        }
+        for (std::uint32_t i = 0; i < chunkCount; i++)
+        {
+            const unsigned char *entry { data + fixedSize + i * chunkEntrySize };
+            Chunk chunk { getU32(entry), getU64(entry + 8), getU64(entry + 16) };
+            if (chunk.offset > fileSize || chunk.size > fileSize - chunk.offset)
+            {
+                throw Error("chunk is past the end of the file");
+            }
+            header.chunks.push_back(chunk);
+        }
+        return header;
+    }
+
+    void putU16(std::vector<unsigned char> &out, std::uint16_t v)
+    {
+        out.push_back(static_cast<unsigned char>(v));
+        out.push_back(static_cast<unsigned char>(v >> 8));
+    }
+
+    void putU32(std::vector<unsigned char> &out, std::uint32_t v)
+    {
+        for (int i = 0; i < 4; i++) { out.push_back(static_cast<unsigned char>(v >> (8 * i))); }
+    }
+
+    void putU64(std::vector<unsigned char> &out, std::uint64_t v)
+    {
+        for (int i = 0; i < 8; i++) { out.push_back(static_cast<unsigned char>(v >> (8 * i))); }
+    }
+
+    std::uint16_t getU16(const unsigned char *p)
+    {
+        return static_cast<std::uint16_t>(p[0] | p[1] << 8);
+    }
+
+    std::uint32_t getU32(const unsigned char *p)
+    {
+        return static_cast<std::uint32_t>(p[0])
+            | static_cast<std::uint32_t>(p[1]) << 8
+            | static_cast<std::uint32_t>(p[2]) << 16
+            | static_cast<std::uint32_t>(p[3]) << 24;
+    }
+
+    std::uint64_t getU64(const unsigned char *p)
+    {
+        return static_cast<std::uint64_t>(getU32(p)) | static_cast<std::uint64_t>(getU32(p + 4)) << 32;
+    }
+}
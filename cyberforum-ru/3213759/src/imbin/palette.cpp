@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cstring>
+
+#include <imbin/palette.h>
+
+#include "cpu.h"
+
+namespace imbin
+{
+    namespace
+    {
+        // index of pixel p of a row, the first pixel of a byte is in its highest bits
+        unsigned indexAt(const unsigned char *row, std::size_t p, std::uint32_t bits)
+        {
+            const std::size_t bit { p * bits };
+            return static_cast<unsigned>(row[bit / 8] >> (8 - bits - bit % 8)) & ((1u << bits) - 1);
+        }
+
+        void expandScalar(const unsigned char *row, std::size_t first, std::size_t from, std::size_t pixels, std::uint32_t bits,
+                          const unsigned char *table, unsigned char *rgba)
+        {
+            for (std::size_t i = from; i < pixels; i++)
+            {
+                std::memcpy(rgba + i * 4, table + indexAt(row, first + i, bits) * 4, 4);
+            }
+        }
+
+#ifdef IMBIN_X86
+        // the SIMD kernels start on a byte of the row, do as many whole vectors as there are and return how many
+        // pixels that was, the scalar one finishes the rest
+
+        // 16 indices of fewer than 8 bits, one per byte
+        IMBIN_TARGET("ssse3")
+        __m128i unpack16(const unsigned char *packed, std::uint32_t bits)
+        {
+            const __m128i lowNibble { _mm_set1_epi8(0x0f) };
+            if (bits == 1)
+            {
+                // every byte to 8 lanes, each of them testing its bit
+                std::uint16_t pair;
+                std::memcpy(&pair, packed, 2);
+                const __m128i spread { _mm_shuffle_epi8(_mm_cvtsi32_si128(pair), _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1)) };
+                const __m128i bit { _mm_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1) };
+                return _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(spread, bit), bit), _mm_set1_epi8(1));
+            }
+            const int count { bits == 4 ? 8 : 4 };
+            std::uint64_t word { 0 };
+            std::memcpy(&word, packed, static_cast<std::size_t>(count));
+            const __m128i v { _mm_cvtsi64_si128(static_cast<long long>(word)) };
+            // the high nibble of every byte comes first
+            const __m128i nibbles { _mm_unpacklo_epi8(_mm_and_si128(_mm_srli_epi16(v, 4), lowNibble), _mm_and_si128(v, lowNibble)) };
+            if (bits == 4)
+            {
+                return nibbles;
+            }
+            // two indices per nibble
+            const __m128i high { _mm_shuffle_epi8(_mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3), nibbles) };
+            const __m128i low { _mm_shuffle_epi8(_mm_setr_epi8(0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3), nibbles) };
+            return _mm_unpacklo_epi8(high, low);
+        }
+
+        // the first 16 entries split into a register per channel, looked up with a byte shuffle each
+        IMBIN_TARGET("ssse3")
+        std::size_t shuffleSsse3(const unsigned char *packed, std::size_t pixels, std::uint32_t bits,
+                                 const unsigned char *table, unsigned char *rgba)
+        {
+            unsigned char planes[4][16];
+            for (int e = 0; e < 16; e++)
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    planes[c][e] = table[e * 4 + c];
+                }
+            }
+            const __m128i r { _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[0])) };
+            const __m128i g { _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[1])) };
+            const __m128i b { _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[2])) };
+            const __m128i a { _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[3])) };
+            std::size_t i { 0 };
+            for (; i + 16 <= pixels; i += 16)
+            {
+                const __m128i indices { unpack16(packed + i * bits / 8, bits) };
+                const __m128i vr { _mm_shuffle_epi8(r, indices) };
+                const __m128i vg { _mm_shuffle_epi8(g, indices) };
+                const __m128i vb { _mm_shuffle_epi8(b, indices) };
+                const __m128i va { _mm_shuffle_epi8(a, indices) };
+                const __m128i rgLow { _mm_unpacklo_epi8(vr, vg) };
+                const __m128i rgHigh { _mm_unpackhi_epi8(vr, vg) };
+                const __m128i baLow { _mm_unpacklo_epi8(vb, va) };
+                const __m128i baHigh { _mm_unpackhi_epi8(vb, va) };
+                __m128i *out { reinterpret_cast<__m128i*>(rgba + i * 4) };
+                _mm_storeu_si128(out, _mm_unpacklo_epi16(rgLow, baLow));
+                _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLow, baLow));
+                _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHigh, baHigh));
+                _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHigh, baHigh));
+            }
+            return i;
+        }
+
+        // 8 entries of the 256-entry table at a time
+        IMBIN_TARGET("avx2")
+        std::size_t gatherAvx2(const unsigned char *indices, std::size_t pixels, const unsigned char *table, unsigned char *rgba)
+        {
+            std::size_t i { 0 };
+            for (; i + 8 <= pixels; i += 8)
+            {
+                const __m256i offsets { _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + i))) };
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + i * 4),
+                                    _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), offsets, 4));
+            }
+            return i;
+        }
+
+        Simd usable(Simd simd)
+        {
+            return simdSupported(simd) ? simd : bestSimd();
+        }
+#endif
+    }
+
+    std::vector<unsigned char> paletteTable(const Palette &palette)
+    {
+        std::vector<unsigned char> table(256 * 4);
+        std::copy_n(palette.entries.begin(), std::min<std::size_t>(palette.entries.size(), table.size()), table.begin());
+        return table;
+    }
+
+    void expandIndices(const unsigned char *row, std::size_t first, std::size_t pixels, std::uint32_t bits,
+                       const unsigned char *table, unsigned char *rgba, Simd simd)
+    {
+        // up to the first pixel that starts a byte
+        const std::size_t perByte { 8 / bits };
+        const std::size_t lead { std::min(pixels, (perByte - first % perByte) % perByte) };
+        expandScalar(row, first, 0, lead, bits, table, rgba);
+        std::size_t done { lead };
+#ifdef IMBIN_X86
+        const unsigned char *packed { row + (first + lead) * bits / 8 };
+        const Simd level { usable(simd) };
+        if (bits == 8 && level == Simd::Avx2)
+        {
+            done += gatherAvx2(packed, pixels - lead, table, rgba + lead * 4);
+        }
+        else if (bits < 8 && level != Simd::Scalar)
+        {
+            done += shuffleSsse3(packed, pixels - lead, bits, table, rgba + lead * 4);
+        }
+#else
+        (void)simd;
+#endif
+        expandScalar(row, first, done, pixels, bits, table, rgba);
+    }
+}
@@ -0,0 +1,62 @@
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <imbin/parallel.h>
+
+namespace imbin
+{
+    unsigned defaultThreadCount()
+    {
+        unsigned n { std::thread::hardware_concurrency() };
+        return n > 0 ? n : 1;
+    }
+
+    void parallelFor(std::size_t count, unsigned threadCount, const std::function<void(std::size_t)> &fn)
+    {
+        if (threadCount > count) { threadCount = static_cast<unsigned>(count); }
+        if (threadCount <= 1)
+        {
+            for (std::size_t i = 0; i < count; i++) { fn(i); }
+            return;
+        }
+
+        std::atomic<std::size_t> next { 0 };
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        auto work = [&]
+        {
+            for (std::size_t i = next++; i < count; i = next++)
+            {
+                try
+                {
+                    fn(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock { errorMutex };
+                    if (!error) { error = std::current_exception(); }
+                    next = count; // no point in starting anything else
+                }
+            }
+        };
+
+        std::vector<std::thread> helpers;
+        helpers.reserve(threadCount - 1);
+        for (unsigned t = 1; t < threadCount; t++)
+        {
+            helpers.emplace_back(work);
+        }
+        work();
+        for (auto &helper : helpers)
+        {
+            helper.join();
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
@@ -0,0 +1,192 @@
+#include <imbin/planar.h>
+
+#include "cpu.h"
+
+namespace imbin
+{
+    namespace
+    {
+        void deinterleaveScalar(const unsigned char *rgba, std::size_t from, std::size_t pixels,
+                                unsigned char *r, unsigned char *g, unsigned char *b, unsigned char *a)
+        {
+            for (std::size_t i = from; i < pixels; i++)
+            {
+                r[i] = rgba[i * 4];
+                g[i] = rgba[i * 4 + 1];
+                b[i] = rgba[i * 4 + 2];
+                a[i] = rgba[i * 4 + 3];
+            }
+        }
+
+        void interleaveScalar(const unsigned char *r, const unsigned char *g, const unsigned char *b, const unsigned char *a,
+                              std::size_t from, std::size_t pixels, unsigned char *rgba)
+        {
+            for (std::size_t i = from; i < pixels; i++)
+            {
+                rgba[i * 4] = r[i];
+                rgba[i * 4 + 1] = g[i];
+                rgba[i * 4 + 2] = b[i];
+                rgba[i * 4 + 3] = a[i];
+            }
+        }
+
+#ifdef IMBIN_X86
+        // the SIMD kernels do as many whole vectors as there are and return how many pixels that was,
+        // the scalar ones finish the rest
+
+        IMBIN_TARGET("ssse3")
+        std::size_t deinterleaveSsse3(const unsigned char *rgba, std::size_t pixels,
+                                      unsigned char *r, unsigned char *g, unsigned char *b, unsigned char *a)
+        {
+            // RGBA x4 -> RRRR GGGG BBBB AAAA
+            const __m128i gather { _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15) };
+            std::size_t i { 0 };
+            for (; i + 16 <= pixels; i += 16)
+            {
+                const __m128i *in { reinterpret_cast<const __m128i*>(rgba + i * 4) };
+                const __m128i p0 { _mm_shuffle_epi8(_mm_loadu_si128(in), gather) };
+                const __m128i p1 { _mm_shuffle_epi8(_mm_loadu_si128(in + 1), gather) };
+                const __m128i p2 { _mm_shuffle_epi8(_mm_loadu_si128(in + 2), gather) };
+                const __m128i p3 { _mm_shuffle_epi8(_mm_loadu_si128(in + 3), gather) };
+                // 4x4 transpose of the 4-byte groups
+                const __m128i rg01 { _mm_unpacklo_epi32(p0, p1) };
+                const __m128i ba01 { _mm_unpackhi_epi32(p0, p1) };
+                const __m128i rg23 { _mm_unpacklo_epi32(p2, p3) };
+                const __m128i ba23 { _mm_unpackhi_epi32(p2, p3) };
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(r + i), _mm_unpacklo_epi64(rg01, rg23));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(g + i), _mm_unpackhi_epi64(rg01, rg23));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(b + i), _mm_unpacklo_epi64(ba01, ba23));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(a + i), _mm_unpackhi_epi64(ba01, ba23));
+            }
+            return i;
+        }
+
+        IMBIN_TARGET("ssse3")
+        std::size_t interleaveSsse3(const unsigned char *r, const unsigned char *g, const unsigned char *b, const unsigned char *a,
+                                    std::size_t pixels, unsigned char *rgba)
+        {
+            std::size_t i { 0 };
+            for (; i + 16 <= pixels; i += 16)
+            {
+                const __m128i vr { _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i)) };
+                const __m128i vg { _mm_loadu_si128(reinterpret_cast<const __m128i*>(g + i)) };
+                const __m128i vb { _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)) };
+                const __m128i va { _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)) };
+                const __m128i rgLow { _mm_unpacklo_epi8(vr, vg) };
+                const __m128i rgHigh { _mm_unpackhi_epi8(vr, vg) };
+                const __m128i baLow { _mm_unpacklo_epi8(vb, va) };
+                const __m128i baHigh { _mm_unpackhi_epi8(vb, va) };
+                __m128i *out { reinterpret_cast<__m128i*>(rgba + i * 4) };
+                _mm_storeu_si128(out, _mm_unpacklo_epi16(rgLow, baLow));
+                _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLow, baLow));
+                _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHigh, baHigh));
+                _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHigh, baHigh));
+            }
+            return i;
+        }
+
+        IMBIN_TARGET("avx2")
+        std::size_t deinterleaveAvx2(const unsigned char *rgba, std::size_t pixels,
+                                     unsigned char *r, unsigned char *g, unsigned char *b, unsigned char *a)
+        {
+            // the same as the SSSE3 one in each 128-bit lane, the lanes hold every other group of 4 pixels,
+            // which the final permutation puts back in order
+            const __m256i gather { _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+                                                    0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15) };
+            const __m256i order { _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7) };
+            std::size_t i { 0 };
+            for (; i + 32 <= pixels; i += 32)
+            {
+                const __m256i *in { reinterpret_cast<const __m256i*>(rgba + i * 4) };
+                const __m256i p0 { _mm256_shuffle_epi8(_mm256_loadu_si256(in), gather) };
+                const __m256i p1 { _mm256_shuffle_epi8(_mm256_loadu_si256(in + 1), gather) };
+                const __m256i p2 { _mm256_shuffle_epi8(_mm256_loadu_si256(in + 2), gather) };
+                const __m256i p3 { _mm256_shuffle_epi8(_mm256_loadu_si256(in + 3), gather) };
+                const __m256i rg01 { _mm256_unpacklo_epi32(p0, p1) };
+                const __m256i ba01 { _mm256_unpackhi_epi32(p0, p1) };
+                const __m256i rg23 { _mm256_unpacklo_epi32(p2, p3) };
+                const __m256i ba23 { _mm256_unpackhi_epi32(p2, p3) };
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(r + i), _mm256_permutevar8x32_epi32(_mm256_unpacklo_epi64(rg01, rg23), order));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(g + i), _mm256_permutevar8x32_epi32(_mm256_unpackhi_epi64(rg01, rg23), order));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(b + i), _mm256_permutevar8x32_epi32(_mm256_unpacklo_epi64(ba01, ba23), order));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(a + i), _mm256_permutevar8x32_epi32(_mm256_unpackhi_epi64(ba01, ba23), order));
+            }
+            return i;
+        }
+
+        IMBIN_TARGET("avx2")
+        std::size_t interleaveAvx2(const unsigned char *r, const unsigned char *g, const unsigned char *b, const unsigned char *a,
+                                   std::size_t pixels, unsigned char *rgba)
+        {
+            std::size_t i { 0 };
+            for (; i + 32 <= pixels; i += 32)
+            {
+                const __m256i vr { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + i)) };
+                const __m256i vg { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(g + i)) };
+                const __m256i vb { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)) };
+                const __m256i va { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)) };
+                const __m256i rgLow { _mm256_unpacklo_epi8(vr, vg) };
+                const __m256i rgHigh { _mm256_unpackhi_epi8(vr, vg) };
+                const __m256i baLow { _mm256_unpacklo_epi8(vb, va) };
+                const __m256i baHigh { _mm256_unpackhi_epi8(vb, va) };
+                // unpacking works within the lanes: q0 holds pixels 0-3 and 16-19, q1 4-7 and 20-23 and so on
+                const __m256i q0 { _mm256_unpacklo_epi16(rgLow, baLow) };
+                const __m256i q1 { _mm256_unpackhi_epi16(rgLow, baLow) };
+                const __m256i q2 { _mm256_unpacklo_epi16(rgHigh, baHigh) };
+                const __m256i q3 { _mm256_unpackhi_epi16(rgHigh, baHigh) };
+                __m256i *out { reinterpret_cast<__m256i*>(rgba + i * 4) };
+                _mm256_storeu_si256(out, _mm256_permute2x128_si256(q0, q1, 0x20));
+                _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(q2, q3, 0x20));
+                _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(q0, q1, 0x31));
+                _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(q2, q3, 0x31));
+            }
+            return i;
+        }
+
+        Simd usable(Simd simd)
+        {
+            return simdSupported(simd) ? simd : bestSimd();
+        }
+#endif
+    }
+
+    void deinterleaveRgba(const unsigned char *rgba, std::size_t pixels, unsigned char *planes, std::size_t planeStride, Simd simd)
+    {
+        unsigned char *r { planes };
+        unsigned char *g { planes + planeStride };
+        unsigned char *b { planes + 2 * planeStride };
+        unsigned char *a { planes + 3 * planeStride };
+        std::size_t done { 0 };
+#ifdef IMBIN_X86
+        switch (usable(simd))
+        {
+        case Simd::Avx2: done = deinterleaveAvx2(rgba, pixels, r, g, b, a); break;
+        case Simd::Ssse3: done = deinterleaveSsse3(rgba, pixels, r, g, b, a); break;
+        default: break;
+        }
+#else
+        (void)simd;
+#endif
+        deinterleaveScalar(rgba, done, pixels, r, g, b, a);
+    }
+
+    void interleaveRgba(const unsigned char *planes, std::size_t planeStride, std::size_t pixels, unsigned char *rgba, Simd simd)
+    {
+        const unsigned char *r { planes };
+        const unsigned char *g { planes + planeStride };
+        const unsigned char *b { planes + 2 * planeStride };
+        const unsigned char *a { planes + 3 * planeStride };
+        std::size_t done { 0 };
+#ifdef IMBIN_X86
+        switch (usable(simd))
+        {
+        case Simd::Avx2: done = interleaveAvx2(r, g, b, a, pixels, rgba); break;
+        case Simd::Ssse3: done = interleaveSsse3(r, g, b, a, pixels, rgba); break;
+        default: break;
+        }
+#else
+        (void)simd;
+#endif
+        interleaveScalar(r, g, b, a, done, pixels, rgba);
+    }
+}
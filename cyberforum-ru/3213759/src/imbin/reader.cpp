@@ -0,0 +1,626 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#ifdef USING_PACKAGE_MANAGER
+    #include <zlib/zlib.h>
+#else
+    #include <zlib.h>
+#endif
+
+#include <imbin/filters.h>
+#include <imbin/palette.h>
+#include <imbin/parallel.h>
+#include <imbin/planar.h>
+#include <imbin/reader.h>
+#include <imbin/rgb.h>
+
+namespace imbin
+{
+    namespace
+    {
+        unsigned threadCount(const DecodeOptions &options)
+        {
+            return options.threads > 0 ? options.threads : defaultThreadCount();
+        }
+
+        // the exact size is always known up front, so it is one uncompress() straight into the destination
+        void inflateExact(const unsigned char *source, std::uint64_t sourceSize, unsigned char *destination, std::uint64_t destinationSize)
+        {
+            uLongf length { static_cast<uLongf>(destinationSize) };
+            int r { uncompress(destination, &length, source, static_cast<uLong>(sourceSize)) };
+            if (r != Z_OK || length != destinationSize)
+            {
+                throw Error("corrupted payload (zlib error " + std::to_string(r) + ")");
+            }
+        }
+
+        // raw inflate of one independent block, which has to fill the destination exactly;
+        // all but the last block end with a sync flush instead of the final deflate block
+        void inflateBlock(const unsigned char *source, std::uint64_t sourceSize, unsigned char *destination, std::uint64_t destinationSize,
+                          bool last)
+        {
+            z_stream stream {};
+            // the largest window reads whatever the writer used
+            int r { inflateInit2(&stream, -15) };
+            if (r != Z_OK)
+            {
+                throw Error("inflateInit2 error " + std::to_string(r));
+            }
+            stream.next_in = const_cast<Bytef*>(source);
+            stream.avail_in = static_cast<uInt>(sourceSize);
+            stream.next_out = destination;
+            stream.avail_out = static_cast<uInt>(destinationSize);
+            r = inflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+            const bool done { stream.avail_in == 0 && stream.avail_out == 0
+                && (last ? r == Z_STREAM_END : (r == Z_OK || r == Z_BUF_ERROR)) };
+            inflateEnd(&stream);
+            if (!done)
+            {
+                throw Error("corrupted block (zlib error " + std::to_string(r) + ")");
+            }
+        }
+
+        // bytes per pixel of the payload, opaque files don't have the alpha; indexed ones take a byte per index
+        // in tiles and are filtered a byte at a time
+        std::size_t storedBytesPerPixel(const Header &header)
+        {
+            if (header.flags & flagIndexed)
+            {
+                return 1;
+            }
+            return header.flags & flagOpaque ? 3 : bytesPerPixel(header.format);
+        }
+
+        // what the payload decodes to: one pixel of constant files, the pixels (without the alpha if opaque) otherwise
+        std::uint64_t storedSize(const Header &header)
+        {
+            if (header.flags & flagConstant)
+            {
+                return bytesPerPixel(header.format);
+            }
+            if (header.flags & flagOpaque)
+            {
+                return static_cast<std::uint64_t>(header.width) * header.height * 3;
+            }
+            return imageSize(header.format, header.width, header.height);
+        }
+
+        void validate(const Header &header)
+        {
+            if (header.codec == Codec::ZlibSequence)
+            {
+                throw Error("the file is an image sequence, it has to be read with imbin::SequenceReader");
+            }
+            if (header.codec != Codec::Zlib && header.codec != Codec::ZlibTiles && header.codec != Codec::Stored)
+            {
+                throw Error("unsupported codec " + std::to_string(static_cast<int>(header.codec)));
+            }
+            if (header.layout != Layout::Interleaved && !(header.layout == Layout::PlanarRows && header.format == PixelFormat::Rgba8))
+            {
+                throw Error("unsupported layout " + std::to_string(static_cast<int>(header.layout)));
+            }
+            if (header.flags & ~knownFlags)
+            {
+                throw Error("unsupported flags " + std::to_string(header.flags));
+            }
+            if (isBlockFormat(header.format) && (header.codec == Codec::ZlibTiles || header.flags != 0))
+            {
+                throw Error("blocks can't be tiled or filtered");
+            }
+            if ((header.flags & (flagOpaque | flagConstant)) && header.layout != Layout::Interleaved)
+            {
+                throw Error("opaque and constant images have to be interleaved");
+            }
+            if ((header.flags & flagConstant)
+                && ((header.flags & (flagOpaque | flagFilteredRows)) || header.codec == Codec::ZlibTiles))
+            {
+                throw Error("constant images can't be opaque, filtered or tiled");
+            }
+            if ((header.flags & flagIndexed)
+                && ((header.flags & (flagOpaque | flagConstant)) || header.layout != Layout::Interleaved || header.format != PixelFormat::Rgba8))
+            {
+                throw Error("indexed images have to be interleaved Rgba8, and can't be opaque or constant");
+            }
+            // the size of indexed ones depends on the bits of the palette, see readHeader()
+            if (!(header.flags & flagIndexed) && header.uncompressedSize != storedSize(header))
+            {
+                throw Error("uncompressed size doesn't match the dimensions");
+            }
+            if (header.codec == Codec::Stored && header.payloadSize != header.uncompressedSize)
+            {
+                throw Error("stored payload doesn't match the uncompressed size");
+            }
+        }
+
+        // the payload in one go, a single zlib stream or stored
+        void readWhole(const unsigned char *data, const Header &header, unsigned char *destination)
+        {
+            if (header.codec == Codec::Stored)
+            {
+                std::memcpy(destination, data + header.payloadOffset, static_cast<std::size_t>(header.uncompressedSize));
+            }
+            else
+            {
+                inflateExact(data + header.payloadOffset, header.payloadSize, destination, header.uncompressedSize);
+            }
+        }
+
+        TileIndex readTileIndex(const unsigned char *data, const Header &header)
+        {
+            const Chunk *chunk { header.findChunk(tileChunk) };
+            if (!chunk)
+            {
+                throw Error("tiled payload without a tile index");
+            }
+            TileIndex index { parseTileIndex(data + chunk->offset, static_cast<std::size_t>(chunk->size), header.width, header.height) };
+            for (const auto &tile : index.tiles)
+            {
+                if (tile.offset > header.payloadSize || tile.size > header.payloadSize - tile.offset)
+                {
+                    throw Error("tile is past the end of the payload");
+                }
+            }
+            return index;
+        }
+
+        Palette readPalette(const unsigned char *data, const Header &header)
+        {
+            const Chunk *chunk { header.findChunk(paletteChunk) };
+            if (!chunk)
+            {
+                throw Error("indexed payload without a palette");
+            }
+            return parsePalette(data + chunk->offset, static_cast<std::size_t>(chunk->size));
+        }
+
+        // the filter of every row, nullptr if the rows aren't filtered
+        const unsigned char* readFilters(const unsigned char *data, const Header &header, std::uint32_t tilesX)
+        {
+            if (!(header.flags & flagFilteredRows))
+            {
+                return nullptr;
+            }
+            const Chunk *chunk { header.findChunk(filterChunk) };
+            if (!chunk || chunk->size != static_cast<std::uint64_t>(header.height) * tilesX)
+            {
+                throw Error("filtered rows without a matching filter chunk");
+            }
+            return data + chunk->offset;
+        }
+
+        // rows one after another, unfiltered top to bottom as every row depends on the one above
+        void unfilterRows(unsigned char *rows, std::uint32_t count, std::size_t rowBytes, std::size_t bpp, const unsigned char *filters)
+        {
+            for (std::uint32_t y = 0; y < count; y++)
+            {
+                unsigned char *row { rows + y * rowBytes };
+                unfilterRow(static_cast<RowFilter>(filters[y]), row, y > 0 ? row - rowBytes : nullptr, rowBytes, bpp);
+            }
+        }
+
+        // false if the payload is a plain zlib stream
+        bool readBlockIndex(const unsigned char *data, const Header &header, BlockIndex &index)
+        {
+            const Chunk *chunk { header.findChunk(blockChunk) };
+            if (!chunk || header.codec != Codec::Zlib)
+            {
+                return false;
+            }
+            index = parseBlockIndex(data + chunk->offset, static_cast<std::size_t>(chunk->size), header.uncompressedSize);
+            if (index.blockSize > std::numeric_limits<uInt>::max())
+            {
+                throw Error("block size is too big");
+            }
+            // the blocks go one after another, from right after the zlib header up to the trailer
+            std::uint64_t offset { 2 };
+            for (const auto &block : index.blocks)
+            {
+                if (block.offset != offset || block.size > std::numeric_limits<uInt>::max())
+                {
+                    throw Error("invalid block index");
+                }
+                offset += block.size;
+            }
+            if (header.payloadSize < 4 || offset != header.payloadSize - 4)
+            {
+                throw Error("block index doesn't match the payload");
+            }
+            return true;
+        }
+
+        // inflates blocks [first, last) into destination (which corresponds to the start of the first one),
+        // the checksum of everything is compared with the trailer when all the blocks are inflated
+        void inflateBlocks(const unsigned char *data, const Header &header, const BlockIndex &index,
+                           std::size_t first, std::size_t last, unsigned char *destination, unsigned threads)
+        {
+            const unsigned char *payload { data + header.payloadOffset };
+            const bool whole { first == 0 && last == index.blocks.size() };
+            std::vector<uLong> checksums(whole ? index.blocks.size() : 0);
+            parallelFor(last - first, threads, [&](std::size_t i)
+            {
+                const std::size_t b { first + i };
+                const std::uint64_t length { std::min(index.blockSize, header.uncompressedSize - b * index.blockSize) };
+                unsigned char *out { destination + i * index.blockSize };
+                inflateBlock(payload + index.blocks[b].offset, index.blocks[b].size, out, length, b + 1 == index.blocks.size());
+                if (whole)
+                {
+                    checksums[i] = adler32_z(adler32(0, nullptr, 0), out, static_cast<z_size_t>(length));
+                }
+            });
+
+            if (whole)
+            {
+                uLong checksum { checksums[0] };
+                for (std::size_t b = 1; b < checksums.size(); b++)
+                {
+                    const std::uint64_t length { std::min(index.blockSize, header.uncompressedSize - b * index.blockSize) };
+                    checksum = adler32_combine(checksum, checksums[b], static_cast<z_off_t>(length));
+                }
+                const unsigned char *trailer { payload + header.payloadSize - 4 };
+                const uLong expected { static_cast<uLong>(trailer[0]) << 24 | static_cast<uLong>(trailer[1]) << 16
+                    | static_cast<uLong>(trailer[2]) << 8 | trailer[3] };
+                if (checksum != expected)
+                {
+                    throw Error("corrupted payload (checksum mismatch)");
+                }
+            }
+        }
+
+        // inflates one tile and copies the part of it that overlaps the region into the region's pixels;
+        // table is the palette of indexed files (see paletteTable()), nullptr otherwise
+        void decodeTile(const unsigned char *data, const Header &header, const TileIndex &index,
+                        const unsigned char *filters, const unsigned char *table, std::uint32_t tx, std::uint32_t ty,
+                        std::vector<unsigned char> &scratch,
+                        unsigned char *region, std::uint32_t regionX, std::uint32_t regionY,
+                        std::uint32_t regionWidth, std::uint32_t regionHeight)
+        {
+            const std::size_t bpp { bytesPerPixel(header.format) };
+            const std::size_t storedBpp { storedBytesPerPixel(header) };
+            const std::uint32_t x0 { tx * index.tileWidth };
+            const std::uint32_t y0 { ty * index.tileHeight };
+            const std::uint32_t w { std::min(index.tileWidth, header.width - x0) };
+            const std::uint32_t h { std::min(index.tileHeight, header.height - y0) };
+
+            const TileIndex::Entry &tile { index.tiles[static_cast<std::size_t>(ty) * index.tilesX + tx] };
+            scratch.resize(static_cast<std::size_t>(w) * h * storedBpp);
+            inflateExact(data + header.payloadOffset + tile.offset, tile.size, scratch.data(), scratch.size());
+
+            const std::uint32_t left { std::max(x0, regionX) };
+            const std::uint32_t right { std::min(x0 + w, regionX + regionWidth) };
+            const std::uint32_t top { std::max(y0, regionY) };
+            const std::uint32_t bottom { std::min(y0 + h, regionY + regionHeight) };
+            if (filters)
+            {
+                // the previous bands are all full height
+                unfilterRows(scratch.data(), bottom - y0, static_cast<std::size_t>(w) * storedBpp, storedBpp,
+                             filters + static_cast<std::size_t>(ty) * index.tilesX * index.tileHeight + static_cast<std::size_t>(tx) * h);
+            }
+            for (std::uint32_t y = top; y < bottom; y++)
+            {
+                unsigned char *destination { region + ((static_cast<std::size_t>(y) - regionY) * regionWidth + (left - regionX)) * bpp };
+                const unsigned char *row { scratch.data() + (static_cast<std::size_t>(y) - y0) * w * storedBpp };
+                if (header.layout == Layout::PlanarRows)
+                {
+                    interleaveRgba(row + (left - x0), w, right - left, destination);
+                }
+                else if (header.flags & flagOpaque)
+                {
+                    expandRgb(row + (left - x0) * storedBpp, right - left, destination);
+                }
+                else if (table)
+                {
+                    expandIndices(row, left - x0, right - left, 8, table, destination);
+                }
+                else
+                {
+                    std::memcpy(destination, row + (left - x0) * bpp, (right - left) * bpp);
+                }
+            }
+        }
+
+        // the tiles don't overlap, so every one of them is inflated on its own thread straight into the region
+        void decodeTiles(const unsigned char *data, const Header &header,
+                         std::uint32_t x, std::uint32_t y, std::uint32_t width, std::uint32_t height,
+                         unsigned char *region, unsigned threads)
+        {
+            if (width == 0 || height == 0)
+            {
+                return;
+            }
+            const TileIndex index { readTileIndex(data, header) };
+            const unsigned char *filters { readFilters(data, header, index.tilesX) };
+            const std::vector<unsigned char> table { header.flags & flagIndexed ? paletteTable(readPalette(data, header))
+                                                                                : std::vector<unsigned char> {} };
+            const std::uint32_t firstX { x / index.tileWidth };
+            const std::uint32_t firstY { y / index.tileHeight };
+            const std::uint32_t countX { (x + width - 1) / index.tileWidth - firstX + 1 };
+            const std::uint32_t countY { (y + height - 1) / index.tileHeight - firstY + 1 };
+            parallelFor(static_cast<std::size_t>(countX) * countY, threads, [&](std::size_t i)
+            {
+                std::vector<unsigned char> scratch;
+                decodeTile(data, header, index, filters, table.empty() ? nullptr : table.data(), firstX + static_cast<std::uint32_t>(i % countX), firstY + static_cast<std::uint32_t>(i / countX),
+                           scratch, region, x, y, width, height);
+            });
+        }
+
+        // PlanarRows -> Interleaved in place, bands of rows in parallel
+        void interleaveRows(unsigned char *pixels, const Header &header, unsigned threads)
+        {
+            const std::size_t rowBytes { static_cast<std::size_t>(header.width) * bytesPerPixel(header.format) };
+            const std::uint32_t bandRows { 64 };
+            parallelFor((header.height + bandRows - 1) / bandRows, threads, [&](std::size_t band)
+            {
+                std::vector<unsigned char> planes(rowBytes);
+                const std::size_t last { std::min<std::size_t>((band + 1) * bandRows, header.height) };
+                for (std::size_t y = band * bandRows; y < last; y++)
+                {
+                    unsigned char *row { pixels + y * rowBytes };
+                    std::memcpy(planes.data(), row, rowBytes);
+                    interleaveRgba(planes.data(), header.width, header.width, row);
+                }
+            });
+        }
+
+        void decodePayload(const unsigned char *data, const Header &header, unsigned char *pixels, const DecodeOptions &options)
+        {
+            const std::size_t count { static_cast<std::size_t>(header.width) * header.height };
+            if (header.flags & flagConstant)
+            {
+                unsigned char pixel[4];
+                readWhole(data, header, pixel);
+                fillPixels(pixel, count, pixels);
+                return;
+            }
+            if (header.codec == Codec::ZlibTiles)
+            {
+                decodeTiles(data, header, 0, 0, header.width, header.height, pixels, threadCount(options));
+                return;
+            }
+            // opaque rows go at the end of the pixels and are expanded forward from there in place,
+            // indices go to a buffer of their own, so that bands of rows can be expanded in parallel
+            const bool opaque { (header.flags & flagOpaque) != 0 };
+            const bool indexed { (header.flags & flagIndexed) != 0 };
+            std::vector<unsigned char> indices(indexed ? static_cast<std::size_t>(header.uncompressedSize) : 0);
+            unsigned char *stored { indexed ? indices.data() : opaque ? pixels + count : pixels };
+            BlockIndex blocks;
+            const unsigned threads { threadCount(options) };
+            if (threads > 1 && readBlockIndex(data, header, blocks) && blocks.blocks.size() > 1)
+            {
+                inflateBlocks(data, header, blocks, 0, blocks.blocks.size(), stored, threads);
+            }
+            else
+            {
+                readWhole(data, header, stored);
+            }
+            const std::size_t storedRowBytes { header.height > 0 ? static_cast<std::size_t>(header.uncompressedSize / header.height) : 0 };
+            if (const unsigned char *filters { readFilters(data, header, 1) })
+            {
+                unfilterRows(stored, header.height, storedRowBytes, storedBytesPerPixel(header), filters);
+            }
+            if (opaque)
+            {
+                expandRgb(stored, count, pixels);
+            }
+            if (indexed)
+            {
+                const Palette palette { readPalette(data, header) };
+                const std::vector<unsigned char> table { paletteTable(palette) };
+                const std::size_t rowBytes { static_cast<std::size_t>(header.width) * 4 };
+                const std::uint32_t bandRows { 64 };
+                parallelFor((header.height + bandRows - 1) / bandRows, threads, [&](std::size_t band)
+                {
+                    const std::size_t last { std::min<std::size_t>((band + 1) * bandRows, header.height) };
+                    for (std::size_t y = band * bandRows; y < last; y++)
+                    {
+                        expandIndices(stored + y * storedRowBytes, 0, header.width, palette.bits, table.data(), pixels + y * rowBytes);
+                    }
+                });
+            }
+            if (header.layout == Layout::PlanarRows)
+            {
+                interleaveRows(pixels, header, threads);
+            }
+        }
+
+        Header readHeader(const unsigned char *data, std::size_t size)
+        {
+            Header header { parseHeader(data, size, size) };
+            validate(header);
+            if (header.flags & flagIndexed)
+            {
+                const Palette palette { readPalette(data, header) };
+                if (header.uncompressedSize != header.height * indexRowBytes(header.width, palette.bits))
+                {
+                    throw Error("uncompressed size doesn't match the dimensions");
+                }
+                if (header.codec == Codec::ZlibTiles && palette.bits != 8)
+                {
+                    throw Error("tiled indices have to take 8 bits");
+                }
+            }
+            return header;
+        }
+    }
+
+    Info readInfo(const unsigned char *data, std::size_t size)
+    {
+        const Header header { readHeader(data, size) };
+        Info info;
+        info.width = header.width;
+        info.height = header.height;
+        info.format = header.format;
+        info.pixelsSize = imageSize(header.format, header.width, header.height);
+        return info;
+    }
+
+    void decodeInto(const unsigned char *data, std::size_t size, unsigned char *pixels, std::size_t pixelsSize,
+                    const DecodeOptions &options)
+    {
+        const Header header { readHeader(data, size) };
+        if (pixelsSize < imageSize(header.format, header.width, header.height))
+        {
+            throw Error("the buffer is too small for the image");
+        }
+        decodePayload(data, header, pixels, options);
+    }
+
+    Image decode(const unsigned char *data, std::size_t size, const DecodeOptions &options)
+    {
+        const Header header { readHeader(data, size) };
+        Image image;
+        image.width = header.width;
+        image.height = header.height;
+        image.format = header.format;
+        image.pixels.resize(static_cast<std::size_t>(imageSize(header.format, header.width, header.height)));
+        decodePayload(data, header, image.pixels.data(), options);
+        return image;
+    }
+
+    std::uint32_t mipLevelCount(const unsigned char *data, std::size_t size)
+    {
+        const Header header { readHeader(data, size) };
+        const Chunk *chunk { header.findChunk(mipChunk) };
+        if (!chunk)
+        {
+            return 0;
+        }
+        const MipIndex index { parseMipIndex(data + chunk->offset, static_cast<std::size_t>(chunk->size), header.width, header.height) };
+        return static_cast<std::uint32_t>(index.levels.size());
+    }
+
+    Image decodeMipLevel(const unsigned char *data, std::size_t size, std::uint32_t level, const DecodeOptions &options)
+    {
+        if (level == 0)
+        {
+            return decode(data, size, options);
+        }
+        const Header header { readHeader(data, size) };
+        const Chunk *chunk { header.findChunk(mipChunk) };
+        const MipIndex index { chunk ? parseMipIndex(data + chunk->offset, static_cast<std::size_t>(chunk->size), header.width, header.height) : MipIndex {} };
+        if (level > index.levels.size())
+        {
+            throw Error("there's no mip level " + std::to_string(level));
+        }
+        const MipIndex::Level &entry { index.levels[level - 1] };
+        Image image;
+        image.width = entry.width;
+        image.height = entry.height;
+        image.format = header.format;
+        image.pixels.resize(static_cast<std::size_t>(entry.width) * entry.height * bytesPerPixel(header.format));
+        inflateExact(data + chunk->offset + entry.offset, entry.size, image.pixels.data(), image.pixels.size());
+        return image;
+    }
+
+    Image decodeRegion(const unsigned char *data, std::size_t size,
+                       std::uint32_t x, std::uint32_t y, std::uint32_t width, std::uint32_t height,
+                       const DecodeOptions &options)
+    {
+        const Header header { readHeader(data, size) };
+        if (x > header.width || width > header.width - x || y > header.height || height > header.height - y)
+        {
+            throw Error("region is outside of the image");
+        }
+        if (isBlockFormat(header.format))
+        {
+            throw Error("regions of blocks aren't supported, decode the whole image");
+        }
+        if (x == 0 && y == 0 && width == header.width && height == header.height)
+        {
+            return decode(data, size, options);
+        }
+
+        const std::size_t bpp { bytesPerPixel(header.format) };
+        Image region;
+        region.width = width;
+        region.height = height;
+        region.format = header.format;
+        region.pixels.resize(static_cast<std::size_t>(width) * height * bpp);
+
+        if (header.flags & flagConstant)
+        {
+            unsigned char pixel[4];
+            readWhole(data, header, pixel);
+            fillPixels(pixel, static_cast<std::size_t>(width) * height, region.pixels.data());
+            return region;
+        }
+
+        if (header.codec == Codec::ZlibTiles)
+        {
+            decodeTiles(data, header, x, y, width, height, region.pixels.data(), threadCount(options));
+            return region;
+        }
+        if (width == 0 || height == 0)
+        {
+            return region;
+        }
+
+        // the rows of the region, either inflated from just the blocks holding them or cut out of the whole image;
+        // filtered rows depend on all the rows above, so those have to be inflated from the top
+        const std::size_t storedBpp { storedBytesPerPixel(header) };
+        // a row of the payload, of packed indices too
+        const std::size_t stride { static_cast<std::size_t>(header.uncompressedSize / header.height) };
+        const unsigned char *filters { readFilters(data, header, 1) };
+        std::vector<unsigned char> rows;
+        std::size_t rowsOffset { 0 }; // where the rows buffer starts in the image
+        BlockIndex blocks;
+        if (readBlockIndex(data, header, blocks))
+        {
+            const std::size_t first { filters ? 0 : static_cast<std::size_t>(y * stride / blocks.blockSize) };
+            const std::size_t last { static_cast<std::size_t>(((y + height) * stride - 1) / blocks.blockSize + 1) };
+            rowsOffset = first * blocks.blockSize;
+            rows.resize(static_cast<std::size_t>(std::min<std::uint64_t>(last * blocks.blockSize, header.uncompressedSize)) - rowsOffset);
+            inflateBlocks(data, header, blocks, first, last, rows.data(), threadCount(options));
+        }
+        else
+        {
+            rows.resize(static_cast<std::size_t>(header.uncompressedSize));
+            readWhole(data, header, rows.data());
+        }
+        if (filters)
+        {
+            unfilterRows(rows.data(), y + height, stride, storedBpp, filters);
+        }
+        const Palette palette { header.flags & flagIndexed ? readPalette(data, header) : Palette {} };
+        const std::vector<unsigned char> table { header.flags & flagIndexed ? paletteTable(palette) : std::vector<unsigned char> {} };
+        for (std::uint32_t row = 0; row < height; row++)
+        {
+            unsigned char *destination { region.pixels.data() + static_cast<std::size_t>(row) * width * bpp };
+            const unsigned char *source { rows.data() + (static_cast<std::size_t>(y) + row) * stride - rowsOffset };
+            if (header.layout == Layout::PlanarRows)
+            {
+                interleaveRgba(source + x, header.width, width, destination);
+            }
+            else if (header.flags & flagOpaque)
+            {
+                expandRgb(source + x * storedBpp, width, destination);
+            }
+            else if (header.flags & flagIndexed)
+            {
+                expandIndices(source, x, width, palette.bits, table.data(), destination);
+            }
+            else
+            {
+                std::memcpy(destination, source + x * bpp, width * bpp);
+            }
+        }
+        return region;
+    }
+
+    Image readFile(const std::filesystem::path &path, const DecodeOptions &options)
+    {
+        std::ifstream file { path, std::ios::binary };
+        if (!file)
+        {
+            throw Error("couldn't open " + path.string());
+        }
+        std::vector<unsigned char> data(static_cast<std::size_t>(std::filesystem::file_size(path)));
+        file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (static_cast<std::size_t>(file.gcount()) != data.size())
+        {
+            throw Error("couldn't read " + path.string());
+        }
+        return decode(data.data(), data.size(), options);
+    }
+}
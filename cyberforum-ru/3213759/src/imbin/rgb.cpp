@@ -0,0 +1,225 @@
+#include <cstdint>
+#include <cstring>
+
+#include <imbin/rgb.h>
+
+#include "cpu.h"
+
+namespace imbin
+{
+    namespace
+    {
+        // forward, so packing in place only ever writes over pixels that have been read
+        void packScalar(const unsigned char *rgba, std::size_t from, std::size_t pixels, unsigned char *rgb)
+        {
+            for (std::size_t i = from; i < pixels; i++)
+            {
+                rgb[i * 3] = rgba[i * 4];
+                rgb[i * 3 + 1] = rgba[i * 4 + 1];
+                rgb[i * 3 + 2] = rgba[i * 4 + 2];
+            }
+        }
+
+        // forward too: with rgb at the end of rgba, pixel i is written below where pixel i + 1 is read from
+        void expandScalar(const unsigned char *rgb, std::size_t from, std::size_t pixels, unsigned char *rgba)
+        {
+            for (std::size_t i = from; i < pixels; i++)
+            {
+                const unsigned char r { rgb[i * 3] };
+                const unsigned char g { rgb[i * 3 + 1] };
+                const unsigned char b { rgb[i * 3 + 2] };
+                rgba[i * 4] = r;
+                rgba[i * 4 + 1] = g;
+                rgba[i * 4 + 2] = b;
+                rgba[i * 4 + 3] = 255;
+            }
+        }
+
+        void fillScalar(const unsigned char *pixel, std::size_t from, std::size_t pixels, unsigned char *rgba)
+        {
+            for (std::size_t i = from; i < pixels; i++)
+            {
+                std::memcpy(rgba + i * 4, pixel, 4);
+            }
+        }
+
+#ifdef IMBIN_X86
+        // the SIMD kernels do as many whole vectors as there are and return how many pixels that was,
+        // the scalar ones finish the rest; every one of them reads everything of a step before it writes any of it,
+        // which is what keeps packing and expanding in place working
+
+        IMBIN_TARGET("ssse3")
+        std::size_t packSsse3(const unsigned char *rgba, std::size_t pixels, unsigned char *rgb)
+        {
+            // RGBA x4 -> RGB x4 in the low 12 bytes
+            const __m128i gather { _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1) };
+            std::size_t i { 0 };
+            for (; i + 16 <= pixels; i += 16)
+            {
+                const __m128i *in { reinterpret_cast<const __m128i*>(rgba + i * 4) };
+                const __m128i p0 { _mm_shuffle_epi8(_mm_loadu_si128(in), gather) };
+                const __m128i p1 { _mm_shuffle_epi8(_mm_loadu_si128(in + 1), gather) };
+                const __m128i p2 { _mm_shuffle_epi8(_mm_loadu_si128(in + 2), gather) };
+                const __m128i p3 { _mm_shuffle_epi8(_mm_loadu_si128(in + 3), gather) };
+                // 4 x 12 bytes -> 3 x 16
+                __m128i *out { reinterpret_cast<__m128i*>(rgb + i * 3) };
+                _mm_storeu_si128(out, _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+                _mm_storeu_si128(out + 1, _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+                _mm_storeu_si128(out + 2, _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+            }
+            return i;
+        }
+
+        IMBIN_TARGET("ssse3")
+        std::size_t expandSsse3(const unsigned char *rgb, std::size_t pixels, unsigned char *rgba)
+        {
+            const __m128i spread { _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1) };
+            const __m128i alpha { _mm_set1_epi32(static_cast<int>(0xff000000u)) };
+            std::size_t i { 0 };
+            for (; i + 16 <= pixels; i += 16)
+            {
+                const __m128i *in { reinterpret_cast<const __m128i*>(rgb + i * 3) };
+                const __m128i in0 { _mm_loadu_si128(in) };
+                const __m128i in1 { _mm_loadu_si128(in + 1) };
+                const __m128i in2 { _mm_loadu_si128(in + 2) };
+                // the 12 bytes of every 4 pixels at the bottom of a register
+                const __m128i q0 { in0 };
+                const __m128i q1 { _mm_alignr_epi8(in1, in0, 12) };
+                const __m128i q2 { _mm_alignr_epi8(in2, in1, 8) };
+                const __m128i q3 { _mm_srli_si128(in2, 4) };
+                __m128i *out { reinterpret_cast<__m128i*>(rgba + i * 4) };
+                _mm_storeu_si128(out, _mm_or_si128(_mm_shuffle_epi8(q0, spread), alpha));
+                _mm_storeu_si128(out + 1, _mm_or_si128(_mm_shuffle_epi8(q1, spread), alpha));
+                _mm_storeu_si128(out + 2, _mm_or_si128(_mm_shuffle_epi8(q2, spread), alpha));
+                _mm_storeu_si128(out + 3, _mm_or_si128(_mm_shuffle_epi8(q3, spread), alpha));
+            }
+            return i;
+        }
+
+        IMBIN_TARGET("sse2")
+        std::size_t fillSse2(const unsigned char *pixel, std::size_t pixels, unsigned char *rgba)
+        {
+            std::uint32_t value;
+            std::memcpy(&value, pixel, 4);
+            const __m128i v { _mm_set1_epi32(static_cast<int>(value)) };
+            std::size_t i { 0 };
+            for (; i + 4 <= pixels; i += 4)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4), v);
+            }
+            return i;
+        }
+
+        IMBIN_TARGET("avx2")
+        std::size_t packAvx2(const unsigned char *rgba, std::size_t pixels, unsigned char *rgb)
+        {
+            // the SSSE3 gather in each lane, then the two 12-byte halves next to each other
+            const __m256i gather { _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                                    0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1) };
+            const __m256i join { _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7) };
+            std::size_t i { 0 };
+            // the second store goes 8 bytes past the 48 of the step
+            for (; i * 3 + 56 <= pixels * 3; i += 16)
+            {
+                const __m256i *in { reinterpret_cast<const __m256i*>(rgba + i * 4) };
+                const __m256i p0 { _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256(in), gather), join) };
+                const __m256i p1 { _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256(in + 1), gather), join) };
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgb + i * 3), p0);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgb + i * 3 + 24), p1);
+            }
+            return i;
+        }
+
+        IMBIN_TARGET("avx2")
+        std::size_t expandAvx2(const unsigned char *rgb, std::size_t pixels, unsigned char *rgba)
+        {
+            // 24 bytes of 8 pixels -> 12 in each lane, spread there like the SSSE3 one does
+            const __m256i split { _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6) };
+            const __m256i spread { _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                                    0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1) };
+            const __m256i alpha { _mm256_set1_epi32(static_cast<int>(0xff000000u)) };
+            std::size_t i { 0 };
+            // the second load goes 8 bytes past the 48 of the step
+            for (; i * 3 + 56 <= pixels * 3; i += 16)
+            {
+                const __m256i in0 { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgb + i * 3)) };
+                const __m256i in1 { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgb + i * 3 + 24)) };
+                const __m256i q0 { _mm256_permutevar8x32_epi32(in0, split) };
+                const __m256i q1 { _mm256_permutevar8x32_epi32(in1, split) };
+                __m256i *out { reinterpret_cast<__m256i*>(rgba + i * 4) };
+                _mm256_storeu_si256(out, _mm256_or_si256(_mm256_shuffle_epi8(q0, spread), alpha));
+                _mm256_storeu_si256(out + 1, _mm256_or_si256(_mm256_shuffle_epi8(q1, spread), alpha));
+            }
+            return i;
+        }
+
+        IMBIN_TARGET("avx2")
+        std::size_t fillAvx2(const unsigned char *pixel, std::size_t pixels, unsigned char *rgba)
+        {
+            std::uint32_t value;
+            std::memcpy(&value, pixel, 4);
+            const __m256i v { _mm256_set1_epi32(static_cast<int>(value)) };
+            std::size_t i { 0 };
+            for (; i + 8 <= pixels; i += 8)
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + i * 4), v);
+            }
+            return i;
+        }
+
+        Simd usable(Simd simd)
+        {
+            return simdSupported(simd) ? simd : bestSimd();
+        }
+#endif
+    }
+
+    void packRgb(const unsigned char *rgba, std::size_t pixels, unsigned char *rgb, Simd simd)
+    {
+        std::size_t done { 0 };
+#ifdef IMBIN_X86
+        switch (usable(simd))
+        {
+        case Simd::Avx2: done = packAvx2(rgba, pixels, rgb); break;
+        case Simd::Ssse3: done = packSsse3(rgba, pixels, rgb); break;
+        default: break;
+        }
+#else
+        (void)simd;
+#endif
+        packScalar(rgba, done, pixels, rgb);
+    }
+
+    void expandRgb(const unsigned char *rgb, std::size_t pixels, unsigned char *rgba, Simd simd)
+    {
+        std::size_t done { 0 };
+#ifdef IMBIN_X86
+        switch (usable(simd))
+        {
+        case Simd::Avx2: done = expandAvx2(rgb, pixels, rgba); break;
+        case Simd::Ssse3: done = expandSsse3(rgb, pixels, rgba); break;
+        default: break;
+        }
+#else
+        (void)simd;
+#endif
+        expandScalar(rgb, done, pixels, rgba);
+    }
+
+    void fillPixels(const unsigned char *pixel, std::size_t pixels, unsigned char *rgba, Simd simd)
+    {
+        std::size_t done { 0 };
+#ifdef IMBIN_X86
+        switch (usable(simd))
+        {
+        case Simd::Avx2: done = fillAvx2(pixel, pixels, rgba); break;
+        // SSE2 is all it takes
+        case Simd::Ssse3: done = fillSse2(pixel, pixels, rgba); break;
+        default: break;
+        }
+#else
+        (void)simd;
+#endif
+        fillScalar(pixel, done, pixels, rgba);
+    }
+}
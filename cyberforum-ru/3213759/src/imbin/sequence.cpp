@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#ifdef USING_PACKAGE_MANAGER
+    #include <zlib/zlib.h>
+#else
+    #include <zlib.h>
+#endif
+
+#include <imbin/sequence.h>
+
+#include "cpu.h"
+
+namespace imbin
+{
+    namespace
+    {
+        void xorScalar(const unsigned char *a, const unsigned char *b, unsigned char *target, std::size_t from, std::size_t size)
+        {
+            for (std::size_t i = from; i < size; i++)
+            {
+                target[i] = static_cast<unsigned char>(a[i] ^ b[i]);
+            }
+        }
+
+#ifdef IMBIN_X86
+        // as with the planar kernels, the SIMD ones do the whole vectors and the scalar one the rest
+
+        std::size_t xorSse2(const unsigned char *a, const unsigned char *b, unsigned char *target, std::size_t size)
+        {
+            std::size_t i { 0 };
+            for (; i + 16 <= size; i += 16)
+            {
+                const __m128i va { _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)) };
+                const __m128i vb { _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)) };
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(target + i), _mm_xor_si128(va, vb));
+            }
+            return i;
+        }
+
+        IMBIN_TARGET("avx2")
+        std::size_t xorAvx2(const unsigned char *a, const unsigned char *b, unsigned char *target, std::size_t size)
+        {
+            std::size_t i { 0 };
+            for (; i + 32 <= size; i += 32)
+            {
+                const __m256i va { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)) };
+                const __m256i vb { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)) };
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + i), _mm256_xor_si256(va, vb));
+            }
+            return i;
+        }
+#endif
+
+        void inflateExact(const unsigned char *source, std::uint64_t sourceSize, unsigned char *destination, std::uint64_t destinationSize)
+        {
+            uLongf length { static_cast<uLongf>(destinationSize) };
+            int r { uncompress(destination, &length, source, static_cast<uLong>(sourceSize)) };
+            if (r != Z_OK || length != destinationSize)
+            {
+                throw Error("corrupted frame (zlib error " + std::to_string(r) + ")");
+            }
+        }
+
+        bool changed(const unsigned char *bitmap, std::size_t tile)
+        {
+            return (bitmap[tile / 8] >> (tile % 8)) & 1;
+        }
+    }
+
+    void xorBytes(const unsigned char *a, const unsigned char *b, unsigned char *target, std::size_t size, Simd simd)
+    {
+        std::size_t done { 0 };
+#ifdef IMBIN_X86
+        switch (simdSupported(simd) ? simd : bestSimd())
+        {
+        case Simd::Avx2: done = xorAvx2(a, b, target, size); break;
+        // SSE2 is all it takes
+        case Simd::Ssse3: done = xorSse2(a, b, target, size); break;
+        default: break;
+        }
+#else
+        (void)simd;
+#endif
+        xorScalar(a, b, target, done, size);
+    }
+
+    bool isSequence(const unsigned char *data, std::size_t size)
+    {
+        return size >= headerSize && std::equal(std::begin(magic), std::end(magic), data)
+            && data[22] == static_cast<unsigned char>(Codec::ZlibSequence);
+    }
+
+    SequenceReader::SequenceReader(std::vector<unsigned char> file)
+        : m_file { std::move(file) }
+    {
+        m_header = parseHeader(m_file.data(), m_file.size(), m_file.size());
+        if (m_header.codec != Codec::ZlibSequence)
+        {
+            throw Error("not an image sequence");
+        }
+        if (m_header.layout != Layout::Interleaved || m_header.flags != 0)
+        {
+            throw Error("unsupported layout or flags for an image sequence");
+        }
+        const std::uint64_t frameBytes { static_cast<std::uint64_t>(m_header.width) * m_header.height * bytesPerPixel(m_header.format) };
+        if (m_header.uncompressedSize != frameBytes)
+        {
+            throw Error("uncompressed size doesn't match the dimensions");
+        }
+        if (m_header.payloadOffset > m_file.size() || m_header.payloadSize > m_file.size() - m_header.payloadOffset)
+        {
+            throw Error("payload is past the end of the file");
+        }
+        const Chunk *chunk { m_header.findChunk(frameChunk) };
+        if (!chunk)
+        {
+            throw Error("image sequence without a frame index");
+        }
+        m_index = parseFrameIndex(m_file.data() + chunk->offset, static_cast<std::size_t>(chunk->size));
+        if (m_index.frames.empty() || m_index.frames.front().kind != FrameIndex::Kind::Key)
+        {
+            throw Error("image sequence doesn't start with a keyframe");
+        }
+        for (const auto &frame : m_index.frames)
+        {
+            if (frame.offset > m_header.payloadSize || frame.size > m_header.payloadSize - frame.offset)
+            {
+                throw Error("frame is past the end of the payload");
+            }
+        }
+        m_frame.width = m_header.width;
+        m_frame.height = m_header.height;
+        m_frame.format = m_header.format;
+        m_frame.pixels.resize(static_cast<std::size_t>(frameBytes));
+    }
+
+    SequenceReader SequenceReader::open(const std::filesystem::path &path)
+    {
+        std::ifstream file { path, std::ios::binary };
+        if (!file)
+        {
+            throw Error("couldn't open " + path.string());
+        }
+        std::vector<unsigned char> data(static_cast<std::size_t>(std::filesystem::file_size(path)));
+        file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (static_cast<std::size_t>(file.gcount()) != data.size())
+        {
+            throw Error("couldn't read " + path.string());
+        }
+        return SequenceReader { std::move(data) };
+    }
+
+    const Image& SequenceReader::frame(std::uint32_t index)
+    {
+        if (index >= m_index.frames.size())
+        {
+            throw Error("there's no frame " + std::to_string(index));
+        }
+        std::uint32_t keyframe { index };
+        while (m_index.frames[keyframe].kind != FrameIndex::Kind::Key)
+        {
+            keyframe--;
+        }
+        // the current frame is between the keyframe and the one asked for, the deltas can go on from there
+        std::uint32_t from { keyframe };
+        if (m_position >= keyframe && m_position <= index)
+        {
+            from = static_cast<std::uint32_t>(m_position) + 1;
+        }
+        // until the frame is complete, in case something throws on the way
+        m_position = -1;
+        if (from == keyframe)
+        {
+            decodeKeyframe(keyframe);
+            from = keyframe + 1;
+        }
+        for (std::uint32_t i = from; i <= index; i++)
+        {
+            applyDelta(i);
+        }
+        m_position = index;
+        return m_frame;
+    }
+
+    const Image& SequenceReader::next()
+    {
+        return frame(static_cast<std::uint32_t>(m_position + 1));
+    }
+
+    void SequenceReader::decodeKeyframe(std::uint32_t index)
+    {
+        const FrameIndex::Entry &entry { m_index.frames[index] };
+        inflateExact(m_file.data() + m_header.payloadOffset + entry.offset, entry.size, m_frame.pixels.data(), m_frame.pixels.size());
+    }
+
+    void SequenceReader::applyDelta(std::uint32_t index)
+    {
+        const FrameIndex::Entry &entry { m_index.frames[index] };
+        const std::uint32_t tileWidth { m_index.tileWidth };
+        const std::uint32_t tileHeight { m_index.tileHeight };
+        const std::uint32_t tilesX { (m_header.width + tileWidth - 1) / tileWidth };
+        const std::uint32_t tilesY { (m_header.height + tileHeight - 1) / tileHeight };
+        const std::size_t bitmapSize { tileBitmapSize(static_cast<std::size_t>(tilesX) * tilesY) };
+        if (entry.size < bitmapSize)
+        {
+            throw Error("truncated delta frame");
+        }
+        const unsigned char *bitmap { m_file.data() + m_header.payloadOffset + entry.offset };
+
+        const std::size_t bpp { bytesPerPixel(m_header.format) };
+        std::uint64_t deltaSize { 0 };
+        std::uint32_t changedTiles { 0 };
+        for (std::uint32_t ty = 0; ty < tilesY; ty++)
+        {
+            for (std::uint32_t tx = 0; tx < tilesX; tx++)
+            {
+                if (changed(bitmap, static_cast<std::size_t>(ty) * tilesX + tx))
+                {
+                    const std::uint32_t w { std::min(tileWidth, m_header.width - tx * tileWidth) };
+                    const std::uint32_t h { std::min(tileHeight, m_header.height - ty * tileHeight) };
+                    deltaSize += static_cast<std::uint64_t>(w) * h * bpp;
+                    changedTiles++;
+                }
+            }
+        }
+        if (changedTiles != entry.changedTiles)
+        {
+            throw Error("delta frame doesn't match the frame index");
+        }
+        if (changedTiles == 0)
+        {
+            return;
+        }
+        m_delta.resize(static_cast<std::size_t>(deltaSize));
+        inflateExact(bitmap + bitmapSize, entry.size - bitmapSize, m_delta.data(), deltaSize);
+
+        const std::size_t rowBytes { static_cast<std::size_t>(m_header.width) * bpp };
+        const Simd simd { bestSimd() };
+        const unsigned char *rows { m_delta.data() };
+        for (std::uint32_t ty = 0; ty < tilesY; ty++)
+        {
+            for (std::uint32_t tx = 0; tx < tilesX; tx++)
+            {
+                if (!changed(bitmap, static_cast<std::size_t>(ty) * tilesX + tx))
+                {
+                    continue;
+                }
+                const std::size_t tileRowBytes { std::min(tileWidth, m_header.width - tx * tileWidth) * bpp };
+                const std::uint32_t h { std::min(tileHeight, m_header.height - ty * tileHeight) };
+                unsigned char *target { m_frame.pixels.data() + static_cast<std::size_t>(ty) * tileHeight * rowBytes + tx * tileWidth * bpp };
+                for (std::uint32_t y = 0; y < h; y++)
+                {
+                    xorBytes(target, rows, target, tileRowBytes, simd);
+                    target += rowBytes;
+                    rows += tileRowBytes;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+#include <imbin/simd.h>
+
+#include "cpu.h"
+
+namespace imbin
+{
+    namespace
+    {
+        Simd detect()
+        {
+#if defined(IMBIN_X86) && (defined(__GNUC__) || defined(__clang__))
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) { return Simd::Avx2; }
+            if (__builtin_cpu_supports("ssse3")) { return Simd::Ssse3; }
+#elif defined(IMBIN_X86) && defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            const int maxLeaf { info[0] };
+            __cpuid(info, 1);
+            const bool ssse3 { (info[2] & (1 << 9)) != 0 };
+            // AVX2 also needs the OS to save the YMM registers
+            const bool osxsave { (info[2] & (1 << 27)) != 0 };
+            if (maxLeaf >= 7 && osxsave && (_xgetbv(0) & 6) == 6)
+            {
+                __cpuidex(info, 7, 0);
+                if (info[1] & (1 << 5)) { return Simd::Avx2; }
+            }
+            if (ssse3) { return Simd::Ssse3; }
+#endif
+            return Simd::Scalar;
+        }
+    }
+
+    Simd bestSimd()
+    {
+        static const Simd best { detect() };
+        return best;
+    }
+
+    bool simdSupported(Simd simd)
+    {
+        return static_cast<int>(simd) <= static_cast<int>(bestSimd());
+    }
+
+    const char* simdName(Simd simd)
+    {
+        switch (simd)
+        {
+        case Simd::Ssse3: return "ssse3";
+        case Simd::Avx2: return "avx2";
+        default: return "scalar";
+        }
+    }
+}
@@ -0,0 +1,148 @@
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <fcntl.h>
+    #include <io.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "errors.h"
+#include "input.h"
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path &path)
+{
+    HANDLE file { CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        throw ConversionError("couldn't open the file");
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        throw ConversionError("couldn't get the file size");
+    }
+    m_file = file;
+    m_size = static_cast<std::size_t>(size.QuadPart);
+    if (m_size == 0) { return; } // can't map an empty file, but it's not a mapping error either
+
+    m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping)
+    {
+        CloseHandle(file);
+        throw ConversionError("couldn't map the file");
+    }
+    m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data)
+    {
+        CloseHandle(m_mapping);
+        CloseHandle(file);
+        throw ConversionError("couldn't map the file");
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data) { UnmapViewOfFile(m_data); }
+    if (m_mapping) { CloseHandle(m_mapping); }
+    CloseHandle(m_file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path &path)
+{
+    m_file = open(path.c_str(), O_RDONLY);
+    if (m_file < 0)
+    {
+        throw ConversionError("couldn't open the file");
+    }
+    struct stat info;
+    if (fstat(m_file, &info) != 0)
+    {
+        close(m_file);
+        throw ConversionError("couldn't get the file size");
+    }
+    m_size = static_cast<std::size_t>(info.st_size);
+    if (m_size == 0) { return; } // can't map an empty file, but it's not a mapping error either
+
+    void *mapped { mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0) };
+    if (mapped == MAP_FAILED)
+    {
+        close(m_file);
+        throw ConversionError("couldn't map the file");
+    }
+    // libpng reads front to back, so let the kernel read ahead aggressively and drop pages behind
+    madvise(mapped, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const unsigned char*>(mapped);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data) { munmap(const_cast<unsigned char*>(m_data), m_size); }
+    close(m_file);
+}
+
+#endif
+
+PipeInput::PipeInput(int fd, std::size_t bufferSize)
+    : m_fd { fd },
+      m_buffer(bufferSize)
+{
+#ifdef _WIN32
+    // stdin is in text mode by default
+    _setmode(fd, _O_BINARY);
+#endif
+}
+
+bool PipeInput::fill()
+{
+    if (m_begin == m_end)
+    {
+        m_begin = m_end = 0;
+    }
+    else if (m_end == m_buffer.size())
+    {
+        if (m_begin == 0)
+        {
+            // nobody consumes bigger pieces than the buffer
+            throw ConversionError("internal error: input buffer full");
+        }
+        std::memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+    for (;;)
+    {
+#ifdef _WIN32
+        const int r { _read(m_fd, m_buffer.data() + m_end, static_cast<unsigned>(m_buffer.size() - m_end)) };
+#else
+        const ssize_t r { read(m_fd, m_buffer.data() + m_end, m_buffer.size() - m_end) };
+#endif
+        if (r > 0)
+        {
+            m_end += static_cast<std::size_t>(r);
+            return true;
+        }
+        if (r == 0)
+        {
+            return false;
+        }
+        if (errno != EINTR)
+        {
+            throw ConversionError(std::string { "couldn't read the input: " } + std::strerror(errno));
+        }
+    }
+}
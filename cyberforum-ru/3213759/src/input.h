@@ -0,0 +1,68 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+#include "memory_pool.h"
+
+// read-only mapping of a whole file, so libpng can be served straight from the page cache
+// instead of going through std::ifstream's own buffer; throws ConversionError
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::filesystem::path &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+private:
+    const unsigned char *m_data { nullptr };
+    std::size_t m_size { 0 };
+#ifdef _WIN32
+    void *m_file { nullptr };
+    void *m_mapping { nullptr };
+#else
+    int m_file { -1 };
+#endif
+};
+
+// bytes from a descriptor that may not be seekable (a pipe, a socket, stdin), read as they become available;
+// throws ConversionError
+class PipeInput
+{
+public:
+    explicit PipeInput(int fd, std::size_t bufferSize = 64 * 1024);
+
+    PipeInput(const PipeInput&) = delete;
+    PipeInput& operator=(const PipeInput&) = delete;
+
+    // what has been read and not consumed yet
+    const unsigned char* data() const { return m_buffer.data() + m_begin; }
+    std::size_t size() const { return m_end - m_begin; }
+    void consume(std::size_t count)
+    {
+        m_begin += count;
+        m_consumed += count;
+    }
+    // everything consumed so far
+    std::uint64_t consumed() const { return m_consumed; }
+
+    // reads whatever is available after the unconsumed bytes, waiting for at least one byte,
+    // returns false at the end of the input
+    bool fill();
+
+private:
+    int m_fd;
+    ByteBuffer m_buffer;
+    std::size_t m_begin { 0 };
+    std::size_t m_end { 0 };
+    std::uint64_t m_consumed { 0 };
+};
+
+#endif // INPUT_H
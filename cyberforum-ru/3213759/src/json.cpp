@@ -0,0 +1,90 @@
+#include <cstdio>
+
+#include "json.h"
+
+void JsonWriter::value(const char *key, const std::string &v)
+{
+    prefix(key);
+    string(v);
+}
+
+void JsonWriter::value(const char *key, bool v)
+{
+    prefix(key);
+    m_out << (v ? "true" : "false");
+}
+
+void JsonWriter::value(const char *key, double v)
+{
+    prefix(key);
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.*g", m_precision, v);
+    m_out << buffer;
+}
+
+void JsonWriter::value(const char *key, std::uint64_t v)
+{
+    prefix(key);
+    m_out << v;
+}
+
+void JsonWriter::open(const char *key, char bracket)
+{
+    prefix(key);
+    m_out << bracket;
+    m_first.push_back(true);
+}
+
+void JsonWriter::close(char bracket)
+{
+    m_first.pop_back();
+    newLine();
+    m_out << bracket;
+    if (m_first.empty())
+    {
+        m_out << '\n';
+    }
+}
+
+void JsonWriter::prefix(const char *key)
+{
+    if (!m_first.empty())
+    {
+        if (!m_first.back())
+        {
+            m_out << ',';
+        }
+        newLine();
+        m_first.back() = false;
+    }
+    if (key)
+    {
+        string(key);
+        m_out << (m_pretty ? ": " : ":");
+    }
+}
+
+void JsonWriter::string(const std::string &s)
+{
+    m_out << '"';
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\') { m_out << '\\' << c; }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned>(c));
+            m_out << buffer;
+        }
+        else { m_out << c; }
+    }
+    m_out << '"';
+}
+
+void JsonWriter::newLine()
+{
+    if (m_pretty)
+    {
+        m_out << '\n' << std::string(m_first.size() * 2, ' ');
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// just enough JSON for reports: nested objects and arrays, strings and numbers, written as they come;
+// keys are for values inside objects, nullptr for values inside arrays
+class JsonWriter
+{
+public:
+    // indented, or everything on one line (for big machine-only documents such as traces);
+    // doubles get that many significant digits
+    explicit JsonWriter(std::ostream &out, bool pretty = true, int precision = 6)
+        : m_out { out }, m_pretty { pretty }, m_precision { precision } {}
+
+    void beginObject(const char *key = nullptr) { open(key, '{'); }
+    void endObject() { close('}'); }
+    void beginArray(const char *key = nullptr) { open(key, '['); }
+    void endArray() { close(']'); }
+
+    void value(const char *key, const std::string &v);
+    // without it string literals would go to the bool one
+    void value(const char *key, const char *v) { value(key, std::string { v }); }
+    void value(const char *key, bool v);
+    void value(const char *key, double v);
+    void value(const char *key, std::uint64_t v);
+
+private:
+    void open(const char *key, char bracket);
+    void close(char bracket);
+    // the comma, the indentation and the key of the next value
+    void prefix(const char *key);
+    void string(const std::string &s);
+    void newLine();
+
+    std::ostream &m_out;
+    bool m_pretty;
+    int m_precision;
+    // per open object/array: nothing has been written into it yet
+    std::vector<bool> m_first;
+};
+
+#endif // JSON_H
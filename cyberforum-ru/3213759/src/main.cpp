@@ -1,97 +1,75 @@
+#include <chrono>
 #include <iostream>
-#include <fstream>
-#include <cassert>
-#include <vector>
+#include <memory>
+#include <stdexcept>
 
-#ifdef USING_PACKAGE_MANAGER
-    #include <zlib/zlib.h>
-    #include <png/png.h>
-#else
-    #include <zlib.h>
-    #include <png.h>
-#endif
-
-void userReadData(png_structp pngPtr, png_bytep data, png_size_t length)
-{
-    std::istream *s { reinterpret_cast<std::istream*>(png_get_io_ptr(pngPtr)) };
-    s->read(reinterpret_cast<char*>(data), static_cast<int>(length));
-}
+#include "batch.h"
+#include "converter.h"
+#include "manifest.h"
+#include "options.h"
 
 int main(int argc, char *argv[])
 {
-    // the PNG file is expected to be alongside the executable (and working folder should be set to that one too)
-    std::ifstream file { "./some.png", std::ios::binary };
-    png_byte header[8];
-
-    int res;
-    file.read(reinterpret_cast<char*>(header), sizeof(header));
-    res = png_sig_cmp(header, 0, 8);
-    assert(!res && "invalid file");
-
-    png_structp pngPtr { png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr,nullptr, nullptr) };
-    assert(pngPtr);
-
-    png_infop infoPtr { png_create_info_struct(pngPtr) };
-    if (!infoPtr)
+    Options options;
+    try
+    {
+        options = parseOptions(argc, argv);
+    }
+    catch (const std::invalid_argument &ex)
     {
-        png_destroy_read_struct(&pngPtr, nullptr, nullptr);
+        std::cerr << ex.what() << std::endl << std::endl;
+        printUsage(std::cerr);
         return 1;
     }
-
-    png_infop endInfo { png_create_info_struct(pngPtr) };
-    if (!endInfo)
+    if (options.help)
     {
-        png_destroy_read_struct(&pngPtr, &infoPtr,nullptr);
-        return 2;
+        printUsage(std::cout);
+        return 0;
     }
 
-    if (setjmp(png_jmpbuf(pngPtr)))
+    if (options.inputFd >= 0)
     {
-        png_destroy_read_struct(&pngPtr, &infoPtr, &endInfo);
-        return 3;
+        return runStream(options) == 0 ? 0 : 3;
     }
 
-    png_set_sig_bytes(pngPtr, 8);
-    png_set_read_fn(pngPtr,reinterpret_cast<png_voidp>(&file), userReadData);
-    png_read_info(pngPtr, infoPtr);
-
-    int w { static_cast<int>(png_get_image_width(pngPtr, infoPtr)) };
-    int h { static_cast<int>(png_get_image_height(pngPtr, infoPtr)) };
-
-    int depth { png_get_bit_depth(pngPtr, infoPtr) };
-    assert(depth == 8 && "invalid depth");
-
-    int channels { png_get_channels(pngPtr, infoPtr) };
-    assert(channels == 4 && "invalid number of channels");
-
-    int rowbytes { static_cast<int>(png_get_rowbytes(pngPtr, infoPtr)) };
-    png_read_update_info(pngPtr, infoPtr);
-
-    std::vector<png_bytep> rowPtrs(h);
-    std::vector<unsigned char> data(h * rowbytes);
-    for (int i = 0; i < h; i++) {
-        rowPtrs[i] = data.data() + i * rowbytes;
+    if (options.inputs.empty())
+    {
+        // the PNG file is expected to be alongside the executable (and working folder should be set to that one too)
+        const ConversionJob job { "./some.png", "./im.bin" };
+        const auto started { std::chrono::steady_clock::now() };
+        ConversionResult result { convertFile(job.input, job.output, makeSettings(options, 1)) };
+        const double seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count() };
+        if (!result.ok)
+        {
+            std::cerr << "./some.png: " << result.error << std::endl;
+        }
+        else
+        {
+            (options.stats == StatsFormat::Json ? std::cerr : std::cout) << result.width << "x" << result.height << std::endl;
+        }
+        reportStats({ job }, { result }, seconds, options);
+        return result.ok ? 0 : 2;
     }
-    png_read_image(pngPtr, rowPtrs.data());
-
-    png_destroy_read_struct(&pngPtr, &infoPtr, &endInfo);
-
-    file.close();
-
-    std::cout << w << "x" << h << std::endl;
 
-    int s { static_cast<int>(data.size()) };
-    uLongf size { compressBound(s) };
-
-    std::vector<Bytef> zip(size);
-    int r { compress2(zip.data(), &size, reinterpret_cast<Byte*>(data.data()), s, Z_BEST_COMPRESSION) };
-    assert(r == Z_OK && "compression error");
-
-    std::ofstream out { "./im.bin", std::ios::binary };
-    out.write(reinterpret_cast<char*>(&w), sizeof(w));
-    out.write(reinterpret_cast<char*>(&h), sizeof(h));
-    out.write(reinterpret_cast<char*>(zip.data()), size);
-    out.close();
+    std::vector<ConversionJob> jobs;
+    std::unique_ptr<Manifest> manifest;
+    try
+    {
+        jobs = collectJobs(options);
+        if (!options.manifest.empty())
+        {
+            manifest = std::make_unique<Manifest>(options.manifest);
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
 
-    return 0;
+    if (!options.sequenceOutput.empty())
+    {
+        return runSequence(jobs, options) == 0 ? 0 : 3;
+    }
+    return runBatch(jobs, options, manifest.get()) == 0 ? 0 : 3;
 }
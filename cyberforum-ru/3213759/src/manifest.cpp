@@ -0,0 +1,298 @@
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifdef USING_PACKAGE_MANAGER
+    #include <zlib/zlib.h>
+#else
+    #include <zlib.h>
+#endif
+
+#include "input.h"
+#include "manifest.h"
+
+namespace
+{
+    const char *const signature { "some-manifest 1" };
+
+    std::uint64_t hashBytes(const unsigned char *data, std::size_t size)
+    {
+        const uLong crc { crc32_z(crc32(0, nullptr, 0), data, size) };
+        const uLong adler { adler32_z(adler32(0, nullptr, 0), data, size) };
+        return (static_cast<std::uint64_t>(crc) << 32) | (adler & 0xffffffff);
+    }
+
+    std::string key(const std::filesystem::path &path)
+    {
+        return std::filesystem::absolute(path).lexically_normal().string();
+    }
+
+    // tabs and newlines separate the fields, paths with them in aren't recorded (and are simply always converted)
+    bool recordable(const std::string &path)
+    {
+        return path.find_first_of("\t\r\n") == std::string::npos;
+    }
+
+    // size \t time \t content hash \t settings hash \t output size \t input \t output
+    std::string format(const std::string &input, const ManifestEntry &entry)
+    {
+        char numbers[128];
+        std::snprintf(numbers, sizeof(numbers), "%llu\t%lld\t%016llx\t%016llx\t%llu\t",
+                      static_cast<unsigned long long>(entry.inputSize), static_cast<long long>(entry.inputTime),
+                      static_cast<unsigned long long>(entry.contentHash),
+                      static_cast<unsigned long long>(entry.settingsHash),
+                      static_cast<unsigned long long>(entry.outputSize));
+        return numbers + input + '\t' + entry.output + '\n';
+    }
+
+    // false for anything that isn't a whole line, such as the last one of a journal cut short
+    bool parse(const std::string &line, std::string &input, ManifestEntry &entry)
+    {
+        std::vector<std::string> fields;
+        std::size_t start { 0 };
+        for (;;)
+        {
+            const std::size_t tab { line.find('\t', start) };
+            fields.push_back(line.substr(start, tab - start));
+            if (tab == std::string::npos)
+            {
+                break;
+            }
+            start = tab + 1;
+        }
+        if (fields.size() != 7 || fields[5].empty() || fields[6].empty())
+        {
+            return false;
+        }
+        auto number = [&fields](std::size_t i, int base, unsigned long long &value)
+        {
+            char *end { nullptr };
+            value = std::strtoull(fields[i].c_str(), &end, base);
+            return !fields[i].empty() && *end == '\0';
+        };
+        unsigned long long values[5];
+        for (std::size_t i = 0; i < 5; i++)
+        {
+            if (!number(i, i == 2 || i == 3 ? 16 : 10, values[i]))
+            {
+                return false;
+            }
+        }
+        entry.inputSize = values[0];
+        entry.inputTime = static_cast<std::int64_t>(values[1]);
+        entry.contentHash = values[2];
+        entry.settingsHash = values[3];
+        entry.outputSize = values[4];
+        input = fields[5];
+        entry.output = fields[6];
+        return true;
+    }
+
+    // false if the file isn't there
+    bool load(const std::filesystem::path &path, std::unordered_map<std::string, ManifestEntry> &entries)
+    {
+        std::ifstream file { path, std::ios::binary };
+        if (!file)
+        {
+            return false;
+        }
+        std::string line;
+        if (!std::getline(file, line) || line != signature)
+        {
+            throw std::runtime_error(path.string() + " isn't a manifest");
+        }
+        std::string input;
+        ManifestEntry entry;
+        while (std::getline(file, line))
+        {
+            // a line without its newline is one that didn't make it to the disk whole
+            if (!file.eof() && parse(line, input, entry))
+            {
+                entries[input] = entry;
+            }
+        }
+        if (file.bad())
+        {
+            throw std::runtime_error("couldn't read " + path.string());
+        }
+        return true;
+    }
+
+    std::int64_t writeTime(const std::filesystem::path &path, std::error_code &ec)
+    {
+        return static_cast<std::int64_t>(std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+    }
+}
+
+std::uint64_t hashFile(const std::filesystem::path &path)
+{
+    const MappedFile file { path };
+    return hashBytes(file.data(), file.size());
+}
+
+std::uint64_t hashString(const std::string &text)
+{
+    return hashBytes(reinterpret_cast<const unsigned char*>(text.data()), text.size());
+}
+
+Manifest::Manifest(std::filesystem::path path)
+    : m_path { std::move(path) }
+{
+    m_journalPath = m_path;
+    m_journalPath += ".journal";
+    load(m_path, m_entries);
+    // what an interrupted run managed to convert
+    m_changed = load(m_journalPath, m_entries);
+}
+
+bool Manifest::needsConversion(const std::filesystem::path &input, const std::filesystem::path &output,
+                               std::uint64_t settingsHash, ManifestEntry &entry)
+{
+    std::error_code ec;
+    entry = {};
+    entry.settingsHash = settingsHash;
+    entry.output = key(output);
+    entry.inputSize = std::filesystem::file_size(input, ec);
+    if (!ec)
+    {
+        entry.inputTime = writeTime(input, ec);
+    }
+    if (ec)
+    {
+        // the conversion reports whatever is wrong with it
+        return true;
+    }
+
+    const std::string inputKey { key(input) };
+    ManifestEntry known;
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        const auto found { m_entries.find(inputKey) };
+        if (found == m_entries.end())
+        {
+            return true;
+        }
+        known = found->second;
+    }
+    if (known.settingsHash != settingsHash || known.output != entry.output || known.inputSize != entry.inputSize
+        || std::filesystem::file_size(output, ec) != known.outputSize || ec)
+    {
+        return true;
+    }
+    if (known.inputTime == entry.inputTime)
+    {
+        return false;
+    }
+
+    // touched (a checkout, a copy) but maybe not changed
+    try
+    {
+        entry.contentHash = hashFile(input);
+    }
+    catch (const std::exception&)
+    {
+        return true;
+    }
+    if (entry.contentHash != known.contentHash)
+    {
+        return true;
+    }
+    // the new time, so the next run doesn't have to read it again
+    entry.outputSize = known.outputSize;
+    std::lock_guard<std::mutex> lock { m_mutex };
+    m_entries[inputKey] = entry;
+    append(inputKey, entry);
+    return false;
+}
+
+void Manifest::record(const std::filesystem::path &input, ManifestEntry entry)
+{
+    std::error_code ec;
+    entry.outputSize = std::filesystem::file_size(entry.output, ec);
+    if (ec)
+    {
+        return;
+    }
+    if (entry.contentHash == 0)
+    {
+        // needsConversion() only reads the inputs that look unchanged; this is the state before the conversion
+        // as long as the time didn't change in the meantime
+        try
+        {
+            entry.contentHash = hashFile(input);
+        }
+        catch (const std::exception&)
+        {
+            return;
+        }
+        if (writeTime(input, ec) != entry.inputTime || ec)
+        {
+            return;
+        }
+    }
+    const std::string inputKey { key(input) };
+    if (!recordable(inputKey) || !recordable(entry.output))
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock { m_mutex };
+    m_entries[inputKey] = entry;
+    append(inputKey, entry);
+}
+
+void Manifest::save()
+{
+    std::lock_guard<std::mutex> lock { m_mutex };
+    if (!m_changed)
+    {
+        return;
+    }
+    // into a temporary file first, so an interrupted save leaves the old manifest (and the journal) in place
+    std::filesystem::path temporary { m_path };
+    temporary += ".tmp";
+    {
+        std::ofstream file { temporary, std::ios::binary | std::ios::trunc };
+        file << signature << '\n';
+        for (const auto &[input, entry] : m_entries)
+        {
+            file << format(input, entry);
+        }
+        file.close();
+        if (!file)
+        {
+            throw std::runtime_error("couldn't write " + temporary.string());
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, m_path, ec);
+    if (ec)
+    {
+        throw std::runtime_error("couldn't replace " + m_path.string() + ": " + ec.message());
+    }
+    if (m_journal.is_open())
+    {
+        m_journal.close();
+    }
+    std::filesystem::remove(m_journalPath, ec);
+    m_changed = false;
+}
+
+void Manifest::append(const std::string &input, const ManifestEntry &entry)
+{
+    m_changed = true;
+    if (!m_journal.is_open())
+    {
+        const bool exists { std::filesystem::exists(m_journalPath) };
+        m_journal.open(m_journalPath, std::ios::binary | std::ios::app);
+        if (!exists)
+        {
+            m_journal << signature << '\n';
+        }
+    }
+    // a failing journal only costs the conversions of this run if it's interrupted, save() still writes them all
+    m_journal << format(input, entry);
+    m_journal.flush();
+}
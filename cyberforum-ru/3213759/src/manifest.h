@@ -0,0 +1,65 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// what an input was like when it was converted, and what it was converted to
+struct ManifestEntry
+{
+    std::uint64_t inputSize { 0 };
+    // last write time, in ticks of std::filesystem::file_time_type
+    std::int64_t inputTime { 0 };
+    std::uint64_t contentHash { 0 };
+    // of the options that change the output, so changing them converts everything again
+    std::uint64_t settingsHash { 0 };
+    std::string output;
+    std::uint64_t outputSize { 0 };
+};
+
+// the inputs converted by earlier runs, so a run only converts what changed since (--manifest);
+// the file is rewritten whole at the end of a run, and until then every conversion is appended to a journal
+// next to it, which the next run picks up if this one is interrupted; safe to use from any number of threads
+class Manifest
+{
+public:
+    // a missing file is an empty manifest; throws std::runtime_error if it can't be read or isn't a manifest
+    explicit Manifest(std::filesystem::path path);
+
+    Manifest(const Manifest&) = delete;
+    Manifest& operator=(const Manifest&) = delete;
+
+    // false if the input is the same as when it was converted with the same settings to the same output, which
+    // is still there; same size and write time is enough, a different time with the same contents is unchanged too;
+    // otherwise entry gets the current state of the input, to be recorded once it's converted
+    bool needsConversion(const std::filesystem::path &input, const std::filesystem::path &output,
+                         std::uint64_t settingsHash, ManifestEntry &entry);
+    // remembers a successful conversion, with entry from needsConversion()
+    void record(const std::filesystem::path &input, ManifestEntry entry);
+
+    // writes the whole manifest (if anything was recorded) and removes the journal, at the end of a run;
+    // throws std::runtime_error
+    void save();
+
+private:
+    // the journal goes to disk line by line, so at most the line being written is lost
+    void append(const std::string &input, const ManifestEntry &entry);
+
+    std::filesystem::path m_path;
+    std::filesystem::path m_journalPath;
+    std::unordered_map<std::string, ManifestEntry> m_entries;
+    std::ofstream m_journal;
+    // anything in the journal (from this run or an interrupted one) that the manifest file doesn't have
+    bool m_changed { false };
+    std::mutex m_mutex;
+};
+
+// crc32 and adler32 of the contents side by side, both as fast as zlib makes them; throws ConversionError
+std::uint64_t hashFile(const std::filesystem::path &path);
+std::uint64_t hashString(const std::string &text);
+
+#endif // MANIFEST_H
@@ -0,0 +1,253 @@
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+
+#include "memory_pool.h"
+
+namespace
+{
+    // the blocks other threads free for a thread: they are handed back to the thread that allocated them, which
+    // is the one that asks for that size again (in the pipeline mode the decode thread allocates the pixels and
+    // the compress thread frees them); never destroyed, the list of a thread that ended goes to the next thread
+    // that starts, and blocks freed while no thread has it go straight back to the system
+    struct RemoteFrees
+    {
+        std::mutex mutex;
+        void *head { nullptr };
+        bool owned { false };
+        // set with head, so the owner only takes the lock when there is something to take
+        std::atomic<bool> pending { false };
+        RemoteFrees *nextUnowned { nullptr };
+    };
+
+    // in front of every block, big enough to keep malloc's alignment
+    struct alignas(std::max_align_t) BlockHeader
+    {
+        unsigned sizeClass;
+        RemoteFrees *owner;
+    };
+
+    // classes of 64 bytes to 256 MB, anything bigger goes straight to malloc and back
+    const unsigned smallestClass { 6 };
+    const unsigned classCount { 23 };
+    const unsigned unpooled { classCount };
+    // more than this sitting in the free lists of one thread goes back to the system
+    const std::size_t cacheLimit { std::size_t { 256 } * 1024 * 1024 };
+
+    unsigned sizeClassOf(std::size_t size)
+    {
+        unsigned c { smallestClass };
+        while (c < smallestClass + classCount && (std::size_t { 1 } << c) < size)
+        {
+            c++;
+        }
+        return c - smallestClass;
+    }
+
+    std::size_t classBytes(unsigned sizeClass)
+    {
+        return std::size_t { 1 } << (sizeClass + smallestClass);
+    }
+
+    // the lists of the threads that ended, allocated and never freed, so they outlive every thread
+    struct RemoteRegistry
+    {
+        std::mutex mutex;
+        RemoteFrees *unowned { nullptr };
+    };
+
+    RemoteRegistry& remoteRegistry()
+    {
+        static RemoteRegistry *registry { new RemoteRegistry };
+        return *registry;
+    }
+
+    RemoteFrees* takeRemoteFrees()
+    {
+        RemoteRegistry &registry { remoteRegistry() };
+        RemoteFrees *remote { nullptr };
+        {
+            std::lock_guard<std::mutex> lock { registry.mutex };
+            remote = registry.unowned;
+            if (remote)
+            {
+                registry.unowned = remote->nextUnowned;
+            }
+        }
+        if (!remote)
+        {
+            remote = new RemoteFrees;
+        }
+        std::lock_guard<std::mutex> lock { remote->mutex };
+        remote->owned = true;
+        return remote;
+    }
+
+    void freeList(void *head)
+    {
+        while (head)
+        {
+            void *next { *static_cast<void**>(head) };
+            std::free(static_cast<BlockHeader*>(head) - 1);
+            head = next;
+        }
+    }
+
+    class ThreadCache
+    {
+    public:
+        ThreadCache() : m_remote { takeRemoteFrees() } {}
+
+        ~ThreadCache()
+        {
+            void *remoteHead { nullptr };
+            {
+                std::lock_guard<std::mutex> lock { m_remote->mutex };
+                m_remote->owned = false;
+                remoteHead = m_remote->head;
+                m_remote->head = nullptr;
+                m_remote->pending = false;
+            }
+            freeList(remoteHead);
+            RemoteRegistry &registry { remoteRegistry() };
+            {
+                std::lock_guard<std::mutex> lock { registry.mutex };
+                m_remote->nextUnowned = registry.unowned;
+                registry.unowned = m_remote;
+            }
+            for (void *&head : m_heads)
+            {
+                freeList(head);
+                head = nullptr;
+            }
+            m_cached = 0;
+        }
+
+        ThreadCache(const ThreadCache&) = delete;
+        ThreadCache& operator=(const ThreadCache&) = delete;
+
+        void* allocate(std::size_t size)
+        {
+            m_counts.requests++;
+            const unsigned sizeClass { sizeClassOf(size) };
+            if (sizeClass != unpooled && !m_heads[sizeClass] && m_remote->pending.load(std::memory_order_acquire))
+            {
+                takeRemote();
+            }
+            if (sizeClass != unpooled && m_heads[sizeClass])
+            {
+                // free blocks keep the pointer to the next one where the data goes
+                void *block { m_heads[sizeClass] };
+                m_heads[sizeClass] = *static_cast<void**>(block);
+                m_cached -= classBytes(sizeClass);
+                return block;
+            }
+
+            m_counts.system++;
+            const std::size_t bytes { sizeClass == unpooled ? size : classBytes(sizeClass) };
+            if (bytes > static_cast<std::size_t>(-1) - sizeof(BlockHeader))
+            {
+                return nullptr;
+            }
+            BlockHeader *header { static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader) + bytes)) };
+            if (!header)
+            {
+                return nullptr;
+            }
+            header->sizeClass = sizeClass;
+            header->owner = m_remote;
+            return header + 1;
+        }
+
+        void release(void *block)
+        {
+            BlockHeader *header { static_cast<BlockHeader*>(block) - 1 };
+            const unsigned sizeClass { header->sizeClass };
+            if (sizeClass != unpooled && header->owner != m_remote)
+            {
+                releaseRemote(block, header->owner);
+                return;
+            }
+            if (sizeClass == unpooled || m_cached + classBytes(sizeClass) > cacheLimit)
+            {
+                std::free(header);
+                return;
+            }
+            *static_cast<void**>(block) = m_heads[sizeClass];
+            m_heads[sizeClass] = block;
+            m_cached += classBytes(sizeClass);
+        }
+
+        const AllocationCounts& counts() const { return m_counts; }
+
+        void charge(const AllocationCounts &counts)
+        {
+            m_counts.requests += counts.requests;
+            m_counts.system += counts.system;
+        }
+
+    private:
+        static void releaseRemote(void *block, RemoteFrees *owner)
+        {
+            {
+                std::lock_guard<std::mutex> lock { owner->mutex };
+                if (owner->owned)
+                {
+                    *static_cast<void**>(block) = owner->head;
+                    owner->head = block;
+                    owner->pending.store(true, std::memory_order_release);
+                    return;
+                }
+            }
+            std::free(static_cast<BlockHeader*>(block) - 1);
+        }
+
+        // the blocks other threads freed go to the lists (or back to the system past the limit)
+        void takeRemote()
+        {
+            void *head { nullptr };
+            {
+                std::lock_guard<std::mutex> lock { m_remote->mutex };
+                head = m_remote->head;
+                m_remote->head = nullptr;
+                m_remote->pending.store(false, std::memory_order_relaxed);
+            }
+            while (head)
+            {
+                void *next { *static_cast<void**>(head) };
+                release(head);
+                head = next;
+            }
+        }
+
+        RemoteFrees *m_remote;
+        void *m_heads[classCount] {};
+        std::size_t m_cached { 0 };
+        AllocationCounts m_counts;
+    };
+
+    thread_local ThreadCache cache;
+}
+
+void* poolAllocate(std::size_t size)
+{
+    return cache.allocate(size);
+}
+
+void poolFree(void *block)
+{
+    if (block)
+    {
+        cache.release(block);
+    }
+}
+
+AllocationCounts threadAllocationCounts()
+{
+    return cache.counts();
+}
+
+void chargeAllocations(const AllocationCounts &counts)
+{
+    cache.charge(counts);
+}
@@ -0,0 +1,83 @@
+#ifndef MEMORY_POOL_H
+#define MEMORY_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+// every thread keeps the blocks freed on it in free lists by power-of-two size class and hands them out again;
+// a conversion asks for the same few sizes as the one before (the libpng structs and row buffers, the zlib
+// windows and hash chains, the pixels, the compressed payload), so once a worker has converted an image
+// the next ones are served from its lists instead of malloc
+//
+// blocks can be freed on another thread than the one that allocated them, they go back to the lists of that thread
+// (the next time it runs out of a size), or to the system if it has ended
+
+// never throws, nullptr when the system is out of memory (what libpng and zlib expect of their hooks)
+void* poolAllocate(std::size_t size);
+// nullptr is fine
+void poolFree(void *block);
+
+// what the pool of the calling thread has done since the thread started
+struct AllocationCounts
+{
+    std::uint64_t requests { 0 };
+    // the requests that couldn't be served from a free list and went to malloc
+    std::uint64_t system { 0 };
+};
+
+AllocationCounts threadAllocationCounts();
+
+// counts allocations made by other threads on behalf of the calling one (the helpers of parallelFor()) as its own
+void chargeAllocations(const AllocationCounts &counts);
+
+// std::allocator on top of the pool; it also default-initializes instead of value-initializing,
+// so resize() leaves the new bytes as they are instead of zeroing them
+template<typename T>
+struct PoolAllocator
+{
+    using value_type = T;
+
+    PoolAllocator() = default;
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n)
+    {
+        void *p { poolAllocate(n * sizeof(T)) };
+        if (!p)
+        {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T *p, std::size_t) noexcept
+    {
+        poolFree(p);
+    }
+
+    template<typename U>
+    void construct(U *p) noexcept(noexcept(::new(static_cast<void*>(p)) U))
+    {
+        ::new(static_cast<void*>(p)) U;
+    }
+
+    template<typename U, typename... Args>
+    void construct(U *p, Args&&... args)
+    {
+        ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+};
+
+// pixels, rows and compressed data: reused between images and never zero-filled
+using ByteBuffer = std::vector<unsigned char, PoolAllocator<unsigned char>>;
+
+#endif // MEMORY_POOL_H
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "imbin/cpu.h"
+#include "mipmap.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+namespace
+{
+    // sRGB <-> linear light, with 16 bits of linear so that the sum of a block fits 18 and dark colours keep their steps
+    struct LinearTables
+    {
+        std::uint16_t toLinear[256];
+        std::vector<unsigned char> toSrgb;
+
+        LinearTables()
+            : toSrgb(65536)
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                const double c { i / 255.0 };
+                const double linear { c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4) };
+                toLinear[i] = static_cast<std::uint16_t>(std::lround(linear * 65535.0));
+            }
+            for (std::size_t i = 0; i < toSrgb.size(); i++)
+            {
+                const double linear { i / 65535.0 };
+                const double c { linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1 / 2.4) - 0.055 };
+                toSrgb[i] = static_cast<unsigned char>(std::lround(std::clamp(c, 0.0, 1.0) * 255.0));
+            }
+        }
+    };
+
+    const LinearTables& linearTables()
+    {
+        static const LinearTables tables;
+        return tables;
+    }
+
+    // a row of the level from two rows of the one above, columns 2x and 2x + 1 (the last one twice on a 1 wide level)
+    void boxRowScalar(const unsigned char *row0, const unsigned char *row1, std::uint32_t sourceWidth,
+                      unsigned char *out, std::uint32_t from, std::uint32_t width)
+    {
+        for (std::uint32_t x = from; x < width; x++)
+        {
+            const std::size_t x0 { static_cast<std::size_t>(x) * 2 * 4 };
+            const std::size_t x1 { static_cast<std::size_t>(std::min(x * 2 + 1, sourceWidth - 1)) * 4 };
+            for (std::size_t c = 0; c < 4; c++)
+            {
+                const unsigned sum { 2u + row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] };
+                out[x * 4 + c] = static_cast<unsigned char>(sum >> 2);
+            }
+        }
+    }
+
+    void linearRow(const unsigned char *row0, const unsigned char *row1, std::uint32_t sourceWidth,
+                   unsigned char *out, std::uint32_t width)
+    {
+        const LinearTables &tables { linearTables() };
+        for (std::uint32_t x = 0; x < width; x++)
+        {
+            const std::size_t x0 { static_cast<std::size_t>(x) * 2 * 4 };
+            const std::size_t x1 { static_cast<std::size_t>(std::min(x * 2 + 1, sourceWidth - 1)) * 4 };
+            for (std::size_t c = 0; c < 3; c++)
+            {
+                const std::uint32_t sum { 2u + tables.toLinear[row0[x0 + c]] + tables.toLinear[row0[x1 + c]]
+                    + tables.toLinear[row1[x0 + c]] + tables.toLinear[row1[x1 + c]] };
+                out[x * 4 + c] = tables.toSrgb[sum >> 2];
+            }
+            out[x * 4 + 3] = static_cast<unsigned char>((2u + row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3]) >> 2);
+        }
+    }
+
+#ifdef IMBIN_X86
+    // 4 pixels of the level out of 8 of each row above at a time, returns how many it did
+    IMBIN_TARGET("sse2")
+    std::uint32_t boxRowSse2(const unsigned char *row0, const unsigned char *row1, std::uint32_t sourceWidth,
+                             unsigned char *out, std::uint32_t width)
+    {
+        const __m128i zero { _mm_setzero_si128() };
+        const __m128i two { _mm_set1_epi16(2) };
+        std::uint32_t x { 0 };
+        for (; x + 4 <= width && (x + 4) * 2 <= sourceWidth; x += 4)
+        {
+            const __m128i a0 { _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8)) };
+            const __m128i a1 { _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8 + 16)) };
+            const __m128i b0 { _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8)) };
+            const __m128i b1 { _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 16)) };
+            // the two rows added up as 16-bit channels, two pixels per register
+            const __m128i s01 { _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero)) };
+            const __m128i s23 { _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero)) };
+            const __m128i s45 { _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero)) };
+            const __m128i s67 { _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero)) };
+            // and the neighbouring pixels: 0+1 and 2+3, 4+5 and 6+7
+            const __m128i q0 { _mm_add_epi16(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23)) };
+            const __m128i q1 { _mm_add_epi16(_mm_unpacklo_epi64(s45, s67), _mm_unpackhi_epi64(s45, s67)) };
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4),
+                             _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(q0, two), 2), _mm_srli_epi16(_mm_add_epi16(q1, two), 2)));
+        }
+        return x;
+    }
+#endif
+}
+
+void downsample(const Image &source, Image &target, MipFilter filter, imbin::Simd simd)
+{
+    target.width = std::max(source.width / 2, 1u);
+    target.height = std::max(source.height / 2, 1u);
+    target.rowBytes = static_cast<std::size_t>(target.width) * 4;
+    target.pixels.resize(target.height * target.rowBytes);
+    const bool vector { simd != imbin::Simd::Scalar && imbin::simdSupported(imbin::Simd::Ssse3) };
+    for (std::uint32_t y = 0; y < target.height; y++)
+    {
+        const unsigned char *row0 { source.pixels.data() + static_cast<std::size_t>(y) * 2 * source.rowBytes };
+        const unsigned char *row1 { source.pixels.data() + std::min(y * 2 + 1, source.height - 1) * source.rowBytes };
+        unsigned char *out { target.pixels.data() + y * target.rowBytes };
+        if (filter == MipFilter::LinearBox)
+        {
+            linearRow(row0, row1, source.width, out, target.width);
+            continue;
+        }
+        std::uint32_t done { 0 };
+#ifdef IMBIN_X86
+        if (vector)
+        {
+            done = boxRowSse2(row0, row1, source.width, out, target.width);
+        }
+#else
+        (void)vector;
+#endif
+        boxRowScalar(row0, row1, source.width, out, done, target.width);
+    }
+}
+
+imbin::ChunkData makeMipChunk(const Image &image, MipFilter filter, const DeflateSettings &deflate, unsigned threads)
+{
+    std::size_t count { 0 };
+    for (std::uint32_t w = image.width, h = image.height; w > 1 || h > 1; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u))
+    {
+        count++;
+    }
+    std::vector<Image> levels(count);
+    {
+        StageScope scope { Stage::Transform };
+        for (std::size_t i = 0; i < count; i++)
+        {
+            downsample(i == 0 ? image : levels[i - 1], levels[i], filter);
+        }
+    }
+
+    // every level is one stream, the levels are what's done in parallel
+    DeflateSettings settings { deflate };
+    settings.threads = 1;
+    settings.independentBlocks = false;
+    if (settings.automatic && count > 0)
+    {
+        StageScope scope { Stage::Deflate };
+        settings = chooseDeflateSettings(levels[0].pixels.data(), levels[0].rowBytes, levels[0].height, settings);
+    }
+    std::vector<ByteBuffer> streams(count);
+    parallelFor(count, threads, [&](std::size_t i)
+    {
+        StageScope scope { Stage::Deflate };
+        streams[i] = deflateBuffer(levels[i].pixels.data(), levels[i].height * levels[i].rowBytes, settings);
+    });
+
+    imbin::MipIndex index;
+    index.filter = filter == MipFilter::LinearBox ? imbin::MipIndex::Filter::LinearBox : imbin::MipIndex::Filter::Box;
+    std::uint64_t offset { imbin::mipIndexSize(count) };
+    for (std::size_t i = 0; i < count; i++)
+    {
+        index.levels.push_back({ levels[i].width, levels[i].height, offset, streams[i].size() });
+        offset += streams[i].size();
+    }
+    imbin::ChunkData chunk { imbin::mipChunk, imbin::serializeMipIndex(index) };
+    chunk.data.reserve(static_cast<std::size_t>(offset));
+    for (const ByteBuffer &stream : streams)
+    {
+        chunk.data.insert(chunk.data.end(), stream.begin(), stream.end());
+    }
+    return chunk;
+}
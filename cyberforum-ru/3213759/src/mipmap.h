@@ -0,0 +1,26 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <cstdint>
+
+#include "deflate.h"
+#include "image.h"
+#include <imbin/format.h>
+#include <imbin/simd.h>
+
+enum class MipFilter
+{
+    None,
+    Box, // the 2x2 blocks are averaged as they are
+    LinearBox // the colours are averaged in linear light (taken and given back as sRGB), alpha as it is
+};
+
+// the next level of the MIPS chunk (see include/imbin/format.h): half the size rounded down (at least 1),
+// every pixel the average of a 2x2 block; the box filter runs SSE2 with simd above Scalar
+void downsample(const Image &source, Image &target, MipFilter filter, imbin::Simd simd = imbin::bestSimd());
+
+// all the levels below the image down to 1x1, each deflated as a single stream on up to threads threads
+// (a level per thread), in a MIPS chunk; throws ConversionError
+imbin::ChunkData makeMipChunk(const Image &image, MipFilter filter, const DeflateSettings &deflate, unsigned threads);
+
+#endif // MIPMAP_H
@@ -0,0 +1,464 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "options.h"
+
+bool takeValue(const std::string &arg, const char *shortName, const char *longName,
+               int &i, int argc, char *argv[], std::string &value)
+{
+    const std::string longString { longName };
+    if (arg == longString || (shortName && arg == shortName))
+    {
+        if (i + 1 >= argc)
+        {
+            throw std::invalid_argument(arg + " requires a value");
+        }
+        value = argv[++i];
+        return true;
+    }
+    if (arg.compare(0, longString.size() + 1, longString + "=") == 0)
+    {
+        value = arg.substr(longString.size() + 1);
+        return true;
+    }
+    return false;
+}
+
+unsigned long parseUnsigned(const std::string &name, const std::string &value)
+{
+    std::size_t end { 0 };
+    unsigned long n { 0 };
+    try
+    {
+        n = std::stoul(value, &end);
+    }
+    catch (const std::exception&)
+    {
+        end = 0;
+    }
+    if (end == 0 || end != value.size() || value[0] == '-')
+    {
+        throw std::invalid_argument("invalid value for " + name + ": " + value);
+    }
+    return n;
+}
+
+unsigned long parseRange(const std::string &name, const std::string &value, unsigned long min, unsigned long max)
+{
+    const unsigned long n { parseUnsigned(name, value) };
+    if (n < min || n > max)
+    {
+        throw std::invalid_argument(name + " must be between " + std::to_string(min) + " and " + std::to_string(max));
+    }
+    return n;
+}
+
+Options parseOptions(int argc, char *argv[])
+{
+    Options options;
+    // the pipeline reads the files on a stage of its own, the way to read them can't be chosen there
+    bool inputGiven { false };
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg { argv[i] };
+        std::string value;
+        if (arg == "-h" || arg == "--help")
+        {
+            options.help = true;
+        }
+        else if (arg == "-v" || arg == "--verbose")
+        {
+            options.verbose = true;
+        }
+        else if (arg == "--verify")
+        {
+            options.verify = true;
+        }
+        else if (arg == "--stream")
+        {
+            options.streaming = true;
+        }
+        else if (arg == "--filter")
+        {
+            options.filterRows = true;
+        }
+        else if (arg == "--independent-blocks")
+        {
+            options.deflate.independentBlocks = true;
+        }
+        else if (takeValue(arg, nullptr, "--input", i, argc, argv, value))
+        {
+            if (value == "mmap") { options.input = InputMethod::Mapped; }
+            else if (value == "stream") { options.input = InputMethod::Stream; }
+            else { throw std::invalid_argument("invalid value for --input: " + value); }
+            inputGiven = true;
+        }
+        else if (takeValue(arg, nullptr, "--layout", i, argc, argv, value))
+        {
+            if (value == "interleaved") { options.layout = imbin::Layout::Interleaved; }
+            else if (value == "planar") { options.layout = imbin::Layout::PlanarRows; }
+            else { throw std::invalid_argument("invalid value for --layout: " + value); }
+        }
+        else if (takeValue(arg, nullptr, "--stats", i, argc, argv, value))
+        {
+            if (value == "text") { options.stats = StatsFormat::Text; }
+            else if (value == "json") { options.stats = StatsFormat::Json; }
+            else { throw std::invalid_argument("invalid value for --stats: " + value); }
+        }
+        else if (takeValue(arg, nullptr, "--trace", i, argc, argv, value))
+        {
+            if (value != "chrome")
+            {
+                throw std::invalid_argument("invalid value for --trace: " + value);
+            }
+            options.trace = true;
+        }
+        else if (takeValue(arg, nullptr, "--trace-file", i, argc, argv, value))
+        {
+            options.traceFile = value;
+        }
+        else if (takeValue(arg, nullptr, "--tiles", i, argc, argv, value))
+        {
+            // either "256" or "256x128"
+            const std::size_t x { value.find('x') };
+            const unsigned long w { parseRange("--tiles", value.substr(0, x), 1, 65536) };
+            const unsigned long h { x == std::string::npos ? w : parseRange("--tiles", value.substr(x + 1), 1, 65536) };
+            options.tileWidth = static_cast<std::uint32_t>(w);
+            options.tileHeight = static_cast<std::uint32_t>(h);
+        }
+        else if (takeValue(arg, nullptr, "--mips", i, argc, argv, value))
+        {
+            if (value == "box") { options.mips = MipFilter::Box; }
+            else if (value == "linear") { options.mips = MipFilter::LinearBox; }
+            else { throw std::invalid_argument("invalid value for --mips: " + value); }
+        }
+        else if (takeValue(arg, nullptr, "--format", i, argc, argv, value))
+        {
+            if (value == "rgba8") { options.format = imbin::PixelFormat::Rgba8; }
+            else if (value == "bc1") { options.format = imbin::PixelFormat::Bc1; }
+            else if (value == "bc3") { options.format = imbin::PixelFormat::Bc3; }
+            else if (value == "bc7") { options.format = imbin::PixelFormat::Bc7; }
+            else { throw std::invalid_argument("invalid value for --format: " + value); }
+        }
+        else if (takeValue(arg, nullptr, "--quality", i, argc, argv, value))
+        {
+            if (value == "fast") { options.blockQuality = BlockQuality::Fast; }
+            else if (value == "normal") { options.blockQuality = BlockQuality::Normal; }
+            else if (value == "best") { options.blockQuality = BlockQuality::Best; }
+            else { throw std::invalid_argument("invalid value for --quality: " + value); }
+        }
+        else if (arg == "--no-deflate")
+        {
+            options.storeBlocks = true;
+        }
+        else if (arg == "--keep-rgba")
+        {
+            options.keepRgba = true;
+        }
+        else if (takeValue(arg, nullptr, "--roi", i, argc, argv, value))
+        {
+            // x,y,w,h
+            std::uint32_t *fields[] { &options.region.x, &options.region.y, &options.region.width, &options.region.height };
+            std::size_t start { 0 };
+            for (std::size_t field = 0; field < 4; field++)
+            {
+                const std::size_t comma { value.find(',', start) };
+                if ((comma == std::string::npos) != (field == 3))
+                {
+                    throw std::invalid_argument("--roi takes x,y,width,height: " + value);
+                }
+                *fields[field] = static_cast<std::uint32_t>(parseRange("--roi", value.substr(start, comma - start),
+                                                                       field < 2 ? 0 : 1, 0x7fffffff));
+                start = comma + 1;
+            }
+        }
+        else if (takeValue(arg, "-j", "--jobs", i, argc, argv, value))
+        {
+            options.jobs = static_cast<unsigned>(parseUnsigned("--jobs", value));
+        }
+        else if (takeValue(arg, nullptr, "--level", i, argc, argv, value))
+        {
+            options.deflate.automatic = value == "auto";
+            if (!options.deflate.automatic)
+            {
+                options.deflate.level = static_cast<int>(parseRange("--level", value, 0, 9));
+            }
+        }
+        else if (takeValue(arg, nullptr, "--mem-level", i, argc, argv, value))
+        {
+            options.deflate.memLevel = static_cast<int>(parseRange("--mem-level", value, 1, 9));
+        }
+        else if (takeValue(arg, nullptr, "--window-bits", i, argc, argv, value))
+        {
+            options.deflate.windowBits = static_cast<int>(parseRange("--window-bits", value, 9, 15));
+        }
+        else if (takeValue(arg, nullptr, "--strategy", i, argc, argv, value))
+        {
+            if (value == "default") { options.deflate.strategy = DeflateStrategy::Default; }
+            else if (value == "filtered") { options.deflate.strategy = DeflateStrategy::Filtered; }
+            else if (value == "rle") { options.deflate.strategy = DeflateStrategy::Rle; }
+            else if (value == "huffman") { options.deflate.strategy = DeflateStrategy::HuffmanOnly; }
+            else { throw std::invalid_argument("invalid value for --strategy: " + value); }
+        }
+        else if (takeValue(arg, nullptr, "--deflate-threads", i, argc, argv, value))
+        {
+            options.deflateThreads = static_cast<unsigned>(parseUnsigned("--deflate-threads", value));
+        }
+        else if (takeValue(arg, nullptr, "--block-size", i, argc, argv, value))
+        {
+            const unsigned long kilobytes { parseUnsigned("--block-size", value) };
+            if (kilobytes < 32 || kilobytes > 1024 * 1024)
+            {
+                throw std::invalid_argument("--block-size must be between 32 and 1048576 KB");
+            }
+            options.blockSize = static_cast<std::size_t>(kilobytes) * 1024;
+        }
+        else if (takeValue(arg, nullptr, "--input-fd", i, argc, argv, value))
+        {
+            options.inputFd = static_cast<int>(parseRange("--input-fd", value, 0, 1024 * 1024));
+        }
+        else if (takeValue(arg, nullptr, "--schedule", i, argc, argv, value))
+        {
+            if (value == "largest") { options.schedule = Schedule::LargestFirst; }
+            else if (value == "fifo") { options.schedule = Schedule::InOrder; }
+            else { throw std::invalid_argument("invalid value for --schedule: " + value); }
+        }
+        else if (takeValue(arg, nullptr, "--pipeline", i, argc, argv, value))
+        {
+            // either "auto" or "<read>,<decode>,<compress>,<write>" threads, 0 for the default of a stage
+            options.pipelined = true;
+            if (value != "auto")
+            {
+                unsigned *threads[] { &options.pipeline.readThreads, &options.pipeline.decodeThreads,
+                                      &options.pipeline.compressThreads, &options.pipeline.writeThreads };
+                std::size_t start { 0 };
+                for (std::size_t stage = 0; stage < 4; stage++)
+                {
+                    const std::size_t comma { value.find(',', start) };
+                    if ((comma == std::string::npos) != (stage == 3))
+                    {
+                        throw std::invalid_argument("--pipeline takes auto or 4 thread counts: " + value);
+                    }
+                    const unsigned long n { parseRange("--pipeline", value.substr(start, comma - start), 0, 1024) };
+                    if (n > 0)
+                    {
+                        *threads[stage] = static_cast<unsigned>(n);
+                    }
+                    start = comma + 1;
+                }
+            }
+        }
+        else if (takeValue(arg, nullptr, "--queue-depth", i, argc, argv, value))
+        {
+            options.pipeline.queueDepth = parseRange("--queue-depth", value, 1, 1024);
+        }
+        else if (takeValue(arg, nullptr, "--manifest", i, argc, argv, value))
+        {
+            options.manifest = value;
+        }
+        else if (takeValue(arg, nullptr, "--sequence", i, argc, argv, value))
+        {
+            options.sequenceOutput = value;
+        }
+        else if (takeValue(arg, nullptr, "--keyframe-interval", i, argc, argv, value))
+        {
+            options.sequence.keyframeInterval = static_cast<std::uint32_t>(parseRange("--keyframe-interval", value, 1, 1000000));
+        }
+        else if (takeValue(arg, "-o", "--output-dir", i, argc, argv, value))
+        {
+            options.outputDirectory = value;
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            throw std::invalid_argument("unknown option " + arg);
+        }
+        else
+        {
+            options.inputs.emplace_back(arg);
+        }
+    }
+
+    if (std::find(options.inputs.begin(), options.inputs.end(), std::filesystem::path { "-" }) != options.inputs.end())
+    {
+        if (options.inputs.size() > 1 || options.inputFd >= 0)
+        {
+            throw std::invalid_argument("- can't be combined with other inputs");
+        }
+        options.inputs.clear();
+        options.inputFd = 0;
+    }
+    if (options.mips != MipFilter::None && (options.streaming || options.inputFd >= 0 || !options.sequenceOutput.empty()))
+    {
+        throw std::invalid_argument("--mips needs whole images, it can't be combined with --stream, a pipe or --sequence");
+    }
+    if (imbin::isBlockFormat(options.format))
+    {
+        if (options.streaming || options.inputFd >= 0 || !options.sequenceOutput.empty() || options.mips != MipFilter::None)
+        {
+            throw std::invalid_argument("block formats need whole images, they can't be combined with --stream, a pipe, --sequence or --mips");
+        }
+        if (options.tileWidth > 0 || options.layout != imbin::Layout::Interleaved || options.filterRows)
+        {
+            throw std::invalid_argument("block formats can't be combined with --tiles, --layout planar or --filter");
+        }
+    }
+    else if (options.storeBlocks)
+    {
+        throw std::invalid_argument("--no-deflate only goes with --format bc1, bc3 or bc7");
+    }
+    if (options.pipelined && options.streaming)
+    {
+        throw std::invalid_argument("--pipeline can't be combined with --stream, it decodes whole images");
+    }
+    if (options.pipelined && inputGiven)
+    {
+        throw std::invalid_argument("--pipeline can't be combined with --input, it reads whole files into memory");
+    }
+    if (!options.sequenceOutput.empty())
+    {
+        if (options.inputFd >= 0 || options.inputs.empty())
+        {
+            throw std::invalid_argument("--sequence needs input files");
+        }
+        if (options.pipelined || options.streaming)
+        {
+            throw std::invalid_argument("--sequence can't be combined with --pipeline or --stream, it has stages of its own");
+        }
+        if (options.layout != imbin::Layout::Interleaved || options.filterRows)
+        {
+            throw std::invalid_argument("--sequence can't be combined with --layout planar or --filter");
+        }
+        if (!options.manifest.empty() || !options.outputDirectory.empty())
+        {
+            throw std::invalid_argument("--sequence can't be combined with --manifest or --output-dir, it makes a single file");
+        }
+        if (options.stats != StatsFormat::None || options.trace)
+        {
+            throw std::invalid_argument("--sequence can't be combined with --stats or --trace");
+        }
+        if (options.tileWidth > 0)
+        {
+            options.sequence.tileWidth = options.tileWidth;
+            options.sequence.tileHeight = options.tileHeight;
+            options.tileWidth = 0;
+            options.tileHeight = 0;
+        }
+    }
+    if (options.inputFd >= 0)
+    {
+        if (options.pipelined)
+        {
+            throw std::invalid_argument("--pipeline needs input files, it can't be used with a pipe");
+        }
+        if (!options.inputs.empty())
+        {
+            throw std::invalid_argument("--input-fd can't be combined with input files");
+        }
+        if (options.verify)
+        {
+            throw std::invalid_argument("--verify needs the output files, it can't be used with a pipe");
+        }
+        if (!options.outputDirectory.empty())
+        {
+            throw std::invalid_argument("--output-dir can't be used with a pipe, the results go to stdout");
+        }
+        if (!options.manifest.empty())
+        {
+            throw std::invalid_argument("--manifest needs input files, it can't be used with a pipe");
+        }
+        if (!options.region.empty())
+        {
+            throw std::invalid_argument("--roi needs input files, it can't be used with a pipe");
+        }
+    }
+    else if (options.inputs.empty())
+    {
+        if (!options.manifest.empty())
+        {
+            throw std::invalid_argument("--manifest needs input files, ./some.png is always converted");
+        }
+        if (!options.outputDirectory.empty())
+        {
+            throw std::invalid_argument("--output-dir needs input files, ./some.png always goes to ./im.bin");
+        }
+    }
+    return options;
+}
+
+void printUsage(std::ostream &out)
+{
+    out << "Usage: some [options] [<file.png|directory>...]\n"
+        << "       some [options] -\n"
+        << "\n"
+        << "Converts PNG images to im.bin files. Directories are scanned recursively for *.png,\n"
+        << "every <name>.png becomes <name>.im.bin. Without inputs ./some.png is converted to ./im.bin\n"
+        << "With - the PNGs are read from stdin one after another as they arrive, and the im.bin files\n"
+        << "are written to stdout one after another (always in the --stream mode, messages go to stderr)\n"
+        << "\n"
+        << "Options:\n"
+        << "  -j, --jobs <n>         number of images converted in parallel (default: all cores)\n"
+        << "      --level <0-9|auto> deflate level (default: 9), auto picks level and strategy per image\n"
+        << "                         by trying a few of them on a sample of rows\n"
+        << "      --mem-level <1-9>  deflate memLevel (default: 8)\n"
+        << "      --window-bits <9-15>\n"
+        << "                         deflate window size (default: 15)\n"
+        << "      --strategy <name>  default, filtered, rle or huffman (default: default)\n"
+        << "      --schedule <order> largest (default): the images with the most pixels (going by the PNG headers)\n"
+        << "                         are converted first, fifo: as listed, without reading the headers first\n"
+        << "      --deflate-threads <n>\n"
+        << "                         threads compressing blocks of one image (default: depends on the share of\n"
+        << "                         the batch's pixels the image has, all cores for a single image, 1 when\n"
+        << "                         there are enough images to keep every core busy anyway)\n"
+        << "      --block-size <KB>  size of the blocks compressed in parallel (default: 128)\n"
+        << "      --independent-blocks\n"
+        << "                         don't prime the blocks with the previous one and index them in the file,\n"
+        << "                         so readers can inflate them in parallel too (slightly bigger output)\n"
+        << "      --pipeline <auto|r,d,c,w>\n"
+        << "                         separate threads for reading (2), decoding (all cores), compressing (all cores)\n"
+        << "                         and writing (2) instead of -j workers doing everything, so slow disks and the\n"
+        << "                         cores can overlap; the counts are given in that order, 0 keeps the default\n"
+        << "      --queue-depth <n>  images waiting between two pipeline stages (default: 4)\n"
+        << "      --input <method>   how input files are read: mmap (default) or stream (std::ifstream),\n"
+        << "                         not with --pipeline\n"
+        << "      --input-fd <n>     read the PNGs from an inherited descriptor instead of stdin, as with -\n"
+        << "      --stream           decode and compress row by row with memory independent of the image height\n"
+        << "                         (single-threaded deflate, interlaced images are still decoded whole)\n"
+        << "      --layout <name>    interleaved (default) or planar: every row is split into R, G, B and A planes,\n"
+        << "                         which usually deflates better\n"
+        << "      --filter           PNG-style prediction filters (Sub, Up, Average, Paeth) picked for every row\n"
+        << "      --tiles <w>[x<h>]  tiled output, every tile compressed separately (and in parallel),\n"
+        << "                         so a region can be decoded without inflating the whole image\n"
+        << "      --mips <filter>    store the mip levels of every image down to 1x1 in front of its pixels, made\n"
+        << "                         while converting it: box (2x2 averages) or linear (the same in linear light)\n"
+        << "      --format <name>    rgba8 (default), or 4x4 blocks GPUs take as they are: bc1 (RGB, 1-bit alpha,\n"
+        << "                         8 bytes per block), bc3 (RGBA, 16 bytes) or bc7 (RGBA in mode 6, 16 bytes)\n"
+        << "      --quality <preset> how hard the block formats look for the endpoints: fast (bounding box),\n"
+        << "                         normal (principal axis, the default) or best (refined by least squares)\n"
+        << "      --no-deflate       store the blocks without deflating them, so they can be uploaded straight\n"
+        << "                         from a mapping of the file\n"
+        << "      --keep-rgba        store the alpha of opaque images, every pixel of single-colour ones and the\n"
+        << "                         colours of ones with 256 colours or fewer, which are otherwise stored as RGB,\n"
+        << "                         as just the one pixel and as palette indices (for older readers)\n"
+        << "      --roi <x,y,w,h>    convert only that rectangle of every image (cut to the image): the rows above\n"
+        << "                         it are decoded without being kept and nothing below it is decoded at all\n"
+        << "      --verify           decode every written file and compare it with the source\n"
+        << "      --stats <format>   time spent reading, decoding, transforming, deflating, writing and verifying,\n"
+        << "                         per image and in total, with compression ratios: text (after the summary)\n"
+        << "                         or json (on stdout, the summary goes to stderr)\n"
+        << "      --trace chrome     write a Chrome trace of every stage of every image (see --trace-file)\n"
+        << "      --trace-file <path>\n"
+        << "                         where the trace goes (default: some-trace.json)\n"
+        << "      --sequence <path>  put all the inputs into one file as the frames of an animation, in the order\n"
+        << "                         given (directories sorted by name); frames between keyframes are stored as\n"
+        << "                         the XOR of the tiles that changed since the frame before (--tiles sets their\n"
+        << "                         size, default: 64); all the frames have to be the same size\n"
+        << "      --keyframe-interval <n>\n"
+        << "                         a keyframe at least every n frames of a sequence, and at every cut (default: 30)\n"
+        << "  -o, --output-dir <dir> where to put the results (default: next to the inputs)\n"
+        << "      --manifest <path>  record what every input was converted from and with, and skip the inputs\n"
+        << "                         that are unchanged since (same size and time, or same contents) and were\n"
+        << "                         converted with the same options to an output that is still there\n"
+        << "  -v, --verbose          report every converted image, not only the failed ones\n"
+        << "  -h, --help             show this message\n";
+}
@@ -0,0 +1,88 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "converter.h"
+#include "pipeline.h"
+
+enum class StatsFormat
+{
+    None,
+    Text, // a table of the stages after the summary (and a line per image with --verbose)
+    Json // per-image and aggregate numbers on stdout, the summary goes to stderr then
+};
+
+enum class Schedule
+{
+    LargestFirst, // by the pixel count in the PNG headers, so the big ones don't start at the end
+    InOrder // as listed, nothing read before the conversions start
+};
+
+struct Options
+{
+    // files and/or directories (scanned recursively for *.png)
+    std::vector<std::filesystem::path> inputs;
+    // a pipe the PNGs come from one after another ("-" for stdin, or --input-fd), -1 for the files in inputs;
+    // the im.bin files go to stdout one after another then, and everything else to stderr
+    int inputFd { -1 };
+    // empty means next to each input
+    std::filesystem::path outputDirectory;
+    // where the inputs converted by earlier runs are recorded, so only the new and changed ones are converted
+    std::filesystem::path manifest;
+    // parallel conversions, 0 means all cores
+    unsigned jobs { 0 };
+    Schedule schedule { Schedule::LargestFirst };
+    // read, decode, compress and write stages with threads of their own instead of workers doing everything
+    bool pipelined { false };
+    PipelineSettings pipeline;
+    // all the inputs (in the order given, directories sorted) go into this one file as frames of an image sequence
+    std::filesystem::path sequenceOutput;
+    // --tiles sets the tile size of the deltas then
+    SequenceSettings sequence;
+    // level, strategy and the rest; "--level auto" sets the automatic flag
+    DeflateSettings deflate;
+    // threads deflating blocks of a single image, 0 means "decide depending on the number of images"
+    unsigned deflateThreads { 0 };
+    std::size_t blockSize { 128 * 1024 };
+    InputMethod input { InputMethod::Mapped };
+    bool streaming { false };
+    imbin::Layout layout { imbin::Layout::Interleaved };
+    bool filterRows { false };
+    bool verify { false };
+    std::uint32_t tileWidth { 0 };
+    std::uint32_t tileHeight { 0 };
+    // convert only this part of every image
+    Region region;
+    MipFilter mips { MipFilter::None };
+    // GPU block formats instead of RGBA8
+    imbin::PixelFormat format { imbin::PixelFormat::Rgba8 };
+    BlockQuality blockQuality { BlockQuality::Normal };
+    bool storeBlocks { false };
+    // every pixel with its alpha even for opaque and single-colour images
+    bool keepRgba { false };
+    StatsFormat stats { StatsFormat::None };
+    // Chrome trace event format (chrome://tracing, Perfetto) of every stage of every image
+    bool trace { false };
+    std::filesystem::path traceFile { "some-trace.json" };
+    bool verbose { false };
+    bool help { false };
+};
+
+// throws std::invalid_argument with a human-readable message
+Options parseOptions(int argc, char *argv[]);
+
+void printUsage(std::ostream &out);
+
+// helpers for parsing command lines, shared with the benchmark; all of them throw std::invalid_argument
+
+// supports both "--name value" and "--name=value", returns false if arg is a different option
+bool takeValue(const std::string &arg, const char *shortName, const char *longName,
+               int &i, int argc, char *argv[], std::string &value);
+unsigned long parseUnsigned(const std::string &name, const std::string &value);
+unsigned long parseRange(const std::string &name, const std::string &value, unsigned long min, unsigned long max);
+
+#endif // OPTIONS_H
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <system_error>
+#include <thread>
+
+#include "pipeline.h"
+#include "thread_pool.h"
+
+namespace
+{
+    // an image on its way through the stages, every one of them leaving its result here for the next
+    struct Work
+    {
+        std::size_t index { 0 };
+        std::filesystem::path input;
+        std::filesystem::path output;
+        ConversionResult result;
+        ByteBuffer png;
+        Image image;
+        EncodedImage encoded;
+    };
+
+    using WorkPtr = std::unique_ptr<Work>;
+
+    // between two stages; keeps the time-weighted number of images in it for the stats
+    class WorkQueue
+    {
+    public:
+        explicit WorkQueue(std::size_t capacity)
+            : m_capacity { capacity },
+              m_started { monotonicNanoseconds() },
+              m_since { m_started }
+        {}
+
+        // waits for room
+        void push(WorkPtr work)
+        {
+            std::unique_lock<std::mutex> lock { m_mutex };
+            m_spaceAvailable.wait(lock, [this] { return m_items.size() < m_capacity; });
+            account();
+            m_items.push_back(std::move(work));
+            m_itemAvailable.notify_one();
+        }
+
+        // waits for an image, false once the stage before has finished and everything is taken
+        bool pop(WorkPtr &work)
+        {
+            std::unique_lock<std::mutex> lock { m_mutex };
+            m_itemAvailable.wait(lock, [this] { return !m_items.empty() || m_closed; });
+            if (m_items.empty())
+            {
+                return false;
+            }
+            account();
+            work = std::move(m_items.front());
+            m_items.pop_front();
+            m_spaceAvailable.notify_one();
+            return true;
+        }
+
+        // nothing more is coming
+        void close()
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            m_closed = true;
+            m_itemAvailable.notify_all();
+        }
+
+        std::size_t capacity() const { return m_capacity; }
+
+        double averageFill()
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            account();
+            return m_since > m_started ? static_cast<double>(m_fillIntegral) / static_cast<double>(m_since - m_started) : 0;
+        }
+
+    private:
+        // under the lock, before the number of images changes
+        void account()
+        {
+            const std::uint64_t now { monotonicNanoseconds() };
+            m_fillIntegral += m_items.size() * (now - m_since);
+            m_since = now;
+        }
+
+        std::deque<WorkPtr> m_items;
+        std::size_t m_capacity;
+        bool m_closed { false };
+        std::uint64_t m_started;
+        std::uint64_t m_since;
+        std::uint64_t m_fillIntegral { 0 };
+
+        std::mutex m_mutex;
+        std::condition_variable m_itemAvailable;
+        std::condition_variable m_spaceAvailable;
+    };
+
+    struct StageCounters
+    {
+        std::atomic<std::uint64_t> busy { 0 };
+        std::atomic<std::uint64_t> starved { 0 };
+        std::atomic<std::uint64_t> blocked { 0 };
+        // the last thread of the stage to finish closes the queue after it
+        std::atomic<unsigned> running { 0 };
+    };
+
+    class Pipeline
+    {
+    public:
+        Pipeline(const PipelineJobs &jobs, const ConversionSettings &settings, const PipelineSettings &pipeline)
+            : m_jobs { jobs },
+              m_settings { settings },
+              m_decodeQueue { std::max<std::size_t>(pipeline.queueDepth, 1) },
+              m_compressQueue { std::max<std::size_t>(pipeline.queueDepth, 1) },
+              m_writeQueue { std::max<std::size_t>(pipeline.queueDepth, 1) }
+        {
+            const unsigned cores { defaultThreadCount() };
+            m_threads[0] = std::max(pipeline.readThreads, 1u);
+            m_threads[1] = pipeline.decodeThreads > 0 ? pipeline.decodeThreads : cores;
+            m_threads[2] = pipeline.compressThreads > 0 ? pipeline.compressThreads : cores;
+            m_threads[3] = std::max(pipeline.writeThreads, 1u);
+        }
+
+        PipelineStats run()
+        {
+            const std::uint64_t started { monotonicNanoseconds() };
+            std::vector<std::thread> threads;
+            for (std::size_t stage = 0; stage < stageCount; stage++)
+            {
+                m_counters[stage].running = m_threads[stage];
+                for (unsigned t = 0; t < m_threads[stage]; t++)
+                {
+                    threads.emplace_back([this, stage] { stage == 0 ? readLoop() : stageLoop(stage); });
+                }
+            }
+            for (std::thread &thread : threads)
+            {
+                thread.join();
+            }
+
+            PipelineStats stats;
+            stats.seconds = static_cast<double>(monotonicNanoseconds() - started) / 1e9;
+            const char *names[stageCount] { "read", "decode", "compress", "write" };
+            WorkQueue *queues[stageCount] { nullptr, &m_decodeQueue, &m_compressQueue, &m_writeQueue };
+            for (std::size_t stage = 0; stage < stageCount; stage++)
+            {
+                PipelineStageStats &line { stats.stages.emplace_back() };
+                line.name = names[stage];
+                line.threads = m_threads[stage];
+                line.busySeconds = static_cast<double>(m_counters[stage].busy) / 1e9;
+                line.starvedSeconds = static_cast<double>(m_counters[stage].starved) / 1e9;
+                line.blockedSeconds = static_cast<double>(m_counters[stage].blocked) / 1e9;
+                if (queues[stage])
+                {
+                    line.queueCapacity = queues[stage]->capacity();
+                    line.queueFill = queues[stage]->averageFill();
+                }
+            }
+            return stats;
+        }
+
+    private:
+        static constexpr std::size_t stageCount { 4 };
+
+        // the jobs are taken in order from a counter, so there's no queue in front of this stage
+        void readLoop()
+        {
+            for (;;)
+            {
+                const std::size_t index { m_next++ };
+                if (index >= m_jobs.count)
+                {
+                    break;
+                }
+                WorkPtr work { std::make_unique<Work>() };
+                work->index = index;
+                if (!m_jobs.start(index, work->input, work->output))
+                {
+                    continue;
+                }
+                if (process(0, *work))
+                {
+                    forward(0, std::move(work));
+                }
+            }
+            finishStage(0);
+        }
+
+        void stageLoop(std::size_t stage)
+        {
+            WorkQueue &in { stage == 1 ? m_decodeQueue : stage == 2 ? m_compressQueue : m_writeQueue };
+            for (;;)
+            {
+                const std::uint64_t waiting { monotonicNanoseconds() };
+                WorkPtr work;
+                const bool more { in.pop(work) };
+                m_counters[stage].starved += monotonicNanoseconds() - waiting;
+                if (!more)
+                {
+                    break;
+                }
+                if (process(stage, *work) && stage + 1 < stageCount)
+                {
+                    forward(stage, std::move(work));
+                }
+            }
+            finishStage(stage);
+        }
+
+        // false if the image is done with, failed or (after the last stage) converted
+        bool process(std::size_t stage, Work &work)
+        {
+            const std::uint64_t started { monotonicNanoseconds() };
+            const std::uint64_t allocatedBefore { threadAllocationCounts().system };
+            StageRecorder recorder { m_settings.keepSpans };
+            if (m_settings.recordStages)
+            {
+                recorder.start();
+            }
+            bool ok { true };
+            try
+            {
+                switch (stage)
+                {
+                case 0:
+                    work.png = readPng(work.input, work.result);
+                    break;
+                case 1:
+                    work.image = decodeImage(work.png, m_settings, work.result);
+                    work.png = ByteBuffer {};
+                    break;
+                case 2:
+                    work.encoded = encodeImage(work.image, m_settings, work.result);
+                    work.image = Image {};
+                    break;
+                default:
+                    if (work.output.has_parent_path())
+                    {
+                        std::error_code ec;
+                        std::filesystem::create_directories(work.output.parent_path(), ec);
+                    }
+                    writeEncoded(work.output, work.encoded, m_settings);
+                    work.encoded = EncodedImage {};
+                    work.result.ok = true;
+                    break;
+                }
+            }
+            catch (const std::exception &ex)
+            {
+                work.result.error = ex.what();
+                ok = false;
+            }
+            if (m_settings.recordStages)
+            {
+                recorder.stop();
+                addTimes(work.result.times, recorder.times());
+            }
+            work.result.allocations += threadAllocationCounts().system - allocatedBefore;
+            m_counters[stage].busy += monotonicNanoseconds() - started;
+            if (!ok || stage + 1 == stageCount)
+            {
+                m_jobs.finished(work.index, work.result);
+                return false;
+            }
+            return true;
+        }
+
+        void forward(std::size_t stage, WorkPtr work)
+        {
+            WorkQueue &out { stage == 0 ? m_decodeQueue : stage == 1 ? m_compressQueue : m_writeQueue };
+            const std::uint64_t waiting { monotonicNanoseconds() };
+            out.push(std::move(work));
+            m_counters[stage].blocked += monotonicNanoseconds() - waiting;
+        }
+
+        void finishStage(std::size_t stage)
+        {
+            if (--m_counters[stage].running == 0 && stage + 1 < stageCount)
+            {
+                (stage == 0 ? m_decodeQueue : stage == 1 ? m_compressQueue : m_writeQueue).close();
+            }
+        }
+
+        const PipelineJobs &m_jobs;
+        const ConversionSettings &m_settings;
+        std::atomic<std::size_t> m_next { 0 };
+        unsigned m_threads[stageCount] {};
+        StageCounters m_counters[stageCount];
+        WorkQueue m_decodeQueue;
+        WorkQueue m_compressQueue;
+        WorkQueue m_writeQueue;
+    };
+}
+
+PipelineStats runPipeline(const PipelineJobs &jobs, const ConversionSettings &settings, const PipelineSettings &pipeline)
+{
+    ConversionSettings staged { settings };
+    staged.streaming = false;
+    Pipeline runner { jobs, staged, pipeline };
+    return runner.run();
+}
+
+void printPipelineStats(const PipelineStats &stats, std::ostream &out)
+{
+    out << std::endl
+        << "pipeline stage  threads   working   waiting   blocked   queue (average/capacity)" << std::endl;
+    const PipelineStageStats *bottleneck { nullptr };
+    double highest { -1 };
+    for (const PipelineStageStats &stage : stats.stages)
+    {
+        const double threadSeconds { std::max(stats.seconds * stage.threads, 1e-9) };
+        const double working { stage.busySeconds / threadSeconds };
+        out << std::left << std::setw(16) << stage.name << std::right
+            << std::setw(7) << stage.threads
+            << std::fixed << std::setprecision(1)
+            << std::setw(9) << working * 100 << "%"
+            << std::setw(9) << stage.starvedSeconds / threadSeconds * 100 << "%"
+            << std::setw(9) << stage.blockedSeconds / threadSeconds * 100 << "%";
+        if (stage.queueCapacity > 0)
+        {
+            out << std::setw(10) << stage.queueFill << "/" << stage.queueCapacity;
+        }
+        out << std::endl;
+        if (working > highest)
+        {
+            highest = working;
+            bottleneck = &stage;
+        }
+    }
+    if (bottleneck)
+    {
+        out << "the busiest stage is " << bottleneck->name << ", more threads there (or fewer elsewhere) may help"
+            << std::endl;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+#include "converter.h"
+
+// a batch converted by stages with threads of their own, every one handing the images to the next through
+// a bounded queue: reading the files ahead, decoding, compressing and writing behind, so the disks and the cores
+// are busy at the same time instead of every worker waiting for its own reads and writes
+struct PipelineSettings
+{
+    // 0 means as many as there are cores
+    unsigned readThreads { 2 };
+    unsigned decodeThreads { 0 };
+    unsigned compressThreads { 0 };
+    unsigned writeThreads { 2 };
+    // images waiting between two stages, a full queue stops the stage before it
+    std::size_t queueDepth { 4 };
+};
+
+// how the threads of a stage spent a run, summed over all of them
+struct PipelineStageStats
+{
+    const char *name { "" };
+    unsigned threads { 0 };
+    // on the images
+    double busySeconds { 0 };
+    // waiting for the stage before it
+    double starvedSeconds { 0 };
+    // waiting for room in the queue after it
+    double blockedSeconds { 0 };
+    // the queue in front of the stage, none for the first one
+    std::size_t queueCapacity { 0 };
+    double queueFill { 0 };
+};
+
+struct PipelineStats
+{
+    double seconds { 0 };
+    std::vector<PipelineStageStats> stages;
+};
+
+struct PipelineJobs
+{
+    std::size_t count { 0 };
+    // where job i comes from and goes to, called by the reading threads; false to skip it
+    std::function<bool(std::size_t, std::filesystem::path&, std::filesystem::path&)> start;
+    // once for every job that was started, converted or failed, from the thread of the stage it ended in
+    std::function<void(std::size_t, ConversionResult&)> finished;
+};
+
+// the conversions are the same as convertFile()'s except for the streaming mode, which doesn't have stages
+PipelineStats runPipeline(const PipelineJobs &jobs, const ConversionSettings &settings, const PipelineSettings &pipeline);
+
+// a line per stage with the share of its threads' time spent working, waiting for input and waiting for room,
+// and the one most likely holding the rest up
+void printPipelineStats(const PipelineStats &stats, std::ostream &out);
+
+#endif // PIPELINE_H
@@ -0,0 +1,88 @@
+#include <cstring>
+
+#include "imbin/cpu.h"
+#include "pixel_scan.h"
+
+namespace
+{
+    // what differs from the first pixel (OR of the XORs) and which alpha bits are missing, from pixel from on
+    void scanScalar(const unsigned char *rgba, std::size_t from, std::size_t pixels, std::uint32_t first,
+                    std::uint32_t &differs, unsigned &missingAlpha)
+    {
+        for (std::size_t i = from; i < pixels; i++)
+        {
+            std::uint32_t pixel;
+            std::memcpy(&pixel, rgba + i * 4, 4);
+            differs |= pixel ^ first;
+            missingAlpha |= static_cast<unsigned>(~rgba[i * 4 + 3]) & 255;
+        }
+    }
+
+#ifdef IMBIN_X86
+    // 4 pixels at a time, returns how many it did
+    IMBIN_TARGET("sse2")
+    std::size_t scanSse2(const unsigned char *rgba, std::size_t pixels, std::uint32_t first,
+                         std::uint32_t &differs, unsigned &missingAlpha)
+    {
+        const __m128i reference { _mm_set1_epi32(static_cast<int>(first)) };
+        const __m128i alpha { _mm_set1_epi32(static_cast<int>(0xff000000u)) };
+        __m128i diff { _mm_setzero_si128() };
+        __m128i missing { _mm_setzero_si128() };
+        std::size_t i { 0 };
+        for (; i + 4 <= pixels; i += 4)
+        {
+            const __m128i v { _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4)) };
+            diff = _mm_or_si128(diff, _mm_xor_si128(v, reference));
+            missing = _mm_or_si128(missing, _mm_andnot_si128(v, alpha));
+        }
+        const __m128i zero { _mm_setzero_si128() };
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xffff)
+        {
+            differs |= 1;
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(missing, zero)) != 0xffff)
+        {
+            missingAlpha |= 1;
+        }
+        return i;
+    }
+#endif
+}
+
+PixelScan::PixelScan(imbin::Simd simd)
+    : m_vector { simd != imbin::Simd::Scalar && imbin::simdSupported(imbin::Simd::Ssse3) }
+{}
+
+void PixelScan::reset()
+{
+    m_opaque = true;
+    m_constant = true;
+    m_first = true;
+    m_colors.clear();
+}
+
+void PixelScan::add(const unsigned char *rgba, std::size_t pixels)
+{
+    if ((!m_opaque && !m_constant && m_colors.overflowed()) || pixels == 0)
+    {
+        return;
+    }
+    m_colors.add(rgba, pixels);
+    if (m_first)
+    {
+        std::memcpy(&m_pixel, rgba, 4);
+        m_first = false;
+    }
+    std::uint32_t differs { 0 };
+    unsigned missingAlpha { 0 };
+    std::size_t done { 0 };
+#ifdef IMBIN_X86
+    if (m_vector)
+    {
+        done = scanSse2(rgba, pixels, m_pixel, differs, missingAlpha);
+    }
+#endif
+    scanScalar(rgba, done, pixels, m_pixel, differs, missingAlpha);
+    m_constant = m_constant && differs == 0;
+    m_opaque = m_opaque && missingAlpha == 0;
+}
@@ -0,0 +1,39 @@
+#ifndef PIXEL_SCAN_H
+#define PIXEL_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <imbin/simd.h>
+
+#include "color_set.h"
+
+// whether all the RGBA8 pixels of an image have the alpha 255, whether they are all the same and which colours
+// they have if they have few, worked out a row at a time while the rows are still in the cache from being decoded;
+// the rows stop being looked at as soon as none of it can be true any more; SSE2 with simd above Scalar
+class PixelScan
+{
+public:
+    explicit PixelScan(imbin::Simd simd = imbin::bestSimd());
+
+    // forgets the rows added so far
+    void reset();
+    void add(const unsigned char *rgba, std::size_t pixels);
+
+    // all three are true before any pixel is added
+    bool opaque() const { return m_opaque; }
+    bool constant() const { return m_constant; }
+    // no more than ColorSet::maxColors colours, which are then in colors()
+    bool fewColors() const { return !m_colors.overflowed(); }
+    const ColorSet &colors() const { return m_colors; }
+
+private:
+    bool m_vector;
+    bool m_opaque { true };
+    bool m_constant { true };
+    bool m_first { true };
+    std::uint32_t m_pixel { 0 };
+    ColorSet m_colors;
+};
+
+#endif // PIXEL_SCAN_H
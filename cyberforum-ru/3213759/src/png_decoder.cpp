@@ -0,0 +1,667 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#ifdef USING_PACKAGE_MANAGER
+    #include <png/png.h>
+#else
+    #include <png.h>
+#endif
+
+#include "errors.h"
+#include "memory_pool.h"
+#include "png_decoder.h"
+#include "stats.h"
+
+namespace
+{
+    // png_error() longjmps, so the stage scopes end before it
+
+    void userReadData(png_structp pngPtr, png_bytep data, png_size_t length)
+    {
+        std::istream *s { reinterpret_cast<std::istream*>(png_get_io_ptr(pngPtr)) };
+        bool complete { false };
+        {
+            StageScope scope { Stage::Read };
+            s->read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(length));
+            complete = static_cast<png_size_t>(s->gcount()) == length;
+        }
+        if (!complete)
+        {
+            png_error(pngPtr, "unexpected end of file");
+        }
+    }
+
+    void memoryReadData(png_structp pngPtr, png_bytep data, png_size_t length)
+    {
+        MemoryInput *m { reinterpret_cast<MemoryInput*>(png_get_io_ptr(pngPtr)) };
+        if (length > m->size - m->offset)
+        {
+            png_error(pngPtr, "unexpected end of file");
+        }
+        // touching the mapping is where the file is actually read
+        StageScope scope { Stage::Read };
+        std::memcpy(data, m->data + m->offset, length);
+        m->offset += length;
+    }
+
+    // libpng reports errors by longjmp-ing, so the message is kept until we are back in C++ land
+    void userError(png_structp pngPtr, png_const_charp message)
+    {
+        PngErrorState *state { reinterpret_cast<PngErrorState*>(png_get_error_ptr(pngPtr)) };
+        state->message = message;
+        png_longjmp(pngPtr, 1);
+    }
+
+    void userWarning(png_structp, png_const_charp) {}
+
+    // the read struct, the info struct, the row buffers and zlib's inflate state all come from the thread's pool
+    png_voidp userMalloc(png_structp, png_alloc_size_t size)
+    {
+        return poolAllocate(size);
+    }
+
+    void userFree(png_structp, png_voidp block)
+    {
+        poolFree(block);
+    }
+
+    // PLTE and tRNS
+    SourceInfo readTransparency(png_structp pngPtr, png_infop infoPtr, SourceColor color)
+    {
+        SourceInfo sourceInfo;
+        png_bytep alpha { nullptr };
+        int alphaCount { 0 };
+        png_color_16p key { nullptr };
+        const bool hasTrns { png_get_tRNS(pngPtr, infoPtr, &alpha, &alphaCount, &key) != 0 };
+
+        if (color == SourceColor::Palette)
+        {
+            png_colorp palette { nullptr };
+            int count { 0 };
+            png_get_PLTE(pngPtr, infoPtr, &palette, &count);
+            for (int i = 0; i < 256; i++)
+            {
+                unsigned char entry[4] { 0, 0, 0, 255 };
+                if (i < count)
+                {
+                    entry[0] = palette[i].red;
+                    entry[1] = palette[i].green;
+                    entry[2] = palette[i].blue;
+                }
+                if (hasTrns && alpha && i < alphaCount)
+                {
+                    entry[3] = alpha[i];
+                }
+                std::memcpy(&sourceInfo.palette[static_cast<std::size_t>(i)], entry, 4);
+            }
+        }
+        else if (hasTrns && key && (color == SourceColor::Gray || color == SourceColor::Rgb))
+        {
+            sourceInfo.colorKey = true;
+            if (color == SourceColor::Gray)
+            {
+                sourceInfo.key[0] = key->gray;
+            }
+            else
+            {
+                sourceInfo.key[0] = key->red;
+                sourceInfo.key[1] = key->green;
+                sourceInfo.key[2] = key->blue;
+            }
+        }
+        return sourceInfo;
+    }
+
+    bool withoutAlpha(SourceColor color, const SourceInfo &info)
+    {
+        switch (color)
+        {
+        case SourceColor::Gray:
+        case SourceColor::Rgb:
+            return !info.colorKey;
+        case SourceColor::Palette:
+            // the entries are RGBA bytes
+            return std::all_of(info.palette.begin(), info.palette.end(), [](std::uint32_t entry)
+            {
+                return reinterpret_cast<const unsigned char*>(&entry)[3] == 255;
+            });
+        case SourceColor::GrayAlpha:
+        case SourceColor::Rgba:
+            break;
+        }
+        return false;
+    }
+
+    // what the scan of the rows found out
+    void noteScan(const PixelScan &scan, Image &image)
+    {
+        image.opaque = scan.opaque();
+        image.constant = scan.constant();
+        image.palette.clear();
+        if (scan.fewColors())
+        {
+            const ColorSet &colors { scan.colors() };
+            image.palette.assign(colors.colors(), colors.colors() + colors.size());
+        }
+    }
+}
+
+// in all the methods below only libpng frames are skipped by the longjmp,
+// and nothing with a destructor is created between setjmp() and the libpng calls
+
+PngReader::PngReader(std::istream &file)
+{
+    png_byte header[8];
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (file.gcount() != sizeof(header))
+    {
+        throw ConversionError("not a PNG file");
+    }
+    open(header, &file, false);
+}
+
+PngReader::PngReader(const unsigned char *data, std::size_t size)
+    : m_memory { data, size, 8 }
+{
+    if (size < 8)
+    {
+        throw ConversionError("not a PNG file");
+    }
+    open(data, &m_memory, true);
+}
+
+void PngReader::open(const unsigned char *signature, void *ioPtr, bool fromMemory)
+{
+    if (png_sig_cmp(signature, 0, 8))
+    {
+        throw ConversionError("not a PNG file");
+    }
+
+    png_structp pngPtr { png_create_read_struct_2(PNG_LIBPNG_VER_STRING, &m_errorState, userError, userWarning,
+                                                     nullptr, userMalloc, userFree) };
+    if (!pngPtr)
+    {
+        throw ConversionError("couldn't create PNG read struct");
+    }
+    png_infop infoPtr { png_create_info_struct(pngPtr) };
+    if (!infoPtr)
+    {
+        png_destroy_read_struct(&pngPtr, nullptr, nullptr);
+        throw ConversionError("couldn't create PNG info struct");
+    }
+    m_png = pngPtr;
+    m_info = infoPtr;
+
+    if (setjmp(png_jmpbuf(pngPtr)))
+    {
+        png_destroy_read_struct(&pngPtr, &infoPtr, nullptr);
+        throw ConversionError(m_errorState.message);
+    }
+
+    png_set_sig_bytes(pngPtr, 8);
+    png_set_read_fn(pngPtr, ioPtr, fromMemory ? memoryReadData : userReadData);
+    png_read_info(pngPtr, infoPtr);
+
+    m_sourceColor = static_cast<SourceColor>(png_get_color_type(pngPtr, infoPtr));
+    m_sourceDepth = png_get_bit_depth(pngPtr, infoPtr);
+    m_sourceInfo = readTransparency(pngPtr, infoPtr, m_sourceColor);
+
+    m_interlaced = png_get_interlace_type(pngPtr, infoPtr) != PNG_INTERLACE_NONE;
+    if (m_interlaced)
+    {
+        png_set_interlace_handling(pngPtr);
+    }
+    png_read_update_info(pngPtr, infoPtr);
+
+    m_width = png_get_image_width(pngPtr, infoPtr);
+    m_height = png_get_image_height(pngPtr, infoPtr);
+    m_sourceRowBytes = png_get_rowbytes(pngPtr, infoPtr);
+    m_rowBytes = static_cast<std::size_t>(m_width) * 4;
+
+    // libpng has checked the type and depth in IHDR, so this only fails on a target we don't have a converter for
+    try
+    {
+        if (m_sourceColor != SourceColor::Rgba || m_sourceDepth != 8)
+        {
+            m_converter = findRowConverter(m_sourceColor, m_sourceDepth, m_sourceInfo.colorKey, imbin::PixelFormat::Rgba8);
+            m_sourceRow.resize(m_sourceRowBytes);
+        }
+    }
+    catch (...)
+    {
+        png_destroy_read_struct(&pngPtr, &infoPtr, nullptr);
+        throw;
+    }
+}
+
+PngReader::~PngReader()
+{
+    png_structp pngPtr { static_cast<png_structp>(m_png) };
+    png_infop infoPtr { static_cast<png_infop>(m_info) };
+    png_destroy_read_struct(&pngPtr, &infoPtr, nullptr);
+}
+
+bool PngReader::opaqueSource() const
+{
+    return withoutAlpha(m_sourceColor, m_sourceInfo);
+}
+
+void PngReader::readRow(unsigned char *row)
+{
+    png_structp pngPtr { static_cast<png_structp>(m_png) };
+    if (setjmp(png_jmpbuf(pngPtr)))
+    {
+        throw ConversionError(m_errorState.message);
+    }
+    png_read_row(pngPtr, m_converter ? m_sourceRow.data() : row, nullptr);
+    if (m_converter)
+    {
+        m_converter(m_sourceRow.data(), m_width, row, m_sourceInfo);
+    }
+    m_scan.add(row, m_width);
+}
+
+void PngReader::readRow(unsigned char *row, std::uint32_t x, std::uint32_t width)
+{
+    if (x == 0 && width == m_width)
+    {
+        readRow(row);
+        return;
+    }
+    // 8-bit RGBA doesn't have a source row otherwise
+    m_sourceRow.resize(m_sourceRowBytes);
+    // with less than a byte per pixel the conversion starts from the first pixel of the byte holding x
+    const int pixelsPerByte { m_sourceDepth < 8 ? 8 / m_sourceDepth : 1 };
+    const std::uint32_t skipped { x % static_cast<std::uint32_t>(pixelsPerByte) };
+    if (skipped > 0)
+    {
+        m_cropRow.resize((static_cast<std::size_t>(width) + skipped) * 4);
+    }
+
+    png_structp pngPtr { static_cast<png_structp>(m_png) };
+    if (setjmp(png_jmpbuf(pngPtr)))
+    {
+        throw ConversionError(m_errorState.message);
+    }
+    png_read_row(pngPtr, m_sourceRow.data(), nullptr);
+    if (!m_converter)
+    {
+        std::memcpy(row, m_sourceRow.data() + static_cast<std::size_t>(x) * 4, static_cast<std::size_t>(width) * 4);
+    }
+    else if (m_sourceDepth >= 8)
+    {
+        m_converter(m_sourceRow.data() + static_cast<std::size_t>(x) * (m_sourceRowBytes / m_width), width, row, m_sourceInfo);
+    }
+    else
+    {
+        const unsigned char *source { m_sourceRow.data() + x / static_cast<std::uint32_t>(pixelsPerByte) };
+        if (skipped == 0)
+        {
+            m_converter(source, width, row, m_sourceInfo);
+        }
+        else
+        {
+            m_converter(source, width + skipped, m_cropRow.data(), m_sourceInfo);
+            std::memcpy(row, m_cropRow.data() + static_cast<std::size_t>(skipped) * 4, static_cast<std::size_t>(width) * 4);
+        }
+    }
+    m_scan.add(row, width);
+}
+
+void PngReader::skipRows(std::uint32_t count)
+{
+    m_sourceRow.resize(m_sourceRowBytes);
+    png_structp pngPtr { static_cast<png_structp>(m_png) };
+    if (setjmp(png_jmpbuf(pngPtr)))
+    {
+        throw ConversionError(m_errorState.message);
+    }
+    for (std::uint32_t i = 0; i < count; i++)
+    {
+        png_read_row(pngPtr, m_sourceRow.data(), nullptr);
+    }
+}
+
+void PngReader::readRegion(Image &image, std::uint32_t x, std::uint32_t y, std::uint32_t width, std::uint32_t height)
+{
+    if (x == 0 && y == 0 && width == m_width && height == m_height)
+    {
+        readImage(image);
+        return;
+    }
+    if (m_interlaced)
+    {
+        // every pass goes over all the rows, the crop is moved to the start of the buffer in place
+        readImage(image);
+        const std::size_t rowBytes { static_cast<std::size_t>(width) * 4 };
+        for (std::uint32_t i = 0; i < height; i++)
+        {
+            std::memmove(image.pixels.data() + i * rowBytes,
+                         image.pixels.data() + (static_cast<std::size_t>(y) + i) * m_rowBytes + static_cast<std::size_t>(x) * 4, rowBytes);
+        }
+        image.width = width;
+        image.height = height;
+        image.rowBytes = rowBytes;
+        image.pixels.resize(height * rowBytes);
+        // the scan was of the whole image, the rectangle can be opaque, constant or of few colours when the image isn't
+        m_scan.reset();
+        m_scan.add(image.pixels.data(), static_cast<std::size_t>(width) * height);
+        noteScan(m_scan, image);
+        return;
+    }
+
+    image.width = width;
+    image.height = height;
+    image.rowBytes = static_cast<std::size_t>(width) * 4;
+    image.pixels.resize(height * image.rowBytes);
+    skipRows(y);
+    m_scan.reset();
+    for (std::uint32_t i = 0; i < height; i++)
+    {
+        readRow(image.pixels.data() + i * image.rowBytes, x, width);
+    }
+    noteScan(m_scan, image);
+}
+
+void PngReader::readImage(Image &image)
+{
+    image.width = m_width;
+    image.height = m_height;
+    image.rowBytes = m_rowBytes;
+    image.pixels.resize(m_height * m_rowBytes);
+    m_scan.reset();
+
+    if (!m_interlaced)
+    {
+        // a row at a time (through one source row if it has to be converted, so there's no second copy of the image),
+        // scanned while it's still in the cache
+        for (std::uint32_t i = 0; i < m_height; i++)
+        {
+            readRow(image.pixels.data() + i * m_rowBytes);
+        }
+        noteScan(m_scan, image);
+        return;
+    }
+
+    // the passes of an interlaced image go over the rows several times, so its source rows are kept whole
+    ByteBuffer source(m_converter ? m_height * m_sourceRowBytes : 0);
+    unsigned char *target { m_converter ? source.data() : image.pixels.data() };
+    const std::size_t targetRowBytes { m_converter ? m_sourceRowBytes : m_rowBytes };
+
+    std::vector<png_bytep, PoolAllocator<png_bytep>> rowPtrs(m_height);
+    for (std::uint32_t i = 0; i < m_height; i++)
+    {
+        rowPtrs[i] = target + i * targetRowBytes;
+    }
+
+    png_structp pngPtr { static_cast<png_structp>(m_png) };
+    if (setjmp(png_jmpbuf(pngPtr)))
+    {
+        throw ConversionError(m_errorState.message);
+    }
+    png_read_image(pngPtr, rowPtrs.data());
+
+    for (std::uint32_t i = 0; i < m_height; i++)
+    {
+        unsigned char *row { image.pixels.data() + i * m_rowBytes };
+        if (m_converter)
+        {
+            m_converter(rowPtrs[i], m_width, row, m_sourceInfo);
+        }
+        m_scan.add(row, m_width);
+    }
+    noteScan(m_scan, image);
+}
+
+struct PushCallbacks
+{
+    static PngPushReader* reader(png_structp pngPtr)
+    {
+        return static_cast<PngPushReader*>(png_get_progressive_ptr(pngPtr));
+    }
+
+    // png_error() longjmps, so it's called once the reader is done with whatever has a destructor
+
+    static void info(png_structp pngPtr, png_infop)
+    {
+        if (!reader(pngPtr)->start())
+        {
+            png_error(pngPtr, "");
+        }
+    }
+
+    static void row(png_structp pngPtr, png_bytep row, png_uint_32 y, int pass)
+    {
+        if (!reader(pngPtr)->addRow(row, y, pass))
+        {
+            png_error(pngPtr, "");
+        }
+    }
+
+    static void end(png_structp pngPtr, png_infop)
+    {
+        if (!reader(pngPtr)->end())
+        {
+            png_error(pngPtr, "");
+        }
+        // whatever follows IEND is for the caller
+        reader(pngPtr)->m_unconsumed = png_process_data_pause(pngPtr, 0);
+    }
+
+    // keeps the message the reader has already set when it calls png_error() with an empty one
+    static void error(png_structp pngPtr, png_const_charp message)
+    {
+        PngErrorState *state { reinterpret_cast<PngErrorState*>(png_get_error_ptr(pngPtr)) };
+        if (message && *message)
+        {
+            state->message = message;
+        }
+        png_longjmp(pngPtr, 1);
+    }
+};
+
+PngPushReader::PngPushReader()
+{
+    png_structp pngPtr { png_create_read_struct_2(PNG_LIBPNG_VER_STRING, &m_errorState, PushCallbacks::error, userWarning,
+                                                     nullptr, userMalloc, userFree) };
+    if (!pngPtr)
+    {
+        throw ConversionError("couldn't create PNG read struct");
+    }
+    png_infop infoPtr { png_create_info_struct(pngPtr) };
+    if (!infoPtr)
+    {
+        png_destroy_read_struct(&pngPtr, nullptr, nullptr);
+        throw ConversionError("couldn't create PNG info struct");
+    }
+    m_png = pngPtr;
+    m_info = infoPtr;
+    png_set_progressive_read_fn(pngPtr, this, PushCallbacks::info, PushCallbacks::row, PushCallbacks::end);
+}
+
+PngPushReader::~PngPushReader()
+{
+    png_structp pngPtr { static_cast<png_structp>(m_png) };
+    png_infop infoPtr { static_cast<png_infop>(m_info) };
+    png_destroy_read_struct(&pngPtr, &infoPtr, nullptr);
+}
+
+std::size_t PngPushReader::feed(const unsigned char *data, std::size_t size)
+{
+    if (m_finished)
+    {
+        return 0;
+    }
+    png_structp pngPtr { static_cast<png_structp>(m_png) };
+    png_infop infoPtr { static_cast<png_infop>(m_info) };
+    m_unconsumed = 0;
+    if (setjmp(png_jmpbuf(pngPtr)))
+    {
+        throw ConversionError(m_errorState.message);
+    }
+    png_process_data(pngPtr, infoPtr, const_cast<png_bytep>(data), size);
+    return size - m_unconsumed;
+}
+
+bool PngPushReader::opaqueSource() const
+{
+    return withoutAlpha(m_sourceColor, m_sourceInfo);
+}
+
+void PngPushReader::take(std::uint32_t count)
+{
+    count = std::min(count, m_rowsReady);
+    // nothing left to move (the rows can't even have been allocated yet)
+    if (count == m_rowsReady)
+    {
+        m_rowsReady = 0;
+        return;
+    }
+    // whatever is left is at most what one feed() decodes
+    std::memmove(m_rows.data(), m_rows.data() + count * m_rowBytes, (m_rowsReady - count) * m_rowBytes);
+    m_rowsReady -= count;
+}
+
+bool PngPushReader::start()
+{
+    png_structp pngPtr { static_cast<png_structp>(m_png) };
+    png_infop infoPtr { static_cast<png_infop>(m_info) };
+    try
+    {
+        m_sourceColor = static_cast<SourceColor>(png_get_color_type(pngPtr, infoPtr));
+        const int depth { png_get_bit_depth(pngPtr, infoPtr) };
+        m_sourceInfo = readTransparency(pngPtr, infoPtr, m_sourceColor);
+        m_interlaced = png_get_interlace_type(pngPtr, infoPtr) != PNG_INTERLACE_NONE;
+        if (m_interlaced)
+        {
+            png_set_interlace_handling(pngPtr);
+        }
+        png_read_update_info(pngPtr, infoPtr);
+
+        m_width = png_get_image_width(pngPtr, infoPtr);
+        m_height = png_get_image_height(pngPtr, infoPtr);
+        m_sourceRowBytes = png_get_rowbytes(pngPtr, infoPtr);
+        m_rowBytes = static_cast<std::size_t>(m_width) * 4;
+        if (m_sourceColor != SourceColor::Rgba || depth != 8)
+        {
+            m_converter = findRowConverter(m_sourceColor, depth, m_sourceInfo.colorKey, imbin::PixelFormat::Rgba8);
+        }
+        if (m_interlaced)
+        {
+            m_source.resize(m_height * m_sourceRowBytes);
+        }
+        m_started = true;
+        return true;
+    }
+    catch (const std::exception &ex)
+    {
+        m_errorState.message = ex.what();
+        return false;
+    }
+}
+
+bool PngPushReader::addRow(const unsigned char *row, std::uint32_t y, int)
+{
+    if (y >= m_height)
+    {
+        m_errorState.message = "row out of range";
+        return false;
+    }
+    if (m_interlaced)
+    {
+        // rows a pass doesn't touch come with no data
+        png_progressive_combine_row(static_cast<png_structp>(m_png), m_source.data() + y * m_sourceRowBytes, row);
+        return true;
+    }
+    try
+    {
+        m_rows.resize((m_rowsReady + 1) * m_rowBytes);
+        unsigned char *target { m_rows.data() + m_rowsReady * m_rowBytes };
+        if (m_converter)
+        {
+            m_converter(row, m_width, target, m_sourceInfo);
+        }
+        else
+        {
+            std::memcpy(target, row, m_rowBytes);
+        }
+        m_rowsReady++;
+        return true;
+    }
+    catch (const std::exception &ex)
+    {
+        m_errorState.message = ex.what();
+        return false;
+    }
+}
+
+bool PngPushReader::end()
+{
+    try
+    {
+        if (m_interlaced)
+        {
+            m_rows.resize(m_height * m_rowBytes);
+            for (std::uint32_t y = 0; y < m_height; y++)
+            {
+                const unsigned char *source { m_source.data() + y * m_sourceRowBytes };
+                unsigned char *target { m_rows.data() + y * m_rowBytes };
+                if (m_converter)
+                {
+                    m_converter(source, m_width, target, m_sourceInfo);
+                }
+                else
+                {
+                    std::memcpy(target, source, m_rowBytes);
+                }
+            }
+            m_rowsReady = m_height;
+            m_source = ByteBuffer {};
+        }
+        m_finished = true;
+        return true;
+    }
+    catch (const std::exception &ex)
+    {
+        m_errorState.message = ex.what();
+        return false;
+    }
+}
+
+bool peekPngSize(const std::filesystem::path &path, std::uint32_t &width, std::uint32_t &height)
+{
+    // signature, then the length and the type of the first chunk, then the width and the height, big-endian
+    unsigned char bytes[24];
+    std::ifstream file { path, std::ios::binary };
+    if (!file.read(reinterpret_cast<char*>(bytes), sizeof(bytes)) || png_sig_cmp(bytes, 0, 8) != 0
+        || std::memcmp(bytes + 12, "IHDR", 4) != 0)
+    {
+        return false;
+    }
+    auto bigEndian = [&bytes](std::size_t offset)
+    {
+        return static_cast<std::uint32_t>(bytes[offset]) << 24 | static_cast<std::uint32_t>(bytes[offset + 1]) << 16
+            | static_cast<std::uint32_t>(bytes[offset + 2]) << 8 | bytes[offset + 3];
+    };
+    width = bigEndian(16);
+    height = bigEndian(20);
+    return true;
+}
+
+Image decodePng(std::istream &file)
+{
+    PngReader reader { file };
+    Image image;
+    reader.readImage(image);
+    return image;
+}
+
+Image decodePng(const unsigned char *data, std::size_t size)
+{
+    PngReader reader { data, size };
+    Image image;
+    reader.readImage(image);
+    return image;
+}
@@ -0,0 +1,167 @@
+#ifndef PNG_DECODER_H
+#define PNG_DECODER_H
+
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "color_convert.h"
+#include "image.h"
+#include "pixel_scan.h"
+
+// the struct libpng hands back to our callbacks, it only holds what they need
+struct PngErrorState
+{
+    std::string message;
+};
+
+// bytes the caller already has (in memory or in a mapped file), read without any extra buffering
+struct MemoryInput
+{
+    const unsigned char *data { nullptr };
+    std::size_t size { 0 };
+    std::size_t offset { 0 };
+};
+
+// a PNG being read, either all at once or row by row, as RGBA8 whatever its colour type and depth;
+// every method throws ConversionError
+class PngReader
+{
+public:
+    // both check the signature and read everything up to the pixels;
+    // the stream (or the memory) has to outlive the reader
+    explicit PngReader(std::istream &file);
+    PngReader(const unsigned char *data, std::size_t size);
+    ~PngReader();
+
+    PngReader(const PngReader&) = delete;
+    PngReader& operator=(const PngReader&) = delete;
+
+    std::uint32_t width() const { return m_width; }
+    std::uint32_t height() const { return m_height; }
+    std::size_t rowBytes() const { return m_rowBytes; }
+    // the colour type and depth of the file, before the conversion
+    SourceColor sourceColor() const { return m_sourceColor; }
+    int sourceDepth() const { return m_sourceDepth; }
+    // the source can't have any alpha but 255 (no alpha channel, no colour key, no transparent palette entries),
+    // so the image is known to be opaque before any of it is decoded
+    bool opaqueSource() const;
+    // rows of an interlaced image only make sense once all the passes are read, so it can't be streamed
+    bool interlaced() const { return m_interlaced; }
+
+    // the next row, for non-interlaced images only
+    void readRow(unsigned char *row);
+    // only width pixels of the next row starting at x, the rest of it is decoded but not converted or copied
+    void readRow(unsigned char *row, std::uint32_t x, std::uint32_t width);
+    // decodes the next count rows and drops them
+    void skipRows(std::uint32_t count);
+    // all the (remaining) rows, with Image::opaque and Image::constant scanned for as the rows are converted
+    void readImage(Image &image);
+    // just the rectangle (which has to be inside the image) out of the rows that are left: the rows above it are
+    // skipped and the ones below aren't decoded at all; interlaced images are decoded whole and cropped;
+    // Image::opaque and Image::constant are those of the rectangle
+    void readRegion(Image &image, std::uint32_t x, std::uint32_t y, std::uint32_t width, std::uint32_t height);
+
+private:
+    // ioPtr is either an std::istream or m_memory
+    void open(const unsigned char *signature, void *ioPtr, bool fromMemory);
+
+    MemoryInput m_memory;
+    void *m_png { nullptr };
+    void *m_info { nullptr };
+    PngErrorState m_errorState;
+
+    std::uint32_t m_width { 0 };
+    std::uint32_t m_height { 0 };
+    std::size_t m_rowBytes { 0 };
+    bool m_interlaced { false };
+
+    SourceColor m_sourceColor { SourceColor::Rgba };
+    int m_sourceDepth { 8 };
+    SourceInfo m_sourceInfo;
+    // null for 8-bit RGBA, which libpng reads straight into the output
+    RowConverter m_converter { nullptr };
+    std::size_t m_sourceRowBytes { 0 };
+    ByteBuffer m_sourceRow;
+    // the converted pixels of a cropped row that doesn't start on a byte boundary
+    ByteBuffer m_cropRow;
+    // of the rows read since readImage() or readRegion() started
+    PixelScan m_scan;
+};
+
+// a PNG that arrives in pieces (from a pipe, say), handed to libpng's progressive reader as they come;
+// rows come out as RGBA8 as soon as they are decoded, except for interlaced images, which come out all at once
+// after the last pass; every method throws ConversionError
+class PngPushReader
+{
+public:
+    PngPushReader();
+    ~PngPushReader();
+
+    PngPushReader(const PngPushReader&) = delete;
+    PngPushReader& operator=(const PngPushReader&) = delete;
+
+    // decodes what it can of the bytes and returns how many of them belong to this PNG:
+    // all of them unless it ends before they do, the rest is whatever follows it
+    std::size_t feed(const unsigned char *data, std::size_t size);
+
+    // everything up to the pixels has been read, so the size is known
+    bool started() const { return m_started; }
+    // IEND has been read
+    bool finished() const { return m_finished; }
+
+    std::uint32_t width() const { return m_width; }
+    std::uint32_t height() const { return m_height; }
+    std::size_t rowBytes() const { return m_rowBytes; }
+    bool interlaced() const { return m_interlaced; }
+    // see PngReader::opaqueSource(), known once started
+    bool opaqueSource() const;
+
+    // the rows decoded and not taken yet, one after another
+    std::uint32_t rowsReady() const { return m_rowsReady; }
+    unsigned char* rows() { return m_rows.data(); }
+    // drops the first count of them
+    void take(std::uint32_t count);
+
+private:
+    friend struct PushCallbacks;
+
+    // called by libpng, these don't throw (libpng can't be unwound through), they return false with the message set
+    bool start();
+    bool addRow(const unsigned char *row, std::uint32_t y, int pass);
+    bool end();
+
+    void *m_png { nullptr };
+    void *m_info { nullptr };
+    PngErrorState m_errorState;
+    // how much of the bytes being fed is past IEND
+    std::size_t m_unconsumed { 0 };
+    bool m_started { false };
+    bool m_finished { false };
+
+    std::uint32_t m_width { 0 };
+    std::uint32_t m_height { 0 };
+    std::size_t m_rowBytes { 0 };
+    bool m_interlaced { false };
+
+    SourceColor m_sourceColor { SourceColor::Rgba };
+    SourceInfo m_sourceInfo;
+    RowConverter m_converter { nullptr };
+    std::size_t m_sourceRowBytes { 0 };
+    // the passes of an interlaced image in the source format
+    ByteBuffer m_source;
+    ByteBuffer m_rows;
+    std::uint32_t m_rowsReady { 0 };
+};
+
+// the size from the IHDR chunk, which has to come first, without libpng and reading only the first 24 bytes;
+// false if the file can't be read or doesn't start like a PNG
+bool peekPngSize(const std::filesystem::path &path, std::uint32_t &width, std::uint32_t &height);
+
+// decode a whole PNG, throw ConversionError on invalid or unsupported input
+Image decodePng(std::istream &file);
+Image decodePng(const unsigned char *data, std::size_t size);
+
+#endif // PNG_DECODER_H
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "stats.h"
+
+namespace
+{
+    thread_local StageRecorder *currentRecorder { nullptr };
+}
+
+const char* stageName(Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::Read: return "read";
+    case Stage::Decode: return "decode";
+    case Stage::Transform: return "transform";
+    case Stage::Deflate: return "deflate";
+    case Stage::Write: return "write";
+    case Stage::Verify: return "verify";
+    }
+    return "unknown";
+}
+
+std::uint64_t monotonicNanoseconds()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+unsigned threadIndex()
+{
+    static std::atomic<unsigned> next { 0 };
+    thread_local const unsigned index { next++ };
+    return index;
+}
+
+StageRecorder::StageRecorder(bool keepSpans)
+    : m_keepSpans { keepSpans }
+{
+}
+
+void addTimes(StageTimes &times, const StageTimes &part)
+{
+    if (times.duration == 0 && times.start == 0)
+    {
+        times = part;
+        return;
+    }
+    for (std::size_t i = 0; i < stageCount; i++)
+    {
+        times.nanoseconds[i] += part.nanoseconds[i];
+    }
+    times.duration += part.duration;
+    times.start = std::min(times.start, part.start);
+    times.end = std::max(times.end, part.end);
+    times.spans.insert(times.spans.end(), part.spans.begin(), part.spans.end());
+}
+
+StageRecorder::~StageRecorder()
+{
+    if (m_recording)
+    {
+        stop();
+    }
+}
+
+void StageRecorder::start()
+{
+    m_outer = currentRecorder;
+    currentRecorder = this;
+    m_recording = true;
+    m_times.thread = threadIndex();
+    m_times.start = monotonicNanoseconds();
+    m_since = m_times.start;
+}
+
+void StageRecorder::stop()
+{
+    const std::uint64_t now { monotonicNanoseconds() };
+    charge(now);
+    m_times.duration = now - m_times.start;
+    m_times.end = now;
+    m_recording = false;
+    currentRecorder = m_outer;
+}
+
+StageRecorder* StageRecorder::current()
+{
+    return currentRecorder;
+}
+
+int StageRecorder::enter(Stage stage, std::uint64_t now)
+{
+    charge(now);
+    const int previous { m_stage };
+    m_stage = static_cast<int>(stage);
+    return previous;
+}
+
+void StageRecorder::leave(Stage stage, int previous, std::uint64_t started, std::uint64_t now)
+{
+    charge(now);
+    m_stage = previous;
+    if (m_keepSpans)
+    {
+        m_times.spans.push_back({ stage, started, now - started, m_times.thread });
+    }
+}
+
+void StageRecorder::charge(std::uint64_t now)
+{
+    if (m_stage != noStage)
+    {
+        m_times.nanoseconds[static_cast<std::size_t>(m_stage)] += now - m_since;
+    }
+    m_since = now;
+}
@@ -0,0 +1,132 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// where the time of a conversion goes; every moment is charged to the innermost stage active on the thread,
+// so nested stages (reading the file from inside the PNG decoder, writing from inside streaming deflate)
+// aren't counted twice
+enum class Stage
+{
+    Read, // getting the PNG bytes: std::ifstream reads, or the page faults of a mapped file
+    Decode, // libpng and the colour conversion
+    Transform, // layout and filters
+    Deflate,
+    Write,
+    Verify // checksumming the source and decoding the result back
+};
+
+const std::size_t stageCount { 6 };
+
+// "read", "decode", ...
+const char* stageName(Stage stage);
+
+// nanoseconds of a monotonic clock shared by all the threads
+std::uint64_t monotonicNanoseconds();
+
+// small number identifying the calling thread, for traces
+unsigned threadIndex();
+
+// one stage entered and left, for traces; the time includes the stages nested in it
+struct StageSpan
+{
+    Stage stage { Stage::Read };
+    std::uint64_t start { 0 };
+    std::uint64_t duration { 0 };
+    // threadIndex() of the thread it ran on
+    unsigned thread { 0 };
+};
+
+struct StageTimes
+{
+    std::array<std::uint64_t, stageCount> nanoseconds {};
+    // the whole conversion: the time spent on it, and when it started and ended; with parts recorded separately
+    // (the stages of a pipelined conversion) the time is theirs added up, without the waits in the queues between them
+    std::uint64_t start { 0 };
+    std::uint64_t duration { 0 };
+    std::uint64_t end { 0 };
+    unsigned thread { 0 };
+    // only when spans are kept
+    std::vector<StageSpan> spans;
+};
+
+// adds a part of the same conversion recorded separately (on another thread, say) to times: the stages and the
+// durations are summed, start and end span both
+void addTimes(StageTimes &times, const StageTimes &part);
+
+// records the stages of one conversion on the thread that runs it; while it is recording, StageScope objects
+// on that thread report to it, otherwise they do nothing, so the instrumentation costs one thread-local load
+// and a branch when it's off (parallel helpers running on other threads are charged to the stage that waits for them)
+class StageRecorder
+{
+public:
+    explicit StageRecorder(bool keepSpans);
+    // stops recording if still recording
+    ~StageRecorder();
+
+    StageRecorder(const StageRecorder&) = delete;
+    StageRecorder& operator=(const StageRecorder&) = delete;
+
+    void start();
+    void stop();
+
+    const StageTimes& times() const { return m_times; }
+
+    // the recorder of the calling thread, nullptr when nothing is being recorded
+    static StageRecorder* current();
+
+private:
+    friend class StageScope;
+
+    static constexpr int noStage { -1 };
+
+    // returns the stage that was active before, for leave()
+    int enter(Stage stage, std::uint64_t now);
+    void leave(Stage stage, int previous, std::uint64_t started, std::uint64_t now);
+    void charge(std::uint64_t now);
+
+    StageTimes m_times;
+    bool m_keepSpans;
+    bool m_recording { false };
+    int m_stage { noStage };
+    std::uint64_t m_since { 0 };
+    StageRecorder *m_outer { nullptr };
+};
+
+// charges the time until the end of the scope to the stage
+class StageScope
+{
+public:
+    explicit StageScope(Stage stage)
+        : m_recorder { StageRecorder::current() }
+    {
+        if (m_recorder)
+        {
+            m_stage = stage;
+            m_started = monotonicNanoseconds();
+            m_previous = m_recorder->enter(stage, m_started);
+        }
+    }
+
+    ~StageScope()
+    {
+        if (m_recorder)
+        {
+            m_recorder->leave(m_stage, m_previous, m_started, monotonicNanoseconds());
+        }
+    }
+
+    StageScope(const StageScope&) = delete;
+    StageScope& operator=(const StageScope&) = delete;
+
+private:
+    StageRecorder *m_recorder;
+    Stage m_stage { Stage::Read };
+    int m_previous { 0 };
+    std::uint64_t m_started { 0 };
+};
+
+#endif // STATS_H
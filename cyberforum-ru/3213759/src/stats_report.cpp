@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <string>
+
+#include "json.h"
+#include "stats_report.h"
+
+namespace
+{
+    const double megabyte { 1000.0 * 1000.0 };
+
+    double seconds(std::uint64_t nanoseconds)
+    {
+        return static_cast<double>(nanoseconds) / 1e9;
+    }
+
+    double ratio(double a, double b)
+    {
+        return b > 0 ? a / b : 0;
+    }
+
+    // time of the conversion that isn't in any stage (setting up, freeing memory, ...)
+    std::uint64_t otherNanoseconds(const StageTimes &times)
+    {
+        std::uint64_t staged { 0 };
+        for (std::uint64_t ns : times.nanoseconds)
+        {
+            staged += ns;
+        }
+        return times.duration > staged ? times.duration - staged : 0;
+    }
+
+    struct Totals
+    {
+        std::size_t converted { 0 };
+        std::size_t failed { 0 };
+        std::uint64_t inputBytes { 0 };
+        std::uint64_t rawBytes { 0 };
+        std::uint64_t outputBytes { 0 };
+        std::uint64_t allocations { 0 };
+        // the stages, then the time outside of them
+        std::array<std::uint64_t, stageCount + 1> nanoseconds {};
+        std::uint64_t total { 0 };
+    };
+
+    Totals sum(const std::vector<ConversionResult> &results)
+    {
+        Totals totals;
+        for (const ConversionResult &result : results)
+        {
+            if (result.ok)
+            {
+                totals.converted++;
+                totals.inputBytes += result.inputBytes;
+                totals.rawBytes += result.rawBytes;
+                totals.outputBytes += result.outputBytes;
+            }
+            else
+            {
+                totals.failed++;
+            }
+            for (std::size_t s = 0; s < stageCount; s++)
+            {
+                totals.nanoseconds[s] += result.times.nanoseconds[s];
+            }
+            totals.nanoseconds[stageCount] += otherNanoseconds(result.times);
+            totals.allocations += result.allocations;
+            totals.total += result.times.duration;
+        }
+        return totals;
+    }
+
+    const char* columnName(std::size_t column)
+    {
+        return column < stageCount ? stageName(static_cast<Stage>(column)) : "other";
+    }
+
+    std::uint64_t columnNanoseconds(const StageTimes &times, std::size_t column)
+    {
+        return column < stageCount ? times.nanoseconds[column] : otherNanoseconds(times);
+    }
+}
+
+void printStats(const std::vector<ConversionJob> &jobs, const std::vector<ConversionResult> &results,
+                double wallSeconds, bool verbose, std::ostream &out)
+{
+    const Totals totals { sum(results) };
+    out << std::fixed;
+    if (verbose)
+    {
+        for (std::size_t i = 0; i < results.size(); i++)
+        {
+            const ConversionResult &result { results[i] };
+            out << jobs[i].input.string() << ":" << std::setprecision(1);
+            for (std::size_t column = 0; column <= stageCount; column++)
+            {
+                out << (column == 0 ? " " : ", ") << columnName(column) << " " << seconds(columnNanoseconds(result.times, column)) * 1000 << " ms";
+            }
+            if (result.ok)
+            {
+                out << std::setprecision(2) << ", " << ratio(static_cast<double>(result.rawBytes), static_cast<double>(result.outputBytes)) << ":1";
+            }
+            out << ", " << result.allocations << " allocations";
+            out << "\n";
+        }
+    }
+
+    out << std::left << std::setw(12) << "stage" << std::right << std::setw(12) << "seconds" << std::setw(10) << "share"
+        << std::setw(12) << "ms/image" << "\n";
+    const std::size_t images { std::max<std::size_t>(results.size(), 1) };
+    for (std::size_t column = 0; column <= stageCount; column++)
+    {
+        const double s { seconds(totals.nanoseconds[column]) };
+        out << std::left << std::setw(12) << columnName(column) << std::right
+            << std::setw(12) << std::setprecision(3) << s
+            << std::setw(9) << std::setprecision(1) << ratio(100.0 * s, seconds(totals.total)) << "%"
+            << std::setw(12) << std::setprecision(2) << s * 1000 / static_cast<double>(images) << "\n";
+    }
+    // more than the wall time with several workers
+    out << std::left << std::setw(12) << "all workers" << std::right << std::setw(12) << std::setprecision(3) << seconds(totals.total)
+        << " (" << wallSeconds << " s wall)\n";
+    out << std::setprecision(1) << "pixels " << totals.rawBytes / megabyte << " MB -> im.bin " << totals.outputBytes / megabyte
+        << " MB (" << std::setprecision(2) << ratio(static_cast<double>(totals.rawBytes), static_cast<double>(totals.outputBytes))
+        << ":1), " << ratio(static_cast<double>(totals.outputBytes), static_cast<double>(totals.inputBytes))
+        << "x the size of the PNGs\n";
+    // mostly the first image of every worker, the pool serves the rest
+    out << "allocations " << totals.allocations << " (" << ratio(static_cast<double>(totals.allocations), static_cast<double>(images))
+        << " per image)" << std::endl;
+}
+
+void writeStatsJson(const std::vector<ConversionJob> &jobs, const std::vector<ConversionResult> &results,
+                    double wallSeconds, std::ostream &out, const PipelineStats *pipeline)
+{
+    JsonWriter json { out };
+    json.beginObject();
+    json.beginArray("images");
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        const ConversionResult &result { results[i] };
+        json.beginObject();
+        json.value("input", jobs[i].input.string());
+        json.value("output", jobs[i].output.string());
+        json.value("ok", result.ok);
+        if (!result.ok)
+        {
+            json.value("error", result.error);
+        }
+        json.value("width", static_cast<std::uint64_t>(result.width));
+        json.value("height", static_cast<std::uint64_t>(result.height));
+        json.value("inputBytes", result.inputBytes);
+        json.value("rawBytes", result.rawBytes);
+        json.value("outputBytes", result.outputBytes);
+        json.value("ratio", ratio(static_cast<double>(result.rawBytes), static_cast<double>(result.outputBytes)));
+        json.value("pngRatio", ratio(static_cast<double>(result.outputBytes), static_cast<double>(result.inputBytes)));
+        json.value("seconds", seconds(result.times.duration));
+        json.value("allocations", result.allocations);
+        json.beginObject("stages");
+        for (std::size_t column = 0; column <= stageCount; column++)
+        {
+            json.value(columnName(column), seconds(columnNanoseconds(result.times, column)));
+        }
+        json.endObject();
+        json.endObject();
+    }
+    json.endArray();
+
+    const Totals totals { sum(results) };
+    json.beginObject("aggregate");
+    json.value("images", static_cast<std::uint64_t>(results.size()));
+    json.value("failed", static_cast<std::uint64_t>(totals.failed));
+    json.value("wallSeconds", wallSeconds);
+    json.value("imagesPerSecond", ratio(static_cast<double>(totals.converted), wallSeconds));
+    json.value("inputBytes", totals.inputBytes);
+    json.value("rawBytes", totals.rawBytes);
+    json.value("outputBytes", totals.outputBytes);
+    json.value("ratio", ratio(static_cast<double>(totals.rawBytes), static_cast<double>(totals.outputBytes)));
+    json.value("pngRatio", ratio(static_cast<double>(totals.outputBytes), static_cast<double>(totals.inputBytes)));
+    json.value("seconds", seconds(totals.total));
+    json.value("allocations", totals.allocations);
+    json.beginObject("stages");
+    for (std::size_t column = 0; column <= stageCount; column++)
+    {
+        json.beginObject(columnName(column));
+        json.value("seconds", seconds(totals.nanoseconds[column]));
+        json.value("share", ratio(static_cast<double>(totals.nanoseconds[column]), static_cast<double>(totals.total)));
+        json.endObject();
+    }
+    json.endObject();
+    json.endObject();
+    if (pipeline)
+    {
+        json.beginArray("pipeline");
+        for (const PipelineStageStats &stage : pipeline->stages)
+        {
+            json.beginObject();
+            json.value("stage", stage.name);
+            json.value("threads", static_cast<std::uint64_t>(stage.threads));
+            json.value("busySeconds", stage.busySeconds);
+            json.value("starvedSeconds", stage.starvedSeconds);
+            json.value("blockedSeconds", stage.blockedSeconds);
+            json.value("queueCapacity", static_cast<std::uint64_t>(stage.queueCapacity));
+            json.value("queueFill", stage.queueFill);
+            json.endObject();
+        }
+        json.endArray();
+    }
+    json.endObject();
+}
+
+void writeChromeTrace(const std::vector<ConversionJob> &jobs, const std::vector<ConversionResult> &results,
+                      std::ostream &out)
+{
+    // timestamps are microseconds from the start of the first conversion
+    std::uint64_t base { std::numeric_limits<std::uint64_t>::max() };
+    unsigned threads { 0 };
+    for (const ConversionResult &result : results)
+    {
+        base = std::min(base, result.times.start);
+        threads = std::max(threads, result.times.thread + 1);
+        for (const StageSpan &span : result.times.spans)
+        {
+            threads = std::max(threads, span.thread + 1);
+        }
+    }
+    auto microseconds = [base](std::uint64_t ns) { return static_cast<double>(ns - base) / 1000; };
+
+    JsonWriter json { out, false, 15 };
+    json.beginObject();
+    json.value("displayTimeUnit", "ms");
+    json.beginArray("traceEvents");
+    for (unsigned t = 0; t < threads; t++)
+    {
+        json.beginObject();
+        json.value("name", "thread_name");
+        json.value("ph", "M");
+        json.value("pid", static_cast<std::uint64_t>(1));
+        json.value("tid", static_cast<std::uint64_t>(t));
+        json.beginObject("args");
+        json.value("name", "thread " + std::to_string(t));
+        json.endObject();
+        json.endObject();
+    }
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        const StageTimes &times { results[i].times };
+        // the stages of a pipelined conversion run on different threads, the image is an async span then
+        const bool oneThread { std::all_of(times.spans.begin(), times.spans.end(),
+                                           [&times](const StageSpan &span) { return span.thread == times.thread; }) };
+        auto imageEvent = [&](const char *phase, double timestamp, bool withArgs)
+        {
+            json.beginObject();
+            json.value("name", jobs[i].input.filename().string());
+            json.value("cat", "image");
+            json.value("ph", phase);
+            json.value("ts", timestamp);
+            if (oneThread)
+            {
+                json.value("dur", static_cast<double>(times.duration) / 1000);
+            }
+            else
+            {
+                json.value("id", static_cast<std::uint64_t>(i));
+            }
+            json.value("pid", static_cast<std::uint64_t>(1));
+            json.value("tid", static_cast<std::uint64_t>(times.thread));
+            if (withArgs)
+            {
+                json.beginObject("args");
+                json.value("input", jobs[i].input.string());
+                json.value("rawBytes", results[i].rawBytes);
+                json.value("outputBytes", results[i].outputBytes);
+                if (!results[i].ok)
+                {
+                    json.value("error", results[i].error);
+                }
+                json.endObject();
+            }
+            json.endObject();
+        };
+        if (oneThread)
+        {
+            imageEvent("X", microseconds(times.start), true);
+        }
+        else
+        {
+            imageEvent("b", microseconds(times.start), true);
+            imageEvent("e", microseconds(times.end), false);
+        }
+
+        for (const StageSpan &span : times.spans)
+        {
+            json.beginObject();
+            json.value("name", stageName(span.stage));
+            json.value("cat", "stage");
+            json.value("ph", "X");
+            json.value("ts", microseconds(span.start));
+            json.value("dur", static_cast<double>(span.duration) / 1000);
+            json.value("pid", static_cast<std::uint64_t>(1));
+            json.value("tid", static_cast<std::uint64_t>(span.thread));
+            json.endObject();
+        }
+    }
+    json.endArray();
+    json.endObject();
+}
@@ -0,0 +1,23 @@
+#ifndef STATS_REPORT_H
+#define STATS_REPORT_H
+
+#include <ostream>
+#include <vector>
+
+#include "batch.h"
+
+// the results of a batch, one per job, with their stage times; wallSeconds is the time of the whole batch
+
+// a table of the stages and the compression ratios, with a line per image if verbose
+void printStats(const std::vector<ConversionJob> &jobs, const std::vector<ConversionResult> &results,
+                double wallSeconds, bool verbose, std::ostream &out);
+
+// the same as JSON: every image and the aggregate, and the pipeline stages if there were any
+void writeStatsJson(const std::vector<ConversionJob> &jobs, const std::vector<ConversionResult> &results,
+                    double wallSeconds, std::ostream &out, const PipelineStats *pipeline = nullptr);
+
+// Chrome trace event format: a span for every image and every stage in it, on the thread that converted it
+void writeChromeTrace(const std::vector<ConversionJob> &jobs, const std::vector<ConversionResult> &results,
+                      std::ostream &out);
+
+#endif // STATS_REPORT_H
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <thread>
+
+#include "memory_pool.h"
+#include "thread_pool.h"
+
+namespace
+{
+    // one parallelFor() call: the items are claimed one by one by the caller and the helpers that join in;
+    // shared with the helpers, so one that only gets to it after the caller returned finds nothing left to claim
+    // (fn is only used for a claimed item, and the caller waits for every helper that is in run())
+    struct ParallelWork
+    {
+        std::size_t count { 0 };
+        const std::function<void(std::size_t)> *fn { nullptr };
+        std::atomic<std::size_t> next { 0 };
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable done;
+        unsigned running { 0 };
+
+        void run()
+        {
+            for (std::size_t i = next++; i < count; i = next++)
+            {
+                try
+                {
+                    (*fn)(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock { mutex };
+                    if (!error) { error = std::current_exception(); }
+                    next = count; // no point in starting anything else
+                }
+            }
+        }
+    };
+
+    // threads that stay around between the calls, so their pools and zlib streams are reused like the ones of
+    // the calling thread instead of being set up on every call; there are as many as have ever been needed at once,
+    // and they are joined when the program exits
+    class HelperPool
+    {
+    public:
+        ~HelperPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock { m_mutex };
+                m_stopping = true;
+            }
+            m_wake.notify_all();
+            for (auto &helper : m_helpers)
+            {
+                helper.join();
+            }
+        }
+
+        // asks for helpers to help with work, starting threads if there aren't enough idle ones
+        void request(const std::shared_ptr<ParallelWork> &work, unsigned helpers)
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            for (unsigned h = 0; h < helpers; h++)
+            {
+                m_requests.push_back(work);
+            }
+            while (m_idle + m_started < m_requests.size())
+            {
+                m_helpers.emplace_back([this] { serve(); });
+                m_started++;
+            }
+            m_wake.notify_all();
+        }
+
+        // drops the requests for work nobody took yet
+        void withdraw(const std::shared_ptr<ParallelWork> &work)
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            m_requests.erase(std::remove(m_requests.begin(), m_requests.end(), work), m_requests.end());
+        }
+
+    private:
+        void serve()
+        {
+            std::unique_lock<std::mutex> lock { m_mutex };
+            m_started--;
+            for (;;)
+            {
+                m_idle++;
+                m_wake.wait(lock, [this] { return !m_requests.empty() || m_stopping; });
+                m_idle--;
+                if (m_requests.empty())
+                {
+                    return;
+                }
+                const std::shared_ptr<ParallelWork> work { std::move(m_requests.front()) };
+                m_requests.pop_front();
+                lock.unlock();
+                {
+                    std::lock_guard<std::mutex> workLock { work->mutex };
+                    work->running++;
+                }
+                work->run();
+                {
+                    std::lock_guard<std::mutex> workLock { work->mutex };
+                    work->running--;
+                }
+                work->done.notify_all();
+                lock.lock();
+            }
+        }
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::deque<std::shared_ptr<ParallelWork>> m_requests;
+        std::vector<std::thread> m_helpers;
+        std::size_t m_idle { 0 };
+        // started, but not waiting yet
+        std::size_t m_started { 0 };
+        bool m_stopping { false };
+    };
+
+    // runs fn like imbin::parallelFor(), with the helpers from the pool
+    void runOnHelpers(std::size_t count, unsigned threadCount, const std::function<void(std::size_t)> &fn)
+    {
+        if (threadCount > count) { threadCount = static_cast<unsigned>(count); }
+        if (threadCount <= 1)
+        {
+            for (std::size_t i = 0; i < count; i++) { fn(i); }
+            return;
+        }
+
+        static HelperPool pool;
+        const std::shared_ptr<ParallelWork> work { std::make_shared<ParallelWork>() };
+        work->count = count;
+        work->fn = &fn;
+        pool.request(work, threadCount - 1);
+        work->run();
+        // everything is claimed, the helpers that haven't joined in by now have nothing left to do
+        pool.withdraw(work);
+        std::unique_lock<std::mutex> lock { work->mutex };
+        work->done.wait(lock, [&work] { return work->running == 0; });
+        if (work->error)
+        {
+            std::rethrow_exception(work->error);
+        }
+    }
+}
+
+void parallelFor(std::size_t count, unsigned threadCount, const std::function<void(std::size_t)> &fn)
+{
+    const std::thread::id caller { std::this_thread::get_id() };
+    std::atomic<std::uint64_t> requests { 0 };
+    std::atomic<std::uint64_t> system { 0 };
+    runOnHelpers(count, threadCount, [&](std::size_t i)
+    {
+        if (std::this_thread::get_id() == caller)
+        {
+            fn(i);
+            return;
+        }
+        const AllocationCounts before { threadAllocationCounts() };
+        // charged even if fn throws
+        struct Charge
+        {
+            const AllocationCounts &before;
+            std::atomic<std::uint64_t> &requests;
+            std::atomic<std::uint64_t> &system;
+            ~Charge()
+            {
+                const AllocationCounts after { threadAllocationCounts() };
+                requests += after.requests - before.requests;
+                system += after.system - before.system;
+            }
+        } charge { before, requests, system };
+        fn(i);
+    });
+    AllocationCounts helpers;
+    helpers.requests = requests;
+    helpers.system = system;
+    chargeAllocations(helpers);
+}
+
+JobScheduler::JobScheduler(const std::vector<std::size_t> &order, const std::vector<std::uint64_t> &costs,
+                           unsigned threadCount)
+    : m_costs { costs }
+{
+    const std::size_t workers { std::min<std::size_t>(std::max(threadCount, 1u), std::max<std::size_t>(order.size(), 1)) };
+    for (std::size_t i = 0; i < workers; i++)
+    {
+        m_queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (std::size_t i = 0; i < order.size(); i++)
+    {
+        m_queues[i % workers]->jobs.push_back(order[i]);
+    }
+}
+
+void JobScheduler::run(const std::function<void(std::size_t)> &job)
+{
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto work = [&](std::size_t worker)
+    {
+        std::size_t index { 0 };
+        while (next(worker, index))
+        {
+            try
+            {
+                job(index);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock { errorMutex };
+                if (!error) { error = std::current_exception(); }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(m_queues.size());
+    for (std::size_t worker = 0; worker < m_queues.size(); worker++)
+    {
+        workers.emplace_back(work, worker);
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+bool JobScheduler::next(std::size_t worker, std::size_t &job)
+{
+    {
+        WorkerQueue &own { *m_queues[worker] };
+        std::lock_guard<std::mutex> lock { own.mutex };
+        if (!own.jobs.empty())
+        {
+            job = own.jobs.front();
+            own.jobs.pop_front();
+            return true;
+        }
+    }
+    // nothing is ever added, so once every deque has been seen empty there's nothing left
+    for (;;)
+    {
+        std::size_t victim { m_queues.size() };
+        std::uint64_t victimCost { 0 };
+        for (std::size_t i = 0; i < m_queues.size(); i++)
+        {
+            WorkerQueue &other { *m_queues[i] };
+            std::lock_guard<std::mutex> lock { other.mutex };
+            if (!other.jobs.empty() && (victim == m_queues.size() || cost(other.jobs.front()) > victimCost))
+            {
+                victim = i;
+                victimCost = cost(other.jobs.front());
+            }
+        }
+        if (victim == m_queues.size())
+        {
+            return false;
+        }
+        WorkerQueue &other { *m_queues[victim] };
+        std::lock_guard<std::mutex> lock { other.mutex };
+        // its owner may have taken it in the meantime
+        if (!other.jobs.empty())
+        {
+            job = other.jobs.front();
+            other.jobs.pop_front();
+            return true;
+        }
+    }
+}
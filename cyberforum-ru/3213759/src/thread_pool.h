@@ -0,0 +1,54 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <imbin/parallel.h>
+
+// shared with the reader library
+using imbin::defaultThreadCount;
+
+// imbin::parallelFor() on threads that stay around between the calls (so their pools and zlib streams are reused),
+// with what the pool allocated on the helper threads charged to the calling one, so the allocations of a conversion
+// are in its stats wherever they were made; safe to use from scheduled jobs too
+void parallelFor(std::size_t count, unsigned threadCount, const std::function<void(std::size_t)> &fn);
+
+// jobs known up front, run on a fixed set of workers with a deque each: the jobs are dealt to the deques round-robin
+// in the order given (the most expensive first, say), every worker takes the front of its own, and one that has run out
+// takes the front of the deque with the most expensive front, so the big jobs left are started as soon as a worker
+// is free wherever they were dealt; with a few huge jobs among many small ones that keeps the last ones from
+// being started late
+class JobScheduler
+{
+public:
+    // order lists the jobs to run, costs (indexed by job) can be empty to only go by the order
+    JobScheduler(const std::vector<std::size_t> &order, const std::vector<std::uint64_t> &costs, unsigned threadCount);
+
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    // calls job(i) for every job, returns once all are done and rethrows the first exception thrown by one
+    void run(const std::function<void(std::size_t)> &job);
+
+private:
+    struct WorkerQueue
+    {
+        std::deque<std::size_t> jobs;
+        std::mutex mutex;
+    };
+
+    // false once every deque is empty
+    bool next(std::size_t worker, std::size_t &job);
+    std::uint64_t cost(std::size_t job) const { return m_costs.empty() ? 0 : m_costs[job]; }
+
+    const std::vector<std::uint64_t> &m_costs;
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <cstring>
+
+#include <imbin/filters.h>
+#include <imbin/planar.h>
+
+#include "tiles.h"
+#include "thread_pool.h"
+
+TiledCompressor::TiledCompressor(std::uint32_t width, std::uint32_t height, std::size_t bytesPerPixel,
+                                 std::uint32_t tileWidth, std::uint32_t tileHeight, imbin::Layout layout, bool filterRows,
+                                 const DeflateSettings &settings, Sink sink)
+    : m_width { width },
+      m_height { height },
+      m_bytesPerPixel { bytesPerPixel },
+      m_layout { layout },
+      m_filterRows { filterRows },
+      m_settings { settings },
+      m_sink { std::move(sink) },
+      m_index { width, height, tileWidth, tileHeight },
+      m_filters(filterRows ? static_cast<std::size_t>(m_index.tilesX) * height : 0)
+{}
+
+void TiledCompressor::addBand(const unsigned char *rows)
+{
+    const std::uint32_t y0 { m_nextBand * m_index.tileHeight };
+    const std::uint32_t h { std::min(m_index.tileHeight, m_height - y0) };
+    const std::size_t rowBytes { m_width * m_bytesPerPixel };
+
+    std::vector<ByteBuffer> compressed(m_index.tilesX);
+    // the parallelism is across tiles, not within them
+    DeflateSettings tileSettings { m_settings };
+    tileSettings.threads = 1;
+    parallelFor(m_index.tilesX, m_settings.threads, [&](std::size_t tx)
+    {
+        const std::uint32_t x0 { static_cast<std::uint32_t>(tx) * m_index.tileWidth };
+        const std::uint32_t w { std::min(m_index.tileWidth, m_width - x0) };
+        const std::size_t tileRowBytes { w * m_bytesPerPixel };
+        ByteBuffer tile(tileRowBytes * h);
+        for (std::uint32_t y = 0; y < h; y++)
+        {
+            const unsigned char *row { rows + y * rowBytes + x0 * m_bytesPerPixel };
+            if (m_layout == imbin::Layout::PlanarRows)
+            {
+                imbin::deinterleaveRgba(row, w, tile.data() + y * tileRowBytes, w);
+            }
+            else
+            {
+                std::memcpy(tile.data() + y * tileRowBytes, row, tileRowBytes);
+            }
+        }
+        if (m_filterRows)
+        {
+            // bottom up, so the row above is still the original one
+            unsigned char *filters { m_filters.data() + static_cast<std::size_t>(y0) * m_index.tilesX + tx * h };
+            ByteBuffer filtered(tileRowBytes);
+            for (std::uint32_t y = h; y-- > 0;)
+            {
+                unsigned char *row { tile.data() + y * tileRowBytes };
+                filters[y] = static_cast<unsigned char>(imbin::filterRow(row, y > 0 ? row - tileRowBytes : nullptr, tileRowBytes,
+                                                                         m_bytesPerPixel, filtered.data()));
+                std::memcpy(row, filtered.data(), tileRowBytes);
+            }
+        }
+        compressed[tx] = deflateBuffer(tile.data(), tile.size(), tileSettings);
+    });
+
+    for (std::uint32_t tx = 0; tx < m_index.tilesX; tx++)
+    {
+        imbin::TileIndex::Entry &entry { m_index.tiles[static_cast<std::size_t>(m_nextBand) * m_index.tilesX + tx] };
+        entry.offset = m_payloadSize;
+        entry.size = compressed[tx].size();
+        m_sink(compressed[tx].data(), compressed[tx].size());
+        m_payloadSize += compressed[tx].size();
+    }
+    m_nextBand++;
+}
@@ -0,0 +1,45 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "deflate.h"
+#include <imbin/format.h>
+
+// compresses the image band by band (a band being a row of tiles) into independent per-tile zlib streams,
+// the tiles of a band are compressed in parallel and handed to the sink in index order
+class TiledCompressor
+{
+public:
+    using Sink = std::function<void(const unsigned char *data, std::size_t size)>;
+
+    TiledCompressor(std::uint32_t width, std::uint32_t height, std::size_t bytesPerPixel,
+                    std::uint32_t tileWidth, std::uint32_t tileHeight, imbin::Layout layout, bool filterRows,
+                    const DeflateSettings &settings, Sink sink);
+
+    std::uint32_t bandHeight() const { return m_index.tileHeight; }
+    // rows of the next band, that is tileHeight rows (fewer for the last band), one after another, always interleaved
+    void addBand(const unsigned char *rows);
+
+    const imbin::TileIndex& index() const { return m_index; }
+    // contents of the FILT chunk (the filters of the bands added so far), empty without filtering
+    const std::vector<unsigned char>& filters() const { return m_filters; }
+    std::uint64_t payloadSize() const { return m_payloadSize; }
+
+private:
+    std::uint32_t m_width;
+    std::uint32_t m_height;
+    std::size_t m_bytesPerPixel;
+    imbin::Layout m_layout;
+    bool m_filterRows;
+    DeflateSettings m_settings;
+    Sink m_sink;
+    imbin::TileIndex m_index;
+    std::vector<unsigned char> m_filters;
+    std::uint32_t m_nextBand { 0 };
+    std::uint64_t m_payloadSize { 0 };
+};
+
+#endif // TILES_H
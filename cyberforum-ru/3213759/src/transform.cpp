@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cstring>
+
+#include <imbin/filters.h>
+#include <imbin/format.h>
+#include <imbin/planar.h>
+#include <imbin/rgb.h>
+#include <imbin/sequence.h>
+
+#include "thread_pool.h"
+#include "transform.h"
+
+void toPlanarRows(unsigned char *rows, std::uint32_t count, std::uint32_t width, unsigned threads)
+{
+    const std::size_t rowBytes { static_cast<std::size_t>(width) * 4 };
+    const std::uint32_t bandRows { 64 };
+    parallelFor((count + bandRows - 1) / bandRows, threads, [&](std::size_t band)
+    {
+        ByteBuffer pixels(rowBytes);
+        const std::size_t last { std::min<std::size_t>((band + 1) * bandRows, count) };
+        for (std::size_t y = band * bandRows; y < last; y++)
+        {
+            unsigned char *row { rows + y * rowBytes };
+            std::memcpy(pixels.data(), row, rowBytes);
+            imbin::deinterleaveRgba(pixels.data(), width, row, width);
+        }
+    });
+}
+
+void toRgbRows(unsigned char *rows, std::uint32_t count, std::uint32_t width)
+{
+    // the rows move towards the start, so they can't be done in parallel bands
+    imbin::packRgb(rows, static_cast<std::size_t>(count) * width, rows);
+}
+
+void toIndexRows(unsigned char *rows, std::uint32_t count, std::uint32_t width, const ColorSet &colors, std::uint32_t bits)
+{
+    // a byte is written once all of its pixels are read, and never past them, so this can go forward in place too
+    const std::size_t rowBytes { imbin::indexRowBytes(width, bits) };
+    std::uint32_t last { colors.colors()[0] };
+    unsigned lastIndex { 0 };
+    for (std::uint32_t y = 0; y < count; y++)
+    {
+        const unsigned char *pixels { rows + static_cast<std::size_t>(y) * width * 4 };
+        unsigned char *indices { rows + y * rowBytes };
+        unsigned packed { 0 };
+        std::uint32_t filled { 0 };
+        for (std::uint32_t x = 0; x < width; x++)
+        {
+            std::uint32_t color;
+            std::memcpy(&color, pixels + static_cast<std::size_t>(x) * 4, 4);
+            // runs of a colour are the common case
+            if (color != last)
+            {
+                last = color;
+                lastIndex = colors.indexOf(color);
+            }
+            packed = (packed << bits) | lastIndex;
+            filled += bits;
+            if (filled == 8)
+            {
+                *indices++ = static_cast<unsigned char>(packed);
+                packed = 0;
+                filled = 0;
+            }
+        }
+        if (filled > 0)
+        {
+            *indices = static_cast<unsigned char>(packed << (8 - filled));
+        }
+    }
+}
+
+void filterRows(unsigned char *rows, std::uint32_t count, std::size_t rowBytes, std::size_t bytesPerPixel,
+                ByteBuffer &previous, unsigned char *filters, unsigned threads)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    const std::uint32_t bandRows { 64 };
+    const std::size_t bands { (count + bandRows - 1) / bandRows };
+    // every band is filtered bottom up, so the rows above are still the original ones when they are needed,
+    // except for the first row of a band, which needs the last row of the band above that may be done already
+    ByteBuffer above(bands * rowBytes);
+    const bool top { previous.empty() };
+    if (!top)
+    {
+        std::memcpy(above.data(), previous.data(), rowBytes);
+    }
+    for (std::size_t b = 1; b < bands; b++)
+    {
+        std::memcpy(above.data() + b * rowBytes, rows + (b * bandRows - 1) * rowBytes, rowBytes);
+    }
+    previous.assign(rows + (count - 1) * rowBytes, rows + count * rowBytes);
+
+    parallelFor(bands, threads, [&](std::size_t b)
+    {
+        ByteBuffer filtered(rowBytes);
+        const std::size_t first { b * bandRows };
+        for (std::size_t y = std::min<std::size_t>(first + bandRows, count); y-- > first;)
+        {
+            unsigned char *row { rows + y * rowBytes };
+            const unsigned char *rowAbove { y > first ? row - rowBytes : (b == 0 && top ? nullptr : above.data() + b * rowBytes) };
+            filters[y] = static_cast<unsigned char>(imbin::filterRow(row, rowAbove, rowBytes, bytesPerPixel, filtered.data()));
+            std::memcpy(row, filtered.data(), rowBytes);
+        }
+    });
+}
+
+std::uint32_t frameDelta(const unsigned char *frame, const unsigned char *previous, std::uint32_t width, std::uint32_t height,
+                         std::uint32_t tileWidth, std::uint32_t tileHeight, std::vector<unsigned char> &bitmap, ByteBuffer &delta)
+{
+    const std::size_t rowBytes { static_cast<std::size_t>(width) * 4 };
+    const std::uint32_t tilesX { (width + tileWidth - 1) / tileWidth };
+    const std::uint32_t tilesY { (height + tileHeight - 1) / tileHeight };
+    bitmap.assign(imbin::tileBitmapSize(static_cast<std::size_t>(tilesX) * tilesY), 0);
+    delta.clear();
+    const imbin::Simd simd { imbin::bestSimd() };
+    std::uint32_t changed { 0 };
+    for (std::uint32_t ty = 0; ty < tilesY; ty++)
+    {
+        const std::uint32_t h { std::min(tileHeight, height - ty * tileHeight) };
+        for (std::uint32_t tx = 0; tx < tilesX; tx++)
+        {
+            const std::size_t tileRowBytes { static_cast<std::size_t>(std::min(tileWidth, width - tx * tileWidth)) * 4 };
+            const std::size_t first { static_cast<std::size_t>(ty) * tileHeight * rowBytes + static_cast<std::size_t>(tx) * tileWidth * 4 };
+            // memcmp stops at the first difference, most tiles of a typical frame are unchanged all the way through
+            std::uint32_t y { 0 };
+            while (y < h && std::memcmp(frame + first + y * rowBytes, previous + first + y * rowBytes, tileRowBytes) == 0)
+            {
+                y++;
+            }
+            if (y == h)
+            {
+                continue;
+            }
+            const std::size_t tile { static_cast<std::size_t>(ty) * tilesX + tx };
+            bitmap[tile / 8] |= static_cast<unsigned char>(1 << (tile % 8));
+            changed++;
+            const std::size_t offset { delta.size() };
+            delta.resize(offset + h * tileRowBytes);
+            for (y = 0; y < h; y++)
+            {
+                imbin::xorBytes(frame + first + y * rowBytes, previous + first + y * rowBytes,
+                                delta.data() + offset + y * tileRowBytes, tileRowBytes, simd);
+            }
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,35 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "color_set.h"
+#include "memory_pool.h"
+
+// what happens to the decoded rows before they are deflated, for the layouts and flags of include/imbin/format.h
+
+// RGBA rows -> PlanarRows in place, in bands of rows on up to threads threads
+void toPlanarRows(unsigned char *rows, std::uint32_t count, std::uint32_t width, unsigned threads);
+
+// RGBA rows of an opaque image -> RGB ones (flagOpaque) in place, still one after another, so the rows take
+// width * 3 bytes from then on
+void toRgbRows(unsigned char *rows, std::uint32_t count, std::uint32_t width);
+
+// RGBA rows of an image of few colours -> their indices in colors packed bits (1, 2, 4 or 8) to a byte
+// (flagIndexed) in place, still one after another, so the rows take imbin::indexRowBytes(width, bits) from then on;
+// every pixel has to be one of the colours
+void toIndexRows(unsigned char *rows, std::uint32_t count, std::uint32_t width, const ColorSet &colors, std::uint32_t bits);
+
+// filters the rows in place, bands of rows in parallel; previous is the original row above the first one
+// (empty at the top of the image) and is replaced with the original last one, filters gets the filter of every row
+void filterRows(unsigned char *rows, std::uint32_t count, std::size_t rowBytes, std::size_t bytesPerPixel,
+                ByteBuffer &previous, unsigned char *filters, unsigned threads);
+
+// the delta of a frame of a ZlibSequence against the frame before it: bitmap gets a bit for every tile with
+// a pixel that differs, delta the XOR of the rows of those tiles, tile by tile; returns the number of changed tiles
+std::uint32_t frameDelta(const unsigned char *frame, const unsigned char *previous, std::uint32_t width, std::uint32_t height,
+                         std::uint32_t tileWidth, std::uint32_t tileHeight, std::vector<unsigned char> &bitmap, ByteBuffer &delta);
+
+#endif // TRANSFORM_H
@@ -0,0 +1,228 @@
+#include <string>
+#include <vector>
+
+#include <imbin/format.h>
+#include <imbin/reader.h>
+
+#include "support.h"
+#include "tests.h"
+
+namespace
+{
+    // a tiled, filtered file with mip levels, an indexed one and one in independent blocks
+    struct Files
+    {
+        std::vector<unsigned char> tiled;
+        std::vector<unsigned char> indexed;
+        std::vector<unsigned char> blocks;
+    };
+
+    Files makeFiles()
+    {
+        TemporaryDirectory directory;
+        Files files;
+        ConversionSettings tiled;
+        tiled.tileWidth = 16;
+        tiled.tileHeight = 16;
+        tiled.filterRows = true;
+        tiled.mips = MipFilter::Box;
+        files.tiled = convertPng(directory, rgbaSource(makePixels(Content::Mixed, 40, 30, 31)).encode(), tiled);
+        files.indexed = convertPng(directory, rgbaSource(makePixels(Content::FewColors, 40, 30, 32)).encode(), {});
+        ConversionSettings blocks;
+        blocks.deflate.independentBlocks = true;
+        blocks.deflate.blockSize = 32 * 1024;
+        files.blocks = convertPng(directory, rgbaSource(makePixels(Content::Mixed, 100, 90, 33)).encode(), blocks);
+        return files;
+    }
+
+    // everything a reader can do with the file
+    void readEverything(const std::vector<unsigned char> &file)
+    {
+        imbin::DecodeOptions oneThread;
+        oneThread.threads = 1;
+        const imbin::Image image { imbin::decode(file.data(), file.size(), oneThread) };
+        imbin::decode(file.data(), file.size());
+        if (image.width > 2 && image.height > 2)
+        {
+            imbin::decodeRegion(file.data(), file.size(), 1, 1, image.width - 2, image.height - 2);
+        }
+        const std::uint32_t levels { imbin::mipLevelCount(file.data(), file.size()) };
+        for (std::uint32_t level = 1; level <= levels; level++)
+        {
+            imbin::decodeMipLevel(file.data(), file.size(), level);
+        }
+    }
+
+    void setU32(std::vector<unsigned char> &file, std::uint64_t offset, std::uint32_t v)
+    {
+        std::vector<unsigned char> bytes;
+        imbin::putU32(bytes, v);
+        std::copy(bytes.begin(), bytes.end(), file.begin() + static_cast<std::ptrdiff_t>(offset));
+    }
+
+    void setU64(std::vector<unsigned char> &file, std::uint64_t offset, std::uint64_t v)
+    {
+        std::vector<unsigned char> bytes;
+        imbin::putU64(bytes, v);
+        std::copy(bytes.begin(), bytes.end(), file.begin() + static_cast<std::ptrdiff_t>(offset));
+    }
+
+    imbin::Header parse(const std::vector<unsigned char> &file)
+    {
+        return imbin::parseHeader(file.data(), file.size(), file.size());
+    }
+
+    // where the chunk is and where its entry in the chunk table is
+    struct ChunkPosition
+    {
+        std::uint64_t entry { 0 };
+        std::uint64_t offset { 0 };
+        std::uint64_t size { 0 };
+    };
+
+    ChunkPosition findChunk(const std::vector<unsigned char> &file, std::uint32_t id)
+    {
+        const imbin::Header header { parse(file) };
+        for (std::size_t i = 0; i < header.chunks.size(); i++)
+        {
+            if (header.chunks[i].id == id)
+            {
+                return { imbin::headerSize + i * imbin::chunkEntrySize, header.chunks[i].offset, header.chunks[i].size };
+            }
+        }
+        throw TestFailure("the file has no such chunk");
+    }
+
+    // the change has to make the reader throw imbin::Error
+    void checkRejected(const std::vector<unsigned char> &file, const std::string &what,
+                       const std::function<void(std::vector<unsigned char>&)> &change)
+    {
+        std::vector<unsigned char> corrupted { file };
+        change(corrupted);
+        checkImbinError([&] { readEverything(corrupted); }, what);
+    }
+
+    // every byte from begin to end changed in a few ways, one at a time: reading the file has to either work
+    // or throw imbin::Error
+    void checkEveryByte(const std::vector<unsigned char> &file, std::size_t begin, std::size_t end, std::size_t step)
+    {
+        std::vector<unsigned char> corrupted { file };
+        for (std::size_t i = begin; i < end; i += step)
+        {
+            for (const unsigned char mask : { 0x01, 0x80, 0xFF })
+            {
+                corrupted[i] ^= mask;
+                try
+                {
+                    readEverything(corrupted);
+                }
+                catch (const imbin::Error&)
+                {
+                }
+                corrupted[i] = file[i];
+            }
+        }
+    }
+}
+
+void testCorruptedHeaders()
+{
+    const Files files { makeFiles() };
+    for (const auto *file : { &files.tiled, &files.indexed, &files.blocks })
+    {
+        readEverything(*file);
+        // the payload size is in the header, so a file cut anywhere is noticed
+        for (std::size_t size = 0; size < file->size(); size += size < 1024 ? 1 : 37)
+        {
+            const std::vector<unsigned char> truncated { file->begin(), file->begin() + static_cast<std::ptrdiff_t>(size) };
+            checkImbinError([&] { readEverything(truncated); }, "a file truncated to " + std::to_string(size) + " bytes");
+        }
+    }
+
+    const std::vector<unsigned char> &file { files.tiled };
+    const imbin::Header header { parse(file) };
+    checkRejected(file, "another magic", [](auto &f) { f[1] = 'X'; });
+    checkRejected(file, "version 1 with a v2 header", [](auto &f) { f[8] = 1; });
+    checkRejected(file, "a fixed part shorter than 64 bytes", [](auto &f) { f[10] = 63; });
+    checkRejected(file, "a wider image", [](auto &f) { f[12]++; });
+    checkRejected(file, "a lower image", [](auto &f) { f[16]--; });
+    checkRejected(file, "an unknown pixel format", [](auto &f) { f[20] = 9; });
+    checkRejected(file, "an unknown layout", [](auto &f) { f[21] = 7; });
+    checkRejected(file, "an unknown codec", [](auto &f) { f[22] = 9; });
+    checkRejected(file, "the sequence codec", [](auto &f) { f[22] = static_cast<unsigned char>(imbin::Codec::ZlibSequence); });
+    checkRejected(file, "an unknown flag", [](auto &f) { setU32(f, 24, imbin::flagFilteredRows | 0x100); });
+    checkRejected(file, "constant and filtered", [](auto &f) { setU32(f, 24, imbin::flagFilteredRows | imbin::flagConstant); });
+    checkRejected(file, "too many chunks", [](auto &f) { setU32(f, 28, 0xFFFFFFFFu); });
+    checkRejected(file, "a bigger uncompressed size", [&](auto &f) { setU64(f, 32, header.uncompressedSize + 1); });
+    checkRejected(file, "the payload past the end", [&](auto &f) { setU64(f, 40, f.size() + 1); });
+    checkRejected(file, "a longer payload", [&](auto &f) { setU64(f, 48, header.payloadSize + 1); });
+    checkRejected(file, "a chunk past the end", [&](auto &f) { setU64(f, imbin::headerSize + 8, f.size()); });
+    checkRejected(file, "a chunk running past the end", [&](auto &f) { setU64(f, imbin::headerSize + 16, f.size()); });
+
+    for (const auto *f : { &files.tiled, &files.indexed, &files.blocks })
+    {
+        checkEveryByte(*f, 0, static_cast<std::size_t>(parse(*f).payloadOffset), 1);
+    }
+}
+
+void testCorruptedChunks()
+{
+    const Files files { makeFiles() };
+
+    const std::vector<unsigned char> &tiled { files.tiled };
+    const imbin::Header header { parse(tiled) };
+    const ChunkPosition tiles { findChunk(tiled, imbin::tileChunk) };
+    checkRejected(tiled, "no tile index", [&](auto &f) { f[tiles.entry] = 'X'; });
+    checkRejected(tiled, "a short tile index", [&](auto &f) { setU64(f, tiles.entry + 16, tiles.size - 1); });
+    checkRejected(tiled, "tiles 0 pixels wide", [&](auto &f) { setU32(f, tiles.offset, 0); });
+    checkRejected(tiled, "tiles of another size", [&](auto &f) { setU32(f, tiles.offset + 4, 8); });
+    checkRejected(tiled, "a tile past the payload", [&](auto &f) { setU64(f, tiles.offset + 8, header.payloadSize); });
+    checkRejected(tiled, "a tile running past the payload", [&](auto &f) { setU64(f, tiles.offset + 16, header.payloadSize + 1); });
+    checkRejected(tiled, "a tile that is too short", [&](auto &f) { setU64(f, tiles.offset + 16, 3); });
+
+    const ChunkPosition filters { findChunk(tiled, imbin::filterChunk) };
+    checkRejected(tiled, "no filters", [&](auto &f) { f[filters.entry] = 'X'; });
+    checkRejected(tiled, "a filter missing", [&](auto &f) { setU64(f, filters.entry + 16, filters.size - 1); });
+    checkRejected(tiled, "an unknown filter", [&](auto &f) { f[filters.offset + 5] = 9; });
+
+    const ChunkPosition mips { findChunk(tiled, imbin::mipChunk) };
+    checkRejected(tiled, "a mip level missing", [&](auto &f) { setU32(f, mips.offset, 4); });
+    checkRejected(tiled, "a mip level too many", [&](auto &f) { setU32(f, mips.offset, 6); });
+    checkRejected(tiled, "an unknown mip filter", [&](auto &f) { setU32(f, mips.offset + 4, 7); });
+    checkRejected(tiled, "a wider mip level", [&](auto &f) { setU32(f, mips.offset + 8, 21); });
+    checkRejected(tiled, "a mip level of the wrong size", [&](auto &f)
+    {
+        // 20x15 and 10x7 swapped
+        setU32(f, mips.offset + 8, 10);
+        setU32(f, mips.offset + 12, 7);
+        setU32(f, mips.offset + 8 + 24, 20);
+        setU32(f, mips.offset + 12 + 24, 15);
+    });
+    checkRejected(tiled, "a mip level past the chunk", [&](auto &f) { setU64(f, mips.offset + 16, mips.size); });
+    checkRejected(tiled, "a mip level running past the chunk", [&](auto &f) { setU64(f, mips.offset + 24, mips.size); });
+
+    const std::vector<unsigned char> &indexed { files.indexed };
+    CHECK(parse(indexed).flags & imbin::flagIndexed);
+    const ChunkPosition palette { findChunk(indexed, imbin::paletteChunk) };
+    checkRejected(indexed, "no palette", [&](auto &f) { f[palette.entry] = 'X'; });
+    checkRejected(indexed, "3 bits per index", [&](auto &f) { setU32(f, palette.offset, 3); });
+    checkRejected(indexed, "another number of bits per index", [&](auto &f) { setU32(f, palette.offset, 4); });
+    checkRejected(indexed, "an empty palette", [&](auto &f) { setU32(f, palette.offset + 4, 0); });
+    checkRejected(indexed, "more entries than the bits allow", [&](auto &f) { setU32(f, palette.offset + 4, 300); });
+    checkRejected(indexed, "more entries than the chunk has", [&](auto &f) { setU64(f, palette.entry + 16, palette.size - 4); });
+
+    const std::vector<unsigned char> &blocks { files.blocks };
+    const ChunkPosition blockIndex { findChunk(blocks, imbin::blockChunk) };
+    checkRejected(blocks, "blocks of 0 bytes", [&](auto &f) { setU64(f, blockIndex.offset, 0); });
+    checkRejected(blocks, "bigger blocks", [&](auto &f) { setU64(f, blockIndex.offset, 64 * 1024); });
+    checkRejected(blocks, "a block past the payload", [&](auto &f) { setU64(f, blockIndex.offset + 8, parse(blocks).payloadSize); });
+    checkRejected(blocks, "a block that is too short", [&](auto &f) { setU64(f, blockIndex.offset + 16, 3); });
+    checkRejected(blocks, "a block missing", [&](auto &f) { setU64(f, blockIndex.entry + 16, blockIndex.size - 16); });
+
+    // the payload, where it's up to zlib's checksums (the last byte is one of the last stream)
+    for (const auto *f : { &files.tiled, &files.indexed, &files.blocks })
+    {
+        checkEveryByte(*f, static_cast<std::size_t>(parse(*f).payloadOffset), f->size(), 3);
+        checkRejected(*f, "another checksum", [](auto &c) { c.back() ^= 0x5A; });
+    }
+}
@@ -0,0 +1,222 @@
+#include <string>
+#include <vector>
+
+#ifdef USING_PACKAGE_MANAGER
+    #include <zlib/zlib.h>
+#else
+    #include <zlib.h>
+#endif
+
+#include <imbin/format.h>
+#include <imbin/reader.h>
+
+#include "color_convert.h"
+#include "support.h"
+#include "tests.h"
+
+namespace
+{
+    struct Variant
+    {
+        std::string name;
+        ConversionSettings settings;
+    };
+
+    // the ways an image can be stored that change how a region of it is read
+    std::vector<Variant> storageVariants()
+    {
+        std::vector<Variant> variants;
+        auto add = [&variants](const std::string &name, auto change)
+        {
+            Variant variant { name, {} };
+            change(variant.settings);
+            variants.push_back(variant);
+        };
+        add("single stream", [](ConversionSettings&) {});
+        add("filtered", [](ConversionSettings &s) { s.filterRows = true; });
+        add("planar", [](ConversionSettings &s) { s.layout = imbin::Layout::PlanarRows; });
+        add("tiles 16x8", [](ConversionSettings &s) { s.tileWidth = 16; s.tileHeight = 8; });
+        add("filtered tiles 32x32", [](ConversionSettings &s) { s.tileWidth = 32; s.tileHeight = 32; s.filterRows = true; });
+        add("planar tiles 64x16", [](ConversionSettings &s) { s.tileWidth = 64; s.tileHeight = 16; s.layout = imbin::Layout::PlanarRows; });
+        add("independent blocks", [](ConversionSettings &s) { s.deflate.independentBlocks = true; s.deflate.blockSize = 32 * 1024; });
+        add("filtered independent blocks", [](ConversionSettings &s)
+        {
+            s.deflate.independentBlocks = true;
+            s.deflate.blockSize = 32 * 1024;
+            s.filterRows = true;
+        });
+        add("planar independent blocks", [](ConversionSettings &s)
+        {
+            s.deflate.independentBlocks = true;
+            s.deflate.blockSize = 32 * 1024;
+            s.layout = imbin::Layout::PlanarRows;
+        });
+        return variants;
+    }
+
+    const char* contentName(Content content)
+    {
+        switch (content)
+        {
+        case Content::Mixed: return "mixed";
+        case Content::Opaque: return "opaque";
+        case Content::FewColors: return "few colours";
+        }
+        return "?";
+    }
+}
+
+void testColorTypes()
+{
+    struct Type
+    {
+        int colorType;
+        std::vector<int> depths;
+        bool transparency;
+    };
+    const Type types[] {
+        { 0, { 1, 2, 4, 8, 16 }, true }, // grey
+        { 2, { 8, 16 }, true }, // RGB
+        { 3, { 1, 2, 4, 8 }, true }, // palette
+        { 4, { 8, 16 }, false }, // grey+alpha
+        { 6, { 8, 16 }, false } // RGBA
+    };
+    std::vector<Variant> modes(3);
+    modes[0].name = "whole";
+    modes[1].name = "whole as RGBA";
+    modes[1].settings.keepRgba = true;
+    modes[2].name = "streamed";
+    modes[2].settings.streaming = true;
+
+    TemporaryDirectory directory;
+    std::uint64_t seed { 1 };
+    for (const Type &type : types)
+    {
+        for (const int depth : type.depths)
+        {
+            for (int variant = 0; variant < (type.transparency ? 4 : 2); variant++)
+            {
+                const bool interlaced { (variant & 1) != 0 };
+                const bool transparency { (variant & 2) != 0 };
+                // odd sizes, so sub-byte rows end inside a byte and the interlacing passes are uneven
+                SourcePng source { makeSource(type.colorType, depth, 19, 7, transparency, seed++) };
+                source.interlaced = interlaced;
+                const std::vector<unsigned char> png { source.encode() };
+                const Pixels reference { source.reference() };
+                const std::string name { describeSource(static_cast<SourceColor>(type.colorType), depth)
+                                         + (interlaced ? " interlaced" : "") + (transparency ? " with tRNS" : "") };
+                for (const Variant &mode : modes)
+                {
+                    const std::vector<unsigned char> file { convertPng(directory, png, mode.settings) };
+                    const imbin::Image image { imbin::decode(file.data(), file.size()) };
+                    CHECK(image.format == imbin::PixelFormat::Rgba8);
+                    checkSame(reference, image.width, image.height, image.pixels, name + ", " + mode.name);
+                }
+            }
+        }
+    }
+}
+
+void testRegions()
+{
+    struct Region
+    {
+        std::uint32_t x, y, width, height;
+    };
+    const std::uint32_t width { 241 };
+    const std::uint32_t height { 150 };
+    const Region regions[] {
+        { 0, 0, 1, 1 },
+        { width - 1, height - 1, 1, 1 },
+        { 5, 3, 40, 17 },
+        // across tile and block boundaries
+        { 15, 7, 18, 10 },
+        { 60, 30, 100, 90 },
+        { 17, 9, width - 17, height - 9 },
+        { 30, 0, 1, height },
+        { 0, 60, width, 1 },
+        { 0, 0, width, height }
+    };
+
+    TemporaryDirectory directory;
+    std::uint64_t seed { 100 };
+    for (const Content content : { Content::Mixed, Content::Opaque, Content::FewColors })
+    {
+        const Pixels reference { makePixels(content, width, height, seed++) };
+        const std::vector<unsigned char> png { rgbaSource(reference).encode() };
+        for (Variant variant : storageVariants())
+        {
+            for (const bool keepRgba : { false, true })
+            {
+                variant.settings.keepRgba = keepRgba;
+                const std::string name { std::string { contentName(content) } + ", " + variant.name + (keepRgba ? " as RGBA" : "") };
+                const std::vector<unsigned char> file { convertPng(directory, png, variant.settings) };
+
+                imbin::DecodeOptions oneThread;
+                oneThread.threads = 1;
+                const imbin::Image whole { imbin::decode(file.data(), file.size(), oneThread) };
+                checkSame(reference, whole.width, whole.height, whole.pixels, name);
+                const imbin::Image parallel { imbin::decode(file.data(), file.size()) };
+                checkSame(reference, parallel.width, parallel.height, parallel.pixels, name + " on all cores");
+
+                const imbin::Info info { imbin::readInfo(file.data(), file.size()) };
+                CHECK(info.width == width && info.height == height && info.pixelsSize == reference.rgba.size());
+                std::vector<unsigned char> into(info.pixelsSize);
+                imbin::decodeInto(file.data(), file.size(), into.data(), into.size());
+                checkSame(reference, width, height, into, name + " into a buffer");
+                checkImbinError([&] { imbin::decodeInto(file.data(), file.size(), into.data(), into.size() - 1); },
+                                name + ", decodeInto() a buffer too small");
+
+                for (std::size_t i = 0; i < std::size(regions); i++)
+                {
+                    const Region &r { regions[i] };
+                    const imbin::Image part { imbin::decodeRegion(file.data(), file.size(), r.x, r.y, r.width, r.height,
+                                                                  i % 2 ? oneThread : imbin::DecodeOptions {}) };
+                    checkSame(reference.crop(r.x, r.y, r.width, r.height), part.width, part.height, part.pixels,
+                              name + ", region " + std::to_string(r.x) + "," + std::to_string(r.y) + " "
+                              + std::to_string(r.width) + "x" + std::to_string(r.height));
+                }
+                checkImbinError([&] { imbin::decodeRegion(file.data(), file.size(), width, 0, 1, 1); },
+                                name + ", a region to the right of the image");
+                checkImbinError([&] { imbin::decodeRegion(file.data(), file.size(), 0, 1, 1, height); },
+                                name + ", a region over the bottom of the image");
+                checkImbinError([&] { imbin::decodeRegion(file.data(), file.size(), 1, 0, ~0u, 1); },
+                                name + ", a region that wraps around");
+            }
+        }
+    }
+}
+
+void testV1Files()
+{
+    const Pixels reference { makePixels(Content::Mixed, 37, 23, 7) };
+    std::vector<unsigned char> file;
+    imbin::putU32(file, reference.width);
+    imbin::putU32(file, reference.height);
+    uLongf zipSize { compressBound(static_cast<uLong>(reference.rgba.size())) };
+    std::vector<unsigned char> zip(zipSize);
+    CHECK(compress2(zip.data(), &zipSize, reference.rgba.data(), static_cast<uLong>(reference.rgba.size()), 9) == Z_OK);
+    file.insert(file.end(), zip.begin(), zip.begin() + static_cast<std::ptrdiff_t>(zipSize));
+
+    const imbin::Info info { imbin::readInfo(file.data(), file.size()) };
+    CHECK(info.width == reference.width && info.height == reference.height && info.format == imbin::PixelFormat::Rgba8);
+    const imbin::Image image { imbin::decode(file.data(), file.size()) };
+    checkSame(reference, image.width, image.height, image.pixels, "v1");
+    const imbin::Image part { imbin::decodeRegion(file.data(), file.size(), 3, 4, 20, 11) };
+    checkSame(reference.crop(3, 4, 20, 11), part.width, part.height, part.pixels, "v1 region");
+    CHECK(imbin::mipLevelCount(file.data(), file.size()) == 0);
+
+    TemporaryDirectory directory;
+    writeBytes(directory.path() / "v1.im.bin", file);
+    const imbin::Image read { imbin::readFile(directory.path() / "v1.im.bin") };
+    checkSame(reference, read.width, read.height, read.pixels, "v1 from a file");
+
+    std::vector<unsigned char> truncated { file.begin(), file.end() - 5 };
+    checkImbinError([&] { imbin::decode(truncated.data(), truncated.size()); }, "a truncated v1 file");
+    std::vector<unsigned char> wider { file };
+    wider[0]++;
+    checkImbinError([&] { imbin::decode(wider.data(), wider.size()); }, "a v1 file wider than its pixels");
+    std::vector<unsigned char> garbage { file };
+    garbage[8] = 0;
+    checkImbinError([&] { imbin::decode(garbage.data(), garbage.size()); }, "a v1 file without a zlib header");
+}
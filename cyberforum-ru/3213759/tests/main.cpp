@@ -0,0 +1,49 @@
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+#include "tests.h"
+
+// runs every test, or just the one named on the command line (the way CTest runs them)
+int main(int argc, char *argv[])
+{
+    const struct
+    {
+        const char *name;
+        void (*run)();
+    } tests[] {
+        { "color-types", testColorTypes },
+        { "regions", testRegions },
+        { "v1-files", testV1Files },
+        { "sequences", testSequences },
+        { "corrupted-headers", testCorruptedHeaders },
+        { "corrupted-chunks", testCorruptedChunks }
+    };
+
+    int ran { 0 };
+    int failed { 0 };
+    for (const auto &test : tests)
+    {
+        if (argc > 1 && std::strcmp(argv[1], test.name) != 0)
+        {
+            continue;
+        }
+        ran++;
+        try
+        {
+            test.run();
+            std::cout << "ok    " << test.name << std::endl;
+        }
+        catch (const std::exception &ex)
+        {
+            std::cout << "FAIL  " << test.name << ": " << ex.what() << std::endl;
+            failed++;
+        }
+    }
+    if (ran == 0)
+    {
+        std::cerr << "no test called " << argv[1] << std::endl;
+        return 1;
+    }
+    return failed == 0 ? 0 : 1;
+}
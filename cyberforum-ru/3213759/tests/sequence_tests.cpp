@@ -0,0 +1,121 @@
+#include <string>
+#include <vector>
+
+#include <imbin/reader.h>
+#include <imbin/sequence.h>
+
+#include "support.h"
+#include "tests.h"
+
+namespace
+{
+    // a square moving over the background, a cut to another background, and a frame that doesn't change
+    std::vector<Pixels> makeFrames(std::uint32_t width, std::uint32_t height, std::uint32_t count)
+    {
+        std::vector<Pixels> frames;
+        Pixels background { makePixels(Content::Mixed, width, height, 21) };
+        for (std::uint32_t i = 0; i < count; i++)
+        {
+            if (i == 9)
+            {
+                background = makePixels(Content::FewColors, width, height, 22);
+            }
+            Pixels frame { background };
+            if (i != 12)
+            {
+                for (std::uint32_t y = 2 * i % height; y < std::min(height, 2 * i % height + 10); y++)
+                {
+                    for (std::uint32_t x = 3 * i % width; x < std::min(width, 3 * i % width + 10); x++)
+                    {
+                        unsigned char *p { frame.rgba.data() + (static_cast<std::size_t>(y) * width + x) * 4 };
+                        p[0] = static_cast<unsigned char>(i * 17);
+                        p[1] = 200;
+                        p[2] = static_cast<unsigned char>(255 - i);
+                        p[3] = 255;
+                    }
+                }
+            }
+            else
+            {
+                frame = frames.back();
+            }
+            frames.push_back(frame);
+        }
+        return frames;
+    }
+}
+
+void testSequences()
+{
+    const std::uint32_t width { 70 };
+    const std::uint32_t height { 45 };
+    const std::uint32_t count { 15 };
+    const std::vector<Pixels> frames { makeFrames(width, height, count) };
+
+    TemporaryDirectory directory;
+    std::vector<std::filesystem::path> paths;
+    for (std::uint32_t i = 0; i < count; i++)
+    {
+        paths.push_back(directory.path() / ("frame" + std::to_string(i) + ".png"));
+        writeBytes(paths.back(), rgbaSource(frames[i]).encode());
+    }
+    const std::filesystem::path output { directory.path() / "frames.im.bin" };
+    SequenceSettings sequence;
+    sequence.keyframeInterval = 4;
+    sequence.tileWidth = 16;
+    sequence.tileHeight = 16;
+    const SequenceResult result { convertSequence(paths, output, {}, sequence) };
+    if (!result.total.ok)
+    {
+        throw TestFailure("sequence conversion failed: " + result.total.error);
+    }
+    const std::vector<unsigned char> file { readBytes(output) };
+    CHECK(imbin::isSequence(file.data(), file.size()));
+    checkImbinError([&] { imbin::decode(file.data(), file.size()); }, "decode() of a sequence");
+
+    imbin::SequenceReader reader { imbin::SequenceReader::open(output) };
+    CHECK(reader.width() == width && reader.height() == height && reader.frameCount() == count);
+    CHECK(reader.position() == -1);
+    // no more than keyframeInterval - 1 deltas in a row
+    std::uint32_t deltas { 0 };
+    for (const auto &entry : reader.index().frames)
+    {
+        deltas = entry.kind == imbin::FrameIndex::Kind::Key ? 0 : deltas + 1;
+        CHECK(deltas < sequence.keyframeInterval);
+    }
+    CHECK(reader.index().frames[0].kind == imbin::FrameIndex::Kind::Key);
+    CHECK(reader.index().frames[12].kind == imbin::FrameIndex::Kind::Key || reader.index().frames[12].changedTiles == 0);
+
+    for (std::uint32_t i = 0; i < count; i++)
+    {
+        const imbin::Image &frame { reader.next() };
+        CHECK(reader.position() == i);
+        checkSame(frames[i], frame.width, frame.height, frame.pixels, "frame " + std::to_string(i) + " in order");
+    }
+    checkImbinError([&] { reader.next(); }, "next() after the last frame");
+
+    // back to earlier keyframes, forward from the current frame, the same frame again, over the cut
+    const std::uint32_t jumps[] { 14, 0, 7, 7, 8, 3, 12, 11, 5, 13, 1, 9, 10, 2, 6, 4 };
+    for (const std::uint32_t i : jumps)
+    {
+        const imbin::Image &frame { reader.frame(i) };
+        CHECK(reader.position() == i);
+        checkSame(frames[i], frame.width, frame.height, frame.pixels, "frame " + std::to_string(i) + " out of order");
+    }
+    const imbin::Image &after { reader.next() };
+    checkSame(frames[5], after.width, after.height, after.pixels, "next() after jumping to frame 4");
+    checkImbinError([&] { reader.frame(count); }, "a frame past the end");
+
+    // cut anywhere, the frame index or the frames themselves are missing
+    for (std::size_t size = 0; size < file.size(); size += size < 512 ? 1 : 61)
+    {
+        checkImbinError([&]
+        {
+            imbin::SequenceReader truncated { std::vector<unsigned char> { file.begin(), file.begin() + static_cast<std::ptrdiff_t>(size) } };
+            for (std::uint32_t i = 0; i < truncated.frameCount(); i++)
+            {
+                truncated.next();
+            }
+        }, "a sequence truncated to " + std::to_string(size) + " bytes");
+    }
+}
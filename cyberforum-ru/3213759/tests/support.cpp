@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifdef USING_PACKAGE_MANAGER
+    #include <png/png.h>
+#else
+    #include <png.h>
+#endif
+
+#include <imbin/format.h>
+
+#include "support.h"
+
+namespace
+{
+    int channels(int colorType)
+    {
+        switch (colorType)
+        {
+        case PNG_COLOR_TYPE_GRAY: return 1;
+        case PNG_COLOR_TYPE_RGB: return 3;
+        case PNG_COLOR_TYPE_PALETTE: return 1;
+        case PNG_COLOR_TYPE_GRAY_ALPHA: return 2;
+        case PNG_COLOR_TYPE_RGB_ALPHA: return 4;
+        }
+        throw std::runtime_error("unknown colour type " + std::to_string(colorType));
+    }
+
+    unsigned char to8(unsigned value, int bitDepth)
+    {
+        if (bitDepth == 16)
+        {
+            return static_cast<unsigned char>(value >> 8);
+        }
+        return static_cast<unsigned char>(value * 255 / ((1u << bitDepth) - 1));
+    }
+
+    unsigned char entryByte(std::uint32_t entry, int channel)
+    {
+        return static_cast<unsigned char>(entry >> (8 * channel));
+    }
+
+    void writeToVector(png_structp pngPtr, png_bytep data, png_size_t length)
+    {
+        auto *out { reinterpret_cast<std::vector<unsigned char>*>(png_get_io_ptr(pngPtr)) };
+        out->insert(out->end(), data, data + length);
+    }
+
+    void flushNothing(png_structp) {}
+}
+
+void check(bool condition, const char *what, const char *file, int line)
+{
+    if (!condition)
+    {
+        throw TestFailure(std::string { file } + ":" + std::to_string(line) + ": " + what);
+    }
+}
+
+void checkImbinError(const std::function<void()> &fn, const std::string &what)
+{
+    try
+    {
+        fn();
+    }
+    catch (const imbin::Error&)
+    {
+        return;
+    }
+    throw TestFailure(what + " didn't throw imbin::Error");
+}
+
+Pixels Pixels::crop(std::uint32_t x, std::uint32_t y, std::uint32_t w, std::uint32_t h) const
+{
+    Pixels part;
+    part.width = w;
+    part.height = h;
+    part.rgba.resize(static_cast<std::size_t>(w) * h * 4);
+    for (std::uint32_t row = 0; row < h; row++)
+    {
+        std::memcpy(part.rgba.data() + static_cast<std::size_t>(row) * w * 4,
+                    rgba.data() + (static_cast<std::size_t>(y + row) * width + x) * 4, static_cast<std::size_t>(w) * 4);
+    }
+    return part;
+}
+
+std::vector<unsigned char> SourcePng::encode() const
+{
+    // packed the way PNG stores them: 16-bit samples big-endian, smaller ones from the high bits of a byte
+    const int perPixel { channels(colorType) };
+    const std::size_t rowBytes { (static_cast<std::size_t>(width) * perPixel * bitDepth + 7) / 8 };
+    std::vector<unsigned char> packed(rowBytes * height);
+    std::vector<png_bytep> rows(height);
+    for (std::uint32_t y = 0; y < height; y++)
+    {
+        unsigned char *row { packed.data() + y * rowBytes };
+        rows[y] = row;
+        for (std::size_t i = 0; i < static_cast<std::size_t>(width) * perPixel; i++)
+        {
+            const unsigned value { samples[y * static_cast<std::size_t>(width) * perPixel + i] };
+            if (bitDepth == 16)
+            {
+                row[i * 2] = static_cast<unsigned char>(value >> 8);
+                row[i * 2 + 1] = static_cast<unsigned char>(value);
+            }
+            else
+            {
+                const std::size_t bit { i * bitDepth };
+                row[bit / 8] = static_cast<unsigned char>(row[bit / 8] | value << (8 - bitDepth - bit % 8));
+            }
+        }
+    }
+
+    std::vector<png_color> plte;
+    std::vector<png_byte> alpha;
+    for (const std::uint32_t entry : palette)
+    {
+        plte.push_back({ entryByte(entry, 0), entryByte(entry, 1), entryByte(entry, 2) });
+        alpha.push_back(entryByte(entry, 3));
+    }
+    const bool paletteAlpha { std::any_of(alpha.begin(), alpha.end(), [](png_byte a) { return a != 255; }) };
+    png_color_16 trnsKey {};
+    trnsKey.gray = key[0];
+    trnsKey.red = key[0];
+    trnsKey.green = key[1];
+    trnsKey.blue = key[2];
+
+    std::vector<unsigned char> out;
+    png_structp pngPtr { png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr) };
+    png_infop infoPtr { pngPtr ? png_create_info_struct(pngPtr) : nullptr };
+    if (!infoPtr)
+    {
+        png_destroy_write_struct(&pngPtr, nullptr);
+        throw std::runtime_error("couldn't create PNG write struct");
+    }
+    // nothing with a destructor is created past this point
+    if (setjmp(png_jmpbuf(pngPtr)))
+    {
+        png_destroy_write_struct(&pngPtr, &infoPtr);
+        throw std::runtime_error("couldn't encode the PNG");
+    }
+    png_set_write_fn(pngPtr, &out, writeToVector, flushNothing);
+    png_set_IHDR(pngPtr, infoPtr, width, height, bitDepth, colorType,
+                 interlaced ? PNG_INTERLACE_ADAM7 : PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    if (colorType == PNG_COLOR_TYPE_PALETTE)
+    {
+        png_set_PLTE(pngPtr, infoPtr, plte.data(), static_cast<int>(plte.size()));
+        if (paletteAlpha)
+        {
+            png_set_tRNS(pngPtr, infoPtr, alpha.data(), static_cast<int>(alpha.size()), nullptr);
+        }
+    }
+    else if (colorKey)
+    {
+        png_set_tRNS(pngPtr, infoPtr, nullptr, 0, &trnsKey);
+    }
+    png_write_info(pngPtr, infoPtr);
+    // all the passes of interlaced images
+    png_write_image(pngPtr, rows.data());
+    png_write_end(pngPtr, infoPtr);
+    png_destroy_write_struct(&pngPtr, &infoPtr);
+    return out;
+}
+
+Pixels SourcePng::reference() const
+{
+    const int perPixel { channels(colorType) };
+    Pixels pixels;
+    pixels.width = width;
+    pixels.height = height;
+    pixels.rgba.resize(static_cast<std::size_t>(width) * height * 4);
+    for (std::size_t i = 0; i < static_cast<std::size_t>(width) * height; i++)
+    {
+        const std::uint16_t *s { samples.data() + i * perPixel };
+        unsigned char *out { pixels.rgba.data() + i * 4 };
+        switch (colorType)
+        {
+        case PNG_COLOR_TYPE_GRAY:
+            out[0] = out[1] = out[2] = to8(s[0], bitDepth);
+            out[3] = colorKey && s[0] == key[0] ? 0 : 255;
+            break;
+        case PNG_COLOR_TYPE_RGB:
+            for (int c = 0; c < 3; c++) { out[c] = to8(s[c], bitDepth); }
+            out[3] = colorKey && s[0] == key[0] && s[1] == key[1] && s[2] == key[2] ? 0 : 255;
+            break;
+        case PNG_COLOR_TYPE_PALETTE:
+            for (int c = 0; c < 4; c++) { out[c] = entryByte(palette[s[0]], c); }
+            break;
+        case PNG_COLOR_TYPE_GRAY_ALPHA:
+            out[0] = out[1] = out[2] = to8(s[0], bitDepth);
+            out[3] = to8(s[1], bitDepth);
+            break;
+        default:
+            for (int c = 0; c < 4; c++) { out[c] = to8(s[c], bitDepth); }
+            break;
+        }
+    }
+    return pixels;
+}
+
+SourcePng makeSource(int colorType, int bitDepth, std::uint32_t width, std::uint32_t height, bool transparency,
+                     std::uint64_t seed)
+{
+    Random random { seed };
+    SourcePng source;
+    source.width = width;
+    source.height = height;
+    source.colorType = colorType;
+    source.bitDepth = bitDepth;
+    const std::size_t perPixel { static_cast<std::size_t>(channels(colorType)) };
+    const std::uint32_t limit { colorType == PNG_COLOR_TYPE_PALETTE ? std::min(1u << bitDepth, 256u) : 1u << bitDepth };
+    source.samples.resize(static_cast<std::size_t>(width) * height * perPixel);
+    for (auto &sample : source.samples)
+    {
+        sample = static_cast<std::uint16_t>(random.below(limit));
+    }
+
+    if (colorType == PNG_COLOR_TYPE_PALETTE)
+    {
+        for (std::uint32_t i = 0; i < limit; i++)
+        {
+            const std::uint32_t rgb { static_cast<std::uint32_t>(random.next()) & 0xFFFFFFu };
+            const std::uint32_t alpha { transparency && i % 3 == 0 ? random.below(256) : 255u };
+            source.palette.push_back(rgb | alpha << 24);
+        }
+    }
+    else if (transparency && (colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_RGB))
+    {
+        // the colour of the first pixel, and every 7th pixel has it too (which 16-bit samples rarely would by chance)
+        source.colorKey = true;
+        std::copy(source.samples.begin(), source.samples.begin() + static_cast<std::ptrdiff_t>(perPixel), source.key);
+        for (std::size_t i = 0; i < static_cast<std::size_t>(width) * height; i += 7)
+        {
+            std::copy(source.key, source.key + perPixel, source.samples.begin() + static_cast<std::ptrdiff_t>(i * perPixel));
+        }
+    }
+    return source;
+}
+
+Pixels makePixels(Content content, std::uint32_t width, std::uint32_t height, std::uint64_t seed)
+{
+    Random random { seed };
+    Pixels pixels;
+    pixels.width = width;
+    pixels.height = height;
+    pixels.rgba.resize(static_cast<std::size_t>(width) * height * 4);
+    std::vector<std::uint32_t> colors(200);
+    for (auto &color : colors)
+    {
+        const std::uint32_t alphas[3] { 0, 128, 255 };
+        color = (static_cast<std::uint32_t>(random.next()) & 0xFFFFFFu) | alphas[random.below(3)] << 24;
+    }
+
+    for (std::uint32_t y = 0; y < height; y++)
+    {
+        for (std::uint32_t x = 0; x < width; x++)
+        {
+            unsigned char *p { pixels.rgba.data() + (static_cast<std::size_t>(y) * width + x) * 4 };
+            if (content == Content::FewColors)
+            {
+                const std::uint32_t color { colors[(x / 9 + y / 4 * 3 + random.below(3)) % colors.size()] };
+                for (int c = 0; c < 4; c++) { p[c] = entryByte(color, c); }
+                continue;
+            }
+            if (x < width / 3)
+            {
+                p[0] = static_cast<unsigned char>(x * 255 / width);
+                p[1] = static_cast<unsigned char>(y * 255 / height);
+                p[2] = static_cast<unsigned char>(x + y);
+                p[3] = 255;
+            }
+            else if (x < width / 3 * 2)
+            {
+                const std::uint64_t noise { random.next() };
+                std::memcpy(p, &noise, 4);
+            }
+            else if (y < height / 2)
+            {
+                p[0] = 40;
+                p[1] = 80;
+                p[2] = 120;
+                p[3] = 255;
+            }
+            else
+            {
+                std::fill(p, p + 4, 0);
+            }
+            if (content == Content::Opaque)
+            {
+                p[3] = 255;
+            }
+        }
+    }
+    return pixels;
+}
+
+SourcePng rgbaSource(const Pixels &pixels)
+{
+    SourcePng source;
+    source.width = pixels.width;
+    source.height = pixels.height;
+    source.samples.assign(pixels.rgba.begin(), pixels.rgba.end());
+    return source;
+}
+
+std::vector<unsigned char> readBytes(const std::filesystem::path &path)
+{
+    std::ifstream file { path, std::ios::binary };
+    if (!file)
+    {
+        throw std::runtime_error("couldn't open " + path.string());
+    }
+    return { std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> {} };
+}
+
+void writeBytes(const std::filesystem::path &path, const std::vector<unsigned char> &bytes)
+{
+    std::ofstream file { path, std::ios::binary };
+    file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    file.close();
+    if (!file)
+    {
+        throw std::runtime_error("couldn't write " + path.string());
+    }
+}
+
+TemporaryDirectory::TemporaryDirectory()
+{
+    static std::atomic<unsigned> count { 0 };
+    const auto stamp { std::chrono::steady_clock::now().time_since_epoch().count() };
+    m_path = std::filesystem::temp_directory_path() / ("some-tests-" + std::to_string(stamp) + "-" + std::to_string(count++));
+    std::filesystem::create_directories(m_path);
+}
+
+TemporaryDirectory::~TemporaryDirectory()
+{
+    std::error_code ec;
+    std::filesystem::remove_all(m_path, ec);
+}
+
+std::vector<unsigned char> convertPng(const TemporaryDirectory &directory, const std::vector<unsigned char> &png,
+                                      const ConversionSettings &settings)
+{
+    const std::filesystem::path input { directory.path() / "image.png" };
+    const std::filesystem::path output { directory.path() / "image.im.bin" };
+    writeBytes(input, png);
+    const ConversionResult result { convertFile(input, output, settings) };
+    if (!result.ok)
+    {
+        throw TestFailure("conversion failed: " + result.error);
+    }
+    return readBytes(output);
+}
+
+void checkSame(const Pixels &expected, std::uint32_t width, std::uint32_t height, const std::vector<unsigned char> &rgba,
+               const std::string &what)
+{
+    if (width != expected.width || height != expected.height || rgba.size() != expected.rgba.size())
+    {
+        throw TestFailure(what + ": " + std::to_string(width) + "x" + std::to_string(height) + " instead of "
+                          + std::to_string(expected.width) + "x" + std::to_string(expected.height));
+    }
+    const auto mismatch { std::mismatch(rgba.begin(), rgba.end(), expected.rgba.begin()) };
+    if (mismatch.first != rgba.end())
+    {
+        const std::size_t pixel { static_cast<std::size_t>(mismatch.first - rgba.begin()) / 4 };
+        auto describe = [pixel](const std::vector<unsigned char> &bytes)
+        {
+            const unsigned char *p { bytes.data() + pixel * 4 };
+            return std::to_string(p[0]) + "," + std::to_string(p[1]) + "," + std::to_string(p[2]) + "," + std::to_string(p[3]);
+        };
+        throw TestFailure(what + ": pixel " + std::to_string(pixel % width) + "," + std::to_string(pixel / width)
+                          + " is " + describe(rgba) + " instead of " + describe(expected.rgba));
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef TESTS_SUPPORT_H
+#define TESTS_SUPPORT_H
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "converter.h"
+
+// what a failed check throws, the tests themselves let everything through
+class TestFailure : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// throws TestFailure with the condition and where it is
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+void check(bool condition, const char *what, const char *file, int line);
+
+// fn has to throw imbin::Error, anything else thrown by it goes through as it is; what is for the message
+void checkImbinError(const std::function<void()> &fn, const std::string &what);
+
+// splitmix64, the same numbers everywhere, so a failure can be reproduced
+class Random
+{
+public:
+    explicit Random(std::uint64_t seed) : m_state { seed } {}
+
+    std::uint64_t next()
+    {
+        std::uint64_t z { m_state += 0x9E3779B97F4A7C15ull };
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // in [0, n)
+    std::uint32_t below(std::uint32_t n) { return static_cast<std::uint32_t>(next() % n); }
+
+private:
+    std::uint64_t m_state;
+};
+
+// 8-bit RGBA, rows one after another
+struct Pixels
+{
+    std::uint32_t width { 0 };
+    std::uint32_t height { 0 };
+    std::vector<unsigned char> rgba;
+
+    // the rectangle, which has to be inside
+    Pixels crop(std::uint32_t x, std::uint32_t y, std::uint32_t w, std::uint32_t h) const;
+};
+
+// a PNG as it is stored: samples of any colour type and depth, and what RGBA8 the converter has to make of them
+struct SourcePng
+{
+    std::uint32_t width { 0 };
+    std::uint32_t height { 0 };
+    int colorType { 6 }; // PNG_COLOR_TYPE_*
+    int bitDepth { 8 };
+    bool interlaced { false };
+    // channels per pixel of the colour type, row by row, each one below 1 << bitDepth
+    std::vector<std::uint16_t> samples;
+    // RGBA8 entries of palette images, the alpha goes to tRNS if any isn't 255
+    std::vector<std::uint32_t> palette;
+    // tRNS of grey (first one) and RGB images
+    bool colorKey { false };
+    std::uint16_t key[3] {};
+
+    // the PNG file; throws std::runtime_error
+    std::vector<unsigned char> encode() const;
+    // what the samples are as 8-bit RGBA: 16 bits lose the low byte, fewer than 8 are scaled up to the full range
+    Pixels reference() const;
+};
+
+// random samples of the colour type and depth; with transparency grey and RGB ones get a colour key that some of
+// the pixels have, and some of the palette entries get an alpha
+SourcePng makeSource(int colorType, int bitDepth, std::uint32_t width, std::uint32_t height, bool transparency,
+                     std::uint64_t seed);
+
+enum class Content
+{
+    Mixed, // smooth, noisy, flat and transparent areas
+    Opaque, // the same with every alpha 255
+    FewColors // 200 colours, some of them transparent
+};
+
+Pixels makePixels(Content content, std::uint32_t width, std::uint32_t height, std::uint64_t seed);
+// as an 8-bit RGBA PNG
+SourcePng rgbaSource(const Pixels &pixels);
+
+std::vector<unsigned char> readBytes(const std::filesystem::path &path);
+void writeBytes(const std::filesystem::path &path, const std::vector<unsigned char> &bytes);
+
+// a directory of its own under the system's temporary one, removed with everything in it at the end
+class TemporaryDirectory
+{
+public:
+    TemporaryDirectory();
+    ~TemporaryDirectory();
+
+    TemporaryDirectory(const TemporaryDirectory&) = delete;
+    TemporaryDirectory& operator=(const TemporaryDirectory&) = delete;
+
+    const std::filesystem::path& path() const { return m_path; }
+
+private:
+    std::filesystem::path m_path;
+};
+
+// the PNG through convertFile() with the settings, the im.bin it made; a failed conversion fails the test
+std::vector<unsigned char> convertPng(const TemporaryDirectory &directory, const std::vector<unsigned char> &png,
+                                      const ConversionSettings &settings);
+
+// the same image pixel for pixel, with where they differ in the message
+void checkSame(const Pixels &expected, std::uint32_t width, std::uint32_t height, const std::vector<unsigned char> &rgba,
+               const std::string &what);
+
+#endif // TESTS_SUPPORT_H
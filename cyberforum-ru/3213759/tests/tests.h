@@ -0,0 +1,19 @@
+#ifndef TESTS_TESTS_H
+#define TESTS_TESTS_H
+
+// every test throws TestFailure (see support.h), or whatever the code under test let through, when it fails
+
+// every PNG colour type and bit depth (with tRNS and interlacing) against the pixels they stand for
+void testColorTypes();
+// decodeRegion() against the whole image, tiled, filtered, planar, in independent blocks and indexed
+void testRegions();
+// files of the first version, two ints and a zlib stream
+void testV1Files();
+// SequenceReader going through the frames in order and jumping around, and truncated sequences
+void testSequences();
+// the fixed part of the header, the chunk table and truncated files
+void testCorruptedHeaders();
+// the tile, block, filter, mip and palette chunks, and the payload
+void testCorruptedChunks();
+
+#endif // TESTS_TESTS_H